@@ -5,11 +5,12 @@
  */
 
 #include <string.h>
-#include "esp_cpu.h"
 #include "esp_log.h"
 #include "esp_app_trace.h"
 #include "esp_app_trace_port.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_private/startup_internal.h"
+#endif
 
 #ifdef CONFIG_APPTRACE_DEST_UART0
 #define ESP_APPTRACE_DEST_UART_NUM 0
@@ -46,7 +47,7 @@ esp_err_t esp_apptrace_init(void)
     void *hw_data = NULL;
 
     // 'esp_apptrace_init()' is called on every core, so ensure to do main initialization only once
-    if (esp_cpu_get_core_id() == 0) {
+    if (xPortGetCoreID() == 0) {
         memset(&s_trace_channels, 0, sizeof(s_trace_channels));
         hw = esp_apptrace_jtag_hw_get(&hw_data);
         ESP_APPTRACE_LOGD("HW interface %p", hw);
@@ -77,10 +78,18 @@ esp_err_t esp_apptrace_init(void)
     return ESP_OK;
 }
 
+#if CONFIG_IDF_TARGET_LINUX
+// There is no startup code calling init functions on Linux, the constructors run before app_main() instead
+__attribute__((constructor(115))) static void esp_apptrace_init_linux(void)
+{
+    esp_apptrace_init();
+}
+#else
 ESP_SYSTEM_INIT_FN(esp_apptrace_init, SECONDARY, ESP_SYSTEM_INIT_ALL_CORES, 115)
 {
     return esp_apptrace_init();
 }
+#endif
 
 void esp_apptrace_down_buffer_config(uint8_t *buf, uint32_t size)
 {
@@ -445,7 +454,30 @@ bool esp_apptrace_host_is_connected(esp_apptrace_dest_t dest)
     return ch->hw->host_is_connected(ch->hw_data);
 }
 
-#if !CONFIG_APPTRACE_DEST_JTAG
+esp_err_t esp_apptrace_get_stats(esp_apptrace_dest_t dest, int core_id, esp_apptrace_stats_t *stats)
+{
+    esp_apptrace_channel_t *ch;
+
+    ESP_APPTRACE_LOGV("%s(): enter", __func__);
+    if (dest >= ESP_APPTRACE_DEST_MAX || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_inited) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ch = &s_trace_channels[dest];
+    if (ch->hw == NULL) {
+        ESP_APPTRACE_LOGE("Trace destination %d not supported!", dest);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (ch->hw->get_stats == NULL) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    return ch->hw->get_stats(ch->hw_data, core_id, stats);
+}
+
+#if !CONFIG_APPTRACE_DEST_JTAG && !CONFIG_APPTRACE_DEST_HOST
 esp_apptrace_hw_t *esp_apptrace_jtag_hw_get(void **data)
 {
     return NULL;
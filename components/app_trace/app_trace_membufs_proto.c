@@ -8,25 +8,8 @@
 #include <string.h>
 #include "sdkconfig.h"
 #include "esp_log.h"
-#include "esp_cpu.h"
 #include "esp_app_trace_membufs_proto.h"
 
-/** Trace data header. Every user data chunk is prepended with this header.
- * User allocates block with esp_apptrace_buffer_get and then fills it with data,
- * in multithreading environment it can happen that tasks gets buffer and then gets interrupted,
- * so it is possible that user data are incomplete when  memory block is exposed to the host.
- * In this case host SW will see that wr_sz < block_sz and will report error.
- */
-typedef struct {
-#if CONFIG_APPTRACE_SV_ENABLE
-    uint8_t   block_sz; // size of allocated block for user data
-    uint8_t   wr_sz;    // size of actually written data
-#else
-    uint16_t   block_sz; // size of allocated block for user data
-    uint16_t   wr_sz;    // size of actually written data
-#endif
-} esp_tracedata_hdr_t;
-
 /** TODO: docs
  */
 typedef struct {
@@ -34,15 +17,10 @@ typedef struct {
 } esp_hostdata_hdr_t;
 
 #if CONFIG_APPTRACE_SV_ENABLE
-#define ESP_APPTRACE_USR_BLOCK_CORE(_cid_)          (0)
-#define ESP_APPTRACE_USR_BLOCK_LEN(_v_)             (_v_)
 #define ESP_APPTRACE_USR_DATA_LEN_MAX(_hw_data_)    255UL
 #else
-#define ESP_APPTRACE_USR_BLOCK_CORE(_cid_)      ((_cid_) << 15)
-#define ESP_APPTRACE_USR_BLOCK_LEN(_v_)         (~(1 << 15) & (_v_))
 #define ESP_APPTRACE_USR_DATA_LEN_MAX(_hw_data_)       (ESP_APPTRACE_INBLOCK(_hw_data_)->sz - sizeof(esp_tracedata_hdr_t))
 #endif
-#define ESP_APPTRACE_USR_BLOCK_RAW_SZ(_s_)     ((_s_) + sizeof(esp_tracedata_hdr_t))
 
 #define ESP_APPTRACE_INBLOCK_MARKER(_hw_data_)          ((_hw_data_)->state.markers[(_hw_data_)->state.in_block % 2])
 #define ESP_APPTRACE_INBLOCK_MARKER_UPD(_hw_data_, _v_)   do {(_hw_data_)->state.markers[(_hw_data_)->state.in_block % 2] += (_v_);}while(0)
@@ -260,8 +238,8 @@ static inline uint8_t *esp_apptrace_membufs_wait4buf(esp_apptrace_membufs_proto_
 
 static inline uint8_t *esp_apptrace_membufs_pkt_start(uint8_t *ptr, uint16_t size)
 {
-    // it is safe to use esp_cpu_get_core_id() in macro call because arg is used only once inside it
-    ((esp_tracedata_hdr_t *)ptr)->block_sz = ESP_APPTRACE_USR_BLOCK_CORE(esp_cpu_get_core_id()) | size;
+    // it is safe to use xPortGetCoreID() in macro call because arg is used only once inside it
+    ((esp_tracedata_hdr_t *)ptr)->block_sz = ESP_APPTRACE_USR_BLOCK_CORE(xPortGetCoreID()) | size;
     ((esp_tracedata_hdr_t *)ptr)->wr_sz = 0;
     return ptr + sizeof(esp_tracedata_hdr_t);
 }
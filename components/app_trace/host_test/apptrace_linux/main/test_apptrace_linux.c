@@ -0,0 +1,166 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_app_trace.h"
+#include "esp_timer.h"
+#include "unity.h"
+
+#define TEST_CHUNKS_NUM     200000
+#define TEST_CHUNK_SZ       32
+#define TEST_CORE_BIT       31
+
+typedef struct {
+    SemaphoreHandle_t done;
+    portMUX_TYPE *lock;     // if set, the values are taken and the chunks allocated under this lock
+    uint32_t *counter;
+    uint32_t chunk_sz;
+} test_writer_arg_t;
+
+static void test_writer(void *arg)
+{
+    test_writer_arg_t *wr_arg = (test_writer_arg_t *)arg;
+    uint32_t core_bit = (uint32_t)xPortGetCoreID() << TEST_CORE_BIT;
+
+    for (int i = 0; i < TEST_CHUNKS_NUM; i++) {
+        uint32_t val = i | core_bit;
+        uint8_t *ptr;
+        if (wr_arg->lock) {
+            portENTER_CRITICAL(wr_arg->lock);
+            val = (*wr_arg->counter)++ | core_bit;
+            ptr = esp_apptrace_buffer_get(ESP_APPTRACE_DEST_JTAG, wr_arg->chunk_sz, ESP_APPTRACE_TMO_INFINITE);
+            portEXIT_CRITICAL(wr_arg->lock);
+        } else {
+            ptr = esp_apptrace_buffer_get(ESP_APPTRACE_DEST_JTAG, wr_arg->chunk_sz, ESP_APPTRACE_TMO_INFINITE);
+        }
+        if (ptr) {
+            memset(ptr, 0, wr_arg->chunk_sz);
+            memcpy(ptr, &val, sizeof(val));
+            esp_apptrace_buffer_put(ESP_APPTRACE_DEST_JTAG, ptr, ESP_APPTRACE_TMO_INFINITE);
+        }
+    }
+    xSemaphoreGive(wr_arg->done);
+    vTaskDelete(NULL);
+}
+
+/* Runs a writer on every core and returns the time it took all of them to finish, in us */
+static int64_t test_writers_run(test_writer_arg_t *arg, esp_apptrace_stats_t *stats)
+{
+    esp_apptrace_stats_t start_stats[portNUM_PROCESSORS];
+
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        TEST_ESP_OK(esp_apptrace_get_stats(ESP_APPTRACE_DEST_JTAG, i, &start_stats[i]));
+    }
+    arg->done = xSemaphoreCreateCounting(portNUM_PROCESSORS, 0);
+    TEST_ASSERT_NOT_NULL(arg->done);
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(test_writer, "writer", 4096, arg, uxTaskPriorityGet(NULL) + 1, NULL, i));
+    }
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(arg->done, portMAX_DELAY));
+    }
+    int64_t time = esp_timer_get_time() - start;
+    vSemaphoreDelete(arg->done);
+
+    TEST_ESP_OK(esp_apptrace_flush(ESP_APPTRACE_DEST_JTAG, ESP_APPTRACE_TMO_INFINITE));
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        TEST_ESP_OK(esp_apptrace_get_stats(ESP_APPTRACE_DEST_JTAG, i, &stats[i]));
+        stats[i].written -= start_stats[i].written;
+        stats[i].dropped -= start_stats[i].dropped;
+    }
+    return time;
+}
+
+static long test_trace_file_size(void)
+{
+    struct stat st;
+
+    TEST_ASSERT_EQUAL(0, stat(CONFIG_APPTRACE_HOST_FILE_PATH, &st));
+    return st.st_size;
+}
+
+TEST_CASE("trace data of all cores is written in the order it was recorded", "[app_trace]")
+{
+    static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t counter = 0;
+    test_writer_arg_t arg = {
+        .lock = &lock,
+        .counter = &counter,
+        .chunk_sz = sizeof(uint32_t),
+    };
+    esp_apptrace_stats_t stats[portNUM_PROCESSORS];
+
+    long offset = test_trace_file_size();
+    test_writers_run(&arg, stats);
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        TEST_ASSERT_EQUAL_UINT32(TEST_CHUNKS_NUM, stats[i].written);
+        TEST_ASSERT_EQUAL_UINT32(0, stats[i].dropped);
+    }
+
+    uint32_t num = TEST_CHUNKS_NUM * portNUM_PROCESSORS;
+    TEST_ASSERT_EQUAL(offset + num * sizeof(uint32_t), test_trace_file_size());
+    uint32_t *vals = malloc(num * sizeof(uint32_t));
+    TEST_ASSERT_NOT_NULL(vals);
+    FILE *f = fopen(CONFIG_APPTRACE_HOST_FILE_PATH, "rb");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(0, fseek(f, offset, SEEK_SET));
+    TEST_ASSERT_EQUAL(num, fread(vals, sizeof(uint32_t), num, f));
+    fclose(f);
+
+    uint32_t core_switches = 0;
+    for (uint32_t i = 0; i < num; i++) {
+        TEST_ASSERT_EQUAL_UINT32(i, vals[i] & ~(1UL << TEST_CORE_BIT));
+        if (i > 0 && (vals[i] ^ vals[i - 1]) >> TEST_CORE_BIT) {
+            core_switches++;
+        }
+    }
+    free(vals);
+    printf("%" PRIu32 " chunks in order, %" PRIu32 " core switches\n", num, core_switches);
+}
+
+TEST_CASE("trace data throughput", "[app_trace]")
+{
+    test_writer_arg_t arg = {
+        .chunk_sz = TEST_CHUNK_SZ,
+    };
+    esp_apptrace_stats_t stats[portNUM_PROCESSORS];
+
+    long offset = test_trace_file_size();
+    int64_t time = test_writers_run(&arg, stats);
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        TEST_ASSERT_EQUAL_UINT32(TEST_CHUNKS_NUM, stats[i].written);
+        TEST_ASSERT_EQUAL_UINT32(0, stats[i].dropped);
+    }
+    uint32_t size = TEST_CHUNKS_NUM * TEST_CHUNK_SZ * portNUM_PROCESSORS;
+    TEST_ASSERT_EQUAL(offset + size, test_trace_file_size());
+    printf("%" PRIu32 " bytes from %d cores in %lld us, %lld KB/s\n", size, portNUM_PROCESSORS,
+           (long long)time, (long long)size * 1000 / (time > 0 ? time : 1));
+}
+
+TEST_CASE("trace data statistics", "[app_trace]")
+{
+    esp_apptrace_stats_t stats;
+
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, esp_apptrace_get_stats(ESP_APPTRACE_DEST_JTAG, portNUM_PROCESSORS, &stats));
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, esp_apptrace_get_stats(ESP_APPTRACE_DEST_JTAG, 0, NULL));
+    TEST_ESP_ERR(ESP_ERR_INVALID_ARG, esp_apptrace_get_stats(ESP_APPTRACE_DEST_MAX, 0, &stats));
+    TEST_ESP_ERR(ESP_ERR_NOT_SUPPORTED, esp_apptrace_get_stats(ESP_APPTRACE_DEST_UART, 0, &stats));
+}
+
+void app_main(void)
+{
+    printf("Running app_trace linux host test app\n");
+    unity_run_menu();
+}
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2017-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2017-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -25,6 +25,14 @@ typedef enum {
     ESP_APPTRACE_DEST_NUM
 } esp_apptrace_dest_t;
 
+/**
+ * Trace data statistics of a core.
+ */
+typedef struct {
+    uint32_t written;   ///< Number of trace data chunks sent to the host
+    uint32_t dropped;   ///< Number of trace data chunks dropped because there was no space for them or they were not finished in time
+} esp_apptrace_stats_t;
+
 /**
  * @brief  Initializes application tracing module.
  *
@@ -169,6 +177,22 @@ esp_err_t esp_apptrace_down_buffer_put(esp_apptrace_dest_t dest, uint8_t *ptr, u
  */
 bool esp_apptrace_host_is_connected(esp_apptrace_dest_t dest);
 
+/**
+ * @brief Gets the trace data statistics of a core.
+ *
+ * @param dest    Indicates HW interface to use.
+ * @param core_id Core to get the statistics of.
+ * @param stats   Pointer to the statistics to fill.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if the core ID is invalid
+ *      - ESP_ERR_INVALID_STATE if the tracing is not initialized
+ *      - ESP_ERR_NOT_SUPPORTED if the HW interface does not collect statistics. Currently they are only
+ *        collected on the Linux target.
+ */
+esp_err_t esp_apptrace_get_stats(esp_apptrace_dest_t dest, int core_id, esp_apptrace_stats_t *stats);
+
 /**
  * @brief Opens file on host.
  *		  This function has the same semantic as 'fopen' except for the first argument.
@@ -0,0 +1,98 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef ESP_APP_TRACE_SPAN_H_
+#define ESP_APP_TRACE_SPAN_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#if CONFIG_APPTRACE_SV_ENABLE
+#include "SEGGER_SYSVIEW.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Spans mark the regions of code to be shown in the trace, e.g. as slices on the task tracks when the SystemView
+ * trace is converted with `sysviewtrace_proc.py --to-chrome-trace`. They are recorded as SystemView markers,
+ * so the functions below do nothing when SystemView tracing is disabled in menuconfig and only check whether
+ * the tracing has been started otherwise.
+ */
+
+/**
+ * @brief Starts a span.
+ *
+ * Spans with the same ID can be nested, every esp_apptrace_span_end() closes the most recently started one.
+ *
+ * @param id  Span ID.
+ */
+static inline void esp_apptrace_span_begin(uint32_t id)
+{
+#if CONFIG_APPTRACE_SV_ENABLE
+    if (SEGGER_SYSVIEW_Started()) {
+        SEGGER_SYSVIEW_MarkStart(id);
+    }
+#endif
+}
+
+/**
+ * @brief Ends a span.
+ *
+ * @param id  Span ID.
+ */
+static inline void esp_apptrace_span_end(uint32_t id)
+{
+#if CONFIG_APPTRACE_SV_ENABLE
+    if (SEGGER_SYSVIEW_Started()) {
+        SEGGER_SYSVIEW_MarkStop(id);
+    }
+#endif
+}
+
+/**
+ * @brief Records an instant event, named the same way as spans.
+ *
+ * @param id  Span ID.
+ */
+static inline void esp_apptrace_span_mark(uint32_t id)
+{
+#if CONFIG_APPTRACE_SV_ENABLE
+    if (SEGGER_SYSVIEW_Started()) {
+        SEGGER_SYSVIEW_Mark(id);
+    }
+#endif
+}
+
+/**
+ * @brief Sets the name of the spans with the given ID.
+ *
+ * The name is sent to the host now if the tracing has been started, and every time it is started later,
+ * so names can be set at any time.
+ *
+ * @param id    Span ID.
+ * @param name  Span name. The string is not copied and must stay valid.
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_NO_MEM if too many names have been set
+ *      - ESP_ERR_NOT_SUPPORTED if SystemView tracing is disabled
+ */
+#if CONFIG_APPTRACE_SV_ENABLE
+esp_err_t esp_apptrace_span_name(uint32_t id, const char *name);
+#else
+static inline esp_err_t esp_apptrace_span_name(uint32_t id, const char *name)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ESP_APP_TRACE_SPAN_H_
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2018-2021 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2018-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -73,6 +73,13 @@ void esp_sysview_heap_trace_alloc(void *addr, uint32_t size, const void *callers
  */
 void esp_sysview_heap_trace_free(void *addr, const void *callers);
 
+/**
+ * @brief Sends the names of the spans set by esp_apptrace_span_name() to the host.
+ *
+ * Called when SystemView tracing starts, the names sent before are not recorded in the new trace.
+ */
+void esp_sysview_send_span_names(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,657 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0 OR MIT
+ */
+
+/*
+ * Apptrace port for the Linux target.
+ *
+ * The host takes the place of the JTAG debugger, so the trace data is sent through the JTAG channel
+ * (ESP_APPTRACE_DEST_JTAG) and the application code is the same as on chips. This port also does what OpenOCD does
+ * with the blocks read from the target memory: it strips the headers of the user data chunks and writes the data to
+ * a file or a TCP socket.
+ *
+ * Unlike the membufs protocol used by chips, where all cores share two blocks and every buffer is allocated under
+ * a lock, each core has its own pair of blocks here:
+ *
+ *  - A writer allocates a chunk in the current block of its core by advancing the write position of that core with
+ *    compare-and-swap, so writers never take a lock and writers on different cores never contend.
+ *    Every chunk gets a stamp from a counter shared by all cores, which gives the order the chunks were allocated in.
+ *  - When a block is full or the data is flushed, the blocks of all cores are swapped under the swap lock. The chunks
+ *    of the swapped blocks are merged by their stamps and written to the host, so the host gets a single stream
+ *    in the order the data was recorded, as SystemView expects.
+ *  - A chunk is finished when its writer sets the size of the written data in the header, which is all a writer
+ *    does to release it. The swap waits a while for the chunks being written on other cores. The ones which are
+ *    still unfinished after that are written by a later swap, and a block is only reused once all its chunks
+ *    are finished. A block is zeroed when it is reused, so a chunk whose header is not written yet has no size.
+ *
+ * The number of sent and dropped chunks of each core is available with esp_apptrace_get_stats().
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "sdkconfig.h"
+#include "esp_assert.h"
+#include "esp_log.h"
+#include "esp_app_trace.h"
+#include "esp_app_trace_port.h"
+
+/** Header of a user data chunk */
+typedef struct {
+    uint32_t   stamp;       // order of the chunk among the chunks of all cores
+    uint16_t   block_sz;    // size of allocated block for user data
+    uint16_t   wr_sz;       // size of actually written data, set when the writer has finished
+} esp_apptrace_linux_hdr_t;
+
+/** Trace blocks of a core */
+typedef struct {
+    uint8_t               *blocks[2];       // memory blocks
+    uint32_t               block_sz;        // size of every block
+    uint32_t               wr;              // ID of the block being filled and the number of bytes allocated in it
+    uint32_t               markers[2];      // number of bytes allocated in every block, set when it is swapped out
+    uint32_t               sent[2];         // number of bytes of every block sent to the host
+    uint32_t               open_stamps[2];  // the chunks allocated in every block have this or later stamps
+    esp_apptrace_stats_t   stats;
+} esp_apptrace_linux_core_t;
+
+/** Linux host transport data */
+typedef struct {
+    uint8_t                     inited; // set when initialized, for all cores at once
+    esp_apptrace_lock_t         lock;   // swap lock
+    uint32_t                    stamp;  // stamp of the next chunk
+    esp_apptrace_linux_core_t   cores[CONFIG_FREERTOS_NUMBER_OF_CORES];
+} esp_apptrace_linux_data_t;
+
+/** Chunk to be sent to the host */
+typedef struct {
+    uint32_t         stamp;
+    uint16_t         len;
+    const uint8_t   *data;
+} esp_apptrace_linux_chunk_t;
+
+#define ESP_APPTRACE_LINUX_INITED(_hw_)         ((_hw_)->inited != 0)
+// The write position of a core: 31..16 bits - ID of the block being filled, 15..0 bits - bytes allocated in it
+#define ESP_APPTRACE_LINUX_WR_ID(_wr_)          ((_wr_) >> 16)
+#define ESP_APPTRACE_LINUX_WR_LEN(_wr_)         ((_wr_) & 0xFFFFUL)
+#define ESP_APPTRACE_LINUX_WR(_id_, _len_)      (((_id_) << 16) | (_len_))
+#define ESP_APPTRACE_LINUX_CHUNK_SZ(_len_)      (((_len_) + sizeof(esp_apptrace_linux_hdr_t) + 3) & ~3UL)
+#define ESP_APPTRACE_LINUX_CHUNKS_MAX           (CONFIG_APPTRACE_BUF_SIZE / ESP_APPTRACE_LINUX_CHUNK_SZ(1))
+// Blocks which can be written to the host at once: the swapped blocks, the unsent parts of the blocks swapped before
+// and the chunks kept by the previous swap
+#define ESP_APPTRACE_LINUX_SWAP_BLOCKS_MAX      (2 * CONFIG_FREERTOS_NUMBER_OF_CORES + 1)
+
+/** Chunks collected by a swap, in runs sorted by stamp */
+typedef struct {
+    uint32_t   num;                                         // number of chunks
+    uint32_t   runs_num;                                    // number of runs
+    uint32_t   run_ends[ESP_APPTRACE_LINUX_SWAP_BLOCKS_MAX]; // index of the chunk after every run
+} esp_apptrace_linux_runs_t;
+
+// Timeout for flushing the last trace data to the host when the application exits (in us)
+#define ESP_APPTRACE_LINUX_EXIT_FLUSH_TMO       1000000
+// Time to wait for the writers on other cores to finish their chunks when the blocks are swapped (in us)
+#define ESP_APPTRACE_LINUX_WRITERS_TMO          1000
+
+ESP_STATIC_ASSERT(CONFIG_APPTRACE_BUF_SIZE <= 0xFFFF, "The write position of a core can't hold the block size");
+
+static esp_err_t esp_apptrace_linux_init(esp_apptrace_linux_data_t *hw_data);
+static esp_err_t esp_apptrace_linux_flush(esp_apptrace_linux_data_t *hw_data, esp_apptrace_tmo_t *tmo);
+static esp_err_t esp_apptrace_linux_flush_nolock(esp_apptrace_linux_data_t *hw_data, uint32_t min_sz, esp_apptrace_tmo_t *tmo);
+static uint8_t *esp_apptrace_linux_up_buffer_get(esp_apptrace_linux_data_t *hw_data, uint32_t size, esp_apptrace_tmo_t *tmo);
+static esp_err_t esp_apptrace_linux_up_buffer_put(esp_apptrace_linux_data_t *hw_data, uint8_t *ptr, esp_apptrace_tmo_t *tmo);
+static void esp_apptrace_linux_down_buffer_config(esp_apptrace_linux_data_t *hw_data, uint8_t *buf, uint32_t size);
+static uint8_t *esp_apptrace_linux_down_buffer_get(esp_apptrace_linux_data_t *hw_data, uint32_t *size, esp_apptrace_tmo_t *tmo);
+static esp_err_t esp_apptrace_linux_down_buffer_put(esp_apptrace_linux_data_t *hw_data, uint8_t *ptr, esp_apptrace_tmo_t *tmo);
+static bool esp_apptrace_linux_host_is_connected(esp_apptrace_linux_data_t *hw_data);
+static esp_err_t esp_apptrace_linux_get_stats(esp_apptrace_linux_data_t *hw_data, int core_id, esp_apptrace_stats_t *stats);
+static void esp_apptrace_linux_swap(esp_apptrace_linux_data_t *hw_data, bool final);
+
+const static char *TAG = "esp_apptrace";
+
+static esp_apptrace_linux_data_t s_trace_hw_data;
+
+// File or socket the trace data is written to, -1 if it is not open
+static int s_host_fd = -1;
+// Blocks of every core
+static uint8_t s_mem_blocks[CONFIG_FREERTOS_NUMBER_OF_CORES][2][CONFIG_APPTRACE_BUF_SIZE] __attribute__((aligned(4)));
+// Chunks collected by a swap and the same chunks merged in the order of their stamps
+static esp_apptrace_linux_chunk_t s_chunks[ESP_APPTRACE_LINUX_SWAP_BLOCKS_MAX * ESP_APPTRACE_LINUX_CHUNKS_MAX];
+static esp_apptrace_linux_chunk_t s_sorted_chunks[ESP_APPTRACE_LINUX_SWAP_BLOCKS_MAX * ESP_APPTRACE_LINUX_CHUNKS_MAX];
+// User data of the chunks, without the headers
+static uint8_t s_host_buf[ESP_APPTRACE_LINUX_SWAP_BLOCKS_MAX * CONFIG_APPTRACE_BUF_SIZE];
+// Chunks left in the blocks reused by a swap, they are moved here before the writers can overwrite them
+static uint8_t s_reused_bufs[CONFIG_FREERTOS_NUMBER_OF_CORES][CONFIG_APPTRACE_BUF_SIZE] __attribute__((aligned(4)));
+
+esp_apptrace_hw_t *esp_apptrace_jtag_hw_get(void **data)
+{
+    static esp_apptrace_hw_t s_trace_hw = {
+        .init = (esp_err_t (*)(void *))esp_apptrace_linux_init,
+        .get_up_buffer = (uint8_t *(*)(void *, uint32_t, esp_apptrace_tmo_t *))esp_apptrace_linux_up_buffer_get,
+        .put_up_buffer = (esp_err_t (*)(void *, uint8_t *, esp_apptrace_tmo_t *))esp_apptrace_linux_up_buffer_put,
+        .flush_up_buffer_nolock = (esp_err_t (*)(void *, uint32_t, esp_apptrace_tmo_t *))esp_apptrace_linux_flush_nolock,
+        .flush_up_buffer = (esp_err_t (*)(void *, esp_apptrace_tmo_t *))esp_apptrace_linux_flush,
+        .down_buffer_config = (void (*)(void *, uint8_t *, uint32_t ))esp_apptrace_linux_down_buffer_config,
+        .get_down_buffer = (uint8_t *(*)(void *, uint32_t *, esp_apptrace_tmo_t *))esp_apptrace_linux_down_buffer_get,
+        .put_down_buffer = (esp_err_t (*)(void *, uint8_t *, esp_apptrace_tmo_t *))esp_apptrace_linux_down_buffer_put,
+        .host_is_connected = (bool (*)(void *))esp_apptrace_linux_host_is_connected,
+        .get_stats = (esp_err_t (*)(void *, int, esp_apptrace_stats_t *))esp_apptrace_linux_get_stats,
+    };
+    *data = &s_trace_hw_data;
+    return &s_trace_hw;
+}
+
+/* There are no UARTs on the Linux target */
+esp_apptrace_hw_t *esp_apptrace_uart_hw_get(int num, void **data)
+{
+    return NULL;
+}
+
+/*****************************************************************************************/
+/********************************** Host connection **************************************/
+/*****************************************************************************************/
+
+static int esp_apptrace_linux_host_open(void)
+{
+#if CONFIG_APPTRACE_HOST_FILE
+    int fd = open(CONFIG_APPTRACE_HOST_FILE_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ESP_APPTRACE_LOGE("Failed to open trace file %s (%d)!", CONFIG_APPTRACE_HOST_FILE_PATH, errno);
+    }
+#else
+    // The host tools listen for the trace data, e.g. sysviewtrace_proc.py tcp://localhost:<port>
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_APPTRACE_HOST_TCP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ESP_APPTRACE_LOGE("Failed to create trace socket (%d)!", errno);
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_APPTRACE_LOGE("Failed to connect to trace server on port %d (%d)!", CONFIG_APPTRACE_HOST_TCP_PORT, errno);
+        close(fd);
+        return -1;
+    }
+#endif
+    return fd;
+}
+
+static void esp_apptrace_linux_host_write(const uint8_t *data, size_t size)
+{
+    while (size > 0 && s_host_fd >= 0) {
+#if CONFIG_APPTRACE_HOST_FILE
+        ssize_t res = write(s_host_fd, data, size);
+#else
+        // Don't get killed by SIGPIPE if the host closed the connection
+        ssize_t res = send(s_host_fd, data, size, MSG_NOSIGNAL);
+#endif
+        if (res < 0) {
+            if (errno == EINTR) {
+                // Interrupted by the tick signal
+                continue;
+            }
+            ESP_APPTRACE_LOGE("Failed to write trace data to host (%d), tracing stopped!", errno);
+            close(s_host_fd);
+            s_host_fd = -1;
+            return;
+        }
+        data += res;
+        size -= res;
+    }
+}
+
+static void esp_apptrace_linux_exit(void)
+{
+    esp_apptrace_linux_data_t *hw_data = &s_trace_hw_data;
+    esp_apptrace_tmo_t tmo;
+
+    esp_apptrace_tmo_init(&tmo, ESP_APPTRACE_LINUX_EXIT_FLUSH_TMO);
+    // write the data left in the current blocks, including the chunks kept for the next swap
+    if (esp_apptrace_lock_take(&hw_data->lock, &tmo) == ESP_OK) {
+        esp_apptrace_linux_swap(hw_data, true);
+        esp_apptrace_lock_give(&hw_data->lock);
+    }
+    for (int i = 0; i < CONFIG_FREERTOS_NUMBER_OF_CORES; i++) {
+        uint32_t dropped = hw_data->cores[i].stats.dropped;
+        if (dropped != 0) {
+            ESP_APPTRACE_LOGW("%" PRIu32 " trace data chunks were dropped on core %d", dropped, i);
+        }
+    }
+    if (s_host_fd >= 0) {
+        close(s_host_fd);
+        s_host_fd = -1;
+    }
+}
+
+/*****************************************************************************************/
+/********************************** Trace blocks *****************************************/
+/*****************************************************************************************/
+
+static inline bool esp_apptrace_linux_stamp_before(uint32_t stamp, uint32_t other)
+{
+    // stamps wrap around
+    return (int32_t)(stamp - other) < 0;
+}
+
+/* Allocates a chunk in the current block of the core the caller runs on. Returns NULL if the block is full,
+   the core and its write position are returned anyway. */
+static uint8_t *esp_apptrace_linux_chunk_alloc(esp_apptrace_linux_data_t *hw_data, uint32_t size,
+                                               esp_apptrace_linux_core_t **core_out, uint32_t *wr_out)
+{
+    uint32_t chunk_sz = ESP_APPTRACE_LINUX_CHUNK_SZ(size);
+
+    // The task may move to another core after reading the core ID, which is fine because the chunk is allocated
+    // atomically. The write position is only changed by other cores when they swap the blocks.
+    esp_apptrace_linux_core_t *core = &hw_data->cores[xPortGetCoreID()];
+    uint32_t wr = __atomic_load_n(&core->wr, __ATOMIC_ACQUIRE);
+    *core_out = core;
+    do {
+        if (ESP_APPTRACE_LINUX_WR_LEN(wr) + chunk_sz > core->block_sz) {
+            *wr_out = wr;
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&core->wr, &wr, wr + chunk_sz, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    uint8_t *block = core->blocks[ESP_APPTRACE_LINUX_WR_ID(wr) % 2];
+    esp_apptrace_linux_hdr_t *hdr = (esp_apptrace_linux_hdr_t *)(block + ESP_APPTRACE_LINUX_WR_LEN(wr));
+    // Taken after the chunk is allocated, so the chunks of a block never have stamps before its open stamp
+    hdr->stamp = __atomic_fetch_add(&hw_data->stamp, 1, __ATOMIC_SEQ_CST);
+    hdr->wr_sz = 0;
+    // the swap skips the chunk until it has a size
+    __atomic_store_n(&hdr->block_sz, size, __ATOMIC_RELEASE);
+    *wr_out = wr;
+    return (uint8_t *)(hdr + 1);
+}
+
+/* Returns the size of the chunk, or 0 if its header is not written yet */
+static inline uint16_t esp_apptrace_linux_chunk_len(esp_apptrace_linux_hdr_t *hdr)
+{
+    return __atomic_load_n(&hdr->block_sz, __ATOMIC_ACQUIRE);
+}
+
+static inline bool esp_apptrace_linux_chunk_finished(esp_apptrace_linux_hdr_t *hdr, uint16_t len)
+{
+    return len != 0 && __atomic_load_n(&hdr->wr_sz, __ATOMIC_ACQUIRE) == len;
+}
+
+/* Returns the offset of the first unfinished chunk between the offsets of the block, or the end offset */
+static uint32_t esp_apptrace_linux_unfinished_get(esp_apptrace_linux_core_t *core, uint32_t block_num, uint32_t start, uint32_t end)
+{
+    uint32_t offset = start;
+
+    while (offset < end) {
+        esp_apptrace_linux_hdr_t *hdr = (esp_apptrace_linux_hdr_t *)(core->blocks[block_num] + offset);
+        uint16_t len = esp_apptrace_linux_chunk_len(hdr);
+        if (!esp_apptrace_linux_chunk_finished(hdr, len)) {
+            break;
+        }
+        offset += ESP_APPTRACE_LINUX_CHUNK_SZ(len);
+    }
+    return offset;
+}
+
+/* Waits for the unsent chunks of the block to be finished. The writers on this core can't run until the swap is done. */
+static void esp_apptrace_linux_unfinished_wait(esp_apptrace_linux_core_t *core, int core_id, uint32_t block_num, uint32_t end,
+                                               esp_apptrace_tmo_t *tmo)
+{
+    uint32_t offset = core->sent[block_num];
+
+    if (core_id == xPortGetCoreID()) {
+        return;
+    }
+    while ((offset = esp_apptrace_linux_unfinished_get(core, block_num, offset, end)) < end && esp_apptrace_tmo_check(tmo) == ESP_OK) {
+    }
+}
+
+static inline void esp_apptrace_linux_chunk_add(esp_apptrace_linux_runs_t *runs, esp_apptrace_linux_hdr_t *hdr)
+{
+    s_chunks[runs->num].stamp = hdr->stamp;
+    s_chunks[runs->num].len = hdr->block_sz;
+    s_chunks[runs->num].data = (uint8_t *)(hdr + 1);
+    runs->num++;
+}
+
+static inline void esp_apptrace_linux_run_end(esp_apptrace_linux_runs_t *runs)
+{
+    uint32_t start = runs->runs_num > 0 ? runs->run_ends[runs->runs_num - 1] : 0;
+
+    if (runs->num > start) {
+        runs->run_ends[runs->runs_num++] = runs->num;
+    }
+}
+
+/* Adds the complete chunks between the offsets of the block to a new run. Stops at the first incomplete chunk,
+   unless they are dropped. Returns the offset it stopped at. */
+static uint32_t esp_apptrace_linux_chunks_get(esp_apptrace_linux_core_t *core, const uint8_t *block, uint32_t start, uint32_t end,
+                                              esp_apptrace_linux_runs_t *runs, bool drop_incomplete)
+{
+    uint32_t offset = start;
+    uint32_t num = runs->num;
+    uint32_t dropped = 0;
+
+    while (offset < end) {
+        esp_apptrace_linux_hdr_t *hdr = (esp_apptrace_linux_hdr_t *)(block + offset);
+        uint16_t len = esp_apptrace_linux_chunk_len(hdr);
+        if (esp_apptrace_linux_chunk_finished(hdr, len)) {
+            esp_apptrace_linux_chunk_add(runs, hdr);
+        } else if (drop_incomplete) {
+            dropped++;
+            if (len == 0) {
+                // the size of the chunk is not known, so are the chunks after it
+                break;
+            }
+        } else {
+            break;
+        }
+        offset += ESP_APPTRACE_LINUX_CHUNK_SZ(len);
+    }
+    // The chunks of a block are allocated in the order of their stamps, except for writers interrupted between
+    // allocating a chunk and taking its stamp, so the run is almost sorted already
+    for (uint32_t i = num + 1; i < runs->num; i++) {
+        esp_apptrace_linux_chunk_t chunk = s_chunks[i];
+        uint32_t j = i;
+        while (j > num && esp_apptrace_linux_stamp_before(chunk.stamp, s_chunks[j - 1].stamp)) {
+            s_chunks[j] = s_chunks[j - 1];
+            j--;
+        }
+        s_chunks[j] = chunk;
+    }
+    esp_apptrace_linux_run_end(runs);
+    __atomic_add_fetch(&core->stats.written, runs->num - num, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&core->stats.dropped, dropped, __ATOMIC_SEQ_CST);
+    return offset;
+}
+
+/* Merges the runs of chunks into s_sorted_chunks */
+static void esp_apptrace_linux_runs_merge(esp_apptrace_linux_runs_t *runs)
+{
+    uint32_t pos[ESP_APPTRACE_LINUX_SWAP_BLOCKS_MAX];
+
+    for (uint32_t r = 0; r < runs->runs_num; r++) {
+        pos[r] = r > 0 ? runs->run_ends[r - 1] : 0;
+    }
+    for (uint32_t i = 0; i < runs->num; i++) {
+        int min = -1;
+        for (uint32_t r = 0; r < runs->runs_num; r++) {
+            if (pos[r] < runs->run_ends[r] &&
+                    (min < 0 || esp_apptrace_linux_stamp_before(s_chunks[pos[r]].stamp, s_chunks[pos[min]].stamp))) {
+                min = r;
+            }
+        }
+        s_sorted_chunks[i] = s_chunks[pos[min]++];
+    }
+}
+
+/* Returns the smallest stamp of the chunks of the block not sent to the host, or the given stamp if it is smaller */
+static uint32_t esp_apptrace_linux_unsent_stamp(esp_apptrace_linux_core_t *core, uint32_t block_num, uint32_t end, uint32_t stamp)
+{
+    uint32_t offset = core->sent[block_num];
+
+    while (offset < end) {
+        esp_apptrace_linux_hdr_t *hdr = (esp_apptrace_linux_hdr_t *)(core->blocks[block_num] + offset);
+        uint16_t len = esp_apptrace_linux_chunk_len(hdr);
+        if (len == 0) {
+            // the stamp is not known yet, but it is not before the block was opened
+            if (esp_apptrace_linux_stamp_before(core->open_stamps[block_num], stamp)) {
+                stamp = core->open_stamps[block_num];
+            }
+            break;
+        }
+        if (esp_apptrace_linux_stamp_before(hdr->stamp, stamp)) {
+            stamp = hdr->stamp;
+        }
+        offset += ESP_APPTRACE_LINUX_CHUNK_SZ(len);
+    }
+    return stamp;
+}
+
+/* Swaps the blocks of all cores and writes their data to the host. Must be called with the swap lock taken.
+   The chunks are written in the order of their stamps. A chunk is only written when all the chunks with smaller stamps
+   can be written too, so the chunks allocated after the swap started and the ones allocated after a chunk which
+   is not finished yet are kept for the next swap. The final swap writes all finished chunks and drops the rest. */
+static void esp_apptrace_linux_swap(esp_apptrace_linux_data_t *hw_data, bool final)
+{
+    static uint8_t s_carry_bufs[2][CONFIG_APPTRACE_BUF_SIZE];
+    static uint32_t s_carry_len;
+    static uint32_t s_carry_idx;
+    bool swapped[CONFIG_FREERTOS_NUMBER_OF_CORES] = { 0 };
+    esp_apptrace_linux_runs_t runs = { 0 };
+    esp_apptrace_tmo_t tmo;
+
+    // All the chunks with smaller stamps have been allocated before the blocks are swapped
+    uint32_t cutoff = __atomic_load_n(&hw_data->stamp, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < CONFIG_FREERTOS_NUMBER_OF_CORES; i++) {
+        esp_apptrace_linux_core_t *core = &hw_data->cores[i];
+        // Only the swap changes the ID of the block being filled, the writers change the number of allocated bytes
+        uint32_t id = ESP_APPTRACE_LINUX_WR_ID(__atomic_load_n(&core->wr, __ATOMIC_ACQUIRE));
+        uint32_t new_num = (id + 1) % 2;
+        uint32_t end = core->markers[new_num];
+        // A block is only reused when the chunks which were unfinished at the previous swap have been finished
+        if (!final && esp_apptrace_linux_unfinished_get(core, new_num, core->sent[new_num], end) == end) {
+            uint32_t sent = core->sent[new_num];
+            if (sent < end) {
+                // the writers can overwrite the block as soon as it is opened
+                memcpy(s_reused_bufs[i], core->blocks[new_num] + sent, end - sent);
+                esp_apptrace_linux_chunks_get(core, s_reused_bufs[i], 0, end - sent, &runs, true);
+            }
+            memset(core->blocks[new_num], 0, end);
+            core->sent[new_num] = 0;
+            core->open_stamps[new_num] = __atomic_load_n(&hw_data->stamp, __ATOMIC_SEQ_CST);
+            // opens the new block and closes the current one, the chunks allocated before are in its first bytes
+            uint32_t wr = __atomic_exchange_n(&core->wr, ESP_APPTRACE_LINUX_WR((id + 1) & 0xFFFF, 0), __ATOMIC_ACQ_REL);
+            core->markers[id % 2] = ESP_APPTRACE_LINUX_WR_LEN(wr);
+            swapped[i] = true;
+        }
+    }
+
+    esp_apptrace_tmo_init(&tmo, ESP_APPTRACE_LINUX_WRITERS_TMO);
+    for (int i = 0; i < CONFIG_FREERTOS_NUMBER_OF_CORES; i++) {
+        esp_apptrace_linux_core_t *core = &hw_data->cores[i];
+        uint32_t wr = __atomic_load_n(&core->wr, __ATOMIC_ACQUIRE);
+        uint32_t cur_num = ESP_APPTRACE_LINUX_WR_ID(wr) % 2;
+        uint32_t cur_len = ESP_APPTRACE_LINUX_WR_LEN(wr);
+        uint32_t old_num = (cur_num + 1) % 2;
+        if (swapped[i]) {
+            uint32_t len = core->markers[old_num];
+            esp_apptrace_linux_unfinished_wait(core, i, old_num, len, &tmo);
+            core->sent[old_num] = esp_apptrace_linux_chunks_get(core, core->blocks[old_num], 0, len, &runs, false);
+            cutoff = esp_apptrace_linux_unsent_stamp(core, old_num, len, cutoff);
+        } else if (final) {
+            esp_apptrace_linux_unfinished_wait(core, i, old_num, core->markers[old_num], &tmo);
+            esp_apptrace_linux_unfinished_wait(core, i, cur_num, cur_len, &tmo);
+            core->sent[old_num] = esp_apptrace_linux_chunks_get(core, core->blocks[old_num], core->sent[old_num], core->markers[old_num], &runs, true);
+            core->sent[cur_num] = esp_apptrace_linux_chunks_get(core, core->blocks[cur_num], core->sent[cur_num], cur_len, &runs, true);
+        } else {
+            // The core can't swap, so its chunks can't be written until the slow writers finish theirs
+            cutoff = esp_apptrace_linux_unsent_stamp(core, old_num, core->markers[old_num], cutoff);
+            cutoff = esp_apptrace_linux_unsent_stamp(core, cur_num, cur_len, cutoff);
+        }
+    }
+
+    // the chunks kept by the previous swap
+    for (uint32_t offset = 0; offset < s_carry_len; ) {
+        esp_apptrace_linux_hdr_t *hdr = (esp_apptrace_linux_hdr_t *)(s_carry_bufs[s_carry_idx] + offset);
+        esp_apptrace_linux_chunk_add(&runs, hdr);
+        offset += ESP_APPTRACE_LINUX_CHUNK_SZ(hdr->block_sz);
+    }
+    esp_apptrace_linux_run_end(&runs);
+
+    esp_apptrace_linux_runs_merge(&runs);
+    uint32_t keep = runs.num;
+    uint32_t carry_len = 0;
+    if (!final) {
+        // If there is no space for all the chunks to keep, write the oldest ones now, even though they may overtake
+        // an unfinished chunk
+        while (keep > 0 && !esp_apptrace_linux_stamp_before(s_sorted_chunks[keep - 1].stamp, cutoff) &&
+                carry_len + ESP_APPTRACE_LINUX_CHUNK_SZ(s_sorted_chunks[keep - 1].len) <= sizeof(s_carry_bufs[0])) {
+            keep--;
+            carry_len += ESP_APPTRACE_LINUX_CHUNK_SZ(s_sorted_chunks[keep].len);
+        }
+    }
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < keep; i++) {
+        memcpy(&s_host_buf[len], s_sorted_chunks[i].data, s_sorted_chunks[i].len);
+        len += s_sorted_chunks[i].len;
+    }
+    uint8_t *carry_buf = s_carry_bufs[(s_carry_idx + 1) % 2];
+    carry_len = 0;
+    for (uint32_t i = keep; i < runs.num; i++) {
+        uint32_t chunk_sz = ESP_APPTRACE_LINUX_CHUNK_SZ(s_sorted_chunks[i].len);
+        memcpy(carry_buf + carry_len, s_sorted_chunks[i].data - sizeof(esp_apptrace_linux_hdr_t), chunk_sz);
+        carry_len += chunk_sz;
+    }
+    s_carry_idx = (s_carry_idx + 1) % 2;
+    s_carry_len = carry_len;
+    esp_apptrace_linux_host_write(s_host_buf, len);
+}
+
+/*****************************************************************************************/
+/***************************** Apptrace HW iface *****************************************/
+/*****************************************************************************************/
+
+static esp_err_t esp_apptrace_linux_init(esp_apptrace_linux_data_t *hw_data)
+{
+    if (hw_data->inited == 0) {
+        for (int i = 0; i < CONFIG_FREERTOS_NUMBER_OF_CORES; i++) {
+            esp_apptrace_linux_core_t *core = &hw_data->cores[i];
+            core->blocks[0] = s_mem_blocks[i][0];
+            core->blocks[1] = s_mem_blocks[i][1];
+            core->block_sz = CONFIG_APPTRACE_BUF_SIZE;
+        }
+        esp_apptrace_lock_init(&hw_data->lock);
+        s_host_fd = esp_apptrace_linux_host_open();
+        if (s_host_fd < 0) {
+            return ESP_FAIL;
+        }
+        atexit(esp_apptrace_linux_exit);
+    }
+    // apptrace is initialized before the scheduler starts, the host is shared by all cores
+    hw_data->inited = 1;
+    ESP_APPTRACE_LOGI("Apptrace initialized, writing trace data to the host.");
+
+    return ESP_OK;
+}
+
+static uint8_t *esp_apptrace_linux_up_buffer_get(esp_apptrace_linux_data_t *hw_data, uint32_t size, esp_apptrace_tmo_t *tmo)
+{
+    esp_apptrace_linux_core_t *core;
+    uint32_t wr;
+
+    if (!ESP_APPTRACE_LINUX_INITED(hw_data)) {
+        return NULL;
+    }
+    if (size == 0 || size > UINT16_MAX || ESP_APPTRACE_LINUX_CHUNK_SZ(size) > CONFIG_APPTRACE_BUF_SIZE) {
+        ESP_APPTRACE_LOGE("Too large user data size %" PRIu32 "!", size);
+        return NULL;
+    }
+
+    while (1) {
+        uint8_t *ptr = esp_apptrace_linux_chunk_alloc(hw_data, size, &core, &wr);
+        if (ptr != NULL) {
+            return ptr;
+        }
+        // The block is full, swap the blocks unless another writer has already done it
+        if (esp_apptrace_lock_take(&hw_data->lock, tmo) == ESP_OK) {
+            if (ESP_APPTRACE_LINUX_WR_ID(__atomic_load_n(&core->wr, __ATOMIC_ACQUIRE)) == ESP_APPTRACE_LINUX_WR_ID(wr)) {
+                esp_apptrace_linux_swap(hw_data, false);
+            }
+            esp_apptrace_lock_give(&hw_data->lock);
+        }
+        if (esp_apptrace_tmo_check(tmo) != ESP_OK) {
+            break;
+        }
+    }
+    __atomic_add_fetch(&core->stats.dropped, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+static esp_err_t esp_apptrace_linux_up_buffer_put(esp_apptrace_linux_data_t *hw_data, uint8_t *ptr, esp_apptrace_tmo_t *tmo)
+{
+    esp_apptrace_linux_hdr_t *hdr = (esp_apptrace_linux_hdr_t *)(ptr - sizeof(esp_apptrace_linux_hdr_t));
+
+    if (!ESP_APPTRACE_LINUX_INITED(hw_data)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (ptr <= &s_mem_blocks[0][0][0] || ptr >= &s_mem_blocks[0][0][0] + sizeof(s_mem_blocks)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // publishes the data to the swap, which may run on another core
+    __atomic_store_n(&hdr->wr_sz, hdr->block_sz, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+static void esp_apptrace_linux_down_buffer_config(esp_apptrace_linux_data_t *hw_data, uint8_t *buf, uint32_t size)
+{
+    // the host does not send data to the application
+}
+
+static uint8_t *esp_apptrace_linux_down_buffer_get(esp_apptrace_linux_data_t *hw_data, uint32_t *size, esp_apptrace_tmo_t *tmo)
+{
+    // the host does not send data to the application, wait for the timeout like the other ports do without host data
+    while (esp_apptrace_tmo_check(tmo) == ESP_OK) {
+    }
+    return NULL;
+}
+
+static esp_err_t esp_apptrace_linux_down_buffer_put(esp_apptrace_linux_data_t *hw_data, uint8_t *ptr, esp_apptrace_tmo_t *tmo)
+{
+    return ESP_OK;
+}
+
+static bool esp_apptrace_linux_host_is_connected(esp_apptrace_linux_data_t *hw_data)
+{
+    if (!ESP_APPTRACE_LINUX_INITED(hw_data)) {
+        return false;
+    }
+    return s_host_fd >= 0;
+}
+
+static esp_err_t esp_apptrace_linux_flush_nolock(esp_apptrace_linux_data_t *hw_data, uint32_t min_sz, esp_apptrace_tmo_t *tmo)
+{
+    uint32_t sz = 0;
+
+    if (!ESP_APPTRACE_LINUX_INITED(hw_data)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < CONFIG_FREERTOS_NUMBER_OF_CORES; i++) {
+        esp_apptrace_linux_core_t *core = &hw_data->cores[i];
+        sz += ESP_APPTRACE_LINUX_WR_LEN(__atomic_load_n(&core->wr, __ATOMIC_ACQUIRE));
+    }
+    if (sz < min_sz) {
+        ESP_APPTRACE_LOGI("Ignore flush request for min %" PRIu32 " bytes. Bytes in blocks: %" PRIu32, min_sz, sz);
+        return ESP_OK;
+    }
+    // The blocks are not shared by the cores, so unlike on chips there is no lock held by the caller
+    esp_err_t res = esp_apptrace_lock_take(&hw_data->lock, tmo);
+    if (res != ESP_OK) {
+        return res;
+    }
+    esp_apptrace_linux_swap(hw_data, false);
+    esp_apptrace_lock_give(&hw_data->lock);
+    return ESP_OK;
+}
+
+static esp_err_t esp_apptrace_linux_flush(esp_apptrace_linux_data_t *hw_data, esp_apptrace_tmo_t *tmo)
+{
+    return esp_apptrace_linux_flush_nolock(hw_data, 0, tmo);
+}
+
+static esp_err_t esp_apptrace_linux_get_stats(esp_apptrace_linux_data_t *hw_data, int core_id, esp_apptrace_stats_t *stats)
+{
+    if (core_id < 0 || core_id >= CONFIG_FREERTOS_NUMBER_OF_CORES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stats->written = __atomic_load_n(&hw_data->cores[core_id].stats.written, __ATOMIC_SEQ_CST);
+    stats->dropped = __atomic_load_n(&hw_data->cores[core_id].stats.dropped, __ATOMIC_SEQ_CST);
+    return ESP_OK;
+}
@@ -3,7 +3,7 @@
  *
  * SPDX-License-Identifier: BSD-1-Clause
  *
- * SPDX-FileContributor: 2017-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileContributor: 2017-2024 Espressif Systems (Shanghai) CO LTD
  */
 /*********************************************************************
 *                    SEGGER Microcontroller GmbH                     *
@@ -63,6 +63,7 @@ Revision: $Rev: 7745 $
 #include "SEGGER_SYSVIEW.h"
 #include "esp_app_trace.h"
 #include "esp_app_trace_util.h"
+#include "esp_sysview_trace.h"
 #include "esp_intr_alloc.h"
 #include "esp_cpu.h"
 #include "soc/soc.h"
@@ -167,6 +168,7 @@ static void _cbSendSystemDesc(void) {
         snprintf(irq_str, sizeof(irq_str), "I#%d=%s", ETS_INTERNAL_INTR_SOURCE_OFF + i, esp_isr_names[i]);
         SEGGER_SYSVIEW_SendSysDesc(irq_str);
     }
+    esp_sysview_send_span_names();
 }
 
 /*********************************************************************
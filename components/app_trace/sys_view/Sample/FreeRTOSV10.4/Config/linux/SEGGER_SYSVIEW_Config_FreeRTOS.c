@@ -0,0 +1,238 @@
+/*
+ * SPDX-FileCopyrightText: 1995-2021 SEGGER Microcontroller GmbH
+ *
+ * SPDX-License-Identifier: BSD-1-Clause
+ *
+ * SPDX-FileContributor: 2024 Espressif Systems (Shanghai) CO LTD
+ */
+/*********************************************************************
+*                    SEGGER Microcontroller GmbH                     *
+*                        The Embedded Experts                        *
+**********************************************************************
+*                                                                    *
+*            (c) 1995 - 2021 SEGGER Microcontroller GmbH             *
+*                                                                    *
+*       www.segger.com     Support: support@segger.com               *
+*                                                                    *
+**********************************************************************
+*                                                                    *
+*       SEGGER SystemView * Real-time application analysis           *
+*                                                                    *
+**********************************************************************
+*                                                                    *
+* All rights reserved.                                               *
+*                                                                    *
+* SEGGER strongly recommends to not make any changes                 *
+* to or modify the source code of this software in order to stay     *
+* compatible with the SystemView and RTT protocol, and J-Link.       *
+*                                                                    *
+* Redistribution and use in source and binary forms, with or         *
+* without modification, are permitted provided that the following    *
+* condition is met:                                                  *
+*                                                                    *
+* o Redistributions of source code must retain the above copyright   *
+*   notice, this condition and the following disclaimer.             *
+*                                                                    *
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND             *
+* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,        *
+* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF           *
+* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE           *
+* DISCLAIMED. IN NO EVENT SHALL SEGGER Microcontroller BE LIABLE FOR *
+* ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR           *
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  *
+* OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;    *
+* OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF      *
+* LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT          *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE  *
+* USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH   *
+* DAMAGE.                                                            *
+*                                                                    *
+**********************************************************************
+*                                                                    *
+*       SystemView version: 3.42                                    *
+*                                                                    *
+**********************************************************************
+-------------------------- END-OF-HEADER -----------------------------
+
+File    : SEGGER_SYSVIEW_Config_FreeRTOS.c
+Purpose : Sample setup configuration of SystemView with FreeRTOS.
+Revision: $Rev: 7745 $
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "SEGGER_SYSVIEW.h"
+#include "esp_app_trace.h"
+#include "esp_app_trace_util.h"
+#include "esp_sysview_trace.h"
+#include "esp_timer.h"
+
+extern const SEGGER_SYSVIEW_OS_API SYSVIEW_X_OS_TraceAPI;
+
+/*********************************************************************
+*
+*       Defines, configurable
+*
+**********************************************************************
+*/
+// The application name to be displayed in SystemViewer
+#define SYSVIEW_APP_NAME        "FreeRTOS Application"
+
+// The target device name
+#define SYSVIEW_DEVICE_NAME     CONFIG_IDF_TARGET
+// The target core name
+#define SYSVIEW_CORE_NAME       "host"
+
+// esp_timer provides 1us resolution, it is the only timestamp source on the host
+#define SYSVIEW_TIMESTAMP_FREQ  (1000000)
+
+// System Frequency. The host CPU frequency is unknown, the timestamp frequency is reported instead.
+#define SYSVIEW_CPU_FREQ        (SYSVIEW_TIMESTAMP_FREQ)
+
+// The lowest RAM address used for IDs (pointers)
+#define SYSVIEW_RAM_BASE        (0)
+
+// Header of SystemView trace files, as written by OpenOCD when tracing a chip.
+// ESP_Extension indicates that the events of all cores are in the same stream, the core is encoded in the event ID.
+#define SYSVIEW_TRACE_FILE_HEADER   ";\n"                                           \
+                                    "; Version     SEGGER SystemViewer V2.42\n"     \
+                                    "; Author      Espressif Inc\n"                 \
+                                    "; ESP_Extension\n"                             \
+                                    ";\n"
+
+// SystemView is single core specific: it implies that SEGGER_SYSVIEW_LOCK()
+// disables IRQs (disables rescheduling globally). So we can not use finite timeouts for locks and return error
+// in case of expiration, because error will not be handled and SEGGER's code will go further implying that
+// everything is fine, so for multi-core env we have to wait on underlying lock forever
+#define SEGGER_LOCK_WAIT_TMO  ESP_APPTRACE_TMO_INFINITE
+
+static esp_apptrace_lock_t s_sys_view_lock = {.mux = portMUX_INITIALIZER_UNLOCKED, .int_state = 0};
+
+/*********************************************************************
+*
+*       _cbSendSystemDesc()
+*
+*  Function description
+*    Sends SystemView description strings.
+*/
+static void _cbSendSystemDesc(void) {
+    char irq_str[32];
+    SEGGER_SYSVIEW_SendSysDesc("N="SYSVIEW_APP_NAME",D="SYSVIEW_DEVICE_NAME",C="SYSVIEW_CORE_NAME",O=FreeRTOS");
+    // The tick signal is the only interrupt simulated by the FreeRTOS port
+    snprintf(irq_str, sizeof(irq_str), "I#%d=SysTick", portSYSTICK_INTR_ID);
+    SEGGER_SYSVIEW_SendSysDesc(irq_str);
+    esp_sysview_send_span_names();
+}
+
+/*********************************************************************
+*
+*       _cbStopOnExit()
+*
+*  Function description
+*    Stops recording and writes the buffered events to the host when
+*    the application exits.
+*/
+static void _cbStopOnExit(void) {
+    if (SEGGER_SYSVIEW_Started()) {
+        // Recording the stop event flushes the buffered events
+        SEGGER_SYSVIEW_Stop();
+    }
+}
+
+/*********************************************************************
+*
+*       Global functions
+*
+**********************************************************************
+*/
+void SEGGER_SYSVIEW_Conf(void) {
+    U32 disable_evts = 0;
+
+    SEGGER_SYSVIEW_Init(SYSVIEW_TIMESTAMP_FREQ, SYSVIEW_CPU_FREQ,
+                        &SYSVIEW_X_OS_TraceAPI, _cbSendSystemDesc);
+    SEGGER_SYSVIEW_SetRAMBase(SYSVIEW_RAM_BASE);
+
+#if !CONFIG_APPTRACE_SV_EVT_OVERFLOW_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_OVERFLOW;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_ISR_ENTER_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_ISR_ENTER;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_ISR_EXIT_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_ISR_EXIT;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TASK_START_EXEC_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TASK_START_EXEC;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TASK_STOP_EXEC_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TASK_STOP_EXEC;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TASK_START_READY_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TASK_START_READY;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TASK_STOP_READY_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TASK_STOP_READY;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TASK_CREATE_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TASK_CREATE;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TASK_TERMINATE_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TASK_TERMINATE;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_IDLE_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_IDLE;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_ISR_TO_SCHED_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_ISR_TO_SCHEDULER;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TIMER_ENTER_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TIMER_ENTER;
+#endif
+#if !CONFIG_APPTRACE_SV_EVT_TIMER_EXIT_ENABLE
+    disable_evts |= SYSVIEW_EVTMASK_TIMER_EXIT;
+#endif
+    SEGGER_SYSVIEW_DisableEvents(disable_evts);
+
+    /* On a chip, the host starts recording by sending a command through JTAG. There is no such host here,
+     * so recording starts right away, behind the file header which OpenOCD would have written. */
+    esp_err_t res = esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, SYSVIEW_TRACE_FILE_HEADER,
+                                       strlen(SYSVIEW_TRACE_FILE_HEADER), ESP_APPTRACE_TMO_INFINITE);
+    if (res != ESP_OK) {
+        // Trace destination is not available, e.g. the host socket is not listening
+        return;
+    }
+    SEGGER_SYSVIEW_Start();
+    atexit(_cbStopOnExit);
+}
+
+U32 SEGGER_SYSVIEW_X_GetTimestamp(void)
+{
+    return (U32) esp_timer_get_time(); // return lower part of counter value
+}
+
+void SEGGER_SYSVIEW_X_RTT_Lock(void)
+{
+}
+
+void SEGGER_SYSVIEW_X_RTT_Unlock(void)
+{
+}
+
+unsigned SEGGER_SYSVIEW_X_SysView_Lock(void)
+{
+    esp_apptrace_tmo_t tmo;
+    esp_apptrace_tmo_init(&tmo, SEGGER_LOCK_WAIT_TMO);
+    esp_apptrace_lock_take(&s_sys_view_lock, &tmo);
+    // to be recursive save IRQ status on the stack of the caller to keep it from overwriting
+    return s_sys_view_lock.int_state;
+}
+
+void SEGGER_SYSVIEW_X_SysView_Unlock(unsigned int_state)
+{
+    s_sys_view_lock.int_state = int_state;
+    esp_apptrace_lock_give(&s_sys_view_lock);
+}
+
+/*************************** End of file ****************************/
@@ -3,7 +3,7 @@
  *
  * SPDX-License-Identifier: BSD-1-Clause
  *
- * SPDX-FileContributor: 2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileContributor: 2023-2024 Espressif Systems (Shanghai) CO LTD
  */
 /*********************************************************************
 *                    SEGGER Microcontroller GmbH                     *
@@ -92,7 +92,9 @@ static void _cbSendTaskList(void) {
   unsigned n;
 
   for (n = 0; n < _NumTasks; n++) {
-#if INCLUDE_uxTaskGetStackHighWaterMark // Report Task Stack High Watermark
+// Report Task Stack High Watermark. Handles are stored as 32-bit IDs, on 64-bit hosts they can't be turned back into
+// handles, so the watermark recorded when the task was added is reported.
+#if INCLUDE_uxTaskGetStackHighWaterMark && (UINTPTR_MAX == 0xFFFFFFFFu)
     _aTasks[n].uStackHighWaterMark = uxTaskGetStackHighWaterMark((TaskHandle_t)_aTasks[n].xHandle);
 #endif
     SYSVIEW_SendTaskInfo((U32)_aTasks[n].xHandle, _aTasks[n].pcTaskName, (unsigned)_aTasks[n].uxCurrentPriority, (U32)_aTasks[n].pxStack, (unsigned)_aTasks[n].uStackHighWaterMark);
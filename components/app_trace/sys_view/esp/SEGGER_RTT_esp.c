@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2017-2021 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2017-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -12,8 +12,9 @@
 
 #include "esp_app_trace.h"
 #include "esp_log.h"
-#include "esp_cpu.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_private/startup_internal.h"
+#endif
 
 const static char *TAG = "segger_rtt";
 
@@ -41,10 +42,16 @@ static uint8_t s_down_buf[SYSVIEW_DOWN_BUF_SIZE];
 #define APPTRACE_SV_DEST_CPU 1
 #endif // CONFIG_APPTRACE_SV_DEST_CPU_0
 
-#elif CONFIG_APPTRACE_SV_DEST_JTAG || (CONFIG_APPTRACE_ENABLE && CONFIG_APPTRACE_DEST_UART_NONE)
+#elif CONFIG_APPTRACE_SV_DEST_JTAG || CONFIG_APPTRACE_SV_DEST_HOST || (CONFIG_APPTRACE_ENABLE && CONFIG_APPTRACE_DEST_UART_NONE)
+// On Linux, the host file or socket takes the place of JTAG
 #define ESP_APPTRACE_DEST_SYSVIEW ESP_APPTRACE_DEST_TRAX
 #endif
 
+#if CONFIG_APPTRACE_SV_DEST_JTAG || CONFIG_APPTRACE_SV_DEST_HOST
+// Events of all cores are buffered and sent in a single stream
+#define SYSVIEW_EVENTS_BATCHED 1
+#endif
+
 /*********************************************************************
 *
 *       Public code
@@ -159,7 +166,7 @@ unsigned SEGGER_RTT_WriteSkipNoLock(unsigned BufferIndex, const void* pBuffer, u
   uint8_t event_id = *pbuf;
 #if CONFIG_APPTRACE_SV_DEST_UART
   if (
-    (APPTRACE_SV_DEST_CPU != esp_cpu_get_core_id()) &&
+    (APPTRACE_SV_DEST_CPU != xPortGetCoreID()) &&
     (
       (event_id == SYSVIEW_EVTID_ISR_ENTER) ||
       (event_id == SYSVIEW_EVTID_ISR_EXIT) ||
@@ -189,8 +196,8 @@ unsigned SEGGER_RTT_WriteSkipNoLock(unsigned BufferIndex, const void* pBuffer, u
       ESP_LOGE(TAG, "Too large event %u bytes!", NumBytes);
       return 0;
   }
-#if CONFIG_APPTRACE_SV_DEST_JTAG
-  if (esp_cpu_get_core_id()) { // dual core specific code
+#if SYSVIEW_EVENTS_BATCHED
+  if (xPortGetCoreID()) { // dual core specific code
     // use the highest - 1 bit of event ID to indicate core ID
     // the highest bit can not be used due to event ID encoding method
     // this reduces supported ID range to [0..63] (for 1 byte IDs) plus [128..16383] (for 2 bytes IDs)
@@ -200,8 +207,8 @@ unsigned SEGGER_RTT_WriteSkipNoLock(unsigned BufferIndex, const void* pBuffer, u
       *pbuf |= (1 << 6);
     }
   }
-#endif // CONFIG_APPTRACE_SV_DEST_JTAG
-#if CONFIG_APPTRACE_SV_DEST_JTAG
+#endif // SYSVIEW_EVENTS_BATCHED
+#if SYSVIEW_EVENTS_BATCHED
   if (s_events_buf_filled + NumBytes > SYSVIEW_EVENTS_BUF_SZ) {
 
     esp_err_t res = esp_apptrace_write(ESP_APPTRACE_DEST_SYSVIEW, s_events_buf, s_events_buf_filled, SEGGER_HOST_WAIT_TMO);
@@ -296,11 +303,19 @@ int SEGGER_RTT_ConfigDownBuffer(unsigned BufferIndex, const char* sName, void* p
  * linked whenever SystemView is used.
  */
 
+#if CONFIG_IDF_TARGET_LINUX
+// There is no startup code calling init functions on Linux, the constructors run before app_main() instead
+__attribute__((constructor(120))) static void sysview_init(void)
+{
+    SEGGER_SYSVIEW_Conf();
+}
+#else
 ESP_SYSTEM_INIT_FN(sysview_init, SECONDARY, BIT(0), 120)
 {
     SEGGER_SYSVIEW_Conf();
     return ESP_OK;
 }
+#endif
 
 
 /*************************** End of file ****************************/
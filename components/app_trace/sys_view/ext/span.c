@@ -0,0 +1,59 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <sdkconfig.h>
+#include "SEGGER_SYSVIEW.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_app_trace_span.h"
+#include "esp_sysview_trace.h"
+
+#define SPAN_NAMES_MAX  32
+
+typedef struct {
+    uint32_t id;
+    const char *name;
+} span_name_t;
+
+// Names are only added, and published by incrementing the count, so they can be read without the lock
+static span_name_t s_span_names[SPAN_NAMES_MAX];
+static volatile uint32_t s_span_names_num;
+static portMUX_TYPE s_span_names_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t esp_apptrace_span_name(uint32_t id, const char *name)
+{
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&s_span_names_lock);
+    uint32_t i;
+    for (i = 0; i < s_span_names_num; i++) {
+        if (s_span_names[i].id == id) {
+            break;
+        }
+    }
+    if (i < s_span_names_num) {
+        s_span_names[i].name = name;
+    } else if (i < SPAN_NAMES_MAX) {
+        s_span_names[i].id = id;
+        s_span_names[i].name = name;
+        s_span_names_num = i + 1;
+    } else {
+        ret = ESP_ERR_NO_MEM;
+    }
+    portEXIT_CRITICAL(&s_span_names_lock);
+
+    if (ret == ESP_OK && SEGGER_SYSVIEW_Started()) {
+        SEGGER_SYSVIEW_NameMarker(id, name);
+    }
+    return ret;
+}
+
+void esp_sysview_send_span_names(void)
+{
+    uint32_t num = s_span_names_num;
+
+    for (uint32_t i = 0; i < num; i++) {
+        SEGGER_SYSVIEW_NameMarker(s_span_names[i].id, s_span_names[i].name);
+    }
+}
@@ -0,0 +1,338 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_ota_decompress.h"
+
+#ifndef CONFIG_APP_UPDATE_COMPRESSED_IMAGE_MAX_WINDOW_BITS
+#define CONFIG_APP_UPDATE_COMPRESSED_IMAGE_MAX_WINDOW_BITS 12
+#endif
+
+const static char *TAG = "esp_ota_decompress";
+
+typedef enum {
+    DECOMP_STATE_HEADER,        /* collecting container header bytes */
+    DECOMP_STATE_TAG_BIT,       /* reading literal/back-reference tag */
+    DECOMP_STATE_LITERAL,       /* reading 8-bit literal */
+    DECOMP_STATE_BACKREF_INDEX, /* reading back-reference offset */
+    DECOMP_STATE_BACKREF_COUNT, /* reading back-reference length */
+    DECOMP_STATE_DONE,          /* whole image decoded and flushed */
+    DECOMP_STATE_ERROR,         /* stream is invalid or the sink failed */
+} decomp_state_t;
+
+struct esp_ota_decompress {
+    decomp_state_t state;
+    esp_ota_decompress_sink_t sink;
+    void *sink_arg;
+    union {
+        esp_ota_compressed_header_t header;
+        uint8_t header_bytes[ESP_OTA_COMPRESSED_HEADER_SIZE];
+    };
+    uint8_t header_len;
+    uint8_t cur_byte;       /* input byte currently being consumed */
+    uint8_t bit_mask;       /* next bit of cur_byte to consume, 0 if cur_byte is exhausted */
+    uint8_t acc_bits;       /* number of bits collected in acc so far */
+    uint16_t acc;           /* partially read bit field, survives across feed calls */
+    uint16_t backref_index;
+    uint32_t out_total;     /* number of bytes decoded */
+    uint32_t flushed;       /* number of bytes passed to the sink */
+    uint32_t window_mask;
+    uint8_t *window;        /* back-reference window, also used as output buffer */
+};
+
+bool esp_ota_is_compressed_image(const void *data, size_t size)
+{
+    const uint32_t magic = ESP_OTA_COMPRESSED_MAGIC;
+    if (data == NULL || size == 0) {
+        return false;
+    }
+    return memcmp(data, &magic, size < sizeof(magic) ? size : sizeof(magic)) == 0;
+}
+
+esp_err_t esp_ota_decompress_new(esp_ota_decompress_sink_t sink, void *sink_arg, esp_ota_decompress_handle_t *out_handle)
+{
+    if (sink == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_ota_decompress_handle_t handle = calloc(1, sizeof(struct esp_ota_decompress));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->state = DECOMP_STATE_HEADER;
+    handle->sink = sink;
+    handle->sink_arg = sink_arg;
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+void esp_ota_decompress_delete(esp_ota_decompress_handle_t handle)
+{
+    if (handle == NULL) {
+        return;
+    }
+    free(handle->window);
+    free(handle);
+}
+
+bool esp_ota_decompress_is_complete(esp_ota_decompress_handle_t handle)
+{
+    return handle != NULL && handle->state == DECOMP_STATE_DONE;
+}
+
+size_t esp_ota_decompress_get_image_size(esp_ota_decompress_handle_t handle)
+{
+    if (handle == NULL || handle->window == NULL) {
+        return 0;
+    }
+    return handle->header.image_size;
+}
+
+static esp_err_t parse_header(esp_ota_decompress_handle_t handle)
+{
+    const esp_ota_compressed_header_t *hdr = &handle->header;
+    if (hdr->version != ESP_OTA_COMPRESSED_VERSION) {
+        ESP_LOGE(TAG, "Unsupported compressed image version %d", hdr->version);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (hdr->window_bits < ESP_OTA_COMPRESSED_MIN_WINDOW_BITS
+            || hdr->window_bits > CONFIG_APP_UPDATE_COMPRESSED_IMAGE_MAX_WINDOW_BITS
+            || hdr->lookahead_bits < 3 || hdr->lookahead_bits >= hdr->window_bits) {
+        ESP_LOGE(TAG, "Unsupported window parameters W=%d L=%d (max W=%d)",
+                 hdr->window_bits, hdr->lookahead_bits, CONFIG_APP_UPDATE_COMPRESSED_IMAGE_MAX_WINDOW_BITS);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    const size_t window_size = 1U << hdr->window_bits;
+    /* Stream may reference data before the start of the image, heatshrink defines it as zeros */
+    handle->window = calloc(1, window_size);
+    if (handle->window == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->window_mask = window_size - 1;
+    ESP_LOGD(TAG, "Compressed image: %"PRIu32" -> %"PRIu32" bytes, window %u bytes",
+             hdr->compressed_size, hdr->image_size, (unsigned)window_size);
+    return ESP_OK;
+}
+
+/* Pass the decoded but not yet flushed data to the sink. Unflushed data never wraps around the window. */
+static esp_err_t flush_window(esp_ota_decompress_handle_t handle)
+{
+    const uint32_t pending = handle->out_total - handle->flushed;
+    if (pending == 0) {
+        return ESP_OK;
+    }
+    esp_err_t err = handle->sink(&handle->window[handle->flushed & handle->window_mask], pending, handle->sink_arg);
+    if (err != ESP_OK) {
+        return err;
+    }
+    handle->flushed = handle->out_total;
+    return ESP_OK;
+}
+
+static esp_err_t emit_byte(esp_ota_decompress_handle_t handle, uint8_t byte)
+{
+    if (handle->out_total >= handle->header.image_size) {
+        ESP_LOGE(TAG, "Decoded data exceeds image size");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    handle->window[handle->out_total & handle->window_mask] = byte;
+    handle->out_total++;
+    if ((handle->out_total & handle->window_mask) == 0 || handle->out_total == handle->header.image_size) {
+        return flush_window(handle);
+    }
+    return ESP_OK;
+}
+
+/*
+ * Collect `count` bits (MSB first) into handle->acc. Bits are consumed one at a time so that a
+ * field may be split across any number of feed calls. Returns false if the input ran out first.
+ */
+static bool get_bits(esp_ota_decompress_handle_t handle, uint8_t count, const uint8_t **data, size_t *size)
+{
+    while (handle->acc_bits < count) {
+        if (handle->bit_mask == 0) {
+            if (*size == 0) {
+                return false;
+            }
+            handle->cur_byte = **data;
+            handle->bit_mask = 0x80;
+            (*data)++;
+            (*size)--;
+        }
+        handle->acc = (handle->acc << 1) | ((handle->cur_byte & handle->bit_mask) ? 1 : 0);
+        handle->bit_mask >>= 1;
+        handle->acc_bits++;
+    }
+    return true;
+}
+
+static inline uint16_t take_bits(esp_ota_decompress_handle_t handle)
+{
+    uint16_t value = handle->acc;
+    handle->acc = 0;
+    handle->acc_bits = 0;
+    return value;
+}
+
+esp_err_t esp_ota_decompress_feed(esp_ota_decompress_handle_t handle, const void *data, size_t size)
+{
+    const uint8_t *in = (const uint8_t *)data;
+    esp_err_t err = ESP_OK;
+
+    if (handle == NULL || (data == NULL && size > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->state == DECOMP_STATE_ERROR) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    while (handle->state == DECOMP_STATE_HEADER && size > 0) {
+        handle->header_bytes[handle->header_len++] = *in++;
+        size--;
+        if (handle->header_len <= sizeof(handle->header.magic)
+                && !esp_ota_is_compressed_image(handle->header_bytes, handle->header_len)) {
+            ESP_LOGE(TAG, "Invalid compressed image magic");
+            err = ESP_ERR_INVALID_ARG;
+            goto fail;
+        }
+        if (handle->header_len == ESP_OTA_COMPRESSED_HEADER_SIZE) {
+            err = parse_header(handle);
+            if (err != ESP_OK) {
+                goto fail;
+            }
+            handle->state = (handle->header.image_size == 0) ? DECOMP_STATE_DONE : DECOMP_STATE_TAG_BIT;
+        }
+    }
+
+    while (handle->state != DECOMP_STATE_HEADER && handle->state != DECOMP_STATE_DONE) {
+        switch (handle->state) {
+        case DECOMP_STATE_TAG_BIT:
+            if (!get_bits(handle, 1, &in, &size)) {
+                return ESP_OK;
+            }
+            handle->state = take_bits(handle) ? DECOMP_STATE_LITERAL : DECOMP_STATE_BACKREF_INDEX;
+            break;
+        case DECOMP_STATE_LITERAL:
+            if (!get_bits(handle, 8, &in, &size)) {
+                return ESP_OK;
+            }
+            err = emit_byte(handle, (uint8_t)take_bits(handle));
+            if (err != ESP_OK) {
+                goto fail;
+            }
+            handle->state = DECOMP_STATE_TAG_BIT;
+            break;
+        case DECOMP_STATE_BACKREF_INDEX:
+            if (!get_bits(handle, handle->header.window_bits, &in, &size)) {
+                return ESP_OK;
+            }
+            handle->backref_index = take_bits(handle) + 1;
+            handle->state = DECOMP_STATE_BACKREF_COUNT;
+            break;
+        case DECOMP_STATE_BACKREF_COUNT: {
+            if (!get_bits(handle, handle->header.lookahead_bits, &in, &size)) {
+                return ESP_OK;
+            }
+            uint32_t count = take_bits(handle) + 1;
+            /* Copy byte by byte, source and destination may overlap */
+            while (count--) {
+                uint8_t byte = handle->window[(handle->out_total - handle->backref_index) & handle->window_mask];
+                err = emit_byte(handle, byte);
+                if (err != ESP_OK) {
+                    goto fail;
+                }
+            }
+            handle->state = DECOMP_STATE_TAG_BIT;
+            break;
+        }
+        default:
+            abort();
+        }
+        if (handle->out_total == handle->header.image_size) {
+            /* Remaining bits of the current byte are padding */
+            handle->state = DECOMP_STATE_DONE;
+            handle->bit_mask = 0;
+        }
+    }
+
+    if (handle->state == DECOMP_STATE_DONE && size > 0) {
+        ESP_LOGE(TAG, "%u bytes of data after the end of the compressed image", (unsigned)size);
+        err = ESP_ERR_INVALID_SIZE;
+        goto fail;
+    }
+    return ESP_OK;
+
+fail:
+    handle->state = DECOMP_STATE_ERROR;
+    return err;
+}
+
+esp_err_t esp_ota_decompress_flush(esp_ota_decompress_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->state == DECOMP_STATE_ERROR) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* Before the header is complete nothing is decoded, afterwards the window holds the unflushed data */
+    esp_err_t err = flush_window(handle);
+    if (err != ESP_OK) {
+        handle->state = DECOMP_STATE_ERROR;
+    }
+    return err;
+}
+
+typedef struct {
+    uint8_t *out;
+    size_t out_size;
+    size_t out_len;
+} peek_ctx_t;
+
+static esp_err_t peek_sink(const void *data, size_t size, void *arg)
+{
+    peek_ctx_t *ctx = (peek_ctx_t *)arg;
+    size_t copy_len = ctx->out_size - ctx->out_len;
+    if (copy_len > size) {
+        copy_len = size;
+    }
+    memcpy(ctx->out + ctx->out_len, data, copy_len);
+    ctx->out_len += copy_len;
+    /* Stop decoding as soon as the caller's buffer is full */
+    return (ctx->out_len == ctx->out_size) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+esp_err_t esp_ota_decompress_peek(const void *data, size_t size, void *out, size_t out_size, size_t *out_len)
+{
+    if (data == NULL || out == NULL || out_size == 0 || out_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    peek_ctx_t ctx = {
+        .out = out,
+        .out_size = out_size,
+    };
+    esp_ota_decompress_handle_t handle;
+    esp_err_t err = esp_ota_decompress_new(peek_sink, &ctx, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = esp_ota_decompress_feed(handle, data, size);
+    if (err == ESP_OK) {
+        /* Input ran out before the buffer was full, hand over what was decoded so far */
+        err = esp_ota_decompress_flush(handle);
+    }
+    if (ctx.out_len == ctx.out_size) {
+        err = ESP_OK;
+    }
+    esp_ota_decompress_delete(handle);
+    *out_len = ctx.out_len;
+    return err;
+}
@@ -30,6 +30,9 @@
 #include "esp_attr.h"
 #include "esp_bootloader_desc.h"
 #include "esp_flash.h"
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+#include "esp_ota_decompress.h"
+#endif
 
 #define SUB_TYPE_ID(i) (i & 0x0F)
 
@@ -41,6 +44,10 @@ typedef struct ota_ops_entry_ {
     uint32_t wrote_size;
     uint8_t partial_bytes;
     WORD_ALIGNED_ATTR uint8_t partial_data[16];
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+    esp_ota_decompress_handle_t decompress;
+    esp_err_t decompress_sink_err;  /* last error of writing decompressed data, passed to the caller as is */
+#endif
     LIST_ENTRY(ota_ops_entry_) entries;
 } ota_ops_entry_t;
 
@@ -170,10 +177,110 @@ esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp
     return ESP_OK;
 }
 
+static esp_err_t ota_write_entry(ota_ops_entry_t *it, const uint8_t *data_bytes, size_t size)
+{
+    esp_err_t ret;
+
+    if (it->need_erase) {
+        // must erase the partition before writing to it
+        uint32_t first_sector = it->wrote_size / SPI_FLASH_SEC_SIZE; // first affected sector
+        uint32_t last_sector = (it->wrote_size + size - 1) / SPI_FLASH_SEC_SIZE; // last affected sector
+
+        ret = ESP_OK;
+        if ((it->wrote_size % SPI_FLASH_SEC_SIZE) == 0) {
+            ret = esp_partition_erase_range(it->part, it->wrote_size, ((last_sector - first_sector) + 1) * SPI_FLASH_SEC_SIZE);
+        } else if (first_sector != last_sector) {
+            ret = esp_partition_erase_range(it->part, (first_sector + 1) * SPI_FLASH_SEC_SIZE, (last_sector - first_sector) * SPI_FLASH_SEC_SIZE);
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    if (it->wrote_size == 0 && it->partial_bytes == 0 && size > 0 && data_bytes[0] != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG, "OTA image has invalid magic byte (expected 0xE9, saw 0x%02x)", data_bytes[0]);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    if (esp_flash_encryption_enabled()) {
+        /* Can only write 16 byte blocks to flash, so need to cache anything else */
+        size_t copy_len;
+
+        /* check if we have partially written data from earlier */
+        if (it->partial_bytes != 0) {
+            copy_len = MIN(16 - it->partial_bytes, size);
+            memcpy(it->partial_data + it->partial_bytes, data_bytes, copy_len);
+            it->partial_bytes += copy_len;
+            if (it->partial_bytes != 16) {
+                return ESP_OK; /* nothing to write yet, just filling buffer */
+            }
+            /* write 16 byte to partition */
+            ret = esp_partition_write(it->part, it->wrote_size, it->partial_data, 16);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            it->partial_bytes = 0;
+            memset(it->partial_data, 0xFF, 16);
+            it->wrote_size += 16;
+            data_bytes += copy_len;
+            size -= copy_len;
+        }
+
+        /* check if we need to save trailing data that we're about to write */
+        it->partial_bytes = size % 16;
+        if (it->partial_bytes != 0) {
+            size -= it->partial_bytes;
+            memcpy(it->partial_data, data_bytes + size, it->partial_bytes);
+        }
+    }
+
+    ret = esp_partition_write(it->part, it->wrote_size, data_bytes, size);
+    if(ret == ESP_OK){
+        it->wrote_size += size;
+    }
+    return ret;
+}
+
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+static esp_err_t ota_decompress_sink(const void *data, size_t size, void *arg)
+{
+    ota_ops_entry_t *it = (ota_ops_entry_t *)arg;
+    it->decompress_sink_err = ota_write_entry(it, (const uint8_t *)data, size);
+    return it->decompress_sink_err;
+}
+
+static esp_err_t ota_write_compressed(ota_ops_entry_t *it, const uint8_t *data_bytes, size_t size)
+{
+    esp_err_t ret;
+
+    if (it->decompress == NULL) {
+        ret = esp_ota_decompress_new(ota_decompress_sink, it, &it->decompress);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        ESP_LOGI(TAG, "Compressed OTA image detected");
+    }
+    it->decompress_sink_err = ESP_OK;
+    ret = esp_ota_decompress_feed(it->decompress, data_bytes, size);
+    if (ret != ESP_OK && ret == it->decompress_sink_err) {
+        /* Writing the decompressed data failed, e.g. on flash, the stream itself may well be valid */
+        return ret;
+    }
+    /* Only errors of the decoder mean the compressed stream is invalid */
+    switch (ret) {
+        case ESP_ERR_INVALID_ARG:
+        case ESP_ERR_NOT_SUPPORTED:
+        case ESP_ERR_INVALID_SIZE:
+            return ESP_ERR_OTA_VALIDATE_FAILED;
+        default:
+            return ret;
+    }
+}
+#endif // CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+
 esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
 {
     const uint8_t *data_bytes = (const uint8_t *)data;
-    esp_err_t ret;
     ota_ops_entry_t *it;
 
     if (data == NULL) {
@@ -189,64 +296,13 @@ esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
     // find ota handle in linked list
     for (it = LIST_FIRST(&s_ota_ops_entries_head); it != NULL; it = LIST_NEXT(it, entries)) {
         if (it->handle == handle) {
-            if (it->need_erase) {
-                // must erase the partition before writing to it
-                uint32_t first_sector = it->wrote_size / SPI_FLASH_SEC_SIZE; // first affected sector
-                uint32_t last_sector = (it->wrote_size + size - 1) / SPI_FLASH_SEC_SIZE; // last affected sector
-
-                ret = ESP_OK;
-                if ((it->wrote_size % SPI_FLASH_SEC_SIZE) == 0) {
-                    ret = esp_partition_erase_range(it->part, it->wrote_size, ((last_sector - first_sector) + 1) * SPI_FLASH_SEC_SIZE);
-                } else if (first_sector != last_sector) {
-                    ret = esp_partition_erase_range(it->part, (first_sector + 1) * SPI_FLASH_SEC_SIZE, (last_sector - first_sector) * SPI_FLASH_SEC_SIZE);
-                }
-                if (ret != ESP_OK) {
-                    return ret;
-                }
-            }
-
-            if (it->wrote_size == 0 && it->partial_bytes == 0 && size > 0 && data_bytes[0] != ESP_IMAGE_HEADER_MAGIC) {
-                ESP_LOGE(TAG, "OTA image has invalid magic byte (expected 0xE9, saw 0x%02x)", data_bytes[0]);
-                return ESP_ERR_OTA_VALIDATE_FAILED;
-            }
-
-            if (esp_flash_encryption_enabled()) {
-                /* Can only write 16 byte blocks to flash, so need to cache anything else */
-                size_t copy_len;
-
-                /* check if we have partially written data from earlier */
-                if (it->partial_bytes != 0) {
-                    copy_len = MIN(16 - it->partial_bytes, size);
-                    memcpy(it->partial_data + it->partial_bytes, data_bytes, copy_len);
-                    it->partial_bytes += copy_len;
-                    if (it->partial_bytes != 16) {
-                        return ESP_OK; /* nothing to write yet, just filling buffer */
-                    }
-                    /* write 16 byte to partition */
-                    ret = esp_partition_write(it->part, it->wrote_size, it->partial_data, 16);
-                    if (ret != ESP_OK) {
-                        return ret;
-                    }
-                    it->partial_bytes = 0;
-                    memset(it->partial_data, 0xFF, 16);
-                    it->wrote_size += 16;
-                    data_bytes += copy_len;
-                    size -= copy_len;
-                }
-
-                /* check if we need to save trailing data that we're about to write */
-                it->partial_bytes = size % 16;
-                if (it->partial_bytes != 0) {
-                    size -= it->partial_bytes;
-                    memcpy(it->partial_data, data_bytes + size, it->partial_bytes);
-                }
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+            if (it->decompress != NULL
+                    || (it->wrote_size == 0 && it->partial_bytes == 0 && esp_ota_is_compressed_image(data_bytes, size))) {
+                return ota_write_compressed(it, data_bytes, size);
             }
-
-            ret = esp_partition_write(it->part, it->wrote_size, data_bytes, size);
-            if(ret == ESP_OK){
-                it->wrote_size += size;
-            }
-            return ret;
+#endif
+            return ota_write_entry(it, data_bytes, size);
         }
     }
 
@@ -311,6 +367,9 @@ esp_err_t esp_ota_abort(esp_ota_handle_t handle)
         return ESP_ERR_NOT_FOUND;
     }
     LIST_REMOVE(it, entries);
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+    esp_ota_decompress_delete(it->decompress);
+#endif
     free(it);
     return ESP_OK;
 }
@@ -326,6 +385,14 @@ esp_err_t esp_ota_end(esp_ota_handle_t handle)
 
     /* 'it' holds the ota_ops_entry_t for 'handle' */
 
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+    if (it->decompress != NULL && !esp_ota_decompress_is_complete(it->decompress)) {
+        ESP_LOGE(TAG, "Compressed OTA image is incomplete");
+        ret = ESP_ERR_OTA_VALIDATE_FAILED;
+        goto cleanup;
+    }
+#endif
+
     // esp_ota_end() is only valid if some data was written to this handle
     if (it->wrote_size == 0) {
         ret = ESP_ERR_INVALID_ARG;
@@ -356,6 +423,9 @@ esp_err_t esp_ota_end(esp_ota_handle_t handle)
 
  cleanup:
     LIST_REMOVE(it, entries);
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+    esp_ota_decompress_delete(it->decompress);
+#endif
     free(it);
     return ret;
 }
@@ -0,0 +1,400 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Linux host test of the streaming compressed OTA image decoder
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_ota_decompress.h"
+#include "unity.h"
+#include "unity_fixture.h"
+
+#define TEST_IMAGE_SIZE     (64 * 1024)
+#define TEST_ITERATIONS     20
+
+/* Output of `otacompress.py -w 8 -l 4` for the data built by make_vector_source() */
+static const uint8_t s_python_vector[] = {
+    0x4f, 0x54, 0x41, 0x5a, 0x01, 0x08, 0x04, 0x00, 0xeb, 0x01, 0x00, 0x00, 0xd0, 0x00, 0x00, 0x00,
+    0xa2, 0xd4, 0xea, 0x12, 0xda, 0x4d, 0x12, 0x8d, 0x20, 0xb1, 0xdb, 0xed, 0xb7, 0x0b, 0x95, 0x96,
+    0xe7, 0x73, 0xb2, 0xd9, 0x24, 0x14, 0xfa, 0xa5, 0x06, 0x41, 0x69, 0xb6, 0xd8, 0x6c, 0xf6, 0x59,
+    0x05, 0xd2, 0xcb, 0x73, 0xba, 0x48, 0x2e, 0xd6, 0x5b, 0x1d, 0xd2, 0xdf, 0x72, 0x97, 0x48, 0x05,
+    0x3e, 0x29, 0xf1, 0x4f, 0x8a, 0x7c, 0x53, 0xe2, 0x9f, 0x14, 0xf8, 0xa7, 0xc5, 0x3e, 0x29, 0xf1,
+    0x4f, 0x8a, 0x7c, 0x53, 0xf2, 0xe9, 0x04, 0x02, 0x03, 0x02, 0x81, 0xc1, 0x20, 0xb0, 0x68, 0x3c,
+    0x22, 0x13, 0x0a, 0x85, 0xc3, 0x21, 0xb0, 0xe8, 0x7c, 0x42, 0x23, 0x12, 0x89, 0xc5, 0x22, 0xb1,
+    0x68, 0xbc, 0x62, 0x33, 0x1a, 0x8d, 0xc7, 0x23, 0xb1, 0xe8, 0xfc, 0x82, 0x43, 0x22, 0x91, 0xc9,
+    0x24, 0xb2, 0x69, 0x3c, 0xa2, 0x53, 0x2a, 0x95, 0xcb, 0x25, 0xb2, 0xe9, 0x7c, 0xc2, 0x63, 0x32,
+    0x99, 0xcd, 0x26, 0xb3, 0x69, 0xbc, 0xe2, 0x73, 0x3a, 0x9d, 0xcf, 0x27, 0xb3, 0xe9, 0xfc, 0x00,
+    0x01, 0xe0, 0x0f, 0x00, 0x35, 0x52, 0xd1, 0x65, 0x90, 0x5c, 0x6e, 0xb6, 0x9b, 0x1d, 0xae, 0x41,
+    0x62, 0xb9, 0x5b, 0xee, 0xf6, 0xe9, 0x05, 0x9a, 0xdf, 0x78, 0x90, 0x5a, 0xae, 0xb6, 0xdb, 0x85,
+    0xce, 0x41, 0x6f, 0xbb, 0x59, 0x6e, 0x52, 0x0b, 0xa0, 0x78, 0xad, 0x96, 0x1b, 0xd5, 0xe6, 0x41,
+    0x64, 0xb7, 0xd9, 0xe5, 0xd2, 0x01, 0x67, 0x8b, 0x3c, 0x59, 0xe2, 0xcf, 0x16, 0x78, 0xb2, 0x40,
+};
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    size_t max_chunk;
+    size_t calls;
+    esp_err_t fail_with;
+} sink_buf_t;
+
+static esp_err_t buf_sink(const void *data, size_t size, void *arg)
+{
+    sink_buf_t *buf = (sink_buf_t *)arg;
+    if (buf->fail_with != ESP_OK) {
+        return buf->fail_with;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(buf->capacity, buf->size + size);
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    buf->calls++;
+    if (size > buf->max_chunk) {
+        buf->max_chunk = size;
+    }
+    return ESP_OK;
+}
+
+static size_t make_vector_source(uint8_t *out)
+{
+    size_t len = 0;
+    for (int i = 0; i < 6; i++) {
+        const char *s = "ESP-IDF compressed OTA image test vector. ";
+        memcpy(out + len, s, strlen(s));
+        len += strlen(s);
+    }
+    for (int i = 0; i < 64; i++) {
+        out[len++] = i;
+    }
+    memset(out + len, 0, 40);
+    len += 40;
+    for (int i = 0; i < 3; i++) {
+        const char *s = "The quick brown fox jumps over the lazy dog. ";
+        memcpy(out + len, s, strlen(s));
+        len += strlen(s);
+    }
+    return len;
+}
+
+/* Image-like test data: runs, repeated records and incompressible stretches */
+static void make_image(uint8_t *out, size_t size)
+{
+    size_t pos = 0;
+    while (pos < size) {
+        size_t len = 1 + rand() % 300;
+        if (len > size - pos) {
+            len = size - pos;
+        }
+        switch (rand() % 3) {
+        case 0:
+            memset(out + pos, rand() & 0xff, len);
+            break;
+        case 1:
+            for (size_t i = 0; i < len; i++) {
+                out[pos + i] = rand() & 0xff;
+            }
+            break;
+        default:
+            for (size_t i = 0; i < len; i++) {
+                out[pos + i] = (pos > 64) ? out[pos + i - 64] : i;
+            }
+            break;
+        }
+        pos += len;
+    }
+}
+
+typedef struct {
+    uint8_t *data;
+    size_t bits;
+} bit_writer_t;
+
+static void put_bits(bit_writer_t *w, uint32_t value, int count)
+{
+    for (int i = count - 1; i >= 0; i--) {
+        if (value & (1U << i)) {
+            w->data[w->bits / 8] |= 0x80 >> (w->bits % 8);
+        }
+        w->bits++;
+    }
+}
+
+/* Straightforward greedy LZSS encoder producing the same bit stream format as otacompress.py */
+static size_t compress_image(const uint8_t *in, size_t size, uint8_t window_bits, uint8_t lookahead_bits, uint8_t *out)
+{
+    const size_t window = 1U << window_bits;
+    const size_t max_len = 1U << lookahead_bits;
+    bit_writer_t w = { .data = out + ESP_OTA_COMPRESSED_HEADER_SIZE };
+    memset(out, 0, ESP_OTA_COMPRESSED_HEADER_SIZE + size * 9 / 8 + 1);
+
+    size_t pos = 0;
+    while (pos < size) {
+        size_t best_len = 0;
+        size_t best_off = 0;
+        for (size_t off = 1; off <= window && off <= pos; off++) {
+            size_t len = 0;
+            while (len < max_len && pos + len < size && in[pos + len - off] == in[pos + len]) {
+                len++;
+            }
+            if (len > best_len) {
+                best_len = len;
+                best_off = off;
+            }
+        }
+        if (best_len * 9 > 1U + window_bits + lookahead_bits) {
+            put_bits(&w, 0, 1);
+            put_bits(&w, best_off - 1, window_bits);
+            put_bits(&w, best_len - 1, lookahead_bits);
+            pos += best_len;
+        } else {
+            put_bits(&w, 1, 1);
+            put_bits(&w, in[pos], 8);
+            pos++;
+        }
+    }
+
+    const size_t stream_size = (w.bits + 7) / 8;
+    esp_ota_compressed_header_t header = {
+        .magic = ESP_OTA_COMPRESSED_MAGIC,
+        .version = ESP_OTA_COMPRESSED_VERSION,
+        .window_bits = window_bits,
+        .lookahead_bits = lookahead_bits,
+        .image_size = size,
+        .compressed_size = stream_size,
+    };
+    memcpy(out, &header, sizeof(header));
+    return sizeof(header) + stream_size;
+}
+
+/* Feed data in randomly sized fragments, including empty ones and ones splitting the header */
+static esp_err_t feed_fragmented(esp_ota_decompress_handle_t handle, const uint8_t *data, size_t size, size_t max_fragment)
+{
+    size_t pos = 0;
+    while (pos < size) {
+        size_t len = rand() % (max_fragment + 1);
+        if (len > size - pos) {
+            len = size - pos;
+        }
+        esp_err_t err = esp_ota_decompress_feed(handle, data + pos, len);
+        if (err != ESP_OK) {
+            return err;
+        }
+        pos += len;
+    }
+    return ESP_OK;
+}
+
+TEST_GROUP(ota_decompress);
+
+TEST_SETUP(ota_decompress)
+{
+    srand(0x5eed);
+}
+
+TEST_TEAR_DOWN(ota_decompress)
+{
+}
+
+TEST(ota_decompress, test_python_vector)
+{
+    uint8_t expected[512];
+    uint8_t out[512];
+    size_t expected_len = make_vector_source(expected);
+    sink_buf_t buf = { .data = out, .capacity = sizeof(out) };
+    esp_ota_decompress_handle_t handle;
+
+    TEST_ASSERT_TRUE(esp_ota_is_compressed_image(s_python_vector, sizeof(s_python_vector)));
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ASSERT_EQUAL(0, esp_ota_decompress_get_image_size(handle));
+    TEST_ESP_OK(esp_ota_decompress_feed(handle, s_python_vector, sizeof(s_python_vector)));
+    TEST_ASSERT_TRUE(esp_ota_decompress_is_complete(handle));
+    TEST_ASSERT_EQUAL(expected_len, esp_ota_decompress_get_image_size(handle));
+    TEST_ASSERT_EQUAL(expected_len, buf.size);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, expected_len);
+    esp_ota_decompress_delete(handle);
+}
+
+TEST(ota_decompress, test_random_fragments)
+{
+    uint8_t *image = malloc(TEST_IMAGE_SIZE);
+    uint8_t *compressed = malloc(ESP_OTA_COMPRESSED_HEADER_SIZE + TEST_IMAGE_SIZE * 9 / 8 + 1);
+    uint8_t *out = malloc(TEST_IMAGE_SIZE);
+    TEST_ASSERT_NOT_NULL(image);
+    TEST_ASSERT_NOT_NULL(compressed);
+    TEST_ASSERT_NOT_NULL(out);
+
+    for (int i = 0; i < TEST_ITERATIONS; i++) {
+        const uint8_t window_bits = 8 + i % 5;
+        const uint8_t lookahead_bits = 3 + i % 4;
+        const size_t image_size = 1 + rand() % TEST_IMAGE_SIZE;
+        const size_t max_fragment = (i % 2) ? 1 + rand() % 8 : 1 + rand() % 4096;
+
+        make_image(image, image_size);
+        size_t compressed_size = compress_image(image, image_size, window_bits, lookahead_bits, compressed);
+        TEST_ASSERT_TRUE(esp_ota_is_compressed_image(compressed, 1));
+
+        sink_buf_t buf = { .data = out, .capacity = TEST_IMAGE_SIZE };
+        esp_ota_decompress_handle_t handle;
+        TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+        TEST_ESP_OK(feed_fragmented(handle, compressed, compressed_size, max_fragment));
+        TEST_ASSERT_TRUE(esp_ota_decompress_is_complete(handle));
+        TEST_ASSERT_EQUAL(image_size, buf.size);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(image, out, image_size);
+        /* Window doubles as output buffer, data must never be handed over in larger chunks */
+        TEST_ASSERT_LESS_OR_EQUAL(1U << window_bits, buf.max_chunk);
+        esp_ota_decompress_delete(handle);
+    }
+
+    free(out);
+    free(compressed);
+    free(image);
+}
+
+TEST(ota_decompress, test_truncated_stream)
+{
+    uint8_t out[512];
+    sink_buf_t buf = { .data = out, .capacity = sizeof(out) };
+    esp_ota_decompress_handle_t handle;
+
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ESP_OK(esp_ota_decompress_feed(handle, s_python_vector, sizeof(s_python_vector) - 1));
+    TEST_ASSERT_FALSE(esp_ota_decompress_is_complete(handle));
+    esp_ota_decompress_delete(handle);
+}
+
+TEST(ota_decompress, test_trailing_data)
+{
+    uint8_t out[512];
+    uint8_t stream[sizeof(s_python_vector) + 1];
+    sink_buf_t buf = { .data = out, .capacity = sizeof(out) };
+    esp_ota_decompress_handle_t handle;
+
+    memcpy(stream, s_python_vector, sizeof(s_python_vector));
+    stream[sizeof(s_python_vector)] = 0;
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_ota_decompress_feed(handle, stream, sizeof(stream)));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_ota_decompress_feed(handle, stream, 1));
+    esp_ota_decompress_delete(handle);
+}
+
+TEST(ota_decompress, test_invalid_header)
+{
+    uint8_t out[16];
+    sink_buf_t buf = { .data = out, .capacity = sizeof(out) };
+    esp_ota_decompress_handle_t handle;
+    const uint8_t app_image_start[] = { 0xE9, 0x03, 0x02, 0x20 };
+
+    TEST_ASSERT_FALSE(esp_ota_is_compressed_image(app_image_start, sizeof(app_image_start)));
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_ota_decompress_feed(handle, app_image_start, sizeof(app_image_start)));
+    esp_ota_decompress_delete(handle);
+
+    esp_ota_compressed_header_t header = {
+        .magic = ESP_OTA_COMPRESSED_MAGIC,
+        .version = ESP_OTA_COMPRESSED_VERSION,
+        .window_bits = ESP_OTA_COMPRESSED_MAX_WINDOW_BITS + 1,
+        .lookahead_bits = 4,
+        .image_size = 100,
+    };
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, esp_ota_decompress_feed(handle, &header, sizeof(header)));
+    esp_ota_decompress_delete(handle);
+
+    header.window_bits = 8;
+    header.version = ESP_OTA_COMPRESSED_VERSION + 1;
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, esp_ota_decompress_feed(handle, &header, sizeof(header)));
+    esp_ota_decompress_delete(handle);
+}
+
+TEST(ota_decompress, test_sink_error)
+{
+    uint8_t out[512];
+    sink_buf_t buf = { .data = out, .capacity = sizeof(out), .fail_with = ESP_ERR_NO_MEM };
+    esp_ota_decompress_handle_t handle;
+
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, esp_ota_decompress_feed(handle, s_python_vector, sizeof(s_python_vector)));
+    TEST_ASSERT_FALSE(esp_ota_decompress_is_complete(handle));
+    esp_ota_decompress_delete(handle);
+
+    /* A sink error is returned as is, even if the decoder uses the same code for invalid streams */
+    buf.fail_with = ESP_ERR_INVALID_SIZE;
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_ota_decompress_feed(handle, s_python_vector, sizeof(s_python_vector)));
+    esp_ota_decompress_delete(handle);
+}
+
+TEST(ota_decompress, test_peek)
+{
+    uint8_t expected[512];
+    uint8_t out[100];
+    size_t out_len;
+    make_vector_source(expected);
+
+    TEST_ESP_OK(esp_ota_decompress_peek(s_python_vector, sizeof(s_python_vector), out, sizeof(out), &out_len));
+    TEST_ASSERT_EQUAL(sizeof(out), out_len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, sizeof(out));
+
+    /* Input exhausted before the buffer is full */
+    TEST_ESP_OK(esp_ota_decompress_peek(s_python_vector, ESP_OTA_COMPRESSED_HEADER_SIZE + 9, out, sizeof(out), &out_len));
+    TEST_ASSERT_EQUAL(8, out_len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, out_len);
+}
+
+TEST(ota_decompress, test_flush)
+{
+    uint8_t expected[512];
+    uint8_t out[512];
+    sink_buf_t buf = { .data = out, .capacity = sizeof(out) };
+    esp_ota_decompress_handle_t handle;
+    const size_t source_size = make_vector_source(expected);
+
+    TEST_ESP_OK(esp_ota_decompress_new(buf_sink, &buf, &handle));
+    TEST_ESP_OK(esp_ota_decompress_flush(handle));
+    TEST_ASSERT_EQUAL(0, buf.size);
+
+    /* Flushing after each piece of input, as done while the image headers are downloaded,
+       hands over everything decoded so far, in order and across window wrap-arounds */
+    size_t prev_size = 0;
+    for (size_t pos = 0; pos < sizeof(s_python_vector); pos += 7) {
+        const size_t len = sizeof(s_python_vector) - pos < 7 ? sizeof(s_python_vector) - pos : 7;
+        TEST_ESP_OK(esp_ota_decompress_feed(handle, s_python_vector + pos, len));
+        TEST_ESP_OK(esp_ota_decompress_flush(handle));
+        TEST_ASSERT_GREATER_OR_EQUAL(prev_size, buf.size);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, buf.size);
+        prev_size = buf.size;
+    }
+    TEST_ASSERT_TRUE(esp_ota_decompress_is_complete(handle));
+    TEST_ASSERT_EQUAL(source_size, buf.size);
+    esp_ota_decompress_delete(handle);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_ota_decompress_flush(NULL));
+}
+
+TEST_GROUP_RUNNER(ota_decompress)
+{
+    RUN_TEST_CASE(ota_decompress, test_python_vector);
+    RUN_TEST_CASE(ota_decompress, test_random_fragments);
+    RUN_TEST_CASE(ota_decompress, test_truncated_stream);
+    RUN_TEST_CASE(ota_decompress, test_trailing_data);
+    RUN_TEST_CASE(ota_decompress, test_invalid_header);
+    RUN_TEST_CASE(ota_decompress, test_sink_error);
+    RUN_TEST_CASE(ota_decompress, test_peek);
+    RUN_TEST_CASE(ota_decompress, test_flush);
+}
+
+static void run_all_tests(void)
+{
+    RUN_TEST_GROUP(ota_decompress);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_MAIN_FUNC(run_all_tests);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Compressed OTA image container
+ *
+ * A compressed image consists of a fixed size header followed by an LZSS bit stream
+ * (heatshrink compatible encoding: a set tag bit is followed by an 8-bit literal,
+ * a cleared tag bit by a `window_bits` wide back-reference offset minus one and a
+ * `lookahead_bits` wide length minus one). All multi-byte header fields are little-endian.
+ *
+ * Such images are generated by the build system (see CONFIG_APP_UPDATE_GENERATE_COMPRESSED_IMAGE)
+ * or by running components/app_update/otacompress.py on an app binary.
+ */
+
+#define ESP_OTA_COMPRESSED_MAGIC            0x5A41544FU  /*!< "OTAZ" in little-endian byte order */
+#define ESP_OTA_COMPRESSED_VERSION          1            /*!< Container format version */
+#define ESP_OTA_COMPRESSED_HEADER_SIZE      16           /*!< Size of esp_ota_compressed_header_t */
+#define ESP_OTA_COMPRESSED_MIN_WINDOW_BITS  4            /*!< Smallest supported window, 2^4 bytes */
+#define ESP_OTA_COMPRESSED_MAX_WINDOW_BITS  15           /*!< Largest window the format can describe, 2^15 bytes */
+
+/**
+ * @brief Header of a compressed OTA image
+ */
+typedef struct {
+    uint32_t magic;             /*!< ESP_OTA_COMPRESSED_MAGIC */
+    uint8_t version;            /*!< ESP_OTA_COMPRESSED_VERSION */
+    uint8_t window_bits;        /*!< Base-2 logarithm of the back-reference window size */
+    uint8_t lookahead_bits;     /*!< Number of bits used to encode a back-reference length */
+    uint8_t reserved;           /*!< Reserved, must be 0 */
+    uint32_t image_size;        /*!< Size of the decompressed app image in bytes */
+    uint32_t compressed_size;   /*!< Size of the compressed bit stream following the header, in bytes */
+} __attribute__((packed)) esp_ota_compressed_header_t;
+
+_Static_assert(sizeof(esp_ota_compressed_header_t) == ESP_OTA_COMPRESSED_HEADER_SIZE, "Compressed OTA header must be 16 bytes");
+
+/**
+ * @brief Callback which receives decompressed image data
+ *
+ * Data is delivered in order, in chunks of at most the decoder window size.
+ *
+ * @param data  Decompressed data
+ * @param size  Size of data in bytes
+ * @param arg   User argument passed to esp_ota_decompress_new()
+ *
+ * @return ESP_OK to continue decompression, any other value aborts it and is returned from esp_ota_decompress_feed()
+ */
+typedef esp_err_t (*esp_ota_decompress_sink_t)(const void *data, size_t size, void *arg);
+
+/**
+ * @brief Opaque handle of a streaming decompressor
+ */
+typedef struct esp_ota_decompress *esp_ota_decompress_handle_t;
+
+/**
+ * @brief Check whether the given data looks like the start of a compressed OTA image
+ *
+ * Only the available bytes are compared against the container magic, so this can be called
+ * with the first chunk of a download even if it is shorter than the magic word.
+ *
+ * @param data  First bytes of the image
+ * @param size  Number of bytes available at data
+ *
+ * @return true if the data starts with (a prefix of) the compressed image magic
+ */
+bool esp_ota_is_compressed_image(const void *data, size_t size);
+
+/**
+ * @brief Create a streaming decompressor
+ *
+ * The back-reference window is allocated once the container header has been received, its
+ * size is taken from the header and limited by CONFIG_APP_UPDATE_COMPRESSED_IMAGE_MAX_WINDOW_BITS.
+ * The window doubles as output buffer, so no other buffers are allocated.
+ *
+ * @param sink      Callback receiving decompressed data
+ * @param sink_arg  User argument passed to the callback
+ * @param[out] out_handle  Created decompressor
+ *
+ * @return
+ *    - ESP_OK: Decompressor created
+ *    - ESP_ERR_INVALID_ARG: sink or out_handle is NULL
+ *    - ESP_ERR_NO_MEM: Out of memory
+ */
+esp_err_t esp_ota_decompress_new(esp_ota_decompress_sink_t sink, void *sink_arg, esp_ota_decompress_handle_t *out_handle);
+
+/**
+ * @brief Feed compressed data to the decompressor
+ *
+ * Data may be split at arbitrary byte boundaries, including inside the container header.
+ * Decompressed data is passed to the sink whenever the window fills up and once the whole
+ * image has been decoded.
+ *
+ * @param handle  Decompressor handle
+ * @param data    Compressed data
+ * @param size    Size of data in bytes
+ *
+ * @return
+ *    - ESP_OK: Data consumed
+ *    - ESP_ERR_INVALID_ARG: handle is NULL, or the header magic doesn't match
+ *    - ESP_ERR_NOT_SUPPORTED: Unsupported container version or window parameters
+ *    - ESP_ERR_NO_MEM: Window could not be allocated
+ *    - ESP_ERR_INVALID_SIZE: Stream decodes to more data than the header announces, or data was fed after the end of the stream
+ *    - ESP_ERR_INVALID_STATE: A previous call has failed, the decompressor can only be deleted
+ *    - Any error returned by the sink
+ */
+esp_err_t esp_ota_decompress_feed(esp_ota_decompress_handle_t handle, const void *data, size_t size);
+
+/**
+ * @brief Pass the data decompressed so far to the sink
+ *
+ * Normally decompressed data is only passed to the sink when the window fills up. This hands
+ * over the rest, e.g. to inspect the image headers while the image is still being received.
+ * Decompression can continue afterwards.
+ *
+ * @param handle  Decompressor handle
+ *
+ * @return
+ *    - ESP_OK: All data decompressed so far has been passed to the sink
+ *    - ESP_ERR_INVALID_ARG: handle is NULL
+ *    - ESP_ERR_INVALID_STATE: A previous call has failed, the decompressor can only be deleted
+ *    - Any error returned by the sink
+ */
+esp_err_t esp_ota_decompress_flush(esp_ota_decompress_handle_t handle);
+
+/**
+ * @brief Check whether the whole image has been decompressed and passed to the sink
+ *
+ * @param handle  Decompressor handle
+ *
+ * @return true if decompression has completed
+ */
+bool esp_ota_decompress_is_complete(esp_ota_decompress_handle_t handle);
+
+/**
+ * @brief Get the decompressed image size announced by the container header
+ *
+ * @param handle  Decompressor handle
+ *
+ * @return Image size in bytes, or 0 if the header has not been received yet
+ */
+size_t esp_ota_decompress_get_image_size(esp_ota_decompress_handle_t handle);
+
+/**
+ * @brief Decompress the beginning of a compressed image into a buffer
+ *
+ * This is a convenience function for inspecting image headers (e.g. the app description)
+ * before the image is written. Decompression stops once the output buffer is full or the
+ * input is exhausted.
+ *
+ * @param data      Compressed data, starting with the container header
+ * @param size      Size of data in bytes
+ * @param out       Output buffer
+ * @param out_size  Size of the output buffer
+ * @param[out] out_len  Number of bytes stored in out
+ *
+ * @return
+ *    - ESP_OK: out_len bytes have been decompressed
+ *    - Other errors as returned by esp_ota_decompress_new() or esp_ota_decompress_feed()
+ */
+esp_err_t esp_ota_decompress_peek(const void *data, size_t size, void *out, size_t out_size, size_t *out_len);
+
+/**
+ * @brief Delete the decompressor and free its window
+ *
+ * Data still held in the window is discarded.
+ *
+ * @param handle  Decompressor handle, may be NULL
+ */
+void esp_ota_decompress_delete(esp_ota_decompress_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+#
+# otacompress packs an app binary into the compressed OTA image container
+# understood by esp_ota_write() when CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT is enabled.
+#
+# SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+# SPDX-License-Identifier: Apache-2.0
+import argparse
+import struct
+import sys
+from typing import BinaryIO
+from typing import Dict
+from typing import List
+
+__version__ = '1.0'
+
+COMPRESSED_MAGIC = 0x5A41544F  # 'OTAZ'
+COMPRESSED_VERSION = 1
+HEADER_FORMAT = '<IBBBBII'
+MIN_WINDOW_BITS = 4
+MAX_WINDOW_BITS = 15
+
+# Number of earlier positions with the same 3-byte prefix examined per match search.
+# Bounds the encoder run time, costs a fraction of a percent of compression ratio.
+MAX_CHAIN = 128
+HASH_LEN = 3
+
+
+class BitWriter(object):
+    def __init__(self) -> None:
+        self.data = bytearray()
+        self.acc = 0
+        self.bits = 0
+
+    def put(self, value: int, count: int) -> None:
+        self.acc = (self.acc << count) | (value & ((1 << count) - 1))
+        self.bits += count
+        while self.bits >= 8:
+            self.bits -= 8
+            self.data.append((self.acc >> self.bits) & 0xFF)
+        self.acc &= (1 << self.bits) - 1
+
+    def finish(self) -> bytes:
+        if self.bits:
+            # Pad with zero bits, the decoder stops once the announced image size is reached
+            self.data.append((self.acc << (8 - self.bits)) & 0xFF)
+            self.acc = 0
+            self.bits = 0
+        return bytes(self.data)
+
+
+def compress(data: bytes, window_bits: int, lookahead_bits: int) -> bytes:
+    """
+    Return the LZSS (heatshrink compatible) bit stream for data, without container header.
+    """
+    window = 1 << window_bits
+    max_len = 1 << lookahead_bits
+    # A back-reference costs 1 + W + L bits, a literal 9 bits
+    min_len = (1 + window_bits + lookahead_bits) // 9 + 1
+    out = BitWriter()
+    chains = {}  # type: Dict[bytes, List[int]]
+    pos = 0
+    size = len(data)
+
+    def insert(p: int) -> None:
+        if p + HASH_LEN <= size:
+            chain = chains.setdefault(data[p:p + HASH_LEN], [])
+            chain.append(p)
+            if len(chain) > 2 * MAX_CHAIN:
+                del chain[:MAX_CHAIN]
+
+    while pos < size:
+        best_len = 0
+        best_off = 0
+        limit = min(max_len, size - pos)
+        if limit >= HASH_LEN:
+            for cand in reversed(chains.get(data[pos:pos + HASH_LEN], [])[-MAX_CHAIN:]):
+                off = pos - cand
+                if off > window:
+                    break
+                length = HASH_LEN
+                while length < limit and data[cand + length] == data[pos + length]:
+                    length += 1
+                if length > best_len:
+                    best_len = length
+                    best_off = off
+                    if length == limit:
+                        break
+        if best_len >= min_len:
+            out.put(0, 1)
+            out.put(best_off - 1, window_bits)
+            out.put(best_len - 1, lookahead_bits)
+        else:
+            best_len = 1
+            out.put(1, 1)
+            out.put(data[pos], 8)
+        for p in range(pos, pos + best_len):
+            insert(p)
+        pos += best_len
+    return out.finish()
+
+
+def pack(image: bytes, window_bits: int, lookahead_bits: int) -> bytes:
+    if not MIN_WINDOW_BITS <= window_bits <= MAX_WINDOW_BITS:
+        raise ValueError('window bits must be in range {}..{}'.format(MIN_WINDOW_BITS, MAX_WINDOW_BITS))
+    if not 3 <= lookahead_bits < window_bits:
+        raise ValueError('lookahead bits must be at least 3 and smaller than window bits')
+    stream = compress(image, window_bits, lookahead_bits)
+    header = struct.pack(HEADER_FORMAT, COMPRESSED_MAGIC, COMPRESSED_VERSION, window_bits, lookahead_bits, 0,
+                         len(image), len(stream))
+    return header + stream
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='ESP-IDF compressed OTA image generator v{}'.format(__version__))
+    parser.add_argument('--window-bits', '-w', help='base-2 logarithm of the back-reference window size',
+                        type=int, default=11)
+    parser.add_argument('--lookahead-bits', '-l', help='number of bits of the back-reference length field',
+                        type=int, default=4)
+    parser.add_argument('--quiet', '-q', help='suppress size report', action='store_true')
+    parser.add_argument('input', help='app binary to compress', type=argparse.FileType('rb'))
+    parser.add_argument('output', help='compressed OTA image', type=argparse.FileType('wb'))
+    args = parser.parse_args()
+
+    input_file = args.input  # type: BinaryIO
+    image = input_file.read()
+    try:
+        packed = pack(image, args.window_bits, args.lookahead_bits)
+    except ValueError as e:
+        print('Error: {}'.format(e), file=sys.stderr)
+        sys.exit(2)
+    args.output.write(packed)
+
+    if not args.quiet:
+        ratio = 100 * len(packed) // max(len(image), 1)
+        print('Compressed {} -> {} bytes ({}%), decoder window {} bytes'.format(
+            len(image), len(packed), ratio, 1 << args.window_bits))
+
+
+if __name__ == '__main__':
+    main()
@@ -13,6 +13,11 @@
 #include <errno.h>
 #include <sys/param.h>
 #include <inttypes.h>
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+#include <esp_ota_decompress.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
 
 ESP_EVENT_DEFINE_BASE(ESP_HTTPS_OTA_EVENT);
 
@@ -26,6 +31,9 @@ _Static_assert(DEFAULT_OTA_BUF_SIZE > (sizeof(esp_image_header_t) + sizeof(esp_i
 
 #define DEFAULT_REQUEST_SIZE (64 * 1024)
 
+/* Same as the default network timeout of esp_http_client */
+#define DEFAULT_HTTP_TIMEOUT_MS (5000)
+
 static const int DEFAULT_MAX_AUTH_RETRIES = 10;
 
 static const char *TAG = "esp_https_ota";
@@ -46,6 +54,7 @@ struct esp_https_ota_handle {
     int binary_file_len;
     int image_length;
     int max_http_request_size;
+    int timeout_ms;
     esp_https_ota_state state;
     bool bulk_flash_erase;
     bool partial_http_download;
@@ -181,6 +190,35 @@ static void _http_cleanup(esp_http_client_handle_t client)
     esp_http_client_cleanup(client);
 }
 
+/* With partial HTTP download, request the part of the image following the data received so far */
+static esp_err_t _http_request_next_range(esp_https_ota_t *handle)
+{
+    esp_http_client_close(handle->http_client);
+    char *header_val = NULL;
+    int header_size = 0;
+#if CONFIG_ESP_HTTPS_OTA_DECRYPT_CB
+    header_size = handle->enc_img_header_size;
+#endif
+    if ((handle->image_length - handle->binary_file_len) > handle->max_http_request_size) {
+        asprintf(&header_val, "bytes=%d-%d", handle->binary_file_len + header_size, (handle->binary_file_len + header_size + handle->max_http_request_size - 1));
+    } else {
+        asprintf(&header_val, "bytes=%d-", handle->binary_file_len + header_size);
+    }
+    if (header_val == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for HTTP header");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_http_client_set_header(handle->http_client, "Range", header_val);
+    free(header_val);
+    esp_err_t err = _http_connect(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to establish HTTP connection");
+        return ESP_FAIL;
+    }
+    ESP_LOGD(TAG, "Connection start");
+    return ESP_OK;
+}
+
 // Table to lookup ota event name
 static const char* ota_event_name_table[] = {
     "ESP_HTTPS_OTA_START",
@@ -284,6 +322,7 @@ esp_err_t esp_https_ota_begin(const esp_https_ota_config_t *ota_config, esp_http
 
     https_ota_handle->partial_http_download = ota_config->partial_http_download;
     https_ota_handle->max_http_request_size = (ota_config->max_http_request_size == 0) ? DEFAULT_REQUEST_SIZE : ota_config->max_http_request_size;
+    https_ota_handle->timeout_ms = (ota_config->http_config->timeout_ms == 0) ? DEFAULT_HTTP_TIMEOUT_MS : ota_config->http_config->timeout_ms;
     https_ota_handle->max_authorization_retries = ota_config->http_config->max_authorization_retries;
 
     if (https_ota_handle->max_authorization_retries == 0) {
@@ -439,6 +478,125 @@ static esp_err_t read_header(esp_https_ota_t *handle)
     return ESP_OK;
 }
 
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+#if CONFIG_ESP_HTTPS_OTA_DECRYPT_CB
+/* Image headers of a compressed image can only be inspected after decompressing the start of the stream */
+static esp_err_t peek_compressed_image_headers(const void *data, size_t data_len, void *out, size_t out_len, size_t *decompressed_len)
+{
+    esp_err_t err = esp_ota_decompress_peek(data, data_len, out, out_len, decompressed_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to decompress image headers (%s)", esp_err_to_name(err));
+    }
+    return err;
+}
+#endif
+
+typedef struct {
+    uint8_t *out;
+    size_t out_size;
+    size_t out_len;
+} img_headers_ctx_t;
+
+static esp_err_t img_headers_sink(const void *data, size_t size, void *arg)
+{
+    img_headers_ctx_t *ctx = (img_headers_ctx_t *)arg;
+    size_t copy_len = MIN(size, ctx->out_size - ctx->out_len);
+    memcpy(ctx->out + ctx->out_len, data, copy_len);
+    ctx->out_len += copy_len;
+    /* Stop decoding as soon as the headers are complete */
+    return (ctx->out_len == ctx->out_size) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+/*
+ * Decompress the image headers from the data in the upgrade buffer. A stream with a large window
+ * or poorly compressible headers may need more input than the image header read provides, so keep
+ * reading the image into the buffer until the headers are decoded or the image is received. Only
+ * the newly read data is fed to the decompressor. All the data read stays in the buffer to be
+ * written to the OTA partition.
+ */
+static esp_err_t read_compressed_image_headers(esp_https_ota_t *handle, void *out, size_t out_len)
+{
+    img_headers_ctx_t ctx = {
+        .out = out,
+        .out_size = out_len,
+    };
+    esp_ota_decompress_handle_t decompress;
+    esp_err_t err = esp_ota_decompress_new(img_headers_sink, &ctx, &decompress);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to decompress image headers (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    TickType_t last_data_time = xTaskGetTickCount();
+    int fed_len = 0;
+    while (true) {
+        if (fed_len < handle->binary_file_len) {
+            err = esp_ota_decompress_feed(decompress, handle->ota_upgrade_buf + fed_len, handle->binary_file_len - fed_len);
+            if (err == ESP_OK) {
+                err = esp_ota_decompress_flush(decompress);
+            }
+            fed_len = handle->binary_file_len;
+            if (ctx.out_len == ctx.out_size) {
+                err = ESP_OK;
+                break;
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to decompress image headers (%s)", esp_err_to_name(err));
+                break;
+            }
+        }
+        if (esp_http_client_is_complete_data_received(handle->http_client)) {
+            /* With partial HTTP download only the current request is complete */
+            if (!handle->partial_http_download || handle->binary_file_len >= handle->image_length) {
+                break;
+            }
+            err = _http_request_next_range(handle);
+            if (err != ESP_OK) {
+                break;
+            }
+        }
+        if ((size_t)handle->binary_file_len == handle->ota_upgrade_buf_size) {
+            char *buf = (char *)realloc(handle->ota_upgrade_buf, handle->ota_upgrade_buf_size + IMAGE_HEADER_SIZE);
+            if (buf == NULL) {
+                ESP_LOGE(TAG, "Couldn't allocate memory to upgrade data buffer");
+                err = ESP_ERR_NO_MEM;
+                break;
+            }
+            handle->ota_upgrade_buf = buf;
+            handle->ota_upgrade_buf_size += IMAGE_HEADER_SIZE;
+        }
+        int data_read = esp_http_client_read(handle->http_client,
+                                             handle->ota_upgrade_buf + handle->binary_file_len,
+                                             handle->ota_upgrade_buf_size - handle->binary_file_len);
+        if (data_read == -ESP_ERR_HTTP_EAGAIN) {
+            ESP_LOGD(TAG, "ESP_ERR_HTTP_EAGAIN invoked: Call timed out before data was ready");
+            if (xTaskGetTickCount() - last_data_time >= pdMS_TO_TICKS(handle->timeout_ms)) {
+                ESP_LOGE(TAG, "Timed out reading the image headers");
+                err = ESP_ERR_TIMEOUT;
+                break;
+            }
+            continue;
+        }
+        if (data_read <= 0) {
+            ESP_LOGE(TAG, "Connection closed, errno = %d", errno);
+            break;
+        }
+        handle->binary_file_len += data_read;
+        last_data_time = xTaskGetTickCount();
+    }
+    esp_ota_decompress_delete(decompress);
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (ctx.out_len != ctx.out_size) {
+        ESP_LOGE(TAG, "Image ended before its headers could be decompressed (%u of %u bytes)", (unsigned)ctx.out_len, (unsigned)ctx.out_size);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+#endif // CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+
 esp_err_t esp_https_ota_get_img_desc(esp_https_ota_handle_t https_ota_handle, esp_app_desc_t *new_app_info)
 {
     esp_https_ota_dispatch_event(ESP_HTTPS_OTA_GET_IMG_DESC, NULL, 0);
@@ -464,6 +622,19 @@ esp_err_t esp_https_ota_get_img_desc(esp_https_ota_handle_t https_ota_handle, es
 
     const int app_desc_offset = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t);
     esp_app_desc_t *app_info = (esp_app_desc_t *) &handle->ota_upgrade_buf[app_desc_offset];
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+    struct {
+        esp_image_header_t image_header;
+        esp_image_segment_header_t segment_header;
+        esp_app_desc_t app_desc;
+    } img_headers;
+    if (esp_ota_is_compressed_image(handle->ota_upgrade_buf, handle->binary_file_len)) {
+        if (read_compressed_image_headers(handle, &img_headers, sizeof(img_headers)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        app_info = &img_headers.app_desc;
+    }
+#endif
     if (app_info->magic_word != ESP_APP_DESC_MAGIC_WORD) {
         ESP_LOGE(TAG, "Incorrect app descriptor magic");
         return ESP_FAIL;
@@ -511,15 +682,18 @@ esp_err_t esp_https_ota_perform(esp_https_ota_handle_t https_ota_handle)
             /* In case `esp_https_ota_get_img_desc` was invoked first,
                then the image data read there should be written to OTA partition
                */
-            int binary_file_len = 0;
-            if (handle->binary_file_len) {
-                binary_file_len = handle->binary_file_len;
-            } else {
-                if (read_header(handle) != ESP_OK) {
-                    return ESP_FAIL;
-                }
-                binary_file_len = IMAGE_HEADER_SIZE;
+            if (handle->binary_file_len == 0 && read_header(handle) != ESP_OK) {
+                return ESP_FAIL;
+            }
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT && !CONFIG_ESP_HTTPS_OTA_DECRYPT_CB
+            /* Read as much of a compressed image as its header needs before the buffered data is written */
+            esp_image_header_t decompressed_header;
+            const bool compressed = esp_ota_is_compressed_image(handle->ota_upgrade_buf, handle->binary_file_len);
+            if (compressed && read_compressed_image_headers(handle, &decompressed_header, sizeof(decompressed_header)) != ESP_OK) {
+                return ESP_FAIL;
             }
+#endif
+            int binary_file_len = handle->binary_file_len;
             /*
             * Header length gets added to handle->binary_file_len in _ota_write
             * Clear handle->binary_file_len to avoid additional bytes in upgrade image size calculation
@@ -540,7 +714,23 @@ esp_err_t esp_https_ota_perform(esp_https_ota_handle_t https_ota_handle)
                 return ESP_FAIL;
             }
 #endif // CONFIG_ESP_HTTPS_OTA_DECRYPT_CB
-            err = esp_ota_verify_chip_id(data_buf);
+            const void *img_header = data_buf;
+#if CONFIG_APP_UPDATE_COMPRESSED_IMAGE_SUPPORT
+#if CONFIG_ESP_HTTPS_OTA_DECRYPT_CB
+            /* The decrypted image header is all there is, no more input can be read into it */
+            esp_image_header_t decompressed_header;
+            const bool compressed = esp_ota_is_compressed_image(data_buf, binary_file_len);
+            size_t decompressed_len = 0;
+            if (compressed && (peek_compressed_image_headers(data_buf, binary_file_len, &decompressed_header, sizeof(decompressed_header), &decompressed_len) != ESP_OK
+                               || decompressed_len != sizeof(decompressed_header))) {
+                return ESP_FAIL;
+            }
+#endif
+            if (compressed) {
+                img_header = &decompressed_header;
+            }
+#endif
+            err = esp_ota_verify_chip_id(img_header);
             if (err != ESP_OK) {
                 return err;
             }
@@ -594,29 +784,10 @@ esp_err_t esp_https_ota_perform(esp_https_ota_handle_t https_ota_handle)
     }
     if (handle->partial_http_download) {
         if (handle->state == ESP_HTTPS_OTA_IN_PROGRESS && handle->image_length > handle->binary_file_len) {
-            esp_http_client_close(handle->http_client);
-            char *header_val = NULL;
-            int header_size = 0;
-#if CONFIG_ESP_HTTPS_OTA_DECRYPT_CB
-            header_size = handle->enc_img_header_size;
-#endif
-            if ((handle->image_length - handle->binary_file_len) > handle->max_http_request_size) {
-                asprintf(&header_val, "bytes=%d-%d", handle->binary_file_len + header_size, (handle->binary_file_len + header_size + handle->max_http_request_size - 1));
-            } else {
-                asprintf(&header_val, "bytes=%d-", handle->binary_file_len + header_size);
-            }
-            if (header_val == NULL) {
-                ESP_LOGE(TAG, "Failed to allocate memory for HTTP header");
-                return ESP_ERR_NO_MEM;
-            }
-            esp_http_client_set_header(handle->http_client, "Range", header_val);
-            free(header_val);
-            err = _http_connect(handle);
+            err = _http_request_next_range(handle);
             if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to establish HTTP connection");
-                return ESP_FAIL;
+                return err;
             }
-            ESP_LOGD(TAG, "Connection start");
             return ESP_ERR_HTTPS_OTA_IN_PROGRESS;
         }
     }
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2021-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2021-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  *
@@ -8,6 +8,7 @@
 
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include "esp_err.h"
 #include "esp_partition.h"
@@ -722,6 +723,168 @@ TEST(partition_api, test_partition_power_off_emulation)
     free(test_data_ptr);
 }
 
+TEST(partition_api, test_partition_flash_model)
+{
+    const esp_partition_t *partition_data = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+    TEST_ASSERT_NOT_NULL(partition_data);
+
+    esp_partition_flash_model_t model;
+    esp_partition_get_flash_model(&model);
+    const size_t sector_erase_time = model.sector_erase_time;
+    const size_t page_write_time = model.write_times[6]; // 256 bytes
+
+    // 64kB blocks are erased at once if the erased range covers them completely
+    model.block_size = 0x10000;
+    model.block_erase_time = 2 * sector_erase_time;
+    model.page_size = 256;
+    TEST_ESP_OK(esp_partition_set_flash_model(&model));
+
+    esp_partition_clear_stats();
+    TEST_ESP_OK(esp_partition_erase_range(partition_data, 0, 0x10000 + 2 * ESP_PARTITION_EMULATED_SECTOR_SIZE));
+    TEST_ASSERT_EQUAL(16 + 2, esp_partition_get_erase_ops());
+    TEST_ASSERT_EQUAL(2 * sector_erase_time + 2 * sector_erase_time, esp_partition_get_total_time());
+
+    // unaligned write of one page size is split into two page programs
+    uint8_t buf[256];
+    memset(buf, 0xA5, sizeof(buf));
+    esp_partition_clear_stats();
+    TEST_ESP_OK(esp_partition_write(partition_data, 0, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL(page_write_time, esp_partition_get_total_time());
+    esp_partition_clear_stats();
+    TEST_ESP_OK(esp_partition_write(partition_data, sizeof(buf) + 128, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL(2 * model.write_times[5], esp_partition_get_total_time());
+
+    model.page_size = 100;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_partition_set_flash_model(&model));
+    model.page_size = 256;
+    model.block_size = ESP_PARTITION_EMULATED_SECTOR_SIZE / 2;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_partition_set_flash_model(&model));
+
+    // restore defaults
+    TEST_ESP_OK(esp_partition_set_flash_model(NULL));
+    esp_partition_get_flash_model(&model);
+    TEST_ASSERT_EQUAL(0, model.block_size);
+    TEST_ASSERT_EQUAL(0, model.page_size);
+    TEST_ASSERT_EQUAL(sector_erase_time, model.sector_erase_time);
+}
+
+#define CONCURRENT_ROUNDS 50
+#define CONCURRENT_CHUNK 1000
+
+typedef struct {
+    const esp_partition_t *partition;
+    bool failed;
+} concurrent_access_arg_t;
+
+static void *concurrent_access_thread(void *arg)
+{
+    concurrent_access_arg_t *access = (concurrent_access_arg_t *) arg;
+    const esp_partition_t *partition = access->partition;
+    uint8_t buf[CONCURRENT_CHUNK];
+    uint8_t check[CONCURRENT_CHUNK];
+
+    for (int round = 0; round < CONCURRENT_ROUNDS && !access->failed; round++) {
+        if (esp_partition_erase_range(partition, 0, partition->size) != ESP_OK) {
+            access->failed = true;
+        }
+        for (size_t off = 0; off + CONCURRENT_CHUNK <= partition->size && !access->failed; off += CONCURRENT_CHUNK) {
+            memset(buf, (uint8_t)(round + off + partition->address), CONCURRENT_CHUNK);
+            if (esp_partition_write(partition, off, buf, CONCURRENT_CHUNK) != ESP_OK) {
+                access->failed = true;
+            }
+        }
+        // no other thread changed the data
+        for (size_t off = 0; off + CONCURRENT_CHUNK <= partition->size && !access->failed; off += CONCURRENT_CHUNK) {
+            memset(buf, (uint8_t)(round + off + partition->address), CONCURRENT_CHUNK);
+            if (esp_partition_read(partition, off, check, CONCURRENT_CHUNK) != ESP_OK ||
+                    memcmp(buf, check, CONCURRENT_CHUNK) != 0) {
+                access->failed = true;
+            }
+        }
+    }
+    return NULL;
+}
+
+TEST(partition_api, test_partition_concurrent_access)
+{
+    const char *labels[] = {"storage", "storage2", "storage3"};
+    const size_t num_threads = sizeof(labels) / sizeof(labels[0]);
+    concurrent_access_arg_t args[num_threads];
+    pthread_t threads[num_threads];
+    size_t expected_write_ops = 0;
+
+    esp_partition_clear_stats();
+    for (size_t i = 0; i < num_threads; i++) {
+        args[i].partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, labels[i]);
+        TEST_ASSERT_NOT_NULL(args[i].partition);
+        args[i].failed = false;
+        expected_write_ops += CONCURRENT_ROUNDS * (args[i].partition->size / CONCURRENT_CHUNK);
+        TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, concurrent_access_thread, &args[i]));
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_join(threads[i], NULL));
+        TEST_ASSERT_FALSE(args[i].failed);
+    }
+
+    // statistics are consistent as well
+    TEST_ASSERT_EQUAL(expected_write_ops, esp_partition_get_write_ops());
+    TEST_ASSERT_EQUAL(expected_write_ops, esp_partition_get_read_ops());
+}
+
+static void *erase_thread(void *arg)
+{
+    const esp_partition_t *partition = (const esp_partition_t *) arg;
+    esp_partition_erase_range(partition, 0, partition->size);
+    return NULL;
+}
+
+// returns real time in us a read of another partition took while an erase was in progress
+static size_t read_latency_during_erase(bool program_suspend)
+{
+    const esp_partition_t *partition_erase = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage2");
+    const esp_partition_t *partition_read = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage3");
+    TEST_ASSERT_NOT_NULL(partition_erase);
+    TEST_ASSERT_NOT_NULL(partition_read);
+
+    // 10% of the real time, the erase of 16 sectors takes about 60 ms
+    esp_partition_flash_model_t model;
+    esp_partition_get_flash_model(&model);
+    model.delay_percent = 10;
+    model.program_suspend = program_suspend;
+    model.suspend_latency = 30;
+    TEST_ESP_OK(esp_partition_set_flash_model(&model));
+
+    pthread_t thread;
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, erase_thread, (void *) partition_erase));
+    usleep(5000);
+
+    uint8_t buf[16];
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    TEST_ESP_OK(esp_partition_read(partition_read, 0, buf, sizeof(buf)));
+    gettimeofday(&end, NULL);
+
+    TEST_ASSERT_EQUAL(0, pthread_join(thread, NULL));
+    TEST_ESP_OK(esp_partition_set_flash_model(NULL));
+
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+TEST(partition_api, test_partition_program_suspend)
+{
+    esp_partition_clear_stats();
+    size_t latency = read_latency_during_erase(false);
+    ESP_LOGI(TAG, "read latency during erase: %lu us, max wait: %lu us", latency, esp_partition_get_max_wait_time());
+    TEST_ASSERT_GREATER_THAN(20000, latency);
+    TEST_ASSERT_GREATER_THAN(20000, esp_partition_get_max_wait_time());
+
+    esp_partition_clear_stats();
+    latency = read_latency_during_erase(true);
+    ESP_LOGI(TAG, "read latency during erase with program suspend: %lu us", latency);
+    TEST_ASSERT_LESS_THAN(20000, latency);
+    TEST_ASSERT_EQUAL(0, esp_partition_get_max_wait_time());
+}
+
 TEST_GROUP_RUNNER(partition_api)
 {
     RUN_TEST_CASE(partition_api, test_partition_find_basic);
@@ -741,6 +904,9 @@ TEST_GROUP_RUNNER(partition_api)
     RUN_TEST_CASE(partition_api, test_partition_mmap_size_too_small);
     RUN_TEST_CASE(partition_api, test_partition_stats);
     RUN_TEST_CASE(partition_api, test_partition_power_off_emulation);
+    RUN_TEST_CASE(partition_api, test_partition_flash_model);
+    RUN_TEST_CASE(partition_api, test_partition_concurrent_access);
+    RUN_TEST_CASE(partition_api, test_partition_program_suspend);
 }
 
 static void run_all_tests(void)
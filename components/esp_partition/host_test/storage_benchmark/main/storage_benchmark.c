@@ -0,0 +1,875 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Runs the same storage workloads against NVS, SPIFFS, FATFS on top of wear levelling and a raw partition
+ * on the emulated flash of the linux target, and reports the flash cost of each combination as modeled by
+ * the partition statistics (CONFIG_ESP_PARTITION_ENABLE_STATS).
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/param.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "Mockqueue.h"
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_private/partition_linux.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+#include "spiffs_api.h"
+#include "ff.h"
+#include "diskio_impl.h"
+#include "diskio_wl.h"
+#include "wear_levelling.h"
+
+#include "unity.h"
+#include "unity_fixture.h"
+
+#define FLASH_SECTOR_SIZE       4096
+#define MAX_NAME_LEN            16
+#define SECTOR_ALIGN_UP(x)      (((x) + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1))
+#define SECTOR_ALIGN_DOWN(x)    ((x) & ~(FLASH_SECTOR_SIZE - 1))
+
+/* Workload parameters, identical for all backends */
+#define CHURN_OPS               400
+#define CHURN_FILES             16
+#define CHURN_MIN_SIZE          64
+#define CHURN_MAX_SIZE          1024
+#define LOG_RECORDS             1500
+#define LOG_RECORD_SIZE         32
+#define LOG_ROTATE_SIZE         4096
+#define OVERWRITE_FILE_SIZE     8192
+#define OVERWRITE_OPS           400
+#define OVERWRITE_CHUNK         64
+#define CONFIG_KEYS             32
+#define CONFIG_UPDATES          1000
+
+/**
+ * Operations a storage backend provides to the workloads.
+ *
+ * Files are identified by short names. set_config is optional, backends without a native key/value store
+ * keep configuration values at fixed offsets of a "config" file instead.
+ */
+typedef struct {
+    const char *name;
+    const char *partition_label;
+    void (*mount)(const esp_partition_t *partition);
+    void (*unmount)(void);
+    esp_err_t (*write_file)(const char *name, const void *data, size_t size);
+    esp_err_t (*append)(const char *name, const void *data, size_t size);
+    esp_err_t (*overwrite)(const char *name, size_t offset, const void *data, size_t size);
+    esp_err_t (*read)(const char *name, void *data, size_t size);
+    esp_err_t (*remove)(const char *name);
+    esp_err_t (*set_config)(unsigned key, uint32_t value);
+    esp_err_t (*get_config)(unsigned key, uint32_t *value);
+} storage_backend_t;
+
+typedef struct {
+    const char *name;
+    void (*run)(const storage_backend_t *backend);
+} storage_workload_t;
+
+/* Bytes written by the workload itself, for the write amplification */
+static size_t s_payload_bytes;
+/* Heap in use before mounting and the highest value seen while the workload ran */
+static size_t s_heap_base;
+static size_t s_heap_peak;
+
+static uint32_t s_rng_state;
+
+static uint32_t bench_rand(void)
+{
+    /* xorshift32, deterministic so that every backend sees the same sequence of operations */
+    s_rng_state ^= s_rng_state << 13;
+    s_rng_state ^= s_rng_state >> 17;
+    s_rng_state ^= s_rng_state << 5;
+    return s_rng_state;
+}
+
+static size_t heap_in_use(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#elif defined(__GLIBC__)
+    return (size_t) mallinfo().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static void update_heap_peak(void)
+{
+    size_t used = heap_in_use();
+    if (used > s_heap_peak) {
+        s_heap_peak = used;
+    }
+}
+
+static void fill_pattern(uint8_t *buf, size_t size, uint32_t seed)
+{
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = (uint8_t)(seed + i * 31);
+    }
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/* NVS: files are blobs, appends and partial overwrites rewrite the whole blob                       */
+/* ------------------------------------------------------------------------------------------------ */
+
+static nvs_handle_t s_nvs_handle;
+static const char *s_nvs_label;
+
+static void nvs_backend_mount(const esp_partition_t *partition)
+{
+    s_nvs_label = partition->label;
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_flash_init_partition(s_nvs_label));
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_open_from_partition(s_nvs_label, "bench", NVS_READWRITE, &s_nvs_handle));
+}
+
+static void nvs_backend_unmount(void)
+{
+    nvs_close(s_nvs_handle);
+    TEST_ASSERT_EQUAL(ESP_OK, nvs_flash_deinit_partition(s_nvs_label));
+}
+
+static esp_err_t nvs_backend_write_file(const char *name, const void *data, size_t size)
+{
+    esp_err_t err = nvs_set_blob(s_nvs_handle, name, data, size);
+    return err == ESP_OK ? nvs_commit(s_nvs_handle) : err;
+}
+
+static esp_err_t nvs_backend_load(const char *name, size_t min_size, uint8_t **data, size_t *size)
+{
+    *size = 0;
+    esp_err_t err = nvs_get_blob(s_nvs_handle, name, NULL, size);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+    *data = malloc(MAX(MAX(*size, min_size), 1));
+    if (*data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (*size > 0) {
+        err = nvs_get_blob(s_nvs_handle, name, *data, size);
+        if (err != ESP_OK) {
+            free(*data);
+        }
+    }
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+}
+
+static esp_err_t nvs_backend_append(const char *name, const void *data, size_t size)
+{
+    uint8_t *blob;
+    size_t blob_size;
+    esp_err_t err = nvs_backend_load(name, 0, &blob, &blob_size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint8_t *grown = realloc(blob, blob_size + size);
+    if (grown == NULL) {
+        free(blob);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(grown + blob_size, data, size);
+    update_heap_peak();
+    err = nvs_backend_write_file(name, grown, blob_size + size);
+    free(grown);
+    return err;
+}
+
+static esp_err_t nvs_backend_overwrite(const char *name, size_t offset, const void *data, size_t size)
+{
+    uint8_t *blob;
+    size_t blob_size;
+    esp_err_t err = nvs_backend_load(name, offset + size, &blob, &blob_size);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memcpy(blob + offset, data, size);
+    update_heap_peak();
+    err = nvs_backend_write_file(name, blob, MAX(blob_size, offset + size));
+    free(blob);
+    return err;
+}
+
+static esp_err_t nvs_backend_read(const char *name, void *data, size_t size)
+{
+    return nvs_get_blob(s_nvs_handle, name, data, &size);
+}
+
+static esp_err_t nvs_backend_remove(const char *name)
+{
+    esp_err_t err = nvs_erase_key(s_nvs_handle, name);
+    return err == ESP_OK ? nvs_commit(s_nvs_handle) : err;
+}
+
+static esp_err_t nvs_backend_set_config(unsigned key, uint32_t value)
+{
+    char name[MAX_NAME_LEN];
+    snprintf(name, sizeof(name), "cfg%u", key);
+    esp_err_t err = nvs_set_u32(s_nvs_handle, name, value);
+    return err == ESP_OK ? nvs_commit(s_nvs_handle) : err;
+}
+
+static esp_err_t nvs_backend_get_config(unsigned key, uint32_t *value)
+{
+    char name[MAX_NAME_LEN];
+    snprintf(name, sizeof(name), "cfg%u", key);
+    esp_err_t err = nvs_get_u32(s_nvs_handle, name, value);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        /* never updated by the workload */
+        *value = 0;
+        err = ESP_OK;
+    }
+    return err;
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/* SPIFFS                                                                                            */
+/* ------------------------------------------------------------------------------------------------ */
+
+#define SPIFFS_MAX_FILES 4
+
+static spiffs s_spiffs;
+
+static void spiffs_backend_mount(const esp_partition_t *partition)
+{
+    spiffs_config cfg = {};
+
+    esp_spiffs_t *user_data = (esp_spiffs_t *) calloc(1, sizeof(*user_data));
+    TEST_ASSERT_NOT_NULL(user_data);
+    user_data->partition = partition;
+    s_spiffs.user_data = user_data;
+
+    cfg.hal_erase_f = spiffs_api_erase;
+    cfg.hal_read_f = spiffs_api_read;
+    cfg.hal_write_f = spiffs_api_write;
+    cfg.log_block_size = FLASH_SECTOR_SIZE;
+    cfg.log_page_size = CONFIG_SPIFFS_PAGE_SIZE;
+    cfg.phys_addr = 0;
+    cfg.phys_erase_block = FLASH_SECTOR_SIZE;
+    cfg.phys_size = partition->size;
+
+    uint32_t work_sz = cfg.log_page_size * 2;
+    uint8_t *work = (uint8_t *) malloc(work_sz);
+    uint32_t fds_sz = SPIFFS_MAX_FILES * sizeof(spiffs_fd);
+    uint8_t *fds = (uint8_t *) malloc(fds_sz);
+#if CONFIG_SPIFFS_CACHE
+    uint32_t cache_sz = sizeof(spiffs_cache) + SPIFFS_MAX_FILES * (sizeof(spiffs_cache_page) + cfg.log_page_size);
+    uint8_t *cache = (uint8_t *) malloc(cache_sz);
+#else
+    uint32_t cache_sz = 0;
+    uint8_t *cache = NULL;
+#endif
+
+    // Special mounting procedure: mount, format, mount as per
+    // https://github.com/pellepl/spiffs/wiki/Using-spiffs
+    s32_t res = SPIFFS_mount(&s_spiffs, &cfg, work, fds, fds_sz, cache, cache_sz, spiffs_api_check);
+    if (res == SPIFFS_ERR_NOT_A_FS) {
+        TEST_ASSERT_TRUE(SPIFFS_format(&s_spiffs) >= SPIFFS_OK);
+        res = SPIFFS_mount(&s_spiffs, &cfg, work, fds, fds_sz, cache, cache_sz, spiffs_api_check);
+    }
+    TEST_ASSERT_TRUE(res >= SPIFFS_OK);
+}
+
+static void spiffs_backend_unmount(void)
+{
+    SPIFFS_unmount(&s_spiffs);
+
+    free(s_spiffs.work);
+    free(s_spiffs.user_data);
+    free(s_spiffs.fd_space);
+#if CONFIG_SPIFFS_CACHE
+    free(s_spiffs.cache);
+#endif
+    memset(&s_spiffs, 0, sizeof(s_spiffs));
+}
+
+static esp_err_t spiffs_backend_write_at(const char *name, spiffs_flags flags, long offset,
+                                         const void *data, size_t size)
+{
+    spiffs_file fd = SPIFFS_open(&s_spiffs, name, flags, 0);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    s32_t res = SPIFFS_OK;
+    if (offset > 0) {
+        res = SPIFFS_lseek(&s_spiffs, fd, offset, SPIFFS_SEEK_SET);
+    }
+    if (res >= SPIFFS_OK) {
+        res = SPIFFS_write(&s_spiffs, fd, (void *) data, size);
+    }
+    update_heap_peak();
+    s32_t close_res = SPIFFS_close(&s_spiffs, fd);
+    return (res == (s32_t) size && close_res >= SPIFFS_OK) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t spiffs_backend_write_file(const char *name, const void *data, size_t size)
+{
+    return spiffs_backend_write_at(name, SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_WRONLY, 0, data, size);
+}
+
+static esp_err_t spiffs_backend_append(const char *name, const void *data, size_t size)
+{
+    return spiffs_backend_write_at(name, SPIFFS_O_CREAT | SPIFFS_O_APPEND | SPIFFS_O_WRONLY, 0, data, size);
+}
+
+static esp_err_t spiffs_backend_overwrite(const char *name, size_t offset, const void *data, size_t size)
+{
+    return spiffs_backend_write_at(name, SPIFFS_O_RDWR, offset, data, size);
+}
+
+static esp_err_t spiffs_backend_read(const char *name, void *data, size_t size)
+{
+    spiffs_file fd = SPIFFS_open(&s_spiffs, name, SPIFFS_O_RDONLY, 0);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    s32_t res = SPIFFS_read(&s_spiffs, fd, data, size);
+    SPIFFS_close(&s_spiffs, fd);
+    return res == (s32_t) size ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t spiffs_backend_remove(const char *name)
+{
+    return SPIFFS_remove(&s_spiffs, name) >= SPIFFS_OK ? ESP_OK : ESP_FAIL;
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/* FATFS on top of wear levelling                                                                    */
+/* ------------------------------------------------------------------------------------------------ */
+
+static wl_handle_t s_wl_handle = WL_INVALID_HANDLE;
+static BYTE s_fat_pdrv;
+static FATFS *s_fatfs;
+
+static void fat_path(char *path, size_t path_size, const char *name)
+{
+    snprintf(path, path_size, "%u:/%s", s_fat_pdrv, name);
+}
+
+static void fat_backend_mount(const esp_partition_t *partition)
+{
+    char drv[4];
+    BYTE work[FF_MAX_SS];
+    const MKFS_PARM opt = {(BYTE)(FM_ANY | FM_SFD), 0, 0, 0, 0};
+
+    TEST_ASSERT_EQUAL(ESP_OK, wl_mount(partition, &s_wl_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, ff_diskio_get_drive(&s_fat_pdrv));
+    TEST_ASSERT_EQUAL(ESP_OK, ff_diskio_register_wl_partition(s_fat_pdrv, s_wl_handle));
+
+    snprintf(drv, sizeof(drv), "%u:", s_fat_pdrv);
+    TEST_ASSERT_EQUAL(FR_OK, f_mkfs(drv, &opt, work, sizeof(work)));
+    s_fatfs = calloc(1, sizeof(FATFS));
+    TEST_ASSERT_NOT_NULL(s_fatfs);
+    TEST_ASSERT_EQUAL(FR_OK, f_mount(s_fatfs, drv, 1));
+}
+
+static void fat_backend_unmount(void)
+{
+    char drv[4];
+    snprintf(drv, sizeof(drv), "%u:", s_fat_pdrv);
+    f_mount(NULL, drv, 0);
+    ff_diskio_unregister(s_fat_pdrv);
+    TEST_ASSERT_EQUAL(ESP_OK, wl_unmount(s_wl_handle));
+    s_wl_handle = WL_INVALID_HANDLE;
+    free(s_fatfs);
+    s_fatfs = NULL;
+}
+
+static esp_err_t fat_backend_write_at(const char *name, BYTE mode, FSIZE_t offset, const void *data, size_t size)
+{
+    char path[MAX_NAME_LEN + 4];
+    FIL file;
+    UINT bw = 0;
+
+    fat_path(path, sizeof(path), name);
+    FRESULT res = f_open(&file, path, mode);
+    if (res != FR_OK) {
+        return ESP_FAIL;
+    }
+    if (offset > 0) {
+        res = f_lseek(&file, offset);
+    }
+    if (res == FR_OK) {
+        res = f_write(&file, data, size, &bw);
+    }
+    update_heap_peak();
+    FRESULT close_res = f_close(&file);
+    return (res == FR_OK && close_res == FR_OK && bw == size) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t fat_backend_write_file(const char *name, const void *data, size_t size)
+{
+    return fat_backend_write_at(name, FA_CREATE_ALWAYS | FA_WRITE, 0, data, size);
+}
+
+static esp_err_t fat_backend_append(const char *name, const void *data, size_t size)
+{
+    return fat_backend_write_at(name, FA_OPEN_APPEND | FA_WRITE, 0, data, size);
+}
+
+static esp_err_t fat_backend_overwrite(const char *name, size_t offset, const void *data, size_t size)
+{
+    return fat_backend_write_at(name, FA_OPEN_EXISTING | FA_WRITE, offset, data, size);
+}
+
+static esp_err_t fat_backend_read(const char *name, void *data, size_t size)
+{
+    char path[MAX_NAME_LEN + 4];
+    FIL file;
+    UINT br = 0;
+
+    fat_path(path, sizeof(path), name);
+    if (f_open(&file, path, FA_READ) != FR_OK) {
+        return ESP_FAIL;
+    }
+    FRESULT res = f_read(&file, data, size, &br);
+    f_close(&file);
+    return (res == FR_OK && br == size) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t fat_backend_remove(const char *name)
+{
+    char path[MAX_NAME_LEN + 4];
+    fat_path(path, sizeof(path), name);
+    return f_unlink(path) == FR_OK ? ESP_OK : ESP_FAIL;
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/* Raw partition: every file owns a fixed extent of sectors, the directory is only kept in RAM.      */
+/* Appends erase sectors as they are reached, overwrites are sector read-modify-erase-write.         */
+/* This is the baseline of what an application writing the flash directly would typically do.       */
+/* ------------------------------------------------------------------------------------------------ */
+
+#define RAW_MAX_FILES       24
+#define RAW_EXTENT_SIZE     (4 * FLASH_SECTOR_SIZE)
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    bool used;
+    size_t size;        /* bytes written to the extent */
+    size_t erased;      /* the extent is erased from size up to this offset */
+} raw_file_t;
+
+static const esp_partition_t *s_raw_partition;
+static raw_file_t *s_raw_files;
+static uint8_t *s_raw_sector_buf;
+
+static void raw_backend_mount(const esp_partition_t *partition)
+{
+    TEST_ASSERT_TRUE(partition->size >= RAW_MAX_FILES * RAW_EXTENT_SIZE);
+    s_raw_partition = partition;
+    s_raw_files = calloc(RAW_MAX_FILES, sizeof(raw_file_t));
+    s_raw_sector_buf = malloc(FLASH_SECTOR_SIZE);
+    TEST_ASSERT_NOT_NULL(s_raw_files);
+    TEST_ASSERT_NOT_NULL(s_raw_sector_buf);
+}
+
+static void raw_backend_unmount(void)
+{
+    free(s_raw_files);
+    free(s_raw_sector_buf);
+    s_raw_files = NULL;
+    s_raw_sector_buf = NULL;
+}
+
+static raw_file_t *raw_find(const char *name, bool create)
+{
+    raw_file_t *unused = NULL;
+    for (int i = 0; i < RAW_MAX_FILES; i++) {
+        if (s_raw_files[i].used && strcmp(s_raw_files[i].name, name) == 0) {
+            return &s_raw_files[i];
+        }
+        if (!s_raw_files[i].used && unused == NULL) {
+            unused = &s_raw_files[i];
+        }
+    }
+    if (!create || unused == NULL) {
+        return NULL;
+    }
+    snprintf(unused->name, sizeof(unused->name), "%s", name);
+    unused->used = true;
+    unused->size = 0;
+    unused->erased = 0;
+    return unused;
+}
+
+static size_t raw_offset(const raw_file_t *file)
+{
+    return (size_t)(file - s_raw_files) * RAW_EXTENT_SIZE;
+}
+
+static esp_err_t raw_backend_append(const char *name, const void *data, size_t size)
+{
+    raw_file_t *file = raw_find(name, true);
+    if (file == NULL || file->size + size > RAW_EXTENT_SIZE) {
+        return ESP_ERR_NO_MEM;
+    }
+    size_t end = file->size + size;
+    if (end > file->erased) {
+        size_t erase_end = SECTOR_ALIGN_UP(end);
+        esp_err_t err = esp_partition_erase_range(s_raw_partition, raw_offset(file) + file->erased,
+                                                  erase_end - file->erased);
+        if (err != ESP_OK) {
+            return err;
+        }
+        file->erased = erase_end;
+    }
+    esp_err_t err = esp_partition_write(s_raw_partition, raw_offset(file) + file->size, data, size);
+    if (err == ESP_OK) {
+        file->size = end;
+    }
+    return err;
+}
+
+static esp_err_t raw_backend_write_file(const char *name, const void *data, size_t size)
+{
+    raw_file_t *file = raw_find(name, true);
+    if (file == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    /* the old contents are erased on the way */
+    file->size = 0;
+    file->erased = 0;
+    return raw_backend_append(name, data, size);
+}
+
+static esp_err_t raw_backend_overwrite(const char *name, size_t offset, const void *data, size_t size)
+{
+    raw_file_t *file = raw_find(name, false);
+    if (file == NULL || offset + size > file->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *src = data;
+    while (size > 0) {
+        size_t sector = SECTOR_ALIGN_DOWN(offset);
+        size_t in_sector = MIN(size, sector + FLASH_SECTOR_SIZE - offset);
+        size_t valid = MIN(file->size - sector, FLASH_SECTOR_SIZE);
+        size_t addr = raw_offset(file) + sector;
+
+        esp_err_t err = esp_partition_read(s_raw_partition, addr, s_raw_sector_buf, valid);
+        if (err == ESP_OK) {
+            memcpy(s_raw_sector_buf + offset - sector, src, in_sector);
+            err = esp_partition_erase_range(s_raw_partition, addr, FLASH_SECTOR_SIZE);
+        }
+        if (err == ESP_OK) {
+            err = esp_partition_write(s_raw_partition, addr, s_raw_sector_buf, valid);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        offset += in_sector;
+        src += in_sector;
+        size -= in_sector;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t raw_backend_read(const char *name, void *data, size_t size)
+{
+    raw_file_t *file = raw_find(name, false);
+    if (file == NULL || size > file->size) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return esp_partition_read(s_raw_partition, raw_offset(file), data, size);
+}
+
+static esp_err_t raw_backend_remove(const char *name)
+{
+    raw_file_t *file = raw_find(name, false);
+    if (file == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    /* sectors are erased lazily when the extent is written again */
+    file->used = false;
+    return ESP_OK;
+}
+
+static const storage_backend_t s_backends[] = {
+    {
+        .name = "nvs",
+        .partition_label = "bench_nvs",
+        .mount = nvs_backend_mount,
+        .unmount = nvs_backend_unmount,
+        .write_file = nvs_backend_write_file,
+        .append = nvs_backend_append,
+        .overwrite = nvs_backend_overwrite,
+        .read = nvs_backend_read,
+        .remove = nvs_backend_remove,
+        .set_config = nvs_backend_set_config,
+        .get_config = nvs_backend_get_config,
+    },
+    {
+        .name = "spiffs",
+        .partition_label = "bench_spiffs",
+        .mount = spiffs_backend_mount,
+        .unmount = spiffs_backend_unmount,
+        .write_file = spiffs_backend_write_file,
+        .append = spiffs_backend_append,
+        .overwrite = spiffs_backend_overwrite,
+        .read = spiffs_backend_read,
+        .remove = spiffs_backend_remove,
+    },
+    {
+        .name = "fatfs+wl",
+        .partition_label = "bench_fat",
+        .mount = fat_backend_mount,
+        .unmount = fat_backend_unmount,
+        .write_file = fat_backend_write_file,
+        .append = fat_backend_append,
+        .overwrite = fat_backend_overwrite,
+        .read = fat_backend_read,
+        .remove = fat_backend_remove,
+    },
+    {
+        .name = "raw",
+        .partition_label = "bench_raw",
+        .mount = raw_backend_mount,
+        .unmount = raw_backend_unmount,
+        .write_file = raw_backend_write_file,
+        .append = raw_backend_append,
+        .overwrite = raw_backend_overwrite,
+        .read = raw_backend_read,
+        .remove = raw_backend_remove,
+    },
+};
+
+/* ------------------------------------------------------------------------------------------------ */
+/* Workloads                                                                                         */
+/* ------------------------------------------------------------------------------------------------ */
+
+/* Many small files created, replaced and deleted, like a cache or a spool directory */
+static void workload_small_file_churn(const storage_backend_t *backend)
+{
+    static uint8_t buf[CHURN_MAX_SIZE];
+    static uint8_t check[CHURN_MAX_SIZE];
+    size_t sizes[CHURN_FILES] = { 0 };
+    uint32_t seeds[CHURN_FILES] = { 0 };
+    char name[MAX_NAME_LEN];
+
+    for (int i = 0; i < CHURN_OPS; i++) {
+        unsigned idx = bench_rand() % CHURN_FILES;
+        snprintf(name, sizeof(name), "f%u", idx);
+        if (sizes[idx] > 0 && bench_rand() % 4 == 0) {
+            TEST_ASSERT_EQUAL(ESP_OK, backend->remove(name));
+            sizes[idx] = 0;
+            continue;
+        }
+        sizes[idx] = CHURN_MIN_SIZE + bench_rand() % (CHURN_MAX_SIZE - CHURN_MIN_SIZE + 1);
+        seeds[idx] = bench_rand();
+        fill_pattern(buf, sizes[idx], seeds[idx]);
+        TEST_ASSERT_EQUAL(ESP_OK, backend->write_file(name, buf, sizes[idx]));
+        s_payload_bytes += sizes[idx];
+    }
+
+    for (unsigned idx = 0; idx < CHURN_FILES; idx++) {
+        if (sizes[idx] == 0) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "f%u", idx);
+        fill_pattern(buf, sizes[idx], seeds[idx]);
+        TEST_ASSERT_EQUAL(ESP_OK, backend->read(name, check, sizes[idx]));
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(buf, check, sizes[idx]);
+    }
+}
+
+/* Fixed-size records appended to a log which is deleted and started over when it gets too big */
+static void workload_append_log(const storage_backend_t *backend)
+{
+    static uint8_t check[LOG_ROTATE_SIZE];
+    uint8_t record[LOG_RECORD_SIZE];
+    size_t log_size = 0;
+    int first_record = 0;
+
+    for (int i = 0; i < LOG_RECORDS; i++) {
+        if (log_size + LOG_RECORD_SIZE > LOG_ROTATE_SIZE) {
+            TEST_ASSERT_EQUAL(ESP_OK, backend->remove("log"));
+            log_size = 0;
+            first_record = i;
+        }
+        fill_pattern(record, sizeof(record), i);
+        TEST_ASSERT_EQUAL(ESP_OK, backend->append("log", record, sizeof(record)));
+        log_size += sizeof(record);
+        s_payload_bytes += sizeof(record);
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, backend->read("log", check, log_size));
+    for (size_t off = 0; off < log_size; off += LOG_RECORD_SIZE) {
+        fill_pattern(record, sizeof(record), first_record + off / LOG_RECORD_SIZE);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(record, check + off, LOG_RECORD_SIZE);
+    }
+}
+
+/* Small chunks rewritten in place at random offsets of a file, like a database page or a state table */
+static void workload_random_overwrite(const storage_backend_t *backend)
+{
+    static uint8_t shadow[OVERWRITE_FILE_SIZE];
+    static uint8_t check[OVERWRITE_FILE_SIZE];
+
+    fill_pattern(shadow, sizeof(shadow), 0);
+    TEST_ASSERT_EQUAL(ESP_OK, backend->write_file("data", shadow, sizeof(shadow)));
+    s_payload_bytes += sizeof(shadow);
+
+    for (int i = 0; i < OVERWRITE_OPS; i++) {
+        size_t offset = (bench_rand() % (OVERWRITE_FILE_SIZE / OVERWRITE_CHUNK)) * OVERWRITE_CHUNK;
+        fill_pattern(shadow + offset, OVERWRITE_CHUNK, bench_rand());
+        TEST_ASSERT_EQUAL(ESP_OK, backend->overwrite("data", offset, shadow + offset, OVERWRITE_CHUNK));
+        s_payload_bytes += OVERWRITE_CHUNK;
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, backend->read("data", check, sizeof(check)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(shadow, check, sizeof(check));
+}
+
+/* Random updates of a set of 32-bit configuration values */
+static void workload_config_updates(const storage_backend_t *backend)
+{
+    uint32_t values[CONFIG_KEYS] = { 0 };
+
+    if (backend->set_config == NULL) {
+        TEST_ASSERT_EQUAL(ESP_OK, backend->write_file("config", values, sizeof(values)));
+    }
+
+    for (int i = 0; i < CONFIG_UPDATES; i++) {
+        unsigned key = bench_rand() % CONFIG_KEYS;
+        values[key] = bench_rand();
+        if (backend->set_config != NULL) {
+            TEST_ASSERT_EQUAL(ESP_OK, backend->set_config(key, values[key]));
+        } else {
+            TEST_ASSERT_EQUAL(ESP_OK, backend->overwrite("config", key * sizeof(uint32_t), &values[key],
+                                                         sizeof(uint32_t)));
+        }
+        s_payload_bytes += sizeof(uint32_t);
+    }
+
+    uint32_t check[CONFIG_KEYS] = { 0 };
+    if (backend->get_config != NULL) {
+        for (unsigned key = 0; key < CONFIG_KEYS; key++) {
+            TEST_ASSERT_EQUAL(ESP_OK, backend->get_config(key, &check[key]));
+        }
+    } else {
+        TEST_ASSERT_EQUAL(ESP_OK, backend->read("config", check, sizeof(check)));
+    }
+    TEST_ASSERT_EQUAL_HEX32_ARRAY(values, check, CONFIG_KEYS);
+}
+
+/* ------------------------------------------------------------------------------------------------ */
+/* Runner and report                                                                                 */
+/* ------------------------------------------------------------------------------------------------ */
+
+static void run_workload(const storage_workload_t *workload)
+{
+    printf("\n%s\n", workload->name);
+    printf("%-10s %10s %10s %9s %8s %9s %9s %9s %10s %10s\n", "backend", "flash_ms", "payload_B", "write_amp",
+           "erases", "erase_min", "erase_avg", "erase_max", "ram_B", "ram_peak_B");
+
+    for (size_t b = 0; b < sizeof(s_backends) / sizeof(s_backends[0]); b++) {
+        const storage_backend_t *backend = &s_backends[b];
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                    ESP_PARTITION_SUBTYPE_ANY,
+                                                                    backend->partition_label);
+        TEST_ASSERT_NOT_NULL(partition);
+
+        /* every run starts from blank flash, formatting is not part of the measurement */
+        TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(partition, 0, partition->size));
+        s_heap_base = heap_in_use();
+        backend->mount(partition);
+        const size_t heap_mounted = heap_in_use();
+        s_heap_peak = heap_mounted;
+
+        esp_partition_clear_stats();
+        s_payload_bytes = 0;
+        s_rng_state = 0x12345678;
+        workload->run(backend);
+
+        const size_t time_us = esp_partition_get_total_time();
+        const size_t write_bytes = esp_partition_get_write_bytes();
+        const size_t erase_ops = esp_partition_get_erase_ops();
+
+        /* per sector erase counts of the partition, the counts are reset by esp_partition_clear_stats */
+        const size_t first_sector = partition->address / FLASH_SECTOR_SIZE;
+        const size_t num_sectors = partition->size / FLASH_SECTOR_SIZE;
+        size_t erase_min = SIZE_MAX, erase_max = 0, erase_sum = 0;
+        for (size_t i = 0; i < num_sectors; i++) {
+            size_t count = esp_partition_get_sector_erase_count(first_sector + i);
+            erase_min = MIN(erase_min, count);
+            erase_max = MAX(erase_max, count);
+            erase_sum += count;
+        }
+
+        printf("%-10s %10.1f %10zu %9.2f %8zu %9zu %9.2f %9zu %10zu %10zu\n", backend->name,
+               time_us / 1000.0, s_payload_bytes, (double) write_bytes / s_payload_bytes, erase_ops,
+               erase_min, (double) erase_sum / num_sectors, erase_max,
+               heap_mounted - s_heap_base, s_heap_peak - s_heap_base);
+
+        backend->unmount();
+    }
+}
+
+TEST_GROUP(storage_benchmark);
+
+TEST_SETUP(storage_benchmark)
+{
+    // CMock init for spiffs xSemaphore* use
+    xQueueSemaphoreTake_IgnoreAndReturn(0);
+    xQueueGenericSend_IgnoreAndReturn(0);
+}
+
+TEST_TEAR_DOWN(storage_benchmark)
+{
+}
+
+TEST(storage_benchmark, small_file_churn)
+{
+    const storage_workload_t workload = { "small file churn", workload_small_file_churn };
+    run_workload(&workload);
+}
+
+TEST(storage_benchmark, append_log)
+{
+    const storage_workload_t workload = { "append-only log", workload_append_log };
+    run_workload(&workload);
+}
+
+TEST(storage_benchmark, random_overwrite)
+{
+    const storage_workload_t workload = { "random overwrite", workload_random_overwrite };
+    run_workload(&workload);
+}
+
+TEST(storage_benchmark, config_updates)
+{
+    const storage_workload_t workload = { "config key/value updates", workload_config_updates };
+    run_workload(&workload);
+}
+
+TEST_GROUP_RUNNER(storage_benchmark)
+{
+    RUN_TEST_CASE(storage_benchmark, small_file_churn);
+    RUN_TEST_CASE(storage_benchmark, append_log);
+    RUN_TEST_CASE(storage_benchmark, random_overwrite);
+    RUN_TEST_CASE(storage_benchmark, config_updates);
+}
+
+static void run_all_tests(void)
+{
+    RUN_TEST_GROUP(storage_benchmark);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_MAIN_FUNC(run_all_tests);
+    return 0;
+}
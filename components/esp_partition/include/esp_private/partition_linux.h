@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2021-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -32,6 +32,40 @@ extern "C" {
 #define ESP_PARTITION_FAIL_AFTER_MODE_WRITE 0x02
 #define ESP_PARTITION_FAIL_AFTER_MODE_BOTH 0x03
 
+/** @brief number of entries in the read and write timing tables of esp_partition_flash_model_t */
+#define ESP_PARTITION_TIMING_LUT_SIZE 11
+
+/**
+ * @brief Timing and behavior of the emulated SPI FLASH device
+ *
+ * Only used if CONFIG_ESP_PARTITION_ENABLE_STATS is enabled. The erase sector size is always
+ * ESP_PARTITION_EMULATED_SECTOR_SIZE, it is reported as erase_size of all partitions.
+ *
+ * The emulated device executes one operation at a time, also when several threads access different partitions.
+ * The contents of the flash change at the beginning of an operation, the modeled time of the operation elapses
+ * afterwards.
+ */
+typedef struct {
+    size_t read_times[ESP_PARTITION_TIMING_LUT_SIZE];   /*!< time of a read in us, for sizes of 4, 8, 16 ... 4096 bytes.
+                                                             Other sizes are interpolated, larger sizes extrapolated
+                                                             linearly from the last entry */
+    size_t write_times[ESP_PARTITION_TIMING_LUT_SIZE];  /*!< time of a program operation in us, same sizes as read_times */
+    size_t sector_erase_time;   /*!< time to erase one sector in us */
+    size_t block_size;          /*!< size of the large erase block in bytes, a power of two multiple of the sector size.
+                                     Aligned blocks within an erased range are erased as a whole. 0 if the device
+                                     only erases sectors */
+    size_t block_erase_time;    /*!< time to erase one large block in us */
+    size_t page_size;           /*!< program page size in bytes, a power of two up to the sector size. Writes are split
+                                     at page boundaries and each page is charged as a separate program operation.
+                                     0 charges each write as one operation */
+    bool program_suspend;       /*!< reads don't wait for a program or erase operation in progress, they suspend it
+                                     and are delayed by suspend_latency instead. Only has effect with delay_percent > 0 */
+    size_t suspend_latency;     /*!< time to suspend a program or erase operation in us */
+    uint32_t delay_percent;     /*!< the calling thread is delayed in real time by this percentage of the modeled time of
+                                     each operation and the device stays busy meanwhile. 0 disables real-time delays,
+                                     100 emulates the real duration of flash operations */
+} esp_partition_flash_model_t;
+
 /**
  * @brief Partition type to string conversion routine
  *
@@ -200,6 +234,38 @@ void esp_partition_fail_after(size_t count, uint8_t mode);
 */
 size_t esp_partition_get_sector_erase_count(size_t sector);
 
+/**
+ * @brief Returns the longest time an operation waited for the emulated flash device
+ *
+ * Operations only wait for each other if real-time delays are enabled in the flash model, see
+ * esp_partition_flash_model_t::delay_percent. Reads suspending a program or erase operation don't wait.
+ *
+ * @return
+ *      - longest real time in us any read, write or erase operation was blocked by another operation in progress,
+ *        since recent esp_partition_clear_stats
+ */
+size_t esp_partition_get_max_wait_time(void);
+
+/**
+ * @brief Returns the timing model of the emulated flash device
+ *
+ * @param[out] model Filled with the current model
+ */
+void esp_partition_get_flash_model(esp_partition_flash_model_t *model);
+
+/**
+ * @brief Changes the timing model of the emulated flash device
+ *
+ * The model can be changed at any time, operations in progress finish with the previous model.
+ *
+ * @param[in] model New model, NULL restores the default model (ESP8266 timing without real-time delays)
+ *
+ * @return
+ *      - ESP_OK: Model changed
+ *      - ESP_ERR_INVALID_ARG: block_size or page_size is not valid
+ */
+esp_err_t esp_partition_set_flash_model(const esp_partition_flash_model_t *model);
+
 typedef struct {
     char flash_file_name[PATH_MAX];      /*!< name of flash dump file, zero-terminated ASCII string */
     size_t flash_file_size;              /*!< size of flash dump file in bytes */
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2021-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2021-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -14,6 +14,9 @@
 #include <unistd.h>
 #include <limits.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/param.h>
 #include "sdkconfig.h"
 #include "esp_partition.h"
 #include "esp_flash_partitions.h"
@@ -27,6 +30,9 @@ static void *s_spiflash_mem_file_buf = NULL;
 static int s_spiflash_mem_file_fd = -1;
 static const esp_partition_mmap_handle_t s_default_partition_mmap_handle = 0;
 
+// serializes read/write/erase operations of all partitions, the emulated flash executes one operation at a time
+static pthread_mutex_t s_esp_partition_flash_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // input control structure, always contains what was specified by caller
 static esp_partition_file_mmap_ctrl_t s_esp_partition_file_mmap_ctrl_input = {0};
 // actual control structure, contains what is actually used by the esp_partition
@@ -43,10 +49,35 @@ static size_t s_esp_partition_stat_total_time = 0;
 static size_t s_esp_partition_emulated_power_off_counter = SIZE_MAX;
 static uint8_t s_esp_partition_emulated_power_off_mode = 0;
 
+static size_t s_esp_partition_stat_max_wait_time = 0;
+
 // tracking erase count individually for each emulated sector
 static size_t *s_esp_partition_stat_sector_erase_count = NULL;
 
-// forward declaration of hooks
+// timing data for ESP8266, 160MHz CPU frequency, 80MHz flash requency
+// all values in microseconds
+// values are for block sizes starting at 4 bytes and going up to 4096 bytes
+static const esp_partition_flash_model_t s_esp_partition_default_flash_model = {
+    .read_times = {7, 5, 6, 7, 11, 18, 32, 60, 118, 231, 459},
+    .write_times = {19, 23, 35, 57, 106, 205, 417, 814, 1622, 3200, 6367},
+    .sector_erase_time = 37142,
+};
+static esp_partition_flash_model_t s_esp_partition_flash_model = s_esp_partition_default_flash_model;
+
+// state of the emulated device, protected by s_esp_partition_flash_lock
+// a program or erase operation is in progress, only set while real-time delays are enabled
+static bool s_esp_partition_flash_busy = false;
+// a read operation occupies the bus, only set while real-time delays are enabled
+static bool s_esp_partition_flash_reading = false;
+static pthread_cond_t s_esp_partition_flash_idle = PTHREAD_COND_INITIALIZER;
+// the operation holding the lock suspended a program or erase operation in progress
+static bool s_esp_partition_flash_op_suspended = false;
+// total time when the operation holding the lock started
+static size_t s_esp_partition_flash_op_start_time = 0;
+
+// forward declaration of device access functions and hooks
+static void esp_partition_flash_acquire(bool is_read);
+static void esp_partition_flash_release(bool is_read);
 static void esp_partition_hook_read(const void *srcAddr, const size_t size);
 static bool esp_partition_hook_write(const void *dstAddr, size_t *size);
 static bool esp_partition_hook_erase(const void *dstAddr, size_t *size);
@@ -60,6 +91,17 @@ static bool esp_partition_hook_erase(const void *dstAddr, size_t *size);
 #define ESP_PARTITION_HOOK_READ(srcAddr, size)
 #define ESP_PARTITION_HOOK_WRITE(dstAddr, size) true
 #define ESP_PARTITION_HOOK_ERASE(dstAddr, size) true
+
+// no timing model, the device lock only keeps concurrent operations from interleaving
+static void esp_partition_flash_acquire(bool is_read __attribute__((unused)))
+{
+    pthread_mutex_lock(&s_esp_partition_flash_lock);
+}
+
+static void esp_partition_flash_release(bool is_read __attribute__((unused)))
+{
+    pthread_mutex_unlock(&s_esp_partition_flash_lock);
+}
 #endif
 
 const char *esp_partition_type_to_str(const uint32_t type)
@@ -387,6 +429,8 @@ esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offse
 
     esp_err_t ret = ESP_OK;
 
+    esp_partition_flash_acquire(false);
+
     // hook gathers statistics and can emulate power-off
     // in case of power - off it decreases new_size to the number of bytes written
     // before power event occured
@@ -407,6 +451,8 @@ esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offse
         ((uint8_t *)dst_addr)[x] &= ((uint8_t *)src)[x];
     }
 
+    esp_partition_flash_release(false);
+
     return ret;
 }
 
@@ -427,10 +473,14 @@ esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset
     void *src_addr = s_spiflash_mem_file_buf + partition->address + src_offset;
     ESP_LOGV(TAG, "esp_partition_read(): partition=%s src_offset=%" PRIu32 " dst=%p size=%" PRIu32 " (real src address: %p)", partition->label, (uint32_t) src_offset, dst, (uint32_t) size, src_addr);
 
+    esp_partition_flash_acquire(true);
+
     memcpy(dst, src_addr, size);
 
     ESP_PARTITION_HOOK_READ(src_addr, size); // statistics
 
+    esp_partition_flash_release(true);
+
     return ESP_OK;
 }
 
@@ -469,6 +519,8 @@ esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t off
     // hook gathers statistics and can emulate power-off
     esp_err_t ret = ESP_OK;
 
+    esp_partition_flash_acquire(false);
+
     if(!ESP_PARTITION_HOOK_ERASE(target_addr, &new_size)) {
         ret =  ESP_ERR_FLASH_OP_FAIL;
     }
@@ -476,6 +528,8 @@ esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t off
     //set all bits to 1 (NOR FLASH default)
     memset(target_addr, 0xFF, new_size);
 
+    esp_partition_flash_release(false);
+
     return ret;
 }
 
@@ -543,24 +597,116 @@ esp_partition_file_mmap_ctrl_t *esp_partition_get_file_mmap_ctrl_act(void)
 }
 
 #ifdef CONFIG_ESP_PARTITION_ENABLE_STATS
-// timing data for ESP8266, 160MHz CPU frequency, 80MHz flash requency
-// all values in microseconds
-// values are for block sizes starting at 4 bytes and going up to 4096 bytes
-static size_t s_esp_partition_stat_read_times[] = {7, 5, 6, 7, 11, 18, 32, 60, 118, 231, 459};
-static size_t s_esp_partition_stat_write_times[] = {19, 23, 35, 57, 106, 205, 417, 814, 1622, 3200, 6367};
-static size_t s_esp_partition_stat_block_erase_time = 37142;
+static uint64_t esp_partition_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void esp_partition_delay_us(size_t us)
+{
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    // the FreeRTOS port for Linux interrupts sleeping threads by signals, continue with the remaining time
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
 
-static size_t esp_partition_stat_time_interpolate(uint32_t bytes, size_t *lut)
+// Checks if the device can't start an operation yet, must be called with the lock held
+static bool esp_partition_flash_occupied(bool is_read)
 {
-    const int lut_size = sizeof(s_esp_partition_stat_read_times) / sizeof(s_esp_partition_stat_read_times[0]);
-    int lz = __builtin_clz(bytes / 4);
-    int log_size = 32 - lz;
-    size_t x2 = 1 << (log_size + 2);
-    size_t upper_index = (log_size < lut_size - 1) ? log_size : lut_size - 1;
-    size_t y2 = lut[upper_index];
-    size_t x1 = 1 << (log_size + 1);
-    size_t y1 = lut[log_size - 1];
-    return (bytes - x1) * (y2 - y1) / (x2 - x1) + y1;
+    const bool can_suspend = is_read && s_esp_partition_flash_model.program_suspend;
+    return s_esp_partition_flash_reading || (s_esp_partition_flash_busy && !can_suspend);
+}
+
+// Takes the emulated flash device for one operation
+// If real-time delays are enabled, waits until the read or the program or erase operation in progress finishes,
+// unless the caller is a read and the model allows to suspend the program or erase operation
+static void esp_partition_flash_acquire(bool is_read)
+{
+    pthread_mutex_lock(&s_esp_partition_flash_lock);
+
+    if (esp_partition_flash_occupied(is_read)) {
+        uint64_t start = esp_partition_time_us();
+        while (esp_partition_flash_occupied(is_read)) {
+            pthread_cond_wait(&s_esp_partition_flash_idle, &s_esp_partition_flash_lock);
+        }
+        s_esp_partition_stat_max_wait_time = MAX(s_esp_partition_stat_max_wait_time,
+                                                 (size_t)(esp_partition_time_us() - start));
+    }
+    s_esp_partition_flash_op_suspended = s_esp_partition_flash_busy;
+    s_esp_partition_flash_op_start_time = s_esp_partition_stat_total_time;
+}
+
+// Releases the emulated flash device after the hooks accounted the time of the operation
+// If real-time delays are enabled, the caller is delayed by the modeled time. The lock is not held while
+// sleeping, the FreeRTOS port for Linux would block every other task touching a partition meanwhile.
+// Reads occupy the bus until they finish. Program and erase operations keep the device busy, but reads
+// can suspend them.
+static void esp_partition_flash_release(bool is_read)
+{
+    if (s_esp_partition_flash_op_suspended) {
+        s_esp_partition_stat_total_time += s_esp_partition_flash_model.suspend_latency;
+    }
+
+    // stats can't be cleared meanwhile, esp_partition_clear_stats takes the lock too
+    size_t op_time = s_esp_partition_stat_total_time - s_esp_partition_flash_op_start_time;
+    size_t delay = (uint64_t) op_time * s_esp_partition_flash_model.delay_percent / 100;
+
+    if (delay == 0) {
+        pthread_mutex_unlock(&s_esp_partition_flash_lock);
+        return;
+    }
+
+    // until the modeled time has passed, a read occupies the bus and a program or erase operation the device
+    bool *state = is_read ? &s_esp_partition_flash_reading : &s_esp_partition_flash_busy;
+    *state = true;
+    pthread_mutex_unlock(&s_esp_partition_flash_lock);
+
+    esp_partition_delay_us(delay);
+
+    pthread_mutex_lock(&s_esp_partition_flash_lock);
+    *state = false;
+    pthread_cond_broadcast(&s_esp_partition_flash_idle);
+    pthread_mutex_unlock(&s_esp_partition_flash_lock);
+}
+
+static size_t esp_partition_stat_time_interpolate(size_t bytes, const size_t *lut)
+{
+    // lut[i] is the time for (4 << i) bytes
+    const size_t lut_last = ESP_PARTITION_TIMING_LUT_SIZE - 1;
+    const size_t lut_max_bytes = 4 << lut_last;
+
+    if (bytes <= 4) {
+        return lut[0];
+    }
+    if (bytes >= lut_max_bytes) {
+        return lut[lut_last] * bytes / lut_max_bytes;
+    }
+    int i = 31 - __builtin_clz((uint32_t) bytes / 4);
+    size_t x1 = 4 << i;
+    size_t x2 = 4 << (i + 1);
+    // the table is not monotonic for small sizes
+    return (size_t)((int64_t) lut[i] + ((int64_t) lut[i + 1] - (int64_t) lut[i]) * (int64_t)(bytes - x1) / (int64_t)(x2 - x1));
+}
+
+// Time to program size bytes at the flash address addr, page by page if the model has a page size
+static size_t esp_partition_stat_write_time(size_t addr, size_t size)
+{
+    const size_t page_size = s_esp_partition_flash_model.page_size;
+
+    if (page_size == 0) {
+        return esp_partition_stat_time_interpolate(size, s_esp_partition_flash_model.write_times);
+    }
+
+    size_t time = 0;
+    while (size > 0) {
+        size_t chunk = MIN(size, page_size - addr % page_size);
+        time += esp_partition_stat_time_interpolate(chunk, s_esp_partition_flash_model.write_times);
+        addr += chunk;
+        size -= chunk;
+    }
+    return time;
 }
 
 // Registers read access statistics of emulated SPI FLASH device (Linux host)
@@ -573,7 +719,7 @@ static void esp_partition_hook_read(const void *srcAddr, const size_t size)
     // stats
     ++s_esp_partition_stat_read_ops;
     s_esp_partition_stat_read_bytes += size;
-    s_esp_partition_stat_total_time += esp_partition_stat_time_interpolate((uint32_t) size, s_esp_partition_stat_read_times);
+    s_esp_partition_stat_total_time += esp_partition_stat_time_interpolate(size, s_esp_partition_flash_model.read_times);
 }
 
 // Registers write access statistics of emulated SPI FLASH device (Linux host)
@@ -616,7 +762,7 @@ static bool esp_partition_hook_write(const void *dstAddr, size_t *size)
         // stats
         ++s_esp_partition_stat_write_ops;
         s_esp_partition_stat_write_bytes += write_cycles * 4;
-        s_esp_partition_stat_total_time += esp_partition_stat_time_interpolate((uint32_t) (*size), s_esp_partition_stat_write_times);
+        s_esp_partition_stat_total_time += esp_partition_stat_write_time(dstAddr - s_spiflash_mem_file_buf, *size);
     }
 
     return ret_val;
@@ -666,10 +812,21 @@ static bool esp_partition_hook_erase(const void *dstAddr, size_t *size)
     }
 
     // update statistcs for all sectors until power down cycle
-    for (size_t sector_index = first_sector_idx; sector_index < first_sector_idx + sector_count; sector_index++) {
+    const size_t block_sectors = s_esp_partition_flash_model.block_size / ESP_PARTITION_EMULATED_SECTOR_SIZE;
+    const size_t end_sector_idx = first_sector_idx + sector_count;
+    for (size_t sector_index = first_sector_idx; sector_index < end_sector_idx; sector_index++) {
         ++s_esp_partition_stat_erase_ops;
         s_esp_partition_stat_sector_erase_count[sector_index]++;
-        s_esp_partition_stat_total_time += s_esp_partition_stat_block_erase_time;
+        if (block_sectors > 1 && sector_index % block_sectors == 0 && end_sector_idx - sector_index >= block_sectors) {
+            // whole aligned block, erased by one block erase
+            s_esp_partition_stat_total_time += s_esp_partition_flash_model.block_erase_time;
+            for (size_t i = 1; i < block_sectors; i++) {
+                ++s_esp_partition_stat_erase_ops;
+                s_esp_partition_stat_sector_erase_count[++sector_index]++;
+            }
+        } else {
+            s_esp_partition_stat_total_time += s_esp_partition_flash_model.sector_erase_time;
+        }
     }
 
     return ret_val;
@@ -677,14 +834,20 @@ static bool esp_partition_hook_erase(const void *dstAddr, size_t *size)
 
 void esp_partition_clear_stats(void)
 {
+    pthread_mutex_lock(&s_esp_partition_flash_lock);
+
     s_esp_partition_stat_read_bytes = 0;
     s_esp_partition_stat_write_bytes = 0;
     s_esp_partition_stat_erase_ops = 0;
     s_esp_partition_stat_read_ops = 0;
     s_esp_partition_stat_write_ops = 0;
     s_esp_partition_stat_total_time = 0;
+    s_esp_partition_stat_max_wait_time = 0;
+    s_esp_partition_flash_op_start_time = 0;
 
     memset(s_esp_partition_stat_sector_erase_count, 0, sizeof(size_t) * s_esp_partition_file_mmap_ctrl_act.flash_file_size / ESP_PARTITION_EMULATED_SECTOR_SIZE);
+
+    pthread_mutex_unlock(&s_esp_partition_flash_lock);
 }
 
 size_t esp_partition_get_read_ops(void)
@@ -719,12 +882,52 @@ size_t esp_partition_get_total_time(void)
 
 void esp_partition_fail_after(size_t count, uint8_t mode)
 {
+    pthread_mutex_lock(&s_esp_partition_flash_lock);
     s_esp_partition_emulated_power_off_counter = count;
     s_esp_partition_emulated_power_off_mode = mode;
+    pthread_mutex_unlock(&s_esp_partition_flash_lock);
 }
 
 size_t esp_partition_get_sector_erase_count(size_t sector)
 {
     return s_esp_partition_stat_sector_erase_count[sector];
 }
+
+size_t esp_partition_get_max_wait_time(void)
+{
+    return s_esp_partition_stat_max_wait_time;
+}
+
+void esp_partition_get_flash_model(esp_partition_flash_model_t *model)
+{
+    assert(model != NULL);
+
+    pthread_mutex_lock(&s_esp_partition_flash_lock);
+    *model = s_esp_partition_flash_model;
+    pthread_mutex_unlock(&s_esp_partition_flash_lock);
+}
+
+esp_err_t esp_partition_set_flash_model(const esp_partition_flash_model_t *model)
+{
+    if (model == NULL) {
+        model = &s_esp_partition_default_flash_model;
+    }
+
+    // power of two, 0 disables the feature
+    if ((model->block_size & (model->block_size - 1)) != 0 ||
+            (model->block_size != 0 && model->block_size < ESP_PARTITION_EMULATED_SECTOR_SIZE)) {
+        ESP_LOGE(TAG, "Invalid flash model block size %" PRIu32, (uint32_t) model->block_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((model->page_size & (model->page_size - 1)) != 0 || model->page_size > ESP_PARTITION_EMULATED_SECTOR_SIZE) {
+        ESP_LOGE(TAG, "Invalid flash model page size %" PRIu32, (uint32_t) model->page_size);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&s_esp_partition_flash_lock);
+    s_esp_partition_flash_model = *model;
+    pthread_mutex_unlock(&s_esp_partition_flash_lock);
+
+    return ESP_OK;
+}
 #endif
@@ -1,19 +1,26 @@
-// Copyright 2021 Espressif Systems (Shanghai) CO LTD
-//
-// Licensed under the Apache License, Version 2.0 (the "License");
-// you may not use this file except in compliance with the License.
-// You may obtain a copy of the License at
-//
-//     http://www.apache.org/licenses/LICENSE-2.0
-//
-// Unless required by applicable law or agreed to in writing, software
-// distributed under the License is distributed on an "AS IS" BASIS,
-// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-// See the License for the specific language governing permissions and
-// limitations under the License.
+/*
+ * SPDX-FileCopyrightText: 2021-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 #include "esp_rom_crc.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CRC32_LE_HAVE_PCLMUL 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRC32) || defined(__linux__))
+#include <arm_acle.h>
+#if !defined(__ARM_FEATURE_CRC32)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define CRC32_LE_HAVE_ARMV8_CRC 1
+#endif
+
 static const uint32_t crc32_le_table[256] = {
     0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L, 0x706af48fL, 0xe963a535L, 0x9e6495a3L,
     0x0edb8832L, 0x79dcb8a4L, 0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L, 0x90bf1d91L,
@@ -163,14 +170,195 @@ static uint8_t crc8_be_table[256] = {
     0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3
 };
 
+/*
+ * The chip ROMs calculate CRC32 byte by byte, which is fine for the few bytes checked at a time by the
+ * components running on the chip. On the host the same components (NVS, wear levelling, ...) are run
+ * on much larger data sets in tests and tools, so esp_rom_crc32_le processes 8 bytes per step using
+ * 8 lookup tables ("slicing-by-8") and uses the carry-less multiplication (x86-64 PCLMULQDQ) or
+ * CRC32 instructions (ARMv8) of the host CPU to process larger buffers.
+ *
+ * All the functions below work with the inverted CRC value, esp_rom_crc32_le does the inversions.
+ */
+static uint32_t crc32_le_bytewise(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc = crc32_le_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+// crc32_le_slice_table[k][n] is the CRC of byte n followed by k zero bytes, [0] equals crc32_le_table
+static uint32_t crc32_le_slice_table[8][256];
+
+static uint32_t crc32_le_slice8(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    const uint32_t (*t)[256] = crc32_le_slice_table;
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, buf, sizeof(lo));
+        memcpy(&hi, buf + 4, sizeof(hi));
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        buf += 8;
+        len -= 8;
+    }
+    return crc32_le_bytewise(crc, buf, len);
+}
+#endif // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+#if CRC32_LE_HAVE_PCLMUL
+/*
+ * Folds 64 byte blocks in 4 parallel 128 bit lanes and reduces the result with a Barrett reduction, see
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009).
+ * The constants are x^n mod P(x) for the bit-reflected CRC32 polynomial, len must be at least 64.
+ */
+#define CRC32_LE_PCLMUL_MIN_LEN 64
+
+__attribute__((target("pclmul,sse2")))
+static uint32_t crc32_le_pclmul(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(buf + 0x00)), _mm_cvtsi32_si128((int)crc));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    // fold the 4 lanes into one
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_loadu_si128((const __m128i *)buf)), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2);
+
+    // Barrett reduction to 32 bits
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    crc = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+
+    return crc32_le_bytewise(crc, buf, len);
+}
+
+static uint32_t crc32_le_fast(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    if (len >= CRC32_LE_PCLMUL_MIN_LEN) {
+        return crc32_le_pclmul(crc, buf, len);
+    }
+    return crc32_le_slice8(crc, buf, len);
+}
+
+static bool crc32_le_fast_supported(void)
+{
+    return __builtin_cpu_supports("pclmul");
+}
+#elif CRC32_LE_HAVE_ARMV8_CRC
+#if !defined(__ARM_FEATURE_CRC32) && defined(__clang__)
+__attribute__((target("crc")))
+#elif !defined(__ARM_FEATURE_CRC32)
+__attribute__((target("+crc")))
+#endif
+static uint32_t crc32_le_fast(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    while (len >= 8) {
+        uint64_t data;
+        memcpy(&data, buf, sizeof(data));
+        crc = __crc32d(crc, data);
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = __crc32b(crc, *buf);
+        buf++;
+        len--;
+    }
+    return crc;
+}
+
+static bool crc32_le_fast_supported(void)
+{
+#if defined(__ARM_FEATURE_CRC32)
+    return true;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
+#endif // CRC32_LE_HAVE_ARMV8_CRC
+
+// Byte by byte calculation is used until the tables are initialized, e.g. by other constructors
+static uint32_t (*crc32_le_impl)(uint32_t crc, uint8_t const *buf, size_t len) = crc32_le_bytewise;
+
+__attribute__((constructor))
+static void crc32_le_init(void)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (int n = 0; n < 256; n++) {
+        uint32_t crc = crc32_le_table[n];
+        crc32_le_slice_table[0][n] = crc;
+        for (int k = 1; k < 8; k++) {
+            crc = crc32_le_table[crc & 0xff] ^ (crc >> 8);
+            crc32_le_slice_table[k][n] = crc;
+        }
+    }
+    crc32_le_impl = crc32_le_slice8;
+#endif // __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if CRC32_LE_HAVE_PCLMUL || CRC32_LE_HAVE_ARMV8_CRC
+    if (crc32_le_fast_supported()) {
+        crc32_le_impl = crc32_le_fast;
+    }
+#endif
+}
+
 uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const * buf,uint32_t len)
 {
-    uint32_t i;
-    crc = ~crc;
-    for(i=0;i<len;i++){
-        crc = crc32_le_table[(crc^buf[i])&0xff]^(crc>>8);
+    if (len < 8) {
+        // e.g. single words checked by wear levelling, not worth an indirect call
+        return ~crc32_le_bytewise(~crc, buf, len);
     }
-    return ~crc;
+    return ~crc32_le_impl(~crc, buf, len);
 }
 
 uint32_t esp_rom_crc32_be(uint32_t crc, uint8_t const * buf,uint32_t len)
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2023-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
@@ -18,6 +18,8 @@
 #include <cstdio>
 #include <regex>
 #include <cstring>
+#include <cinttypes>
+#include <ctime>
 #include "esp_rom_sys.h"
 #include "esp_rom_efuse.h"
 #include "esp_rom_crc.h"
@@ -60,6 +62,66 @@ TEST_CASE("crc quick check")
     CHECK(result == expected_result);
 }
 
+static uint32_t crc32_le_bitwise(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static uint64_t get_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+TEST_CASE("crc32 matches bitwise calculation for all lengths and alignments")
+{
+    static uint8_t buf[16 + 4096];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t) (i * 7 + (i >> 8));
+    }
+
+    // short lengths use the tables, longer ones the host CPU instructions if available
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t len = 0; len <= 300; len++) {
+            uint32_t init = (uint32_t) (offset * 0x01010101 + len);
+            CHECK(esp_rom_crc32_le(init, buf + offset, len) == crc32_le_bitwise(init, buf + offset, len));
+        }
+        CHECK(esp_rom_crc32_le(0, buf + offset, 4096) == crc32_le_bitwise(0, buf + offset, 4096));
+    }
+
+    // calculation can be split at any point
+    uint32_t crc = esp_rom_crc32_le(0xffffffff, buf, 1000);
+    crc = esp_rom_crc32_le(crc, buf + 1000, 3);
+    crc = esp_rom_crc32_le(crc, buf + 1003, 3093);
+    CHECK(crc == esp_rom_crc32_le(0xffffffff, buf, 4096));
+}
+
+TEST_CASE("crc32 throughput")
+{
+    static uint8_t buf[4096];
+    const size_t sizes[] = {4, 32, 256, 4096};
+    const size_t total = 64 * 1024 * 1024;
+    memset(buf, 0x5a, sizeof(buf));
+
+    for (size_t size : sizes) {
+        volatile uint32_t crc = 0;
+        uint64_t start = get_time_ns();
+        for (size_t done = 0; done < total; done += size) {
+            crc = esp_rom_crc32_le(crc, buf, size);
+        }
+        uint64_t elapsed = get_time_ns() - start;
+        printf("crc32_le %4zu byte blocks: %" PRIu64 " MB/s\n", size, (uint64_t) total * 1000 / (elapsed ? elapsed : 1));
+    }
+}
+
 TEST_CASE("reset reason basic check")
 {
     CHECK(esp_rom_get_reset_reason(0) == RESET_REASON_CHIP_POWER_ON);
@@ -0,0 +1,68 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/*
+ * FreeRTOS trace macros of the scheduler profiler, included by FreeRTOSConfig.h if CONFIG_ESP_SCHED_PROF_ENABLE is
+ * set. The macros are only expanded inside tasks.c, so they can access the TCB directly.
+ *
+ * Each profiled task is identified by its slot in the profiler's task table. The slot number is stored in the task
+ * number of the TCB (see vTaskSetTaskNumber()), 0 meaning the task has no slot.
+ *
+ * This file is included before the FreeRTOS types are defined, so the hooks only use standard types.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The hooks are called by the kernel with the kernel lock taken (or interrupts disabled on a single core) */
+uint32_t esp_sched_prof_hook_task_create(void *task, int32_t core_id);
+void esp_sched_prof_hook_task_delete(uint32_t slot);
+void esp_sched_prof_hook_task_ready(uint32_t slot);
+void esp_sched_prof_hook_task_switched_out(uint32_t slot, bool still_ready);
+void esp_sched_prof_hook_task_switched_in(uint32_t slot);
+
+#if ( configNUMBER_OF_CORES > 1 )
+    #define prvSCHED_PROF_CORE_ID( pxTCB )    ( ( int32_t ) ( pxTCB )->xCoreID )
+#else
+    #define prvSCHED_PROF_CORE_ID( pxTCB )    ( 0 )
+#endif
+
+#define traceTASK_CREATE( pxNewTCB )                                                                       \
+    do {                                                                                                   \
+        ( pxNewTCB )->uxTaskNumber = esp_sched_prof_hook_task_create( ( pxNewTCB ),                        \
+                                                                      prvSCHED_PROF_CORE_ID( pxNewTCB ) ); \
+    } while( 0 )
+
+#define traceTASK_DELETE( pxTCB )                                                       \
+    do {                                                                                \
+        esp_sched_prof_hook_task_delete( ( uint32_t ) ( pxTCB )->uxTaskNumber );        \
+        ( pxTCB )->uxTaskNumber = 0;                                                    \
+    } while( 0 )
+
+#define traceMOVED_TASK_TO_READY_STATE( pxTCB )                                         \
+    esp_sched_prof_hook_task_ready( ( uint32_t ) ( pxTCB )->uxTaskNumber )
+
+/* A task which is still in its ready list when switched out was preempted (or yielded) instead of blocking */
+#define traceTASK_SWITCHED_OUT()                                                                                      \
+    do {                                                                                                              \
+        TCB_t * pxTCBOut = pxCurrentTCBs[ portGET_CORE_ID() ];                                                        \
+        esp_sched_prof_hook_task_switched_out( ( uint32_t ) pxTCBOut->uxTaskNumber,                                   \
+                                               listIS_CONTAINED_WITHIN( &( pxReadyTasksLists[ pxTCBOut->uxPriority ] ), \
+                                                                        &( pxTCBOut->xStateListItem ) ) );            \
+    } while( 0 )
+
+#define traceTASK_SWITCHED_IN()                                                                     \
+    esp_sched_prof_hook_task_switched_in( ( uint32_t ) pxCurrentTCBs[ portGET_CORE_ID() ]->uxTaskNumber )
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,182 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Number of buckets of the wakeup latency histograms
+ *
+ * Bucket 0 counts latencies below 1 us, bucket i (0 < i < ESP_SCHED_PROF_LATENCY_BUCKETS - 1) counts latencies of
+ * at least 2^(i-1) and less than 2^i us. The last bucket counts all latencies of 2^(ESP_SCHED_PROF_LATENCY_BUCKETS - 2)
+ * us (16.4 ms) or more.
+ */
+#define ESP_SCHED_PROF_LATENCY_BUCKETS  16
+
+/**
+ * @brief Prefix of the lines printed by the `schedprof --raw` console command, see esp_sched_prof_encode()
+ */
+#define ESP_SCHED_PROF_RAW_PREFIX       "schedprof:"
+
+/**
+ * @brief Cumulative profiler counters of all tasks at a point in time
+ *
+ * Opaque, created by esp_sched_prof_sample_create().
+ */
+typedef struct esp_sched_prof_sample esp_sched_prof_sample_t;
+
+/**
+ * @brief Scheduler statistics of one task during a window
+ */
+typedef struct {
+    TaskHandle_t task;                                      ///< Handle of the task
+    char name[configMAX_TASK_NAME_LEN];                     ///< Name of the task
+    UBaseType_t priority;                                   ///< Current priority of the task
+    BaseType_t core_id;                                     ///< Core the task is pinned to, or tskNO_AFFINITY
+    uint32_t run_time_us[CONFIG_FREERTOS_NUMBER_OF_CORES];  ///< Time the task ran on each core (including ISRs interrupting it)
+    uint32_t switches;                                      ///< Number of times the task was switched in
+    uint32_t preemptions;                                   ///< Number of times the task was switched out while still ready to run (preempted or yielded)
+    uint32_t latency_max_us;                                ///< Longest time from becoming ready to running. The maximum since the task was created, bounded by the highest histogram bucket of the window.
+    uint32_t latency_hist[ESP_SCHED_PROF_LATENCY_BUCKETS];  ///< Histogram of the times from becoming ready to running
+    uint32_t stack_high_water;                              ///< Minimum amount of free stack space the task ever had, in bytes
+} esp_sched_prof_task_stats_t;
+
+/**
+ * @brief Summary of a window between two samples
+ */
+typedef struct {
+    uint32_t duration_us;                                       ///< Length of the window
+    uint32_t untracked_run_time_us[CONFIG_FREERTOS_NUMBER_OF_CORES];  ///< Run time of tasks without a slot on each core
+    size_t num_tasks;                                           ///< Number of tasks with statistics in the window
+    size_t num_tasks_dropped;                                   ///< Number of tasks which didn't fit into the statistics array
+} esp_sched_prof_window_t;
+
+/**
+ * @brief Allocate a sample
+ *
+ * @param[out] ret_sample The new sample. Samples take about 50 bytes plus 80 bytes per core for each
+ *                        task slot (CONFIG_ESP_SCHED_PROF_MAX_TASKS).
+ * @return
+ *      - ESP_OK: Sample allocated
+ *      - ESP_ERR_INVALID_ARG: ret_sample is NULL
+ *      - ESP_ERR_NO_MEM: Out of memory
+ *      - ESP_ERR_NOT_SUPPORTED: The profiler is disabled (CONFIG_ESP_SCHED_PROF_ENABLE)
+ */
+esp_err_t esp_sched_prof_sample_create(esp_sched_prof_sample_t **ret_sample);
+
+/**
+ * @brief Free a sample
+ *
+ * @param sample Sample to free, may be NULL
+ */
+void esp_sched_prof_sample_delete(esp_sched_prof_sample_t *sample);
+
+/**
+ * @brief Copy the current counters of all tasks into a sample
+ *
+ * The counters are read without blocking the scheduler. The stack high water marks of all tasks are read with
+ * uxTaskGetSystemState(), which briefly enters a critical section per task.
+ *
+ * @param sample Sample to overwrite
+ * @return
+ *      - ESP_OK: Success
+ *      - ESP_ERR_INVALID_ARG: sample is NULL
+ *      - ESP_ERR_NO_MEM: Out of memory to list the tasks
+ *      - ESP_ERR_NOT_SUPPORTED: The profiler is disabled
+ */
+esp_err_t esp_sched_prof_sample_take(esp_sched_prof_sample_t *sample);
+
+/**
+ * @brief Get the statistics of all tasks during the window between two samples
+ *
+ * Only tasks which still exist when the end sample was taken are listed. Tasks created during the window are counted
+ * from their creation.
+ *
+ * @param start Sample taken at the start of the window
+ * @param end Sample taken at the end of the window
+ * @param[out] window Summary of the window
+ * @param[out] stats Array for the statistics of each task, sorted by descending total run time
+ * @param max_tasks Number of elements of stats
+ * @return
+ *      - ESP_OK: Success, check window->num_tasks_dropped if stats was too small
+ *      - ESP_ERR_INVALID_ARG: An argument is NULL
+ *      - ESP_ERR_NOT_SUPPORTED: The profiler is disabled
+ */
+esp_err_t esp_sched_prof_get_window(const esp_sched_prof_sample_t *start, const esp_sched_prof_sample_t *end,
+                                    esp_sched_prof_window_t *window, esp_sched_prof_task_stats_t *stats,
+                                    size_t max_tasks);
+
+/**
+ * @brief Profile all tasks for a while
+ *
+ * Convenience function to take a sample, wait for the window and get the statistics of the window.
+ *
+ * @param window_ms Length of the window, the calling task is blocked in the meantime
+ * @param[out] window Summary of the window
+ * @param[out] stats Array for the statistics of each task, sorted by descending total run time
+ * @param max_tasks Number of elements of stats
+ * @return See esp_sched_prof_sample_create() and esp_sched_prof_get_window()
+ */
+esp_err_t esp_sched_prof_measure(uint32_t window_ms, esp_sched_prof_window_t *window,
+                                 esp_sched_prof_task_stats_t *stats, size_t max_tasks);
+
+/**
+ * @brief Get an upper bound of a percentile of the wakeup latencies of a task
+ *
+ * @param stats Statistics of the task
+ * @param percentile Percentile, from 0 to 100
+ * @return The upper bound of the histogram bucket containing the percentile in us (capped to latency_max_us),
+ *         0 if the task never woke up during the window
+ */
+uint32_t esp_sched_prof_latency_percentile(const esp_sched_prof_task_stats_t *stats, uint32_t percentile);
+
+/**
+ * @brief Encode the statistics of a window into a compact binary record
+ *
+ * The record is decoded on the host by sched_prof_decode.py in this component's directory, which also decodes log
+ * output of the `schedprof --raw` console command (ESP_SCHED_PROF_RAW_PREFIX followed by the record in hex).
+ * All fields are little endian:
+ *
+ * - Header: magic "SPRF", version (u8, 1), number of cores (u8), number of latency buckets (u8), task name length
+ *   (u8), window duration in us (u32), number of tasks (u16), reserved (u16), untracked run time in us per core (u32)
+ * - Per task: task handle (u32), name (task name length bytes, zero padded), priority (u8), core ID (i8, -1 if not
+ *   pinned), reserved (u16), stack high water mark in bytes (u32), run time in us per core (u32), switches (u32),
+ *   preemptions (u32), maximum latency in us (u32), latency histogram (u32 per bucket)
+ *
+ * @param window Summary of the window
+ * @param stats Statistics of window->num_tasks tasks
+ * @param[out] buf Buffer for the record, may be NULL to get the size only
+ * @param buf_size Size of buf
+ * @return Size of the record. If it is larger than buf_size, nothing was written.
+ */
+size_t esp_sched_prof_encode(const esp_sched_prof_window_t *window, const esp_sched_prof_task_stats_t *stats,
+                             uint8_t *buf, size_t buf_size);
+
+/**
+ * @brief Register the `schedprof` console command
+ *
+ * `schedprof [-w <ms>] [-n <count>] [-r]` profiles all tasks during -n windows (default 1) of -w ms (default 1000)
+ * and prints a table per window, or the encoded records in hex with -r.
+ *
+ * @return
+ *      - ESP_OK: Success
+ *      - Others: See esp_console_cmd_register()
+ */
+esp_err_t esp_sched_prof_register_console_command(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,584 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Scheduler profiler
+ *
+ * The FreeRTOS trace hooks (see esp_private/sched_prof_freertos.h) keep cumulative counters per task slot in a buffer
+ * per core. Each buffer is only written by its own core, from within the scheduler, so the hooks take no lock and
+ * cost a few dozen cycles per context switch. Samples copy the buffers without blocking the scheduler, using a
+ * sequence counter per core to detect concurrent updates. The statistics of a window are the differences between
+ * two samples.
+ *
+ * Slots are assigned when a task is created and released when it is deleted. The counters of a slot are reset when
+ * it is assigned again, which increments the generation of the slot so that samples can tell the tasks apart.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_sched_prof.h"
+
+#if CONFIG_ESP_SCHED_PROF_ENABLE
+
+#include "esp_private/sched_prof_freertos.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_timer.h"
+#endif
+
+#define NUM_CORES   CONFIG_FREERTOS_NUMBER_OF_CORES
+/* Slot 0 collects the counters of the tasks which didn't get a slot */
+#define NUM_SLOTS   (CONFIG_ESP_SCHED_PROF_MAX_TASKS + 1)
+
+typedef struct {
+    uint32_t run_time_us;
+    uint32_t switches;
+    uint32_t preemptions;
+    uint32_t latency_max_us;
+    uint32_t latency_hist[ESP_SCHED_PROF_LATENCY_BUCKETS];
+} prof_counters_t;
+
+/* Only written by its own core */
+typedef struct {
+    uint32_t seq;               // Odd while the hooks update the core's data
+    bool running;               // A task was switched in on this core, i.e. the scheduler runs
+    uint32_t current_slot;
+    uint32_t switched_in_us;
+    uint32_t out_slot;          // Task switched out, until the next task is switched in
+    bool out_still_ready;
+    prof_counters_t counters[NUM_SLOTS];
+} __attribute__((aligned(64))) prof_core_t;
+
+/* Only written with the kernel lock taken */
+typedef struct {
+    void *task;                 // NULL if the slot is free
+    uint32_t generation;        // Odd while the counters of the slot are reset
+    int32_t core_id;
+    bool ready;                 // The task became ready and wasn't switched in since
+    uint32_t ready_us;
+} prof_slot_t;
+
+typedef struct {
+    TaskHandle_t task;
+    bool valid;                 // The task has a slot and its counters were read consistently
+    uint32_t generation;
+    int32_t core_id;
+    prof_counters_t counters[NUM_CORES];
+    bool listed;                // The task was in the task list when the sample was taken
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    uint32_t stack_high_water;
+} prof_sample_slot_t;
+
+struct esp_sched_prof_sample {
+    uint32_t timestamp_us;
+    prof_sample_slot_t slots[NUM_SLOTS];
+};
+
+static prof_core_t s_cores[NUM_CORES];
+static prof_slot_t s_slots[NUM_SLOTS];
+
+FORCE_INLINE_ATTR uint32_t prof_now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000 + (uint32_t)(ts.tv_nsec / 1000);
+#else
+    return (uint32_t)esp_timer_get_time();
+#endif
+}
+
+FORCE_INLINE_ATTR uint32_t prof_latency_bucket(uint32_t latency_us)
+{
+    uint32_t bucket = 0;
+
+    // A loop instead of __builtin_clz(), which isn't an instruction on all targets and may live in flash
+    while (latency_us != 0 && bucket < ESP_SCHED_PROF_LATENCY_BUCKETS - 1) {
+        latency_us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+FORCE_INLINE_ATTR void prof_core_begin_update(prof_core_t *core)
+{
+    core->seq++;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+FORCE_INLINE_ATTR void prof_core_end_update(prof_core_t *core)
+{
+    __atomic_store_n(&core->seq, core->seq + 1, __ATOMIC_RELEASE);
+}
+
+FORCE_INLINE_ATTR uint32_t prof_valid_slot(uint32_t slot)
+{
+    // The task number may have been changed by vTaskSetTaskNumber()
+    return slot < NUM_SLOTS ? slot : 0;
+}
+
+/* ------------------------------------------------- FreeRTOS Hooks --------------------------------------------------- */
+
+uint32_t IRAM_ATTR esp_sched_prof_hook_task_create(void *task, int32_t core_id)
+{
+    for (uint32_t slot = 1; slot < NUM_SLOTS; slot++) {
+        prof_slot_t *s = &s_slots[slot];
+
+        if (s->task != NULL) {
+            continue;
+        }
+
+        s->generation++;
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        // The other cores don't touch the counters of a free slot
+        for (int core = 0; core < NUM_CORES; core++) {
+            memset(&s_cores[core].counters[slot], 0, sizeof(prof_counters_t));
+        }
+        s->task = task;
+        s->core_id = core_id;
+        s->ready = false;
+        __atomic_store_n(&s->generation, s->generation + 1, __ATOMIC_RELEASE);
+        return slot;
+    }
+    return 0;
+}
+
+void IRAM_ATTR esp_sched_prof_hook_task_delete(uint32_t slot)
+{
+    slot = prof_valid_slot(slot);
+    if (slot != 0) {
+        s_slots[slot].task = NULL;
+    }
+}
+
+void IRAM_ATTR esp_sched_prof_hook_task_ready(uint32_t slot)
+{
+    prof_slot_t *s = &s_slots[prof_valid_slot(slot)];
+
+    // Keep the time the task first became ready, e.g. if its priority is changed while it waits for a core
+    if (slot != 0 && !s->ready) {
+        s->ready_us = prof_now_us();
+        s->ready = true;
+    }
+}
+
+void IRAM_ATTR esp_sched_prof_hook_task_switched_out(uint32_t slot, bool still_ready)
+{
+    prof_core_t *core = &s_cores[xPortGetCoreID()];
+
+    slot = prof_valid_slot(slot);
+    prof_core_begin_update(core);
+    if (core->running) {
+        core->counters[slot].run_time_us += prof_now_us() - core->switched_in_us;
+    }
+    // Counted once the next task is known, the scheduler may select the same task again
+    core->out_slot = slot;
+    core->out_still_ready = still_ready;
+    prof_core_end_update(core);
+
+    // A task which became ready again while running didn't wait for a core
+    s_slots[slot].ready = false;
+}
+
+void IRAM_ATTR esp_sched_prof_hook_task_switched_in(uint32_t slot)
+{
+    prof_core_t *core = &s_cores[xPortGetCoreID()];
+    prof_slot_t *s;
+    uint32_t now = prof_now_us();
+
+    slot = prof_valid_slot(slot);
+    s = &s_slots[slot];
+    prof_core_begin_update(core);
+    if (!core->running || slot != core->out_slot || slot == 0) {
+        if (core->running && core->out_still_ready) {
+            core->counters[core->out_slot].preemptions++;
+        }
+        core->counters[slot].switches++;
+    }
+    if (s->ready) {
+        uint32_t latency = now - s->ready_us;
+
+        core->counters[slot].latency_hist[prof_latency_bucket(latency)]++;
+        if (latency > core->counters[slot].latency_max_us) {
+            core->counters[slot].latency_max_us = latency;
+        }
+    }
+    s->ready = false;
+    core->current_slot = slot;
+    core->switched_in_us = now;
+    core->running = true;
+    prof_core_end_update(core);
+}
+
+/* --------------------------------------------------- Samples -------------------------------------------------------- */
+
+esp_err_t esp_sched_prof_sample_create(esp_sched_prof_sample_t **ret_sample)
+{
+    if (ret_sample == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *ret_sample = calloc(1, sizeof(esp_sched_prof_sample_t));
+    return *ret_sample != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void esp_sched_prof_sample_delete(esp_sched_prof_sample_t *sample)
+{
+    free(sample);
+}
+
+static void sample_read_core(esp_sched_prof_sample_t *sample, int core_id)
+{
+    prof_core_t *core = &s_cores[core_id];
+    uint32_t seq;
+    bool running = false;
+    uint32_t current_slot = 0;
+    uint32_t switched_in_us = 0;
+
+    do {
+        seq = __atomic_load_n(&core->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+        for (int slot = 0; slot < NUM_SLOTS; slot++) {
+            sample->slots[slot].counters[core_id] = core->counters[slot];
+        }
+        running = core->running;
+        current_slot = core->current_slot;
+        switched_in_us = core->switched_in_us;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&core->seq, __ATOMIC_RELAXED) != seq || (seq & 1));
+
+    // Add the time the current task has been running since it was switched in
+    if (running && (int32_t)(sample->timestamp_us - switched_in_us) > 0) {
+        sample->slots[current_slot].counters[core_id].run_time_us += sample->timestamp_us - switched_in_us;
+    }
+}
+
+static prof_sample_slot_t *sample_find_task(esp_sched_prof_sample_t *sample, TaskHandle_t task)
+{
+    for (int slot = 1; slot < NUM_SLOTS; slot++) {
+        if (sample->slots[slot].valid && sample->slots[slot].task == task) {
+            return &sample->slots[slot];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_sched_prof_sample_take(esp_sched_prof_sample_t *sample)
+{
+    TaskStatus_t *status;
+    UBaseType_t num_status;
+
+    if (sample == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Leave some room for tasks created in the meantime
+    num_status = uxTaskGetNumberOfTasks() + 4;
+    status = malloc(num_status * sizeof(TaskStatus_t));
+    if (status == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    sample->timestamp_us = prof_now_us();
+    for (int slot = 0; slot < NUM_SLOTS; slot++) {
+        prof_sample_slot_t *ss = &sample->slots[slot];
+
+        ss->generation = __atomic_load_n(&s_slots[slot].generation, __ATOMIC_ACQUIRE);
+        ss->task = s_slots[slot].task;
+        ss->core_id = s_slots[slot].core_id;
+        ss->listed = false;
+    }
+    for (int core = 0; core < NUM_CORES; core++) {
+        sample_read_core(sample, core);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    for (int slot = 0; slot < NUM_SLOTS; slot++) {
+        prof_sample_slot_t *ss = &sample->slots[slot];
+
+        // The slot was reassigned while its counters were read
+        ss->valid = (ss->generation & 1) == 0 &&
+                    __atomic_load_n(&s_slots[slot].generation, __ATOMIC_RELAXED) == ss->generation &&
+                    (ss->task != NULL || slot == 0);
+    }
+
+    num_status = uxTaskGetSystemState(status, num_status, NULL);
+    for (UBaseType_t i = 0; i < num_status; i++) {
+        prof_sample_slot_t *ss = sample_find_task(sample, status[i].xHandle);
+
+        if (ss != NULL) {
+            ss->listed = true;
+            strlcpy(ss->name, status[i].pcTaskName, sizeof(ss->name));
+            ss->priority = status[i].uxCurrentPriority;
+            ss->stack_high_water = status[i].usStackHighWaterMark * sizeof(StackType_t);
+        }
+    }
+    free(status);
+    return ESP_OK;
+}
+
+/* --------------------------------------------------- Windows -------------------------------------------------------- */
+
+static uint64_t stats_total_run_time(const esp_sched_prof_task_stats_t *stats)
+{
+    uint64_t total = 0;
+
+    for (int core = 0; core < NUM_CORES; core++) {
+        total += stats->run_time_us[core];
+    }
+    return total;
+}
+
+static int stats_compare(const void *a, const void *b)
+{
+    uint64_t run_a = stats_total_run_time(a);
+    uint64_t run_b = stats_total_run_time(b);
+
+    return run_a < run_b ? 1 : run_a > run_b ? -1 : 0;
+}
+
+static void window_task_stats(const prof_sample_slot_t *start, const prof_sample_slot_t *end,
+                              esp_sched_prof_task_stats_t *stats)
+{
+    // The counters of a task created during the window start from 0
+    bool same_task = start->valid && start->task == end->task && start->generation == end->generation;
+    uint32_t latency_max_us = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->task = end->task;
+    strlcpy(stats->name, end->name, sizeof(stats->name));
+    stats->priority = end->priority;
+    stats->core_id = end->core_id;
+    stats->stack_high_water = end->stack_high_water;
+
+    for (int core = 0; core < NUM_CORES; core++) {
+        const prof_counters_t *e = &end->counters[core];
+        const prof_counters_t *s = &start->counters[core];
+
+        stats->run_time_us[core] = e->run_time_us - (same_task ? s->run_time_us : 0);
+        stats->switches += e->switches - (same_task ? s->switches : 0);
+        stats->preemptions += e->preemptions - (same_task ? s->preemptions : 0);
+        for (int bucket = 0; bucket < ESP_SCHED_PROF_LATENCY_BUCKETS; bucket++) {
+            stats->latency_hist[bucket] += e->latency_hist[bucket] - (same_task ? s->latency_hist[bucket] : 0);
+        }
+        if (e->latency_max_us > latency_max_us) {
+            latency_max_us = e->latency_max_us;
+        }
+    }
+
+    // Only the maximum since the task's creation is known, bound it by the histogram of the window
+    stats->latency_max_us = latency_max_us;
+    stats->latency_max_us = esp_sched_prof_latency_percentile(stats, 100);
+}
+
+esp_err_t esp_sched_prof_get_window(const esp_sched_prof_sample_t *start, const esp_sched_prof_sample_t *end,
+                                    esp_sched_prof_window_t *window, esp_sched_prof_task_stats_t *stats,
+                                    size_t max_tasks)
+{
+    esp_sched_prof_task_stats_t task_stats;
+
+    if (start == NULL || end == NULL || window == NULL || (stats == NULL && max_tasks != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(window, 0, sizeof(*window));
+    window->duration_us = end->timestamp_us - start->timestamp_us;
+    for (int core = 0; core < NUM_CORES; core++) {
+        window->untracked_run_time_us[core] = end->slots[0].counters[core].run_time_us -
+                                              start->slots[0].counters[core].run_time_us;
+    }
+
+    for (int slot = 1; slot < NUM_SLOTS; slot++) {
+        if (!end->slots[slot].valid || !end->slots[slot].listed) {
+            continue;
+        }
+        window_task_stats(&start->slots[slot], &end->slots[slot], &task_stats);
+
+        if (window->num_tasks < max_tasks) {
+            stats[window->num_tasks++] = task_stats;
+            continue;
+        }
+
+        // Keep the tasks which ran the longest
+        size_t min = 0;
+        for (size_t i = 1; i < max_tasks; i++) {
+            if (stats_compare(&stats[i], &stats[min]) > 0) {
+                min = i;
+            }
+        }
+        if (max_tasks != 0 && stats_compare(&task_stats, &stats[min]) < 0) {
+            stats[min] = task_stats;
+        }
+        window->num_tasks_dropped++;
+    }
+
+    qsort(stats, window->num_tasks, sizeof(*stats), stats_compare);
+    return ESP_OK;
+}
+
+esp_err_t esp_sched_prof_measure(uint32_t window_ms, esp_sched_prof_window_t *window,
+                                 esp_sched_prof_task_stats_t *stats, size_t max_tasks)
+{
+    esp_sched_prof_sample_t *start = NULL;
+    esp_sched_prof_sample_t *end = NULL;
+    esp_err_t ret;
+
+    ret = esp_sched_prof_sample_create(&start);
+    if (ret == ESP_OK) {
+        ret = esp_sched_prof_sample_create(&end);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_sched_prof_sample_take(start);
+    }
+    if (ret == ESP_OK) {
+        vTaskDelay(pdMS_TO_TICKS(window_ms));
+        ret = esp_sched_prof_sample_take(end);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_sched_prof_get_window(start, end, window, stats, max_tasks);
+    }
+
+    esp_sched_prof_sample_delete(start);
+    esp_sched_prof_sample_delete(end);
+    return ret;
+}
+
+#else /* CONFIG_ESP_SCHED_PROF_ENABLE */
+
+esp_err_t esp_sched_prof_sample_create(esp_sched_prof_sample_t **ret_sample)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void esp_sched_prof_sample_delete(esp_sched_prof_sample_t *sample)
+{
+}
+
+esp_err_t esp_sched_prof_sample_take(esp_sched_prof_sample_t *sample)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_sched_prof_get_window(const esp_sched_prof_sample_t *start, const esp_sched_prof_sample_t *end,
+                                    esp_sched_prof_window_t *window, esp_sched_prof_task_stats_t *stats,
+                                    size_t max_tasks)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_sched_prof_measure(uint32_t window_ms, esp_sched_prof_window_t *window,
+                                 esp_sched_prof_task_stats_t *stats, size_t max_tasks)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif /* CONFIG_ESP_SCHED_PROF_ENABLE */
+
+/* ------------------------------------------------ Post-Processing ---------------------------------------------------- */
+
+uint32_t esp_sched_prof_latency_percentile(const esp_sched_prof_task_stats_t *stats, uint32_t percentile)
+{
+    uint64_t total = 0;
+    uint64_t count = 0;
+    uint64_t target;
+
+    for (int bucket = 0; bucket < ESP_SCHED_PROF_LATENCY_BUCKETS; bucket++) {
+        total += stats->latency_hist[bucket];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    target = (total * (percentile > 100 ? 100 : percentile) + 99) / 100;
+    if (target == 0) {
+        target = 1;
+    }
+    for (int bucket = 0; bucket < ESP_SCHED_PROF_LATENCY_BUCKETS - 1; bucket++) {
+        count += stats->latency_hist[bucket];
+        if (count >= target) {
+            uint32_t bound = (1U << bucket) - 1;
+
+            return bound < stats->latency_max_us ? bound : stats->latency_max_us;
+        }
+    }
+    return stats->latency_max_us;
+}
+
+static uint8_t *encode_u8(uint8_t *p, uint8_t value)
+{
+    *p = value;
+    return p + 1;
+}
+
+static uint8_t *encode_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static uint8_t *encode_u32(uint8_t *p, uint32_t value)
+{
+    p = encode_u16(p, value & 0xFFFF);
+    return encode_u16(p, value >> 16);
+}
+
+size_t esp_sched_prof_encode(const esp_sched_prof_window_t *window, const esp_sched_prof_task_stats_t *stats,
+                             uint8_t *buf, size_t buf_size)
+{
+    const size_t num_cores = CONFIG_FREERTOS_NUMBER_OF_CORES;
+    const size_t header_size = 16 + 4 * num_cores;
+    const size_t task_size = 12 + configMAX_TASK_NAME_LEN + 4 * num_cores + 12 + 4 * ESP_SCHED_PROF_LATENCY_BUCKETS;
+    size_t size = header_size + task_size * window->num_tasks;
+    uint8_t *p = buf;
+
+    if (buf == NULL || size > buf_size) {
+        return size;
+    }
+
+    memcpy(p, "SPRF", 4);
+    p += 4;
+    p = encode_u8(p, 1);
+    p = encode_u8(p, num_cores);
+    p = encode_u8(p, ESP_SCHED_PROF_LATENCY_BUCKETS);
+    p = encode_u8(p, configMAX_TASK_NAME_LEN);
+    p = encode_u32(p, window->duration_us);
+    p = encode_u16(p, window->num_tasks);
+    p = encode_u16(p, 0);
+    for (size_t core = 0; core < num_cores; core++) {
+        p = encode_u32(p, window->untracked_run_time_us[core]);
+    }
+
+    for (size_t i = 0; i < window->num_tasks; i++) {
+        const esp_sched_prof_task_stats_t *s = &stats[i];
+
+        p = encode_u32(p, (uint32_t)(uintptr_t)s->task);
+        strncpy((char *)p, s->name, configMAX_TASK_NAME_LEN);
+        p += configMAX_TASK_NAME_LEN;
+        p = encode_u8(p, s->priority);
+        p = encode_u8(p, s->core_id == tskNO_AFFINITY ? 0xFF : s->core_id);
+        p = encode_u16(p, 0);
+        p = encode_u32(p, s->stack_high_water);
+        for (size_t core = 0; core < num_cores; core++) {
+            p = encode_u32(p, s->run_time_us[core]);
+        }
+        p = encode_u32(p, s->switches);
+        p = encode_u32(p, s->preemptions);
+        p = encode_u32(p, s->latency_max_us);
+        for (int bucket = 0; bucket < ESP_SCHED_PROF_LATENCY_BUCKETS; bucket++) {
+            p = encode_u32(p, s->latency_hist[bucket]);
+        }
+    }
+    return size;
+}
@@ -0,0 +1,156 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "esp_sched_prof.h"
+
+#define NUM_CORES           CONFIG_FREERTOS_NUMBER_OF_CORES
+#define DEFAULT_WINDOW_MS   1000
+#define MAX_STATS           32
+
+static struct {
+    struct arg_int *window_ms;
+    struct arg_int *count;
+    struct arg_lit *raw;
+    struct arg_end *end;
+} s_schedprof_args;
+
+static void print_table(const esp_sched_prof_window_t *window, const esp_sched_prof_task_stats_t *stats)
+{
+    printf("Window: %"PRIu32" ms\n", window->duration_us / 1000);
+    printf("%-*s %4s %4s", configMAX_TASK_NAME_LEN, "Task", "Core", "Prio");
+    for (int core = 0; core < NUM_CORES; core++) {
+        printf("  CPU%d%%", core);
+    }
+    printf(" %8s %8s %8s %8s %8s %6s\n", "Switches", "Preempt", "p50 us", "p99 us", "max us", "Stack");
+
+    for (size_t i = 0; i < window->num_tasks; i++) {
+        const esp_sched_prof_task_stats_t *s = &stats[i];
+
+        printf("%-*s", configMAX_TASK_NAME_LEN, s->name);
+        if (s->core_id == tskNO_AFFINITY) {
+            printf(" %4s", "*");
+        } else {
+            printf(" %4d", (int)s->core_id);
+        }
+        printf(" %4u", (unsigned)s->priority);
+        for (int core = 0; core < NUM_CORES; core++) {
+            printf(" %6.1f", window->duration_us ? 100.0 * s->run_time_us[core] / window->duration_us : 0.0);
+        }
+        printf(" %8"PRIu32" %8"PRIu32" %8"PRIu32" %8"PRIu32" %8"PRIu32" %6"PRIu32"\n",
+               s->switches, s->preemptions,
+               esp_sched_prof_latency_percentile(s, 50), esp_sched_prof_latency_percentile(s, 99),
+               s->latency_max_us, s->stack_high_water);
+    }
+
+    printf("%-*s %4s %4s", configMAX_TASK_NAME_LEN, "(untracked)", "", "");
+    for (int core = 0; core < NUM_CORES; core++) {
+        printf(" %6.1f", window->duration_us ? 100.0 * window->untracked_run_time_us[core] / window->duration_us : 0.0);
+    }
+    printf("\n");
+    if (window->num_tasks_dropped) {
+        printf("%u tasks not shown\n", (unsigned)window->num_tasks_dropped);
+    }
+}
+
+static esp_err_t print_raw(const esp_sched_prof_window_t *window, const esp_sched_prof_task_stats_t *stats)
+{
+    size_t size = esp_sched_prof_encode(window, stats, NULL, 0);
+    uint8_t *buf = malloc(size);
+
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_sched_prof_encode(window, stats, buf, size);
+    printf(ESP_SCHED_PROF_RAW_PREFIX);
+    for (size_t i = 0; i < size; i++) {
+        printf("%02x", buf[i]);
+    }
+    printf("\n");
+    free(buf);
+    return ESP_OK;
+}
+
+static int schedprof_cmd(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **) &s_schedprof_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, s_schedprof_args.end, argv[0]);
+        return 1;
+    }
+
+    int window_ms = s_schedprof_args.window_ms->count ? s_schedprof_args.window_ms->ival[0] : DEFAULT_WINDOW_MS;
+    int count = s_schedprof_args.count->count ? s_schedprof_args.count->ival[0] : 1;
+    bool raw = s_schedprof_args.raw->count != 0;
+    esp_sched_prof_sample_t *samples[2] = { NULL, NULL };
+    esp_sched_prof_task_stats_t *stats = calloc(MAX_STATS, sizeof(esp_sched_prof_task_stats_t));
+    esp_sched_prof_window_t window;
+    esp_err_t ret = ESP_OK;
+
+    if (window_ms <= 0 || count <= 0) {
+        printf("Window and count must be positive\n");
+        free(stats);
+        return 1;
+    }
+    if (stats == NULL) {
+        ret = ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < 2 && ret == ESP_OK; i++) {
+        ret = esp_sched_prof_sample_create(&samples[i]);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_sched_prof_sample_take(samples[0]);
+    }
+
+    // Consecutive windows share their samples, so no context switch is missed between them
+    for (int i = 0; i < count && ret == ESP_OK; i++) {
+        esp_sched_prof_sample_t *start = samples[i % 2];
+        esp_sched_prof_sample_t *end = samples[(i + 1) % 2];
+
+        vTaskDelay(pdMS_TO_TICKS(window_ms));
+        ret = esp_sched_prof_sample_take(end);
+        if (ret == ESP_OK) {
+            ret = esp_sched_prof_get_window(start, end, &window, stats, MAX_STATS);
+        }
+        if (ret == ESP_OK) {
+            if (raw) {
+                ret = print_raw(&window, stats);
+            } else {
+                print_table(&window, stats);
+            }
+        }
+    }
+
+    esp_sched_prof_sample_delete(samples[0]);
+    esp_sched_prof_sample_delete(samples[1]);
+    free(stats);
+    if (ret != ESP_OK) {
+        printf("Profiling failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    return 0;
+}
+
+esp_err_t esp_sched_prof_register_console_command(void)
+{
+    s_schedprof_args.window_ms = arg_int0("w", "window", "<ms>", "Length of each window, default 1000 ms");
+    s_schedprof_args.count = arg_int0("n", "count", "<n>", "Number of windows, default 1");
+    s_schedprof_args.raw = arg_lit0("r", "raw", "Print the encoded windows for sched_prof_decode.py");
+    s_schedprof_args.end = arg_end(3);
+
+    const esp_console_cmd_t cmd = {
+        .command = "schedprof",
+        .help = "Profile the run time, context switches and wakeup latencies of all tasks",
+        .hint = NULL,
+        .func = &schedprof_cmd,
+        .argtable = &s_schedprof_args
+    };
+    return esp_console_cmd_register(&cmd);
+}
@@ -0,0 +1,175 @@
+#!/usr/bin/env python
+#
+# sched_prof_decode decodes the scheduler profiler records printed by the `schedprof --raw` console command
+# (or encoded with esp_sched_prof_encode()) and prints them as tables or CSV.
+#
+# SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+# SPDX-License-Identifier: Apache-2.0
+import argparse
+import csv
+import re
+import struct
+import sys
+from typing import Any
+from typing import Dict
+from typing import List
+from typing import TextIO
+
+__version__ = '1.0'
+
+RAW_PREFIX = 'schedprof:'
+MAGIC = b'SPRF'
+VERSION = 1
+HEADER_FORMAT = '<4sBBBBIHH'
+NO_AFFINITY = -1
+
+
+class FormatError(RuntimeError):
+    pass
+
+
+def bucket_bound(bucket: int) -> int:
+    # Inclusive upper bound of a latency histogram bucket, see ESP_SCHED_PROF_LATENCY_BUCKETS
+    return (1 << bucket) - 1
+
+
+def latency_percentile(task: Dict[str, Any], percentile: int) -> int:
+    # Same as esp_sched_prof_latency_percentile()
+    hist = task['latency_hist']
+    total = sum(hist)
+    if total == 0:
+        return 0
+    target = max(1, (total * min(percentile, 100) + 99) // 100)
+    count = 0
+    for bucket, n in enumerate(hist[:-1]):
+        count += n
+        if count >= target:
+            return min(bucket_bound(bucket), task['latency_max_us'])
+    return int(task['latency_max_us'])
+
+
+def decode(record: bytes) -> Dict[str, Any]:
+    header_size = struct.calcsize(HEADER_FORMAT)
+    if len(record) < header_size:
+        raise FormatError('Record too short')
+    magic, version, num_cores, num_buckets, name_len, duration, num_tasks, _ = struct.unpack_from(HEADER_FORMAT, record)
+    if magic != MAGIC:
+        raise FormatError('Bad magic {!r}'.format(magic))
+    if version != VERSION:
+        raise FormatError('Unsupported version {}'.format(version))
+
+    offset = header_size
+    untracked = list(struct.unpack_from('<{}I'.format(num_cores), record, offset))
+    offset += 4 * num_cores
+
+    task_format = '<I{}sBbHI{}I3I{}I'.format(name_len, num_cores, num_buckets)
+    task_size = struct.calcsize(task_format)
+    if len(record) < offset + task_size * num_tasks:
+        raise FormatError('Record truncated, {} tasks announced'.format(num_tasks))
+
+    tasks = []
+    for _ in range(num_tasks):
+        fields = struct.unpack_from(task_format, record, offset)
+        offset += task_size
+        handle, name, priority, core_id, _, stack = fields[:6]
+        run_time = list(fields[6:6 + num_cores])
+        switches, preemptions, latency_max = fields[6 + num_cores:9 + num_cores]
+        tasks.append({
+            'handle': handle,
+            'name': name.split(b'\0', 1)[0].decode('utf-8', 'replace'),
+            'priority': priority,
+            'core_id': core_id,
+            'stack_high_water': stack,
+            'run_time_us': run_time,
+            'switches': switches,
+            'preemptions': preemptions,
+            'latency_max_us': latency_max,
+            'latency_hist': list(fields[9 + num_cores:]),
+        })
+
+    return {
+        'duration_us': duration,
+        'num_cores': num_cores,
+        'untracked_run_time_us': untracked,
+        'tasks': tasks,
+    }
+
+
+def parse_log(log: TextIO) -> List[Dict[str, Any]]:
+    # The record may be preceded by a log prefix or terminal escape sequences
+    pattern = re.compile(re.escape(RAW_PREFIX) + r'([0-9a-fA-F]+)')
+    windows = []
+    for line in log:
+        match = pattern.search(line)
+        if match:
+            windows.append(decode(bytes.fromhex(match.group(1))))
+    return windows
+
+
+def cpu_percent(run_time_us: int, duration_us: int) -> float:
+    return 100.0 * run_time_us / duration_us if duration_us else 0.0
+
+
+def print_table(window: Dict[str, Any], out: TextIO) -> None:
+    cores = range(window['num_cores'])
+    duration = window['duration_us']
+    out.write('Window: {} ms\n'.format(duration // 1000))
+    out.write('{:<16} {:>4} {:>4}'.format('Task', 'Core', 'Prio'))
+    out.write(''.join(' {:>6}'.format('CPU{}%'.format(core)) for core in cores))
+    out.write(' {:>8} {:>8} {:>8} {:>8} {:>8} {:>6}\n'.format('Switches', 'Preempt', 'p50 us', 'p99 us', 'max us',
+                                                               'Stack'))
+    for task in window['tasks']:
+        core = '*' if task['core_id'] == NO_AFFINITY else str(task['core_id'])
+        out.write('{:<16} {:>4} {:>4}'.format(task['name'], core, task['priority']))
+        out.write(''.join(' {:>6.1f}'.format(cpu_percent(task['run_time_us'][c], duration)) for c in cores))
+        out.write(' {:>8} {:>8} {:>8} {:>8} {:>8} {:>6}\n'.format(task['switches'], task['preemptions'],
+                                                                   latency_percentile(task, 50),
+                                                                   latency_percentile(task, 99),
+                                                                   task['latency_max_us'], task['stack_high_water']))
+    out.write('{:<16} {:>4} {:>4}'.format('(untracked)', '', ''))
+    out.write(''.join(' {:>6.1f}'.format(cpu_percent(window['untracked_run_time_us'][c], duration)) for c in cores))
+    out.write('\n\n')
+
+
+def write_csv(windows: List[Dict[str, Any]], out: TextIO) -> None:
+    if not windows:
+        return
+    num_cores = windows[0]['num_cores']
+    num_buckets = len(windows[0]['tasks'][0]['latency_hist']) if windows[0]['tasks'] else 0
+    writer = csv.writer(out)
+    writer.writerow(['window', 'duration_us', 'task', 'handle', 'core', 'priority'] +
+                    ['run_time_us_cpu{}'.format(core) for core in range(num_cores)] +
+                    ['switches', 'preemptions', 'latency_p50_us', 'latency_p99_us', 'latency_max_us',
+                     'stack_high_water'] +
+                    ['latency_hist_{}'.format(bucket) for bucket in range(num_buckets)])
+    for index, window in enumerate(windows):
+        for task in window['tasks']:
+            writer.writerow([index, window['duration_us'], task['name'], '0x{:08x}'.format(task['handle']),
+                             task['core_id'], task['priority']] + task['run_time_us'] +
+                            [task['switches'], task['preemptions'], latency_percentile(task, 50),
+                             latency_percentile(task, 99), task['latency_max_us'], task['stack_high_water']] +
+                            task['latency_hist'])
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='Decode the scheduler profiler output of `schedprof --raw`')
+    parser.add_argument('input', nargs='?', type=argparse.FileType('r'), default=sys.stdin,
+                        help='Log file containing "{}" lines, stdin by default'.format(RAW_PREFIX))
+    parser.add_argument('--csv', action='store_true', help='Print CSV instead of tables')
+    parser.add_argument('--version', action='version', version='%(prog)s ' + __version__)
+    args = parser.parse_args()
+
+    try:
+        windows = parse_log(args.input)
+    except (FormatError, ValueError) as e:
+        sys.exit('Failed to decode the profiler output: {}'.format(e))
+
+    if args.csv:
+        write_csv(windows, sys.stdout)
+    else:
+        for window in windows:
+            print_table(window, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,385 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_sched_prof.h"
+
+#define TEST_MAX_STATS      (CONFIG_ESP_SCHED_PROF_MAX_TASKS + 1)
+#define TEST_WINDOW_MS      200
+#define TEST_BUSY_PRIO      3
+#define PING_PONG_ROUNDS    1000
+#define TEST_STACK_SIZE     (configMINIMAL_STACK_SIZE + 1024)
+
+static esp_sched_prof_window_t s_window;
+static esp_sched_prof_task_stats_t s_stats[TEST_MAX_STATS];
+static volatile bool s_stop;
+static SemaphoreHandle_t s_done;
+static UBaseType_t s_test_prio;
+
+static void test_begin(void)
+{
+    // The test task must preempt the tasks it profiles
+    s_test_prio = uxTaskPriorityGet(NULL);
+    vTaskPrioritySet(NULL, configMAX_PRIORITIES - 1);
+    s_done = xSemaphoreCreateCounting(CONFIG_ESP_SCHED_PROF_MAX_TASKS + 2, 0);
+    TEST_ASSERT_NOT_NULL(s_done);
+    s_stop = false;
+}
+
+static void test_end(int num_tasks)
+{
+    s_stop = true;
+    for (int i = 0; i < num_tasks; i++) {
+        TEST_ASSERT_TRUE(xSemaphoreTake(s_done, pdMS_TO_TICKS(1000)));
+    }
+    vSemaphoreDelete(s_done);
+    vTaskPrioritySet(NULL, s_test_prio);
+    // Let the idle task free the deleted tasks
+    vTaskDelay(10);
+}
+
+static void busy_task(void *arg)
+{
+    while (!s_stop) {
+    }
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+static void blocked_task(void *arg)
+{
+    while (!s_stop) {
+        vTaskDelay(1);
+    }
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+static TaskHandle_t create_task(TaskFunction_t func, const char *name, void *arg)
+{
+    TaskHandle_t task;
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(func, name, TEST_STACK_SIZE, arg, TEST_BUSY_PRIO, &task, 0));
+    return task;
+}
+
+static const esp_sched_prof_task_stats_t *find_task(TaskHandle_t task)
+{
+    for (size_t i = 0; i < s_window.num_tasks; i++) {
+        if (s_stats[i].task == task) {
+            return &s_stats[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t latency_count(const esp_sched_prof_task_stats_t *stats)
+{
+    uint32_t count = 0;
+
+    for (int i = 0; i < ESP_SCHED_PROF_LATENCY_BUCKETS; i++) {
+        count += stats->latency_hist[i];
+    }
+    return count;
+}
+
+TEST_CASE("busy task run time matches the window", "[sched_prof]")
+{
+    test_begin();
+    TaskHandle_t busy = create_task(busy_task, "busy", NULL);
+
+    TEST_ESP_OK(esp_sched_prof_measure(TEST_WINDOW_MS, &s_window, s_stats, TEST_MAX_STATS));
+    const esp_sched_prof_task_stats_t *stats = find_task(busy);
+    TEST_ASSERT_NOT_NULL(stats);
+    TEST_ASSERT_EQUAL_STRING("busy", stats->name);
+    TEST_ASSERT_EQUAL(TEST_BUSY_PRIO, stats->priority);
+    TEST_ASSERT_EQUAL(0, stats->core_id);
+    // The busy task only leaves the CPU to the test task and the tick interrupt
+    TEST_ASSERT_GREATER_THAN(s_window.duration_us * 8 / 10, stats->run_time_us[0]);
+    TEST_ASSERT_LESS_OR_EQUAL(s_window.duration_us, stats->run_time_us[0]);
+    TEST_ASSERT_EQUAL_PTR(busy, s_stats[0].task);
+    TEST_ASSERT_GREATER_THAN(0, stats->stack_high_water);
+    test_end(1);
+}
+
+TEST_CASE("equal priority busy tasks preempt each other", "[sched_prof]")
+{
+    test_begin();
+    TaskHandle_t busy[2] = {
+        create_task(busy_task, "busy0", NULL),
+        create_task(busy_task, "busy1", NULL),
+    };
+
+    TEST_ESP_OK(esp_sched_prof_measure(TEST_WINDOW_MS, &s_window, s_stats, TEST_MAX_STATS));
+    uint32_t ticks = pdMS_TO_TICKS(TEST_WINDOW_MS);
+    uint32_t run_time = 0;
+    for (int i = 0; i < 2; i++) {
+        const esp_sched_prof_task_stats_t *stats = find_task(busy[i]);
+        TEST_ASSERT_NOT_NULL(stats);
+        // Time slicing switches the tasks on every tick
+        TEST_ASSERT_GREATER_THAN(ticks / 4, stats->preemptions);
+        TEST_ASSERT_GREATER_OR_EQUAL(stats->preemptions - 1, stats->switches);
+        run_time += stats->run_time_us[0];
+    }
+    TEST_ASSERT_GREATER_THAN(s_window.duration_us * 8 / 10, run_time);
+    test_end(2);
+}
+
+static SemaphoreHandle_t s_ping;
+static SemaphoreHandle_t s_pong;
+
+static void ping_task(void *arg)
+{
+    for (int i = 0; i < PING_PONG_ROUNDS; i++) {
+        xSemaphoreGive(s_ping);
+        xSemaphoreTake(s_pong, portMAX_DELAY);
+    }
+    xSemaphoreGive(s_done);
+    // Deleted by the test once its statistics are checked
+    vTaskSuspend(NULL);
+}
+
+static void pong_task(void *arg)
+{
+    for (int i = 0; i < PING_PONG_ROUNDS; i++) {
+        xSemaphoreTake(s_ping, portMAX_DELAY);
+        xSemaphoreGive(s_pong);
+    }
+    xSemaphoreGive(s_done);
+    vTaskSuspend(NULL);
+}
+
+TEST_CASE("semaphore ping pong counts switches and wakeups", "[sched_prof]")
+{
+    esp_sched_prof_sample_t *start;
+    esp_sched_prof_sample_t *end;
+    TaskHandle_t ping;
+    TaskHandle_t pong;
+
+    test_begin();
+    s_ping = xSemaphoreCreateBinary();
+    s_pong = xSemaphoreCreateBinary();
+    TEST_ESP_OK(esp_sched_prof_sample_create(&start));
+    TEST_ESP_OK(esp_sched_prof_sample_create(&end));
+
+    TEST_ESP_OK(esp_sched_prof_sample_take(start));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(ping_task, "ping", TEST_STACK_SIZE, NULL, TEST_BUSY_PRIO,
+                                                      &ping, 0));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(pong_task, "pong", TEST_STACK_SIZE, NULL, TEST_BUSY_PRIO,
+                                                      &pong, CONFIG_FREERTOS_NUMBER_OF_CORES - 1));
+    TEST_ASSERT_TRUE(xSemaphoreTake(s_done, pdMS_TO_TICKS(5000)));
+    TEST_ASSERT_TRUE(xSemaphoreTake(s_done, pdMS_TO_TICKS(5000)));
+    TEST_ESP_OK(esp_sched_prof_sample_take(end));
+    TEST_ESP_OK(esp_sched_prof_get_window(start, end, &s_window, s_stats, TEST_MAX_STATS));
+
+    for (int i = 0; i < 2; i++) {
+        const esp_sched_prof_task_stats_t *stats = find_task(i == 0 ? ping : pong);
+        TEST_ASSERT_NOT_NULL(stats);
+        // Each task blocks once per round and is woken up by the other one
+        TEST_ASSERT_GREATER_OR_EQUAL(PING_PONG_ROUNDS, stats->switches);
+        TEST_ASSERT_GREATER_OR_EQUAL(PING_PONG_ROUNDS, latency_count(stats));
+        TEST_ASSERT_LESS_OR_EQUAL(stats->latency_max_us, esp_sched_prof_latency_percentile(stats, 99));
+    }
+
+    vTaskDelete(ping);
+    vTaskDelete(pong);
+    esp_sched_prof_sample_delete(start);
+    esp_sched_prof_sample_delete(end);
+    test_end(0);
+    vSemaphoreDelete(s_ping);
+    vSemaphoreDelete(s_pong);
+}
+
+TEST_CASE("task created during the window is counted from its creation", "[sched_prof]")
+{
+    esp_sched_prof_sample_t *start;
+    esp_sched_prof_sample_t *end;
+
+    test_begin();
+    TEST_ESP_OK(esp_sched_prof_sample_create(&start));
+    TEST_ESP_OK(esp_sched_prof_sample_create(&end));
+    TEST_ESP_OK(esp_sched_prof_sample_take(start));
+    TaskHandle_t busy = create_task(busy_task, "late", NULL);
+    vTaskDelay(pdMS_TO_TICKS(TEST_WINDOW_MS / 2));
+    TEST_ESP_OK(esp_sched_prof_sample_take(end));
+    TEST_ESP_OK(esp_sched_prof_get_window(start, end, &s_window, s_stats, TEST_MAX_STATS));
+
+    const esp_sched_prof_task_stats_t *stats = find_task(busy);
+    TEST_ASSERT_NOT_NULL(stats);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, stats->switches);
+    TEST_ASSERT_GREATER_THAN(s_window.duration_us / 2, stats->run_time_us[0]);
+    TEST_ASSERT_LESS_OR_EQUAL(s_window.duration_us, stats->run_time_us[0]);
+
+    esp_sched_prof_sample_delete(start);
+    esp_sched_prof_sample_delete(end);
+    test_end(1);
+}
+
+TEST_CASE("deleted tasks are not listed", "[sched_prof]")
+{
+    esp_sched_prof_sample_t *start;
+    esp_sched_prof_sample_t *end;
+
+    test_begin();
+    TEST_ESP_OK(esp_sched_prof_sample_create(&start));
+    TEST_ESP_OK(esp_sched_prof_sample_create(&end));
+    TaskHandle_t task = create_task(blocked_task, "gone", NULL);
+    TEST_ESP_OK(esp_sched_prof_sample_take(start));
+    test_end(1);
+    TEST_ESP_OK(esp_sched_prof_sample_take(end));
+    TEST_ESP_OK(esp_sched_prof_get_window(start, end, &s_window, s_stats, TEST_MAX_STATS));
+    TEST_ASSERT_NULL(find_task(task));
+
+    esp_sched_prof_sample_delete(start);
+    esp_sched_prof_sample_delete(end);
+}
+
+static void short_task(void *arg)
+{
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("slots are reused after tasks are deleted", "[sched_prof]")
+{
+    test_begin();
+    // Churn through more tasks than there are slots
+    for (int i = 0; i < 4 * CONFIG_ESP_SCHED_PROF_MAX_TASKS; i++) {
+        create_task(short_task, "short", NULL);
+        TEST_ASSERT_TRUE(xSemaphoreTake(s_done, pdMS_TO_TICKS(1000)));
+        vTaskDelay(1);
+    }
+
+    TaskHandle_t busy = create_task(busy_task, "busy", NULL);
+    TEST_ESP_OK(esp_sched_prof_measure(TEST_WINDOW_MS / 2, &s_window, s_stats, TEST_MAX_STATS));
+    TEST_ASSERT_NOT_NULL(find_task(busy));
+    TEST_ASSERT_EQUAL(0, s_window.untracked_run_time_us[0]);
+    test_end(1);
+}
+
+TEST_CASE("tasks without a slot are accounted as untracked", "[sched_prof]")
+{
+    TaskHandle_t busy;
+    int num_tasks = 0;
+
+    test_begin();
+    // Take all free slots with blocked tasks, the busy task doesn't get a slot anymore
+    for (int i = 0; i < CONFIG_ESP_SCHED_PROF_MAX_TASKS; i++) {
+        create_task(blocked_task, "blocked", NULL);
+        num_tasks++;
+    }
+    busy = create_task(busy_task, "busy", NULL);
+    num_tasks++;
+
+    TEST_ESP_OK(esp_sched_prof_measure(TEST_WINDOW_MS / 2, &s_window, s_stats, TEST_MAX_STATS));
+    TEST_ASSERT_NULL(find_task(busy));
+    TEST_ASSERT_GREATER_THAN(s_window.duration_us / 2, s_window.untracked_run_time_us[0]);
+    test_end(num_tasks);
+}
+
+TEST_CASE("small stats array keeps the busiest tasks", "[sched_prof]")
+{
+    test_begin();
+    create_task(busy_task, "busy", NULL);
+    TEST_ESP_OK(esp_sched_prof_measure(TEST_WINDOW_MS / 2, &s_window, s_stats, 1));
+    TEST_ASSERT_EQUAL(1, s_window.num_tasks);
+    TEST_ASSERT_GREATER_THAN(0, s_window.num_tasks_dropped);
+    // The busy task, or the idle task of another core which runs just as long
+    uint32_t run_time = 0;
+    for (int core = 0; core < CONFIG_FREERTOS_NUMBER_OF_CORES; core++) {
+        run_time += s_stats[0].run_time_us[core];
+    }
+    TEST_ASSERT_GREATER_THAN(s_window.duration_us * 8 / 10, run_time);
+
+    TEST_ESP_OK(esp_sched_prof_measure(TEST_WINDOW_MS / 2, &s_window, NULL, 0));
+    TEST_ASSERT_EQUAL(0, s_window.num_tasks);
+    TEST_ASSERT_GREATER_THAN(0, s_window.num_tasks_dropped);
+    test_end(1);
+}
+
+TEST_CASE("latency percentiles are bounded by the histogram buckets", "[sched_prof]")
+{
+    esp_sched_prof_task_stats_t stats = { 0 };
+
+    TEST_ASSERT_EQUAL(0, esp_sched_prof_latency_percentile(&stats, 50));
+
+    stats.latency_hist[3] = 90;     // 4 to 7 us
+    stats.latency_hist[7] = 9;      // 64 to 127 us
+    stats.latency_hist[10] = 1;     // 512 to 1023 us
+    stats.latency_max_us = 600;
+    TEST_ASSERT_EQUAL(7, esp_sched_prof_latency_percentile(&stats, 0));
+    TEST_ASSERT_EQUAL(7, esp_sched_prof_latency_percentile(&stats, 50));
+    TEST_ASSERT_EQUAL(7, esp_sched_prof_latency_percentile(&stats, 90));
+    TEST_ASSERT_EQUAL(127, esp_sched_prof_latency_percentile(&stats, 99));
+    TEST_ASSERT_EQUAL(600, esp_sched_prof_latency_percentile(&stats, 100));
+    TEST_ASSERT_EQUAL(600, esp_sched_prof_latency_percentile(&stats, 1000));
+
+    // The last bucket has no upper bound
+    stats.latency_hist[ESP_SCHED_PROF_LATENCY_BUCKETS - 1] = 100;
+    stats.latency_max_us = 50000;
+    TEST_ASSERT_EQUAL(50000, esp_sched_prof_latency_percentile(&stats, 99));
+}
+
+TEST_CASE("encoded record layout", "[sched_prof]")
+{
+    esp_sched_prof_window_t window = {
+        .duration_us = 1000000,
+        .num_tasks = 2,
+    };
+    esp_sched_prof_task_stats_t stats[2] = {
+        { .name = "first", .priority = 5, .core_id = 0, .switches = 10, .stack_high_water = 1024 },
+        { .name = "second", .priority = 1, .core_id = tskNO_AFFINITY, .preemptions = 3 },
+    };
+    const size_t num_cores = CONFIG_FREERTOS_NUMBER_OF_CORES;
+    const size_t header_size = 16 + 4 * num_cores;
+    const size_t task_size = 12 + configMAX_TASK_NAME_LEN + 4 * num_cores + 12 + 4 * ESP_SCHED_PROF_LATENCY_BUCKETS;
+    size_t size = esp_sched_prof_encode(&window, stats, NULL, 0);
+
+    TEST_ASSERT_EQUAL(header_size + 2 * task_size, size);
+    uint8_t *buf = calloc(1, size);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL(size, esp_sched_prof_encode(&window, stats, buf, size - 1));
+    TEST_ASSERT_EACH_EQUAL_UINT8(0, buf, size);
+    TEST_ASSERT_EQUAL(size, esp_sched_prof_encode(&window, stats, buf, size));
+
+    TEST_ASSERT_EQUAL_MEMORY("SPRF", buf, 4);
+    TEST_ASSERT_EQUAL(1, buf[4]);
+    TEST_ASSERT_EQUAL(num_cores, buf[5]);
+    TEST_ASSERT_EQUAL(ESP_SCHED_PROF_LATENCY_BUCKETS, buf[6]);
+    TEST_ASSERT_EQUAL(configMAX_TASK_NAME_LEN, buf[7]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(((uint8_t[]) { 0x40, 0x42, 0x0F, 0x00, 0x02, 0x00 }), &buf[8], 6);
+
+    const uint8_t *task = &buf[header_size];
+    TEST_ASSERT_EQUAL_STRING("first", (const char *)&task[4]);
+    TEST_ASSERT_EQUAL(5, task[4 + configMAX_TASK_NAME_LEN]);
+    TEST_ASSERT_EQUAL(0, task[5 + configMAX_TASK_NAME_LEN]);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(((uint8_t[]) { 0x00, 0x04, 0x00, 0x00 }), &task[8 + configMAX_TASK_NAME_LEN], 4);
+    TEST_ASSERT_EQUAL(10, task[12 + configMAX_TASK_NAME_LEN + 4 * num_cores]);
+    task += task_size;
+    TEST_ASSERT_EQUAL_STRING("second", (const char *)&task[4]);
+    TEST_ASSERT_EQUAL(0xFF, task[5 + configMAX_TASK_NAME_LEN]);
+    TEST_ASSERT_EQUAL(3, task[16 + configMAX_TASK_NAME_LEN + 4 * num_cores]);
+    free(buf);
+}
+
+TEST_CASE("invalid arguments are rejected", "[sched_prof]")
+{
+    esp_sched_prof_sample_t *sample;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_sched_prof_sample_create(NULL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_sched_prof_sample_take(NULL));
+    TEST_ESP_OK(esp_sched_prof_sample_create(&sample));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_sched_prof_get_window(sample, NULL, &s_window, s_stats, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_sched_prof_get_window(sample, sample, NULL, s_stats, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_sched_prof_get_window(sample, sample, &s_window, NULL, 1));
+    esp_sched_prof_sample_delete(sample);
+    esp_sched_prof_sample_delete(NULL);
+}
@@ -0,0 +1,20 @@
+# SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+# SPDX-License-Identifier: CC0-1.0
+
+import pytest
+from pytest_embedded import Dut
+
+
+@pytest.mark.esp32
+@pytest.mark.esp32c3
+@pytest.mark.generic
+def test_esp_sched_prof(dut: Dut) -> None:
+    dut.run_all_single_board_cases()
+
+
+@pytest.mark.linux
+@pytest.mark.host_test
+def test_esp_sched_prof_linux(dut: Dut) -> None:
+    dut.expect_exact('Press ENTER to see the list of tests.')
+    dut.write('*')
+    dut.expect(r'\d{2} Tests 0 Failures 0 Ignored', timeout=120)
@@ -26,25 +26,99 @@
 #define IPC_STACK_SIZE (CONFIG_ESP_IPC_TASK_STACK_SIZE)
 #endif //CONFIG_COMPILER_OPTIMIZATION_NONE
 
+static TaskHandle_t s_ipc_task_handle[CONFIG_FREERTOS_NUMBER_OF_CORES];
+typedef enum {
+    IPC_WAIT_NO = 0,
+    IPC_WAIT_FOR_START,
+    IPC_WAIT_FOR_END,
+} esp_ipc_wait_t;
+
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+/*
+ * Each core has a bounded multi-producer single-consumer queue of calls. Producers claim a cell by advancing
+ * enqueue_pos with a compare-and-swap, and publish it by setting the sequence number of the cell. Only the IPC task
+ * of the core consumes the queue, so dequeue_pos isn't shared.
+ */
+#define IPC_QUEUE_LEN (1U << (32 - __builtin_clz(CONFIG_ESP_IPC_QUEUE_LEN - 1)))   // Rounded up to a power of 2
+
+typedef struct {
+    esp_ipc_func_t func;
+    void *arg;
+    SemaphoreHandle_t ack;          // Given when the call starts or ends, NULL for non-blocking calls
+    esp_ipc_wait_t wait_for;
+} ipc_call_t;
+
+typedef struct {
+    uint32_t seq;                   // Position the cell can be written at, or position + 1 once it was written
+    ipc_call_t call;
+} ipc_cell_t;
+
+typedef struct {
+    uint32_t enqueue_pos;
+    uint32_t dequeue_pos;
+    ipc_cell_t cells[IPC_QUEUE_LEN];
+} ipc_queue_t;
+
+static DRAM_ATTR ipc_queue_t s_ipc_queue[CONFIG_FREERTOS_NUMBER_OF_CORES];
+#else
 static DRAM_ATTR StaticSemaphore_t s_ipc_mutex_buffer[CONFIG_FREERTOS_NUMBER_OF_CORES];
 static DRAM_ATTR StaticSemaphore_t s_ipc_ack_buffer[CONFIG_FREERTOS_NUMBER_OF_CORES];
 
-static TaskHandle_t s_ipc_task_handle[CONFIG_FREERTOS_NUMBER_OF_CORES];
 static SemaphoreHandle_t s_ipc_mutex[CONFIG_FREERTOS_NUMBER_OF_CORES];    // This mutex is used as a global lock for esp_ipc_* APIs
 static SemaphoreHandle_t s_ipc_ack[CONFIG_FREERTOS_NUMBER_OF_CORES];      // Semaphore used to acknowledge that task was woken up,
 static volatile esp_ipc_func_t s_func[CONFIG_FREERTOS_NUMBER_OF_CORES] = { 0 };   // Function which should be called by high priority task
 static void * volatile s_func_arg[CONFIG_FREERTOS_NUMBER_OF_CORES];       // Argument to pass into s_func
-typedef enum {
-    IPC_WAIT_NO = 0,
-    IPC_WAIT_FOR_START,
-    IPC_WAIT_FOR_END,
-} esp_ipc_wait_t;
+#endif // CONFIG_ESP_IPC_QUEUED_CALLS
 
 #if CONFIG_APPTRACE_GCOV_ENABLE
 static volatile esp_ipc_func_t s_gcov_func = NULL;           // Gcov dump starter function which should be called by high priority task
 static void * volatile s_gcov_func_arg;                      // Argument to pass into s_gcov_func
 #endif
 
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+static bool ipc_queue_push(ipc_queue_t *queue, const ipc_call_t *call)
+{
+    uint32_t pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    ipc_cell_t *cell;
+
+    while (true) {
+        cell = &queue->cells[pos & (IPC_QUEUE_LEN - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            // The cell is free, claim it. On failure, pos is updated to the current enqueue position.
+            if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The cell still holds a call from the previous round, the queue is full
+            return false;
+        } else {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->call = *call;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+FORCE_INLINE_ATTR bool ipc_queue_pop(ipc_queue_t *queue, ipc_call_t *call)
+{
+    uint32_t pos = queue->dequeue_pos;
+    ipc_cell_t *cell = &queue->cells[pos & (IPC_QUEUE_LEN - 1)];
+
+    // A claimed cell which isn't written yet is treated as empty, its producer notifies the IPC task once written
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return false;
+    }
+    *call = cell->call;
+    __atomic_store_n(&cell->seq, pos + IPC_QUEUE_LEN, __ATOMIC_RELEASE);
+    queue->dequeue_pos = pos + 1;
+    return true;
+}
+#endif // CONFIG_ESP_IPC_QUEUED_CALLS
+
 static void IRAM_ATTR ipc_task(void* arg)
 {
     const int cpuid = (int) arg;
@@ -62,15 +136,32 @@ static void IRAM_ATTR ipc_task(void* arg)
         if (s_gcov_func) {
             (*s_gcov_func)(s_gcov_func_arg);
             s_gcov_func = NULL;
+#if !CONFIG_ESP_IPC_QUEUED_CALLS
             /* we can not interfer with IPC calls so no need for further processing */
             // esp_ipc API and gcov_from_isr APIs can be processed together if they came at the same time
             if (ipc_wait == IPC_WAIT_NO) {
                 continue;
             }
+#else
+            // The notification value of a queued call may have been overwritten by the gcov one, so the queue
+            // is always drained below
+#endif
         }
 #endif // CONFIG_APPTRACE_GCOV_ENABLE
 
-#ifndef CONFIG_FREERTOS_UNICORE
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+        // Drain the queue, the calls posted in the meantime notified the task again
+        ipc_call_t call;
+        while (ipc_queue_pop(&s_ipc_queue[cpuid], &call)) {
+            if (call.ack != NULL && call.wait_for == IPC_WAIT_FOR_START) {
+                xSemaphoreGive(call.ack);
+            }
+            (*call.func)(call.arg);
+            if (call.ack != NULL && call.wait_for == IPC_WAIT_FOR_END) {
+                xSemaphoreGive(call.ack);
+            }
+        }
+#elif !defined(CONFIG_FREERTOS_UNICORE)
         if (s_func[cpuid]) {
             // we need to cache s_func, s_func_arg and ipc_ack variables locally
             // because they can be changed by a subsequent IPC call (after xTaskNotify(caller_task_handle)).
@@ -89,7 +180,7 @@ static void IRAM_ATTR ipc_task(void* arg)
                 abort();
             }
         }
-#endif // !CONFIG_FREERTOS_UNICORE
+#endif // CONFIG_ESP_IPC_QUEUED_CALLS
     }
     // TODO: currently this is unreachable code. Introduce esp_ipc_uninit
     // function which will signal to both tasks that they can shut down.
@@ -117,8 +208,14 @@ static void esp_ipc_init(void)
 
     for (int i = 0; i < CONFIG_FREERTOS_NUMBER_OF_CORES; ++i) {
         task_name[3] = i + (char)'0';
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+        for (uint32_t pos = 0; pos < IPC_QUEUE_LEN; pos++) {
+            s_ipc_queue[i].cells[pos].seq = pos;
+        }
+#else
         s_ipc_mutex[i] = xSemaphoreCreateMutexStatic(&s_ipc_mutex_buffer[i]);
         s_ipc_ack[i] = xSemaphoreCreateBinaryStatic(&s_ipc_ack_buffer[i]);
+#endif
         BaseType_t res = xTaskCreatePinnedToCore(ipc_task, task_name, IPC_STACK_SIZE, (void*) i,
                                                  configMAX_PRIORITIES - 1, &s_ipc_task_handle[i], i);
         assert(res == pdTRUE);
@@ -126,7 +223,7 @@ static void esp_ipc_init(void)
     }
 }
 
-static esp_err_t esp_ipc_call_and_wait(uint32_t cpu_id, esp_ipc_func_t func, void* arg, esp_ipc_wait_t wait_for)
+static esp_err_t esp_ipc_check_call(uint32_t cpu_id)
 {
     if (cpu_id >= CONFIG_FREERTOS_NUMBER_OF_CORES) {
         return ESP_ERR_INVALID_ARG;
@@ -137,6 +234,64 @@ static esp_err_t esp_ipc_call_and_wait(uint32_t cpu_id, esp_ipc_func_t func, voi
     if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
         return ESP_ERR_INVALID_STATE;
     }
+    return ESP_OK;
+}
+
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+static esp_err_t esp_ipc_call_and_wait(uint32_t cpu_id, esp_ipc_func_t func, void* arg, esp_ipc_wait_t wait_for)
+{
+    esp_err_t ret = esp_ipc_check_call(cpu_id);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // The caller waits on its own semaphore, so blocking calls from several tasks don't serialize on a mutex
+    StaticSemaphore_t ack_buffer;
+    ipc_call_t call = {
+        .func = func,
+        .arg = arg,
+        .ack = xSemaphoreCreateBinaryStatic(&ack_buffer),
+        .wait_for = wait_for,
+    };
+
+    // The IPC task runs at the highest priority, so a full queue is drained within a tick
+    while (!ipc_queue_push(&s_ipc_queue[cpu_id], &call)) {
+        vTaskDelay(1);
+    }
+    xTaskNotifyGive(s_ipc_task_handle[cpu_id]);
+    xSemaphoreTake(call.ack, portMAX_DELAY);
+    vSemaphoreDelete(call.ack);
+    return ESP_OK;
+}
+
+esp_err_t esp_ipc_call_nonblocking(uint32_t cpu_id, esp_ipc_func_t func, void* arg)
+{
+    const ipc_call_t call = {
+        .func = func,
+        .arg = arg,
+        .ack = NULL,
+        .wait_for = IPC_WAIT_NO,
+    };
+    esp_err_t ret = esp_ipc_check_call(cpu_id);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (!ipc_queue_push(&s_ipc_queue[cpu_id], &call)) {
+        return ESP_FAIL;
+    }
+    xTaskNotifyGive(s_ipc_task_handle[cpu_id]);
+    return ESP_OK;
+}
+#else
+static esp_err_t esp_ipc_call_and_wait(uint32_t cpu_id, esp_ipc_func_t func, void* arg, esp_ipc_wait_t wait_for)
+{
+    esp_err_t ret = esp_ipc_check_call(cpu_id);
+
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
 #ifdef CONFIG_ESP_IPC_USES_CALLERS_PRIORITY
     TaskHandle_t task_handler = xTaskGetCurrentTaskHandle();
@@ -164,6 +319,7 @@ static esp_err_t esp_ipc_call_and_wait(uint32_t cpu_id, esp_ipc_func_t func, voi
 #endif
     return ESP_OK;
 }
+#endif // CONFIG_ESP_IPC_QUEUED_CALLS
 
 esp_err_t esp_ipc_call(uint32_t cpu_id, esp_ipc_func_t func, void* arg)
 {
@@ -1,11 +1,12 @@
 /*
- * SPDX-FileCopyrightText: 2015-2021 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #pragma once
 
+#include "sdkconfig.h"
 #include <esp_err.h>
 
 #ifdef __cplusplus
@@ -36,7 +37,9 @@ typedef void (*esp_ipc_func_t)(void* arg);
  * the context of the target CPU's IPC task.
  *
  * - This function will block the target CPU's IPC task has begun execution of the callback
- * - If another IPC call is ongoing, this function will block until the ongoing IPC call completes
+ * - If another IPC call is ongoing, this function will block until the ongoing IPC call completes. If
+ *   CONFIG_ESP_IPC_QUEUED_CALLS is enabled, the callback is queued instead and runs after the ongoing and queued
+ *   callbacks of the target CPU.
  * - The stack size of the IPC task can be configured via the CONFIG_ESP_IPC_TASK_STACK_SIZE option
  *
  * @note In single-core mode, returns ESP_ERR_INVALID_ARG for cpu_id 1.
@@ -71,6 +74,28 @@ esp_err_t esp_ipc_call(uint32_t cpu_id, esp_ipc_func_t func, void* arg);
  */
 esp_err_t esp_ipc_call_blocking(uint32_t cpu_id, esp_ipc_func_t func, void* arg);
 
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+/**
+ * @brief Queue a callback for execution on a given CPU without waiting
+ *
+ * The callback is added to the IPC call queue of the target CPU and executed in the context of its IPC task after the
+ * callbacks queued before. This function doesn't block, so the argument must stay valid until the callback has run.
+ *
+ * @note This function is only available if CONFIG_ESP_IPC_QUEUED_CALLS is enabled, and must not be called from an ISR.
+ *
+ * @param[in]   cpu_id  CPU where the given function should be executed (0 or 1)
+ * @param[in]   func    Pointer to a function of type void func(void* arg) to be executed
+ * @param[in]   arg     Arbitrary argument of type void* to be passed into the function
+ *
+ * @return
+ *      - ESP_ERR_INVALID_ARG if cpu_id is invalid
+ *      - ESP_ERR_INVALID_STATE if the FreeRTOS scheduler is not running
+ *      - ESP_FAIL if the IPC call queue of the target CPU is full (see CONFIG_ESP_IPC_QUEUE_LEN)
+ *      - ESP_OK otherwise
+ */
+esp_err_t esp_ipc_call_nonblocking(uint32_t cpu_id, esp_ipc_func_t func, void* arg);
+#endif // CONFIG_ESP_IPC_QUEUED_CALLS
+
 #endif // !defined(CONFIG_FREERTOS_UNICORE) || defined(CONFIG_APPTRACE_GCOV_ENABLE)
 
 #ifdef __cplusplus
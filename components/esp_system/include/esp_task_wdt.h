@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -29,6 +29,18 @@ typedef struct {
  */
 typedef struct esp_task_wdt_user_handle_s * esp_task_wdt_user_handle_t;
 
+/**
+ * @brief Feed interval statistics of a task or user subscribed to the Task Watchdog Timer (TWDT)
+ *
+ * Intervals are measured from the previous reset, or from the subscription for the first reset.
+ */
+typedef struct {
+    uint32_t feed_count;            /**< Number of times the TWDT was reset on behalf of the task/user */
+    uint32_t last_interval_us;      /**< Interval before the last reset, in microseconds */
+    uint32_t max_interval_us;       /**< Longest interval between two resets, in microseconds */
+    uint32_t since_last_feed_us;    /**< Time elapsed since the last reset, in microseconds */
+} esp_task_wdt_feed_stats_t;
+
 /**
  * @brief  Initialize the Task Watchdog Timer (TWDT)
  *
@@ -169,6 +181,41 @@ esp_err_t esp_task_wdt_delete_user(esp_task_wdt_user_handle_t user_handle);
  */
 esp_err_t esp_task_wdt_status(TaskHandle_t task_handle);
 
+/**
+ * @brief Get the feed interval statistics of a task subscribed to the Task Watchdog Timer (TWDT)
+ *
+ * Comparing the longest interval between two resets to the TWDT timeout shows how close a task came to triggering
+ * the TWDT.
+ *
+ * @note The statistics are only recorded if CONFIG_ESP_TASK_WDT_FEED_STATS is enabled.
+ *
+ * @param[in] task_handle Handle of the task. Input NULL to query the current running task.
+ * @param[out] stats Statistics of the task
+ * @return
+ *  - ESP_OK: Statistics retrieved
+ *  - ESP_ERR_INVALID_ARG: stats is NULL
+ *  - ESP_ERR_NOT_FOUND: The task is not subscribed
+ *  - ESP_ERR_INVALID_STATE: TWDT was never initialized
+ *  - ESP_ERR_NOT_SUPPORTED: CONFIG_ESP_TASK_WDT_FEED_STATS is disabled
+ */
+esp_err_t esp_task_wdt_get_feed_stats(TaskHandle_t task_handle, esp_task_wdt_feed_stats_t *stats);
+
+/**
+ * @brief Get the feed interval statistics of a user subscribed to the Task Watchdog Timer (TWDT)
+ *
+ * @note The statistics are only recorded if CONFIG_ESP_TASK_WDT_FEED_STATS is enabled.
+ *
+ * @param[in] user_handle User handle
+ * @param[out] stats Statistics of the user
+ * @return
+ *  - ESP_OK: Statistics retrieved
+ *  - ESP_ERR_INVALID_ARG: Invalid arguments
+ *  - ESP_ERR_NOT_FOUND: The user is not subscribed
+ *  - ESP_ERR_INVALID_STATE: TWDT was never initialized
+ *  - ESP_ERR_NOT_SUPPORTED: CONFIG_ESP_TASK_WDT_FEED_STATS is disabled
+ */
+esp_err_t esp_task_wdt_get_user_feed_stats(esp_task_wdt_user_handle_t user_handle, esp_task_wdt_feed_stats_t *stats);
+
 /**
  * @brief User ISR callback placeholder
  *
@@ -19,6 +19,7 @@
 #include "esp_log.h"
 #include "esp_debug_helpers.h"
 #include "esp_freertos_hooks.h"
+#include "esp_timer.h"
 #include "esp_task_wdt.h"
 #include "esp_private/system_internal.h"
 #include "esp_private/crosscore_int.h"
@@ -57,27 +58,49 @@ bool g_twdt_isr = false;
 
 // ---------------------- Typedefs -------------------------
 
+/*
+ * Resetting the TWDT must not depend on the number of subscribed tasks/users, as it is done in a critical section:
+ *
+ * - Entries are found through a hash table, indexed by the task handle for task entries and by the entry itself
+ *   (i.e., the user handle) for user entries.
+ * - Instead of clearing a flag in every entry when the timer is fed, feeding the timer starts a new epoch. An entry
+ *   has been reset if its reset_epoch is the current epoch, and num_pending counts the entries which have not.
+ */
+
 /**
  * @brief Structure used for each subscribed task
  */
 typedef struct twdt_entry twdt_entry_t;
 struct twdt_entry {
-    SLIST_ENTRY(twdt_entry) slist_entry;
+    LIST_ENTRY(twdt_entry) list_entry;
     TaskHandle_t task_handle;   // NULL if user entry
     const char *user_name;      // NULL if task entry
-    bool has_reset;
+    uint32_t reset_epoch;       // Epoch in which the entry was last reset
+#if CONFIG_ESP_TASK_WDT_FEED_STATS
+    int64_t last_feed_us;       // Time of the last reset, or of the subscription
+    uint32_t feed_count;
+    uint32_t last_interval_us;
+    uint32_t max_interval_us;
+#endif // CONFIG_ESP_TASK_WDT_FEED_STATS
 };
 
 // Structure used to hold run time configuration of the TWDT
 typedef struct twdt_obj twdt_obj_t;
 struct twdt_obj {
     twdt_ctx_t impl_ctx;
-    SLIST_HEAD(entry_list_head, twdt_entry) entries_slist;
+    LIST_HEAD(entry_list_head, twdt_entry) entries_list;
+    twdt_entry_t **entries_table;   // Hash table of the entries, with linear probing
+    size_t table_size;              // Number of slots of the hash table, a power of 2
+    size_t num_entries;             // Number of subscribed tasks/users
+    size_t num_pending;             // Number of entries which have not been reset in the current epoch
+    uint32_t epoch;                 // Incremented every time the timer is fed
     uint32_t idle_core_mask;    // Current core's who's idle tasks are subscribed
     bool panic; // Flag to trigger panic when TWDT times out
     bool waiting_for_task; // Flag to start the timer as soon as a task is added
 };
 
+#define ENTRIES_TABLE_MIN_SIZE  16
+
 // ----------------------- Objects -------------------------
 
 static const char *TAG = "task_wdt";
@@ -95,68 +118,151 @@ static char core_user_names[CONFIG_FREERTOS_NUMBER_OF_CORES][CORE_USER_NAME_LEN]
 // ----------------------- Helpers -------------------------
 
 /**
- * @brief Reset the timer and reset flags of each entry
+ * @brief Reset the timer and start a new epoch, in which no entry has been reset yet
  * When entering this function, the spinlock has already been taken, no need to take it back.
  */
 static void task_wdt_timer_feed(void)
 {
     esp_task_wdt_impl_timer_feed(p_twdt_obj->impl_ctx);
 
-    /* Clear the has_reset flag in each entry */
-    twdt_entry_t *entry;
-    SLIST_FOREACH(entry, &p_twdt_obj->entries_slist, slist_entry) {
-        entry->has_reset = false;
+    p_twdt_obj->epoch++;
+    p_twdt_obj->num_pending = p_twdt_obj->num_entries;
+}
+
+static inline bool entry_has_reset(const twdt_entry_t *entry)
+{
+    return entry->reset_epoch == p_twdt_obj->epoch;
+}
+
+/**
+ * @brief Get the key of an entry in the hash table: its task handle, or its own address for user entries
+ */
+static inline const void *entry_key(const twdt_entry_t *entry)
+{
+    return entry->task_handle ? (const void *)entry->task_handle : (const void *)entry;
+}
+
+static inline size_t table_home_slot(const void *key, size_t table_size)
+{
+    // The low bits of task handles and user handles are mostly 0, multiply and fold to spread them
+    uint32_t hash = (uint32_t)(uintptr_t)key * 2654435769U;
+    return (hash ^ (hash >> 16)) & (table_size - 1);
+}
+
+static void table_insert(twdt_entry_t **table, size_t table_size, twdt_entry_t *entry)
+{
+    size_t slot = table_home_slot(entry_key(entry), table_size);
+    while (table[slot] != NULL) {
+        slot = (slot + 1) & (table_size - 1);
+    }
+    table[slot] = entry;
+}
+
+static void table_remove(twdt_entry_t *entry)
+{
+    twdt_entry_t **table = p_twdt_obj->entries_table;
+    const size_t mask = p_twdt_obj->table_size - 1;
+    size_t hole = table_home_slot(entry_key(entry), p_twdt_obj->table_size);
+
+    while (table[hole] != entry) {
+        hole = (hole + 1) & mask;
+    }
+    // Move the following entries of the same cluster into the hole, unless that would place them before their home
+    // slot, so the lookups don't stop early at an empty slot
+    for (size_t slot = (hole + 1) & mask; table[slot] != NULL; slot = (slot + 1) & mask) {
+        size_t home = table_home_slot(entry_key(table[slot]), p_twdt_obj->table_size);
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            table[hole] = table[slot];
+            hole = slot;
+        }
     }
+    table[hole] = NULL;
 }
 
 /**
- * @brief Checks whether a user entry exists and if all other entries have been reset
+ * @brief Find a task/user entry
  *
- * @param[in] user_entry User entry
- * @param[out] all_reset Whether all entries have been reset
- * @return Whether the user entry exists
+ * @param[in] is_task Whether the entry is a task entry or user entry
+ * @param[in] key Task handle or user handle
+ * @return Entry, or NULL if not found
  */
-static bool find_entry_and_check_all_reset(twdt_entry_t *user_entry, bool *all_reset)
+static twdt_entry_t *find_entry(bool is_task, const void *key)
 {
-    bool found_user_entry = false;
-    bool found_non_reset = false;
-
-    twdt_entry_t *entry;
-    SLIST_FOREACH(entry, &p_twdt_obj->entries_slist, slist_entry) {
-        if (entry == user_entry) {
-            found_user_entry = true;
-        } else if (entry->has_reset == false) {
-            found_non_reset = true;
+    if (p_twdt_obj->table_size == 0) {
+        return NULL;
+    }
+    const size_t mask = p_twdt_obj->table_size - 1;
+    for (size_t slot = table_home_slot(key, p_twdt_obj->table_size);
+            p_twdt_obj->entries_table[slot] != NULL;
+            slot = (slot + 1) & mask) {
+        twdt_entry_t *entry = p_twdt_obj->entries_table[slot];
+        if (entry_key(entry) == key) {
+            return ((entry->task_handle != NULL) == is_task) ? entry : NULL;
         }
     }
+    return NULL;
+}
 
-    *all_reset = !found_non_reset;
-    return found_user_entry;
+/**
+ * @brief Get the time used for the feed statistics
+ *
+ * This is called before entering the critical section, esp_timer_get_time() may take a lock itself.
+ */
+static inline int64_t feed_time(void)
+{
+#if CONFIG_ESP_TASK_WDT_FEED_STATS
+    return esp_timer_get_time();
+#else
+    return 0;
+#endif // CONFIG_ESP_TASK_WDT_FEED_STATS
 }
 
+#if CONFIG_ESP_TASK_WDT_FEED_STATS
 /**
- * @brief Find whether a task entry exists, and checks if all other entries have been reset
+ * @brief Get the time between two feed timestamps, saturated to the range of uint32_t
  *
- * @param[in] handle Task handle
- * @param[out] all_reset Whether all entries have been reset
- * @return Task entry, or NULL if not found
+ * The timestamps are taken before entering the critical section, so another task may have stored a later one
+ * in the meantime and the interval may be negative.
  */
-static twdt_entry_t *find_entry_from_task_handle_and_check_all_reset(TaskHandle_t handle, bool *all_reset)
+static inline uint32_t feed_interval(int64_t from, int64_t to)
 {
-    twdt_entry_t *target = NULL;
-    bool found_non_reset = false;
+    int64_t interval = to - from;
+    if (interval < 0) {
+        return 0;
+    }
+    return (interval > UINT32_MAX) ? UINT32_MAX : (uint32_t)interval;
+}
+#endif // CONFIG_ESP_TASK_WDT_FEED_STATS
 
-    twdt_entry_t *entry;
-    SLIST_FOREACH(entry, &p_twdt_obj->entries_slist, slist_entry) {
-        if (entry->task_handle == handle) {
-            target = entry;
-        } else if (entry->has_reset == false) {
-            found_non_reset = true;
-        }
+/**
+ * @brief Mark an entry as reset, and feed the timer if all entries have been reset
+ * When entering this function, the spinlock has already been taken, no need to take it back.
+ *
+ * @param[in] entry Task/user entry
+ * @param[in] now Time of the reset, from feed_time()
+ */
+static void reset_entry(twdt_entry_t *entry, int64_t now)
+{
+#if CONFIG_ESP_TASK_WDT_FEED_STATS
+    entry->last_interval_us = feed_interval(entry->last_feed_us, now);
+    if (entry->last_interval_us > entry->max_interval_us) {
+        entry->max_interval_us = entry->last_interval_us;
+    }
+    if (now > entry->last_feed_us) {
+        entry->last_feed_us = now;
     }
+    entry->feed_count++;
+#else
+    (void) now;
+#endif // CONFIG_ESP_TASK_WDT_FEED_STATS
 
-    *all_reset = !found_non_reset;
-    return target;
+    if (!entry_has_reset(entry)) {
+        entry->reset_epoch = p_twdt_obj->epoch;
+        p_twdt_obj->num_pending--;
+    }
+    if (p_twdt_obj->num_pending == 0) {    // Reset if all other tasks in list have reset in
+        task_wdt_timer_feed();
+    }
 }
 
 /**
@@ -170,6 +276,8 @@ static twdt_entry_t *find_entry_from_task_handle_and_check_all_reset(TaskHandle_
 static esp_err_t add_entry(bool is_task, void *entry_data, twdt_entry_t **entry_ret)
 {
     esp_err_t ret;
+    twdt_entry_t **new_table = NULL;
+    size_t new_table_size = 0;
 
     // Allocate entry object
     twdt_entry_t *entry = calloc(1, sizeof(twdt_entry_t));
@@ -181,21 +289,50 @@ static esp_err_t add_entry(bool is_task, void *entry_data, twdt_entry_t **entry_
     } else {
         entry->user_name = (const char *)entry_data;
     }
+#if CONFIG_ESP_TASK_WDT_FEED_STATS
+    entry->last_feed_us = esp_timer_get_time();
+#endif // CONFIG_ESP_TASK_WDT_FEED_STATS
 
     portENTER_CRITICAL(&spinlock);
     // Check TWDT state
     ESP_GOTO_ON_FALSE_ISR((p_twdt_obj != NULL), ESP_ERR_INVALID_STATE, state_err, TAG, "task watchdog was never initialized");
-    // Check if the task is an entry, and if all entries have been reset
-    bool all_reset;
+    // Check if the task is already an entry
     if (is_task) {
-        twdt_entry_t *entry_found = find_entry_from_task_handle_and_check_all_reset(entry->task_handle, &all_reset);
-        ESP_GOTO_ON_FALSE_ISR((entry_found == NULL), ESP_ERR_INVALID_ARG, state_err, TAG, "task is already subscribed");
-    } else {
-        bool entry_found = find_entry_and_check_all_reset(entry, &all_reset);
-        ESP_GOTO_ON_FALSE_ISR(!entry_found, ESP_ERR_INVALID_ARG, state_err, TAG, "user is already subscribed");
+        ESP_GOTO_ON_FALSE_ISR((find_entry(true, entry->task_handle) == NULL), ESP_ERR_INVALID_ARG, state_err, TAG, "task is already subscribed");
+    }
+    // Keep the hash table at most half full. A larger table is allocated outside of the critical section.
+    while ((p_twdt_obj->num_entries + 1) * 2 > p_twdt_obj->table_size) {
+        if ((p_twdt_obj->num_entries + 1) * 2 <= new_table_size) {
+            twdt_entry_t **old_table = p_twdt_obj->entries_table;
+            for (size_t i = 0; i < p_twdt_obj->table_size; i++) {
+                if (old_table[i] != NULL) {
+                    table_insert(new_table, new_table_size, old_table[i]);
+                }
+            }
+            p_twdt_obj->entries_table = new_table;
+            p_twdt_obj->table_size = new_table_size;
+            new_table = old_table;  // Freed once we leave the critical section
+            break;
+        }
+        new_table_size = (p_twdt_obj->table_size != 0) ? p_twdt_obj->table_size * 2 : ENTRIES_TABLE_MIN_SIZE;
+        portEXIT_CRITICAL(&spinlock);
+        free(new_table);
+        new_table = calloc(new_table_size, sizeof(twdt_entry_t *));
+        portENTER_CRITICAL(&spinlock);
+        ESP_GOTO_ON_FALSE_ISR((new_table != NULL), ESP_ERR_NO_MEM, state_err, TAG, "insufficient memory");
+        ESP_GOTO_ON_FALSE_ISR((p_twdt_obj != NULL), ESP_ERR_INVALID_STATE, state_err, TAG, "task watchdog was never initialized");
+        if (is_task) {
+            ESP_GOTO_ON_FALSE_ISR((find_entry(true, entry->task_handle) == NULL), ESP_ERR_INVALID_ARG, state_err, TAG, "task is already subscribed");
+        }
     }
-    // Add entry to list
-    SLIST_INSERT_HEAD(&p_twdt_obj->entries_slist, entry, slist_entry);
+    // Check if all entries have been reset
+    bool all_reset = (p_twdt_obj->num_pending == 0);
+    // Add entry to list, it has not been reset in the current epoch
+    LIST_INSERT_HEAD(&p_twdt_obj->entries_list, entry, list_entry);
+    table_insert(p_twdt_obj->entries_table, p_twdt_obj->table_size, entry);
+    entry->reset_epoch = p_twdt_obj->epoch - 1;
+    p_twdt_obj->num_entries++;
+    p_twdt_obj->num_pending++;
     // Start the timer if it has not been started yet and was waiting on a task to registered
     if (p_twdt_obj->waiting_for_task) {
         esp_task_wdt_impl_timer_restart(p_twdt_obj->impl_ctx);
@@ -205,11 +342,13 @@ static esp_err_t add_entry(bool is_task, void *entry_data, twdt_entry_t **entry_
         task_wdt_timer_feed();
     }
     portEXIT_CRITICAL(&spinlock);
+    free(new_table);
     *entry_ret = entry;
     return ESP_OK;
 
 state_err:
     portEXIT_CRITICAL(&spinlock);
+    free(new_table);
     free(entry);
     return ret;
 }
@@ -218,7 +357,7 @@ state_err:
  * @brief Delete a task/user entry
  *
  * @param[in] is_task Whether the entry is a task entry or user entry
- * @param[in] entry_data Data associated with the entry (either a task handle or user entry name)
+ * @param[in] entry_data Data associated with the entry (either a task handle or user handle)
  * @return ESP_OK if entry was deleted, failure otherwise
  */
 static esp_err_t delete_entry(bool is_task, void *entry_data)
@@ -229,27 +368,28 @@ static esp_err_t delete_entry(bool is_task, void *entry_data)
     // Check TWDT state
     ESP_GOTO_ON_FALSE_ISR((p_twdt_obj != NULL), ESP_ERR_INVALID_STATE, err, TAG, "task watchdog was never initialized");
     // Find entry for task
-    bool all_reset;
-    twdt_entry_t *entry;
+    twdt_entry_t *entry = find_entry(is_task, entry_data);
     if (is_task) {
-        entry = find_entry_from_task_handle_and_check_all_reset((TaskHandle_t)entry_data, &all_reset);
         ESP_GOTO_ON_FALSE_ISR((entry != NULL), ESP_ERR_NOT_FOUND, err, TAG, "task not found");
     } else {
-        entry = (twdt_entry_t *)entry_data;
-        bool entry_found = find_entry_and_check_all_reset(entry, &all_reset);
-        ESP_GOTO_ON_FALSE_ISR(entry_found, ESP_ERR_NOT_FOUND, err, TAG, "user not found");
+        ESP_GOTO_ON_FALSE_ISR((entry != NULL), ESP_ERR_NOT_FOUND, err, TAG, "user not found");
     }
     // Remove entry
-    SLIST_REMOVE(&p_twdt_obj->entries_slist, entry, twdt_entry, slist_entry);
+    LIST_REMOVE(entry, list_entry);
+    table_remove(entry);
+    p_twdt_obj->num_entries--;
+    if (!entry_has_reset(entry)) {
+        p_twdt_obj->num_pending--;
+    }
     /* Stop the timer if we don't have any more tasks/objects to watch */
-    if (SLIST_EMPTY(&p_twdt_obj->entries_slist)) {
+    if (LIST_EMPTY(&p_twdt_obj->entries_list)) {
         p_twdt_obj->waiting_for_task = true;
         esp_task_wdt_impl_timer_stop(p_twdt_obj->impl_ctx);
     } else {
         p_twdt_obj->waiting_for_task = false;
     }
     /* Reset hardware timer if all remaining tasks have reset and if the list of tasks is not empty */
-    if (!p_twdt_obj->waiting_for_task && all_reset) {
+    if (!p_twdt_obj->waiting_for_task && p_twdt_obj->num_pending == 0) {
         task_wdt_timer_feed();
     }
     portEXIT_CRITICAL(&spinlock);
@@ -519,7 +659,7 @@ esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config)
     /* Allocate and initialize the global object */
     obj = calloc(1, sizeof(twdt_obj_t));
     ESP_GOTO_ON_FALSE((obj != NULL), ESP_ERR_NO_MEM, err, TAG, "insufficient memory");
-    SLIST_INIT(&obj->entries_slist);
+    LIST_INIT(&obj->entries_list);
     obj->panic = config->trigger_panic;
 
     /* Allocate the timer itself, NOT STARTED */
@@ -539,7 +679,7 @@ esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config)
     }
 
     /* Start the timer only if we are watching some tasks */
-    if (!SLIST_EMPTY(&p_twdt_obj->entries_slist)) {
+    if (!LIST_EMPTY(&p_twdt_obj->entries_list)) {
         p_twdt_obj->waiting_for_task = false;
         esp_task_wdt_impl_timer_restart(p_twdt_obj->impl_ctx);
     } else {
@@ -590,7 +730,7 @@ esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *config)
     }
 
     /* Start the timer only if we are watching some tasks */
-    if (!SLIST_EMPTY(&p_twdt_obj->entries_slist)) {
+    if (!LIST_EMPTY(&p_twdt_obj->entries_list)) {
         esp_task_wdt_impl_timer_restart(p_twdt_obj->impl_ctx);
     }
 
@@ -645,7 +785,7 @@ esp_err_t esp_task_wdt_deinit(void)
     unsubscribe_idle(p_twdt_obj->idle_core_mask);
 
     // Check TWDT state
-    ESP_GOTO_ON_FALSE_ISR(SLIST_EMPTY(&p_twdt_obj->entries_slist), ESP_ERR_INVALID_STATE, err, TAG, "Tasks/users still subscribed");
+    ESP_GOTO_ON_FALSE_ISR(LIST_EMPTY(&p_twdt_obj->entries_list), ESP_ERR_INVALID_STATE, err, TAG, "Tasks/users still subscribed");
 
     // Disable the timer
     esp_task_wdt_impl_timer_stop(p_twdt_obj->impl_ctx);
@@ -654,6 +794,7 @@ esp_err_t esp_task_wdt_deinit(void)
     esp_task_wdt_impl_timer_free(p_twdt_obj->impl_ctx);
 
     // Free the global object
+    free(p_twdt_obj->entries_table);
     free(p_twdt_obj);
     p_twdt_obj = NULL;
 
@@ -696,18 +837,14 @@ esp_err_t esp_task_wdt_reset(void)
     ESP_RETURN_ON_FALSE(p_twdt_obj != NULL, ESP_ERR_INVALID_STATE, TAG, "TWDT was never initialized");
     esp_err_t ret;
     TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    int64_t now = feed_time();
 
     portENTER_CRITICAL(&spinlock);
     // Find entry from task handle
-    bool all_reset;
-    twdt_entry_t *entry;
-    entry = find_entry_from_task_handle_and_check_all_reset(handle, &all_reset);
+    twdt_entry_t *entry = find_entry(true, handle);
     ESP_GOTO_ON_FALSE_ISR((entry != NULL), ESP_ERR_NOT_FOUND, err, TAG, "task not found");
     // Mark entry as reset and issue timer reset if all entries have been reset
-    entry->has_reset = true;    // Reset the task if it's on the task list
-    if (all_reset) {    // Reset if all other tasks in list have reset in
-        task_wdt_timer_feed();
-    }
+    reset_entry(entry, now);
     ret = ESP_OK;
 err:
     portEXIT_CRITICAL(&spinlock);
@@ -720,18 +857,14 @@ esp_err_t esp_task_wdt_reset_user(esp_task_wdt_user_handle_t user_handle)
     ESP_RETURN_ON_FALSE(user_handle != NULL, ESP_ERR_INVALID_ARG, TAG, "Invalid arguments");
     ESP_RETURN_ON_FALSE(p_twdt_obj != NULL, ESP_ERR_INVALID_STATE, TAG, "TWDT was never initialized");
     esp_err_t ret;
+    int64_t now = feed_time();
 
     portENTER_CRITICAL(&spinlock);
     // Check if entry exists
-    bool all_reset;
-    twdt_entry_t *entry = (twdt_entry_t *)user_handle;
-    bool entry_found = find_entry_and_check_all_reset(entry, &all_reset);
-    ESP_GOTO_ON_FALSE_ISR(entry_found, ESP_ERR_NOT_FOUND, err, TAG, "user handle not found");
+    twdt_entry_t *entry = find_entry(false, user_handle);
+    ESP_GOTO_ON_FALSE_ISR((entry != NULL), ESP_ERR_NOT_FOUND, err, TAG, "user handle not found");
     // Mark entry as reset and issue timer reset if all entries have been reset
-    entry->has_reset = true;    // Reset the task if it's on the task list
-    if (all_reset) {    // Reset if all other tasks in list have reset in
-        task_wdt_timer_feed();
-    }
+    reset_entry(entry, now);
     ret = ESP_OK;
 err:
     portEXIT_CRITICAL(&spinlock);
@@ -768,19 +901,70 @@ esp_err_t esp_task_wdt_status(TaskHandle_t task_handle)
 
     portENTER_CRITICAL(&spinlock);
     // Find entry for task
-    bool all_reset;
-    twdt_entry_t *entry;
-    entry = find_entry_from_task_handle_and_check_all_reset(task_handle, &all_reset);
-    (void) all_reset;   // Unused
+    twdt_entry_t *entry = find_entry(true, task_handle);
     ret = (entry != NULL) ? ESP_OK : ESP_ERR_NOT_FOUND;
     portEXIT_CRITICAL(&spinlock);
 
     return ret;
 }
 
+/**
+ * @brief Copy the feed statistics of a task/user entry
+ *
+ * @param[in] is_task Whether the entry is a task entry or user entry
+ * @param[in] key Task handle or user handle
+ * @param[out] stats Statistics of the entry
+ * @return ESP_OK if the entry was found, failure otherwise
+ */
+static esp_err_t get_feed_stats(bool is_task, const void *key, esp_task_wdt_feed_stats_t *stats)
+{
+#if CONFIG_ESP_TASK_WDT_FEED_STATS
+    esp_err_t ret = ESP_OK;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&spinlock);
+    twdt_entry_t *entry = find_entry(is_task, key);
+    if (entry != NULL) {
+        stats->feed_count = entry->feed_count;
+        stats->last_interval_us = entry->last_interval_us;
+        stats->max_interval_us = entry->max_interval_us;
+        stats->since_last_feed_us = feed_interval(entry->last_feed_us, now);
+    } else {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    portEXIT_CRITICAL(&spinlock);
+
+    return ret;
+#else
+    (void) is_task;
+    (void) key;
+    (void) stats;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif // CONFIG_ESP_TASK_WDT_FEED_STATS
+}
+
+esp_err_t esp_task_wdt_get_feed_stats(TaskHandle_t task_handle, esp_task_wdt_feed_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE(stats != NULL, ESP_ERR_INVALID_ARG, TAG, "Invalid arguments");
+    ESP_RETURN_ON_FALSE(p_twdt_obj != NULL, ESP_ERR_INVALID_STATE, TAG, "TWDT was never initialized");
+    if (task_handle == NULL) {
+        task_handle = xTaskGetCurrentTaskHandle();
+    }
+
+    return get_feed_stats(true, task_handle, stats);
+}
+
+esp_err_t esp_task_wdt_get_user_feed_stats(esp_task_wdt_user_handle_t user_handle, esp_task_wdt_feed_stats_t *stats)
+{
+    ESP_RETURN_ON_FALSE((user_handle != NULL && stats != NULL), ESP_ERR_INVALID_ARG, TAG, "Invalid arguments");
+    ESP_RETURN_ON_FALSE(p_twdt_obj != NULL, ESP_ERR_INVALID_STATE, TAG, "TWDT was never initialized");
+
+    return get_feed_stats(false, user_handle, stats);
+}
+
 esp_err_t esp_task_wdt_print_triggered_tasks(task_wdt_msg_handler msg_handler, void *opaque, int *cpus_fail)
 {
-    if (SLIST_EMPTY(&p_twdt_obj->entries_slist)) {
+    if (LIST_EMPTY(&p_twdt_obj->entries_list)) {
         return ESP_FAIL;
     }
 
@@ -795,8 +979,8 @@ esp_err_t esp_task_wdt_print_triggered_tasks(task_wdt_msg_handler msg_handler, v
     }
 
     // Find what entries triggered the TWDT timeout (i.e., which entries have not been reset)
-    SLIST_FOREACH(entry, &p_twdt_obj->entries_slist, slist_entry) {
-        if (!entry->has_reset) {
+    LIST_FOREACH(entry, &p_twdt_obj->entries_list, list_entry) {
+        if (!entry_has_reset(entry)) {
             const char *cpu;
             const char *name = entry->task_handle ? pcTaskGetName(entry->task_handle) : entry->user_name;
             const UBaseType_t affinity = get_task_affinity(entry->task_handle);
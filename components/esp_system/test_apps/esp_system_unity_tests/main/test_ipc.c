@@ -15,6 +15,8 @@
 #endif
 #include "esp_log.h"
 #include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "test_utils.h"
 
 #if !CONFIG_FREERTOS_UNICORE
 static void test_func_ipc_cb(void *arg)
@@ -162,4 +164,138 @@ TEST_CASE("Test ipc_task can not wake up blocking task early", "[ipc]")
     TEST_ASSERT_EQUAL(31, val2);
 }
 
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+#define TEST_QUEUED_CALLS   10
+
+static int s_call_order[TEST_QUEUED_CALLS];
+static volatile int s_num_calls;
+
+static void test_func_ipc_record(void *arg)
+{
+    s_call_order[s_num_calls++] = (int)arg;
+}
+
+TEST_CASE("Test non-blocking IPC calls run in order", "[ipc]")
+{
+    s_num_calls = 0;
+    for (int i = 0; i < TEST_QUEUED_CALLS; i++) {
+        TEST_ESP_OK(esp_ipc_call_nonblocking(!xPortGetCoreID(), test_func_ipc_record, (void *)i));
+    }
+    // The blocking call is queued behind the non-blocking ones
+    int val = 0;
+    TEST_ESP_OK(esp_ipc_call_blocking(!xPortGetCoreID(), test_func_ipc_cb2, &val));
+    TEST_ASSERT_EQUAL(1, val);
+    TEST_ASSERT_EQUAL(TEST_QUEUED_CALLS, s_num_calls);
+    for (int i = 0; i < TEST_QUEUED_CALLS; i++) {
+        TEST_ASSERT_EQUAL(i, s_call_order[i]);
+    }
+}
+
+static volatile bool s_release_ipc;
+
+static void test_func_ipc_wait_release(void *arg)
+{
+    while (!s_release_ipc) {
+    }
+}
+
+static void test_func_ipc_count(void *arg)
+{
+    (*(volatile int *)arg)++;
+}
+
+TEST_CASE("Test non-blocking IPC call fails when the queue is full", "[ipc]")
+{
+    volatile int count = 0;
+    int posted = 0;
+
+    // Keep the IPC task of the other core busy while its queue fills up
+    s_release_ipc = false;
+    TEST_ESP_OK(esp_ipc_call(!xPortGetCoreID(), test_func_ipc_wait_release, NULL));
+    while (esp_ipc_call_nonblocking(!xPortGetCoreID(), test_func_ipc_count, (void *)&count) == ESP_OK) {
+        posted++;
+        TEST_ASSERT_LESS_OR_EQUAL(256, posted);
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(CONFIG_ESP_IPC_QUEUE_LEN, posted);
+    TEST_ASSERT_EQUAL(0, count);
+
+    s_release_ipc = true;
+    TEST_ESP_OK(esp_ipc_call_blocking(!xPortGetCoreID(), test_func_ipc_count, (void *)&count));
+    TEST_ASSERT_EQUAL(posted + 1, count);
+}
+#endif // CONFIG_ESP_IPC_QUEUED_CALLS
+
+#define TEST_IPC_CALLERS        4
+#define TEST_IPC_CALLS          1000
+
+typedef struct {
+    SemaphoreHandle_t done;
+    int count;
+} test_ipc_caller_t;
+
+static void test_func_ipc_increment(void *arg)
+{
+    ((test_ipc_caller_t *)arg)->count++;
+}
+
+static void ipc_caller_task(void *arg)
+{
+    test_ipc_caller_t *caller = (test_ipc_caller_t *)arg;
+
+    for (int i = 0; i < TEST_IPC_CALLS; i++) {
+        esp_ipc_call_blocking(!xPortGetCoreID(), test_func_ipc_increment, caller);
+    }
+    xSemaphoreGive(caller->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Test IPC call latency and throughput", "[ipc]")
+{
+    test_ipc_caller_t callers[TEST_IPC_CALLERS];
+    test_ipc_caller_t single = { 0 };
+    int64_t start;
+    int64_t duration;
+
+    // Latency of a blocking call from a single task
+    start = esp_timer_get_time();
+    for (int i = 0; i < TEST_IPC_CALLS; i++) {
+        TEST_ESP_OK(esp_ipc_call_blocking(!xPortGetCoreID(), test_func_ipc_increment, &single));
+    }
+    duration = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(TEST_IPC_CALLS, single.count);
+    IDF_LOG_PERFORMANCE("ipc_call_blocking_latency", "%d us", (int)(duration / TEST_IPC_CALLS));
+
+    // Throughput of blocking calls from several tasks on both cores, each calling the other core
+    start = esp_timer_get_time();
+    for (int i = 0; i < TEST_IPC_CALLERS; i++) {
+        callers[i].done = xSemaphoreCreateBinary();
+        callers[i].count = 0;
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(ipc_caller_task, "caller", 4096, &callers[i],
+                                                          uxTaskPriorityGet(NULL), NULL, i % 2));
+    }
+    for (int i = 0; i < TEST_IPC_CALLERS; i++) {
+        xSemaphoreTake(callers[i].done, portMAX_DELAY);
+        vSemaphoreDelete(callers[i].done);
+        TEST_ASSERT_EQUAL(TEST_IPC_CALLS, callers[i].count);
+    }
+    duration = esp_timer_get_time() - start;
+    IDF_LOG_PERFORMANCE("ipc_call_blocking_throughput", "%d calls/s",
+                        (int)(TEST_IPC_CALLERS * TEST_IPC_CALLS * 1000000LL / duration));
+
+#if CONFIG_ESP_IPC_QUEUED_CALLS
+    // Throughput of non-blocking calls, retried while the queue is full
+    single.count = 0;
+    start = esp_timer_get_time();
+    for (int i = 0; i < TEST_IPC_CALLS; i++) {
+        while (esp_ipc_call_nonblocking(!xPortGetCoreID(), test_func_ipc_increment, &single) != ESP_OK) {
+        }
+    }
+    TEST_ESP_OK(esp_ipc_call_blocking(!xPortGetCoreID(), test_func_ipc_increment, &single));
+    duration = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(TEST_IPC_CALLS + 1, single.count);
+    IDF_LOG_PERFORMANCE("ipc_call_nonblocking_throughput", "%d calls/s",
+                        (int)(TEST_IPC_CALLS * 1000000LL / duration));
+#endif
+}
+
 #endif /* !CONFIG_FREERTOS_UNICORE */
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
@@ -10,7 +10,11 @@
 
 #include <stdbool.h>
 #include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_rom_sys.h"
+#include "esp_timer.h"
 #include "esp_task_wdt.h"
 #include "test_utils.h"
 #include "soc/rtc.h"
@@ -189,4 +193,126 @@ TEST_CASE("Task WDT user feed", "[task_wdt]")
     TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_deinit());
 }
 
+#define NUM_FEEDING_TASKS   32
+
+typedef struct {
+    SemaphoreHandle_t done;
+    volatile bool stop;
+} feeding_tasks_ctx_t;
+
+static void feeding_task(void *arg)
+{
+    feeding_tasks_ctx_t *ctx = (feeding_tasks_ctx_t *)arg;
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_add(NULL));
+    while (!ctx->stop) {
+        TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_reset());
+        vTaskDelay(1);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_delete(NULL));
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("Task WDT many tasks feed", "[task_wdt]")
+{
+    feeding_tasks_ctx_t ctx = {
+        .done = xSemaphoreCreateCounting(NUM_FEEDING_TASKS, 0),
+        .stop = false,
+    };
+    timeout_flag = false;
+    esp_task_wdt_config_t twdt_config = {
+        .timeout_ms = TASK_WDT_TIMEOUT_MS,
+        .idle_core_mask = 0,
+        .trigger_panic = false,
+    };
+    TEST_ASSERT_NOT_NULL(ctx.done);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_init(&twdt_config));
+    for (int i = 0; i < NUM_FEEDING_TASKS; i++) {
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(feeding_task, "feeding", 2048, &ctx, UNITY_FREERTOS_PRIORITY - 1,
+                                                          NULL, i % portNUM_PROCESSORS));
+    }
+    vTaskDelay(pdMS_TO_TICKS(2 * TASK_WDT_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(false, timeout_flag);
+    ctx.stop = true;
+    for (int i = 0; i < NUM_FEEDING_TASKS; i++) {
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(ctx.done, portMAX_DELAY));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_deinit());
+    vSemaphoreDelete(ctx.done);
+}
+
+#define PERF_ITERATIONS     10000
+
+TEST_CASE("Task WDT reset performance", "[task_wdt]")
+{
+    esp_task_wdt_user_handle_t user_handles[NUM_FEEDING_TASKS];
+    esp_task_wdt_config_t twdt_config = {
+        .timeout_ms = TASK_WDT_TIMEOUT_MS,
+        .idle_core_mask = 0,
+        .trigger_panic = false,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_init(&twdt_config));
+    // The time to reset the TWDT must not depend on the number of subscribed tasks/users
+    for (int i = 0; i < NUM_FEEDING_TASKS; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_add_user("test_user", &user_handles[i]));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_add(NULL));
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        esp_task_wdt_reset();
+    }
+    IDF_LOG_PERFORMANCE("task_wdt_reset", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_delete(NULL));
+    for (int i = 0; i < NUM_FEEDING_TASKS; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_delete_user(user_handles[i]));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_deinit());
+}
+
+#if CONFIG_ESP_TASK_WDT_FEED_STATS
+TEST_CASE("Task WDT feed statistics", "[task_wdt]")
+{
+    const char *user_name = "test_user";
+    esp_task_wdt_user_handle_t user_handle;
+    esp_task_wdt_feed_stats_t stats;
+    esp_task_wdt_config_t twdt_config = {
+        .timeout_ms = TASK_WDT_TIMEOUT_MS,
+        .idle_core_mask = 0,
+        .trigger_panic = false,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_init(&twdt_config));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_task_wdt_get_feed_stats(NULL, &stats));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_add(NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_add_user(user_name, &user_handle));
+
+    // Reset the task entry at a short interval, then once at a longer one
+    for (int i = 0; i < 3; i++) {
+        esp_rom_delay_us(10 * 1000);
+        TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_reset());
+        TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_reset_user(user_handle));
+    }
+    esp_rom_delay_us(TASK_WDT_TIMEOUT_MS * 1000 / 2);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_reset());
+    esp_rom_delay_us(10 * 1000);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_get_feed_stats(NULL, &stats));
+    TEST_ASSERT_EQUAL(4, stats.feed_count);
+    TEST_ASSERT_UINT32_WITHIN(5 * 1000, TASK_WDT_TIMEOUT_MS * 1000 / 2, stats.last_interval_us);
+    TEST_ASSERT_EQUAL(stats.last_interval_us, stats.max_interval_us);
+    TEST_ASSERT_UINT32_WITHIN(5 * 1000, 10 * 1000, stats.since_last_feed_us);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_get_user_feed_stats(user_handle, &stats));
+    TEST_ASSERT_EQUAL(3, stats.feed_count);
+    TEST_ASSERT_UINT32_WITHIN(5 * 1000, 10 * 1000, stats.max_interval_us);
+    TEST_ASSERT_GREATER_OR_EQUAL(TASK_WDT_TIMEOUT_MS * 1000 / 2, stats.since_last_feed_us);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_delete_user(user_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_delete(NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_task_wdt_deinit());
+}
+#endif // CONFIG_ESP_TASK_WDT_FEED_STATS
+
 #endif // CONFIG_ESP_TASK_WDT_EN
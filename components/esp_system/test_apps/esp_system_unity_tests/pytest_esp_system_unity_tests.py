@@ -1,4 +1,4 @@
-# SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+# SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: CC0-1.0
 
 import pytest
@@ -13,6 +13,7 @@ from pytest_embedded import Dut
         pytest.param('pd_vddsdio', marks=[pytest.mark.supported_targets]),
         pytest.param('psram', marks=[pytest.mark.esp32, pytest.mark.esp32s2, pytest.mark.esp32s3, pytest.mark.esp32p4]),
         pytest.param('single_core_esp32', marks=[pytest.mark.esp32]),
+        pytest.param('ipc_queued', marks=[pytest.mark.esp32]),
     ]
 )
 def test_esp_system(dut: Dut) -> None:
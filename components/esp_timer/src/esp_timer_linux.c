@@ -0,0 +1,36 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * On the Linux target, there is no timer peripheral. Only the time since startup of the application is provided,
+ * based on the monotonic clock of the host.
+ */
+
+#include <time.h>
+#include <assert.h>
+#include "esp_timer.h"
+
+static int64_t s_start_time;
+
+static int64_t get_monotonic_time_us(void)
+{
+    struct timespec current_time;
+    int result = clock_gettime(CLOCK_MONOTONIC, &current_time);
+    assert(result == 0);
+    (void)result;
+    return (int64_t)current_time.tv_sec * 1000000 + current_time.tv_nsec / 1000;
+}
+
+// Runs before the constructors of other components, which may already get the time
+__attribute__((constructor(101))) static void esp_timer_linux_init(void)
+{
+    s_start_time = get_monotonic_time_us();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return get_monotonic_time_us() - s_start_time;
+}
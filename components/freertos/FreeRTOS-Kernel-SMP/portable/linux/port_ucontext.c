@@ -0,0 +1,523 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*-----------------------------------------------------------
+ * Implementation of functions defined in portable.h for the Posix port, switching tasks in user space.
+ *
+ * This is an alternative to port.c, selected by CONFIG_FREERTOS_LINUX_UCONTEXT. All tasks run on the thread which
+ * started the scheduler, each on its own stack. Tasks are switched with swapcontext() instead of signaling and
+ * waiting on the pthread of the next task, so a context switch costs a single system call (restoring the signal
+ * mask) instead of several futex and signal round-trips.
+ *
+ * The timer interrupt uses SIGALRM, like in port.c. Interrupts are masked in software: while a task is in a
+ * critical section (or has interrupts disabled), the tick handler only counts the tick as pending and the ticks
+ * are processed once the interrupts are enabled again. Entering and exiting critical sections thus never makes
+ * a system call.
+ *
+ * The differences to port.c are:
+ *
+ * - Tasks are not pthreads, so debuggers only see the thread running the scheduler. Thread local variables
+ *   (__thread) are shared by all tasks, except for errno which is saved and restored on each context switch.
+ *
+ * - A task holding a pthread mutex internally (e.g., inside malloc() or stdio) may be preempted and another task
+ *   may then try to take the same mutex from the same thread. Like for port.c, stdio (printf() and friends) should
+ *   be called from a single task only or serialized with a FreeRTOS primitive such as a mutex.
+ *----------------------------------------------------------*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/times.h>
+#include <time.h>
+#include <ucontext.h>
+
+/* Scheduler includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+
+#if ( configNUMBER_OF_CORES > 1 )
+#error "Simulating multiple cores is only supported with the IDF FreeRTOS kernel"
+#endif
+/*-----------------------------------------------------------*/
+
+typedef struct CONTEXT
+{
+    ucontext_t xContext;
+    TaskFunction_t pxCode;
+    void *pvParams;
+    BaseType_t xDying;
+} Context_t;
+
+/*
+ * The additional per-task data is stored at the beginning of the
+ * task's stack.
+ */
+static inline Context_t *prvGetContextFromTask(TaskHandle_t xTask)
+{
+    StackType_t *pxTopOfStack = *(StackType_t **)xTask;
+
+    return (Context_t *)(pxTopOfStack + 1);
+}
+
+/*-----------------------------------------------------------*/
+
+static pthread_once_t hSigSetupThread = PTHREAD_ONCE_INIT;
+static pthread_t hSchedulerThread;
+static ucontext_t xSchedulerContext;
+
+/* These are saved as part of a task's state in prvSwitchContext() */
+static volatile BaseType_t uxCriticalNestingIDF = 0;    /* Track nesting calls for IDF style critical sections. FreeRTOS critical section nesting is maintained in the TCB. */
+static volatile UBaseType_t uxInterruptNesting = 0;     /* Tracks if we are currently in an interrupt. */
+static volatile BaseType_t uxInterruptLevel = 0;        /* Tracks the current level (i.e., interrupt mask) */
+
+/* Ticks which arrived while interrupts were masked. Only incremented by the tick handler. */
+static volatile UBaseType_t uxPendingTicks;
+/*-----------------------------------------------------------*/
+
+static void prvSetupSignalsAndSchedulerPolicy( void );
+static void prvSetupTimerInterrupt( void );
+static void prvTaskStart( void );
+static void prvSwitchContext( Context_t *pxContextToResume,
+                              Context_t *pxContextToSuspend );
+static void prvRunPendingTicks( void );
+static void vPortSystemTickHandler( int sig );
+/*-----------------------------------------------------------*/
+
+static void prvFatalError( const char *pcCall, int iErrno )
+{
+    fprintf( stderr, "%s: %s\n", pcCall, strerror( iErrno ) );
+    abort();
+}
+
+static void prvInitialiseContext( Context_t *pxContext,
+                                  void *pvStack,
+                                  size_t ulStackSize )
+{
+    if ( getcontext( &pxContext->xContext ) )
+    {
+        prvFatalError( "getcontext", errno );
+    }
+    pxContext->xContext.uc_stack.ss_sp = pvStack;
+    pxContext->xContext.uc_stack.ss_size = ulStackSize;
+    pxContext->xContext.uc_link = NULL;
+    /* Interrupts are masked in software, the tick signal itself is never
+     * blocked while running a task. */
+    sigdelset( &pxContext->xContext.uc_sigmask, SIGALRM );
+    makecontext( &pxContext->xContext, prvTaskStart, 0 );
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * See header file for description.
+ */
+StackType_t *pxPortInitialiseStack( StackType_t *pxTopOfStack,
+                                    StackType_t *pxEndOfStack,
+                                    TaskFunction_t pxCode,
+                                    void *pvParameters )
+{
+    Context_t *context;
+    size_t ulStackSize;
+
+    (void)pthread_once( &hSigSetupThread, prvSetupSignalsAndSchedulerPolicy );
+
+    /*
+     * Store the additional task data at the start of the stack, aligned for
+     * the ucontext_t it contains.
+     */
+    context = (Context_t *)( ( (uintptr_t)( pxTopOfStack + 1 ) - sizeof( Context_t ) ) & ~(uintptr_t)15 );
+    pxTopOfStack = (StackType_t *)context - 1;
+    ulStackSize = ( (uintptr_t)context - (uintptr_t)pxEndOfStack ) & ~(uintptr_t)15;
+
+    context->pxCode = pxCode;
+    context->pvParams = pvParameters;
+    context->xDying = pdFALSE;
+
+    prvInitialiseContext( context, pxEndOfStack, ulStackSize );
+
+    return pxTopOfStack;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * See header file for description.
+ */
+BaseType_t xPortStartScheduler( void )
+{
+    Context_t *pxFirstContext;
+
+    hSchedulerThread = pthread_self();
+
+    /* Start the timer that generates the tick ISR(SIGALRM).
+       Interrupts are disabled here already. */
+    prvSetupTimerInterrupt();
+
+    /* Start the first task, vPortEndScheduler() switches back here. */
+    pxFirstContext = prvGetContextFromTask( xTaskGetCurrentTaskHandle() );
+    if ( swapcontext( &xSchedulerContext, &pxFirstContext->xContext ) )
+    {
+        prvFatalError( "swapcontext", errno );
+    }
+
+    /* Unlike in port.c there are no threads to cancel, the stacks of
+     * the idle and timer tasks are freed by the kernel. */
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+void vPortEndScheduler( void )
+{
+    struct itimerval itimer;
+    struct sigaction sigtick;
+
+    /* Stop the timer and ignore any pending SIGALRMs that would end
+     * up running on the scheduler context when it is resumed. */
+    itimer.it_value.tv_sec = 0;
+    itimer.it_value.tv_usec = 0;
+
+    itimer.it_interval.tv_sec = 0;
+    itimer.it_interval.tv_usec = 0;
+    (void)setitimer( ITIMER_REAL, &itimer, NULL );
+
+    sigtick.sa_flags = 0;
+    sigtick.sa_handler = SIG_IGN;
+    sigemptyset( &sigtick.sa_mask );
+    sigaction( SIGALRM, &sigtick, NULL );
+
+    /* The current task is never resumed. */
+    (void)setcontext( &xSchedulerContext );
+    prvFatalError( "setcontext", errno );
+}
+/*-----------------------------------------------------------*/
+
+static inline BaseType_t prvInterruptsMasked( void )
+{
+    return ( uxCriticalNestingIDF != 0 || uxInterruptLevel != 0 );
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnterCriticalIDF( void )
+{
+    uxCriticalNestingIDF++;
+    /* Keep the critical section from being moved before the increment */
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+}
+/*-----------------------------------------------------------*/
+
+void vPortExitCriticalIDF( void )
+{
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+    uxCriticalNestingIDF--;
+
+    /* If we have reached 0 then handle the ticks which were masked. */
+    if ( !prvInterruptsMasked() )
+    {
+        prvRunPendingTicks();
+    }
+}
+/*-----------------------------------------------------------*/
+
+void vPortYieldFromISR( void )
+{
+    Context_t *xContextToSuspend;
+    Context_t *xContextToResume;
+
+    xContextToSuspend = prvGetContextFromTask( xTaskGetCurrentTaskHandle() );
+
+    vTaskSwitchContext();
+
+    xContextToResume = prvGetContextFromTask( xTaskGetCurrentTaskHandle() );
+
+    prvSwitchContext( xContextToResume, xContextToSuspend );
+}
+/*-----------------------------------------------------------*/
+
+void vPortYield( void )
+{
+    BaseType_t prev_intr_level = xPortSetInterruptMask();
+
+    vPortYieldFromISR();
+
+    vPortClearInterruptMask( prev_intr_level );
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortSetInterruptMask( void )
+{
+    BaseType_t prev_intr_level = uxInterruptLevel;
+    uxInterruptLevel++;
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+    return prev_intr_level;
+}
+/*-----------------------------------------------------------*/
+
+void vPortClearInterruptMask( BaseType_t xMask )
+{
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+    // Only reenable interrupts if xMask is 0
+    uxInterruptLevel = xMask;
+    if ( !prvInterruptsMasked() )
+    {
+        prvRunPendingTicks();
+    }
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Setup the systick timer to generate the tick interrupts at the required
+ * frequency.
+ */
+void prvSetupTimerInterrupt( void )
+{
+    struct itimerval itimer;
+    int iRet;
+
+    /* Initialise the structure with the current timer information. */
+    iRet = getitimer( ITIMER_REAL, &itimer );
+    if ( iRet )
+    {
+        prvFatalError( "getitimer", errno );
+    }
+
+    /* Set the interval between timer events. */
+    itimer.it_interval.tv_sec = 0;
+    itimer.it_interval.tv_usec = portTICK_RATE_MICROSECONDS;
+
+    /* Set the current count-down. */
+    itimer.it_value.tv_sec = 0;
+    itimer.it_value.tv_usec = portTICK_RATE_MICROSECONDS;
+
+    /* Set-up the timer interrupt. */
+    iRet = setitimer( ITIMER_REAL, &itimer, NULL );
+    if ( iRet )
+    {
+        prvFatalError( "setitimer", errno );
+    }
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Increments the tick count uxTicks times and selects the next task if
+ * required. Must be called with interrupts masked.
+ */
+static void prvProcessTicks( UBaseType_t uxTicks )
+{
+    Context_t *pxContextToSuspend;
+    Context_t *pxContextToResume;
+    BaseType_t xSwitchRequired = pdFALSE;
+
+    // Handling a timer interrupt, so we are currently in an interrupt.
+    uxInterruptNesting++;
+
+#if ( configUSE_PREEMPTION == 1 )
+    pxContextToSuspend = prvGetContextFromTask( xTaskGetCurrentTaskHandle() );
+#endif
+
+    while ( uxTicks-- > 0 )
+    {
+        xSwitchRequired |= xTaskIncrementTick();
+    }
+
+#if ( configUSE_PREEMPTION == 1 )
+    if (xSwitchRequired == pdTRUE) {
+        /* Select Next Task. */
+        vTaskSwitchContext();
+
+        pxContextToResume = prvGetContextFromTask( xTaskGetCurrentTaskHandle() );
+
+        prvSwitchContext( pxContextToResume, pxContextToSuspend );
+    }
+#else
+    (void)xSwitchRequired;
+#endif
+
+    // Returning from the timer interrupt, so we are exiting the interrupt.
+    uxInterruptNesting--;
+}
+/*-----------------------------------------------------------*/
+
+static void prvRunPendingTicks( void )
+{
+    UBaseType_t uxTicks;
+    BaseType_t prev_intr_level;
+
+    while ( uxPendingTicks != 0 )
+    {
+        prev_intr_level = uxInterruptLevel;
+        uxInterruptLevel++;
+        __atomic_signal_fence( __ATOMIC_SEQ_CST );
+
+        /* The tick handler may have run and consumed the ticks
+         * before interrupts were masked again. */
+        uxTicks = __atomic_exchange_n( &uxPendingTicks, 0, __ATOMIC_RELAXED );
+        if ( uxTicks != 0 )
+        {
+            prvProcessTicks( uxTicks );
+        }
+
+        __atomic_signal_fence( __ATOMIC_SEQ_CST );
+        uxInterruptLevel = prev_intr_level;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void vPortSystemTickHandler( int sig )
+{
+    if ( !pthread_equal( pthread_self(), hSchedulerThread ) )
+    {
+        /* A process directed signal may be delivered to any thread which
+         * doesn't block it, e.g., a pthread created by a task. */
+        (void)pthread_kill( hSchedulerThread, sig );
+        return;
+    }
+
+    if ( prvInterruptsMasked() )
+    {
+        /* Interrupts are masked, defer the tick. Signals are blocked in
+         * this signal handler, so the increment can't be interrupted. */
+        uxPendingTicks++;
+        return;
+    }
+
+    uxInterruptLevel++;
+
+    /* Also account for the ticks deferred since the last tick. */
+    prvProcessTicks( 1 + __atomic_exchange_n( &uxPendingTicks, 0, __ATOMIC_RELAXED ) );
+
+    uxInterruptLevel--;
+}
+/*-----------------------------------------------------------*/
+
+void vPortThreadDying( void *pxTaskToDelete, volatile BaseType_t *pxPendYield )
+{
+    Context_t *pxContext = prvGetContextFromTask( pxTaskToDelete );
+
+    pxContext->xDying = pdTRUE;
+}
+
+void vPortCancelThread( void *pxTaskToDelete )
+{
+    /*
+     * Nothing to release, the task's context lives on its stack which is
+     * freed by the kernel.
+     */
+    (void)pxTaskToDelete;
+}
+/*-----------------------------------------------------------*/
+
+static void prvTaskStart( void )
+{
+    Context_t *pxContext = prvGetContextFromTask( xTaskGetCurrentTaskHandle() );
+
+    /* Started for the first time, thus this task didn't previously call
+     * prvSwitchContext(). So we need to initialise the state variables for
+     * this task, which also enables interrupts. */
+    uxCriticalNestingIDF = 0;
+    uxInterruptNesting = 0;
+    uxInterruptLevel = 0;
+    prvRunPendingTicks();
+
+    /* Call the task's entry point. */
+    pxContext->pxCode( pxContext->pvParams );
+
+    /* A function that implements a task must not exit or attempt to return to
+    * its caller as there is nothing to return to. If a task wants to exit it
+    * should instead call vTaskDelete( NULL ). Artificially force an assert()
+    * to be triggered if configASSERT() is defined, so application writers can
+    * catch the error. */
+    configASSERT( pdFALSE );
+}
+/*-----------------------------------------------------------*/
+
+static void prvSwitchContext( Context_t *pxContextToResume,
+                              Context_t *pxContextToSuspend )
+{
+    BaseType_t uxSavedCriticalNestingIDF;
+    BaseType_t uxSavedInterruptNesting;
+    BaseType_t uxSavedInterruptLevel;
+    int iSavedErrno;
+
+    if ( pxContextToSuspend != pxContextToResume )
+    {
+        if ( pxContextToSuspend->xDying )
+        {
+            /* The task is never resumed, so its context doesn't need to be
+             * saved. Its stack is freed by the idle task after the switch. */
+            (void)setcontext( &pxContextToResume->xContext );
+            prvFatalError( "setcontext", errno );
+        }
+
+        /*
+         * Switch tasks.
+         *
+         * It is possible for prvSwitchContext() to be called...
+         * - while inside an ISR (i.e., via vPortSystemTickHandler() or vPortYieldFromISR())
+         * - while interrupts are disabled or in a critical section (i.e., via vPortYield())
+         *
+         * So we need to save the various count variables and errno as part of
+         * the task's context. They are restored when switching back to this
+         * task. Interrupts remain masked until then as the interrupt level is
+         * not zero.
+         */
+        uxSavedCriticalNestingIDF = uxCriticalNestingIDF;
+        uxSavedInterruptNesting = uxInterruptNesting;
+        uxSavedInterruptLevel = uxInterruptLevel;
+        iSavedErrno = errno;
+
+        if ( swapcontext( &pxContextToSuspend->xContext, &pxContextToResume->xContext ) )
+        {
+            prvFatalError( "swapcontext", errno );
+        }
+
+        errno = iSavedErrno;
+        uxCriticalNestingIDF = uxSavedCriticalNestingIDF;
+        uxInterruptNesting = uxSavedInterruptNesting;
+        uxInterruptLevel = uxSavedInterruptLevel;
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvSetupSignalsAndSchedulerPolicy( void )
+{
+    struct sigaction sigtick;
+    int iRet;
+
+    hSchedulerThread = pthread_self();
+
+    /* The tick handler mustn't be nested. System calls interrupted by the
+     * tick are restarted as the tick is not a signal the task is waiting
+     * for. */
+    sigtick.sa_flags = SA_RESTART;
+    sigtick.sa_handler = vPortSystemTickHandler;
+    sigfillset( &sigtick.sa_mask );
+
+    iRet = sigaction( SIGALRM, &sigtick, NULL );
+    if ( iRet )
+    {
+        prvFatalError( "sigaction", errno );
+    }
+}
+/*-----------------------------------------------------------*/
+
+unsigned long ulPortGetRunTime( void )
+{
+    struct tms xTimes;
+
+    times( &xTimes );
+
+    return ( unsigned long ) xTimes.tms_utime;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortCheckIfInISR(void)
+{
+    return (uxInterruptNesting == 0) ? pdFALSE : pdTRUE;
+}
+/*-----------------------------------------------------------*/
@@ -100,10 +100,19 @@ extern void vPortExitCritical( void );
 #define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)    vPortClearInterruptMask(x)
 #define portDISABLE_INTERRUPTS()                portSET_INTERRUPT_MASK()
 #define portENABLE_INTERRUPTS()                 portCLEAR_INTERRUPT_MASK()
+#if ( configNUMBER_OF_CORES > 1 )
+/* Simulated cores run in parallel, the spinlock needs to be taken as well */
+#define portENTER_CRITICAL(mux)                 vPortEnterCriticalMultiCore(mux)
+#define portEXIT_CRITICAL(mux)                  vPortExitCriticalMultiCore(mux)
+#define portENTER_CRITICAL_SAFE(mux)            vPortEnterCriticalMultiCore(mux)
+#define portEXIT_CRITICAL_SAFE(mux)             vPortExitCriticalMultiCore(mux)
+#else
 #define portENTER_CRITICAL(mux)                 {(void)mux;  vPortEnterCritical();}
 #define portEXIT_CRITICAL(mux)                  {(void)mux;  vPortExitCritical();}
 #define portENTER_CRITICAL_SAFE(mux)            {(void)mux;  vPortEnterCritical();}
 #define portEXIT_CRITICAL_SAFE(mux)             {(void)mux;  vPortExitCritical();}
+#endif
+#define portTRY_ENTER_CRITICAL(mux, timeout)    xPortEnterCriticalTimeout(mux, timeout)
 #define portENTER_CRITICAL_ISR(mux)             portENTER_CRITICAL(mux)
 #define portEXIT_CRITICAL_ISR(mux)              portEXIT_CRITICAL(mux)
 
@@ -127,7 +136,12 @@ extern void vPortCancelThread( void *pxTaskToDelete );
  * Thus, only a compilier barrier is needed to prevent the compiler
  * reordering.
  */
+#if ( configNUMBER_OF_CORES > 1 )
+/* Simulated cores are host threads running in parallel */
+#define portMEMORY_BARRIER() __atomic_thread_fence( __ATOMIC_SEQ_CST )
+#else
 #define portMEMORY_BARRIER() __asm volatile( "" ::: "memory" )
+#endif
 
 extern unsigned long ulPortGetRunTime( void );
 #define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() /* no-op */
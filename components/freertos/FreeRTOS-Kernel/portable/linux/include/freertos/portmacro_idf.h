@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -32,11 +32,56 @@ typedef spinlock_t portMUX_TYPE;
         }
 #define portMUX_FREE_VAL                    SPINLOCK_FREE           /**< Spinlock is free. [refactor-todo] check if this is still required */
 
+/* ID of the simulated tick interrupt (SIGALRM), reported to the trace macros by the tick handler */
+#define portSYSTICK_INTR_ID                 (14)
+
 void vPortYieldFromISR(void);
 void vPortYieldOtherCore(BaseType_t coreid);
 
 #define portMUX_INITIALIZE(mux)             spinlock_initialize(mux)    /*< Initialize a spinlock to its unlocked state */
 
+#if ( configNUMBER_OF_CORES > 1 )
+
+/**
+ * @brief Get the current core's ID
+ *
+ * Each simulated core runs on its own host thread, tasks may move between them.
+ *
+ * @note Not inlined, as the compiler must not reuse the core ID read before a context switch
+ * @return BaseType_t Core ID of the calling task
+ */
+BaseType_t xPortGetCoreID(void);
+
+/**
+ * @brief Enter a critical section on a simulated multi-core system
+ *
+ * Masks the interrupts of the current core, then takes the spinlock.
+ *
+ * @param mux Spinlock
+ */
+void vPortEnterCriticalMultiCore(portMUX_TYPE *mux);
+
+/**
+ * @brief Exit a critical section entered with vPortEnterCriticalMultiCore()
+ *
+ * @param mux Spinlock
+ */
+void vPortExitCriticalMultiCore(portMUX_TYPE *mux);
+
+/**
+ * @brief Enter a critical section on a simulated multi-core system, giving up if the spinlock can't be taken
+ *
+ * @param mux Spinlock
+ * @param timeout Number of attempts to take the spinlock, see spinlock_acquire()
+ * @return pdPASS if the critical section was entered, pdFAIL on timeout
+ */
+BaseType_t xPortEnterCriticalTimeout(portMUX_TYPE *mux, BaseType_t timeout);
+
+#define portGET_CORE_ID()                   xPortGetCoreID()
+#define portYIELD_CORE(xCoreID)             vPortYieldOtherCore(xCoreID)
+
+#else
+
 /**
  * @brief Get the current core's ID
  *
@@ -48,6 +93,23 @@ static inline BaseType_t IRAM_ATTR xPortGetCoreID(void)
     return (BaseType_t) 0;
 }
 
+/**
+ * @brief Enter a critical section, the timeout is ignored as there is no spinlock to wait for on a single core
+ *
+ * @param mux Spinlock
+ * @param timeout Unused
+ * @return Always pdPASS
+ */
+static inline BaseType_t xPortEnterCriticalTimeout(portMUX_TYPE *mux, BaseType_t timeout)
+{
+    (void)mux;
+    (void)timeout;
+    vPortEnterCritical();
+    return pdPASS;
+}
+
+#endif /* configNUMBER_OF_CORES > 1 */
+
 /**
  * @brief Checks if a given piece of memory can be used to store a FreeRTOS list
  *
@@ -104,6 +166,8 @@ static inline BaseType_t xPortInIsrContext(void)
     return xPortCheckIfInISR();
 }
 
+#define portCHECK_IF_IN_ISR()   xPortInIsrContext()
+
 #if CONFIG_FREERTOS_ENABLE_STATIC_TASK_CLEAN_UP
 /* If enabled, users must provide an implementation of vPortCleanUpTCB() */
 extern void vPortCleanUpTCB ( void *pxTCB );
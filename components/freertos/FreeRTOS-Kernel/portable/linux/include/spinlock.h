@@ -1,16 +1,25 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 /*
- * This file provides only very simple stubs to build IDF-based FreeRTOSes which use spinlocks on Linux.
+ * Spinlocks for IDF-based FreeRTOSes on Linux.
+ *
+ * On a single core, these are only very simple stubs. If FreeRTOS simulates multiple cores (see
+ * CONFIG_FREERTOS_LINUX_UCONTEXT), each core runs on its own host thread and the spinlocks are real spinlocks based
+ * on atomic compare and set.
  */
 #pragma once
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "sdkconfig.h"
+
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+#include <sched.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,20 +29,28 @@ extern "C" {
 #define SPINLOCK_WAIT_FOREVER  (-1)
 #define SPINLOCK_NO_WAIT        0
 #define SPINLOCK_INITIALIZER   {.owner = SPINLOCK_FREE,.count = 0}
+
+#define SPINLOCK_OWNER_ID_0 0xCDCD /* Use these values to avoid 0 being a valid lock owner, same as CORE_ID_REGVAL_PRO on Xtensa */
+#define SPINLOCK_OWNER_ID_1 0xABAB /* Same as CORE_ID_REGVAL_APP on Xtensa*/
+
 #define CORE_ID_REGVAL_XOR_SWAP (0xCDCD ^ 0xABAB)
+#define SPINLOCK_OWNER_ID_XOR_SWAP CORE_ID_REGVAL_XOR_SWAP
+
+/* Number of failed attempts to take a lock after which the waiting core gives up its host CPU */
+#define SPINLOCK_SPINS_BEFORE_YIELD 1000
 
 /**
  * @brief Spinlock object
  * Owner:
  *  - Set to 0 if uninitialized
  *  - Set to portMUX_FREE_VAL when free
- *  - Set to CORE_ID_REGVAL_PRO or CORE_ID_REGVAL_AP when locked
+ *  - Set to SPINLOCK_OWNER_ID_0 or SPINLOCK_OWNER_ID_1 when locked
  *  - Any other value indicates corruption
  * Count:
  *  - 0 if unlocked
  *  - Recursive count if locked
  *
- * @note Not a true spinlock as single core RISC-V does not have atomic compare and set instruction
+ * @note On a single core, this is not a true spinlock as there is nothing to protect against
  * @note Keep portMUX_INITIALIZER_UNLOCKED in sync with this struct
  */
 typedef struct {
@@ -41,17 +58,69 @@ typedef struct {
     uint32_t count;
 }spinlock_t;
 
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+/* Implemented by the FreeRTOS port, returns the ID of the simulated core the caller runs on (a BaseType_t) */
+extern long xPortGetCoreID(void);
+#endif
+
 static inline void __attribute__((always_inline)) spinlock_initialize(spinlock_t *lock)
 {
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+    lock->owner = SPINLOCK_FREE;
+    lock->count = 0;
+#endif
 }
 
+/**
+ * @brief Take a spinlock
+ *
+ * Must be called with interrupts masked (i.e., from within a critical section), so that the caller can't be moved
+ * to another core while holding the lock.
+ *
+ * @param lock Spinlock to take
+ * @param timeout Number of attempts to take the lock, SPINLOCK_NO_WAIT to try once or SPINLOCK_WAIT_FOREVER.
+ *                Unlike on chip targets, the timeout is not measured in CPU cycles.
+ * @return true if the lock was taken, false on timeout
+ */
 static inline bool __attribute__((always_inline)) spinlock_acquire(spinlock_t *lock, int32_t timeout)
 {
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+    uint32_t core_owner_id = xPortGetCoreID() == 0 ? SPINLOCK_OWNER_ID_0 : SPINLOCK_OWNER_ID_1;
+    uint32_t expected;
+    int32_t spins = 0;
+
+    // The caller is already the owner of the lock. Simply increment the nesting count
+    if (__atomic_load_n(&lock->owner, __ATOMIC_RELAXED) == core_owner_id) {
+        lock->count++;
+        return true;
+    }
+
+    for (;;) {
+        expected = SPINLOCK_FREE;
+        if (__atomic_compare_exchange_n(&lock->owner, &expected, core_owner_id, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if (timeout != SPINLOCK_WAIT_FOREVER && spins >= timeout) {
+            return false;
+        }
+        // The owner may be a core whose host thread isn't scheduled, don't keep it from running for long
+        if (++spins % SPINLOCK_SPINS_BEFORE_YIELD == 0) {
+            sched_yield();
+        }
+    }
+
+    lock->count = 1;
+#endif
     return true;
 }
 
 static inline void __attribute__((always_inline)) spinlock_release(spinlock_t *lock)
 {
+#if CONFIG_FREERTOS_NUMBER_OF_CORES > 1
+    if (--lock->count == 0) {
+        __atomic_store_n(&lock->owner, SPINLOCK_FREE, __ATOMIC_RELEASE);
+    }
+#endif
 }
 
 #ifdef __cplusplus
@@ -6,7 +6,7 @@
  *
  * SPDX-License-Identifier: MIT
  *
- * SPDX-FileContributor: 2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileContributor: 2023-2024 Espressif Systems (Shanghai) CO LTD
  *
  * Permission is hereby granted, free of charge, to any person obtaining a copy of
  * this software and associated documentation files (the "Software"), to deal in
@@ -69,6 +69,10 @@
 #include "task.h"
 #include "timers.h"
 #include "utils/wait_for_event.h"
+
+#if ( configNUMBER_OF_CORES > 1 )
+    #error "Simulating multiple cores requires CONFIG_FREERTOS_LINUX_UCONTEXT"
+#endif
 /*-----------------------------------------------------------*/
 
 #define SIG_RESUME SIGUSR1
@@ -378,6 +382,8 @@ static void vPortSystemTickHandler( int sig )
 
     uxCriticalNesting++; /* Signals are blocked in this signal handler. */
 
+    traceISR_ENTER( portSYSTICK_INTR_ID );
+
 #if ( configUSE_PREEMPTION == 1 )
     pxThreadToSuspend = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
 #endif
@@ -395,12 +401,16 @@ static void vPortSystemTickHandler( int sig )
 */
 
 #if ( configUSE_PREEMPTION == 1 )
+    traceISR_EXIT_TO_SCHEDULER();
+
     /* Select Next Task. */
     vTaskSwitchContext();
 
     pxThreadToResume = prvGetThreadFromTask( xTaskGetCurrentTaskHandle() );
 
     prvSwitchThread(pxThreadToResume, pxThreadToSuspend);
+#else
+    traceISR_EXIT();
 #endif
 
     uxCriticalNesting--;
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -93,7 +93,9 @@ void vApplicationTickHook( void )
 }
 #endif
 
+#if ( configNUMBER_OF_CORES == 1 )
 void vPortYieldOtherCore( BaseType_t coreid ) { } // trying to skip for now
+#endif
 
 #if ( configSUPPORT_STATIC_ALLOCATION == 1 )
 /* configUSE_STATIC_ALLOCATION is set to 1, so the application must provide an
@@ -105,16 +107,20 @@ void vApplicationGetIdleTaskMemory( StaticTask_t ** ppxIdleTaskTCBBuffer,
 {
 /* If the buffers to be provided to the Idle task are declared inside this
  * function then they must be declared static - otherwise they will be allocated on
- * the stack and so not exists after this function exits. */
-    static StaticTask_t xIdleTaskTCB;
-    static StackType_t uxIdleTaskStack[ configMINIMAL_STACK_SIZE ];
+ * the stack and so not exists after this function exits. The kernel creates one
+ * Idle task per core, calling this function for each core in turn. */
+    static StaticTask_t xIdleTaskTCB[ configNUMBER_OF_CORES ];
+    static StackType_t uxIdleTaskStack[ configNUMBER_OF_CORES ][ configMINIMAL_STACK_SIZE ];
+    static BaseType_t xNextCore = 0;
 
     /* Pass out a pointer to the StaticTask_t structure in which the Idle task's
      * state will be stored. */
-    *ppxIdleTaskTCBBuffer = &xIdleTaskTCB;
+    *ppxIdleTaskTCBBuffer = &xIdleTaskTCB[ xNextCore ];
 
     /* Pass out the array that will be used as the Idle task's stack. */
-    *ppxIdleTaskStackBuffer = uxIdleTaskStack;
+    *ppxIdleTaskStackBuffer = uxIdleTaskStack[ xNextCore ];
+
+    xNextCore = ( xNextCore + 1 ) % configNUMBER_OF_CORES;
 
     /* Pass out the size of the array pointed to by *ppxIdleTaskStackBuffer.
      * Note that, as the array is necessarily of type StackType_t,
@@ -0,0 +1,961 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*-----------------------------------------------------------
+ * Implementation of functions defined in portable.h for the Posix port, switching tasks in user space.
+ *
+ * This is an alternative to port.c, selected by CONFIG_FREERTOS_LINUX_UCONTEXT. All tasks run on the thread which
+ * started the scheduler, each on its own stack. Tasks are switched with swapcontext() instead of signaling and
+ * waiting on the pthread of the next task, so a context switch costs a single system call (restoring the signal
+ * mask) instead of several futex and signal round-trips.
+ *
+ * The timer interrupt uses SIGALRM, like in port.c. Interrupts are masked in software: while a task is in a
+ * critical section (or has interrupts disabled), the tick handler only counts the tick as pending and the ticks
+ * are processed once the interrupts are enabled again. Entering and exiting critical sections thus never makes
+ * a system call.
+ *
+ * If FreeRTOS is configured for more than one core (CONFIG_FREERTOS_UNICORE disabled), each simulated core runs
+ * on its own host thread, so tasks on different cores really run in parallel. The thread which started the
+ * scheduler is core 0. Tasks without affinity move between the threads of the cores. The tick of the other cores
+ * and yield requests between cores are delivered to the thread of the core as SIGUSR1. Spinlocks (portMUX_TYPE)
+ * are implemented with atomic operations, see spinlock.h.
+ *
+ * The differences to port.c are:
+ *
+ * - Tasks are not pthreads, so debuggers only see the threads running the cores. Thread local variables
+ *   (__thread) belong to the core instead of the task, except for errno which is saved and restored on each
+ *   context switch. With multiple cores, a task without affinity may be resumed on another thread while a function
+ *   still holds the address of a thread local variable of the previous one. The compiler keeps the address of
+ *   errno across calls, so code which reads errno after a possible context switch should pin its task to a core.
+ *
+ * - A task holding a pthread mutex internally (e.g., inside malloc() or stdio) may be preempted and another task
+ *   may then try to take the same mutex from the same thread. Like for port.c, stdio (printf() and friends) should
+ *   be called from a single task only or serialized with a FreeRTOS primitive such as a mutex.
+ *----------------------------------------------------------*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/times.h>
+#include <time.h>
+#include <ucontext.h>
+
+/* Scheduler includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "esp_private/freertos_idf_additions_priv.h"
+/*-----------------------------------------------------------*/
+
+#define SIG_INTERCORE SIGUSR1
+
+_Static_assert( configNUMBER_OF_CORES <= 2, "The kernel supports up to two cores" );
+
+typedef struct CONTEXT
+{
+    ucontext_t xContext;
+    TaskFunction_t pxCode;
+    void *pvParams;
+    BaseType_t xDying;
+
+    /* The interrupt mask is part of the state of a task. A context which is
+     * not running always has a non-zero nesting count, as it was switched
+     * away from with interrupts masked. */
+    volatile UBaseType_t uxCriticalNesting;
+    volatile BaseType_t xInterruptsDisabled;
+
+#if ( configNUMBER_OF_CORES > 1 )
+    /* Set while a core runs on this context, until the context has been
+     * saved by the core switching away from it. */
+    BaseType_t xRunning;
+#endif
+} Context_t;
+
+/*
+ * State of a simulated core, aligned to keep the cores from sharing cache
+ * lines.
+ */
+typedef struct CORE
+{
+    /* Context of the thread running the core, used before the scheduler is
+     * started and after it ended. */
+    Context_t xSchedulerContext;
+    Context_t *volatile pxCurrentContext;
+    pthread_t xThread;
+
+    /* Interrupts which arrived while interrupts were masked on the core. */
+    UBaseType_t uxPendingTicks;
+    BaseType_t xPendingYield;
+
+#if ( configNUMBER_OF_CORES > 1 )
+    /* Incremented each time pxCurrentContext changes. */
+    UBaseType_t uxSwitches;
+    /* The context the core switched away from, released once the next
+     * context runs. */
+    Context_t *pxPreviousContext;
+    BaseType_t xStarted;
+#endif
+} __attribute__((aligned(64))) Core_t;
+
+/*
+ * The additional per-task data is stored at the beginning of the
+ * task's stack.
+ */
+static inline Context_t *prvGetContextFromTask(TaskHandle_t xTask)
+{
+    StackType_t *pxTopOfStack = *(StackType_t **)xTask;
+
+    return (Context_t *)(pxTopOfStack + 1);
+}
+
+/*-----------------------------------------------------------*/
+
+static pthread_once_t hSigSetupThread = PTHREAD_ONCE_INIT;
+
+static Core_t xCores[ configNUMBER_OF_CORES ] = {
+    [ 0 ] = { .pxCurrentContext = &xCores[ 0 ].xSchedulerContext },
+#if ( configNUMBER_OF_CORES > 1 )
+    [ 1 ] = { .pxCurrentContext = &xCores[ 1 ].xSchedulerContext },
+#endif
+};
+
+#if ( configNUMBER_OF_CORES > 1 )
+static __thread volatile BaseType_t xThreadCoreID;
+static volatile BaseType_t xSchedulerEnding;
+#endif
+/*-----------------------------------------------------------*/
+
+static void prvSetupSignalsAndSchedulerPolicy( void );
+static void prvSetupTimerInterrupt( void );
+static void prvTaskStart( void );
+static void prvSwitchContext( Context_t *pxContextToResume,
+                              Context_t *pxContextToSuspend );
+static void prvRunPendingInterrupts( Context_t *pxContext );
+static void vPortSystemTickHandler( int sig );
+/*-----------------------------------------------------------*/
+
+static void prvFatalError( const char *pcCall, int iErrno )
+{
+    fprintf( stderr, "%s: %s\n", pcCall, strerror( iErrno ) );
+    abort();
+}
+
+static void prvInitialiseContext( Context_t *pxContext,
+                                  void *pvStack,
+                                  size_t ulStackSize )
+{
+    if ( getcontext( &pxContext->xContext ) )
+    {
+        prvFatalError( "getcontext", errno );
+    }
+    pxContext->xContext.uc_stack.ss_sp = pvStack;
+    pxContext->xContext.uc_stack.ss_size = ulStackSize;
+    pxContext->xContext.uc_link = NULL;
+    /* Interrupts are masked in software, the interrupt signals themselves
+     * are never blocked while running a task. */
+    sigdelset( &pxContext->xContext.uc_sigmask, SIGALRM );
+    sigdelset( &pxContext->xContext.uc_sigmask, SIG_INTERCORE );
+    makecontext( &pxContext->xContext, prvTaskStart, 0 );
+}
+/*-----------------------------------------------------------*/
+
+#if ( configNUMBER_OF_CORES > 1 )
+
+/*
+ * A task may be resumed on the thread of another core, so the core ID must
+ * be read again after each possible context switch instead of reusing a
+ * thread local address calculated before.
+ */
+BaseType_t __attribute__((noinline)) xPortGetCoreID( void )
+{
+    return xThreadCoreID;
+}
+
+/*
+ * Returns the context of the calling task. The task may be preempted and
+ * resumed on another core in between reading the core's ID and the core's
+ * current context, so retry until both were read on the same core without
+ * a context switch in between.
+ */
+static Context_t *prvGetCurrentContext( void )
+{
+    BaseType_t xCoreID;
+    UBaseType_t uxSwitches;
+    Context_t *pxContext;
+
+    do
+    {
+        xCoreID = portGET_CORE_ID();
+        uxSwitches = __atomic_load_n( &xCores[ xCoreID ].uxSwitches, __ATOMIC_ACQUIRE );
+        pxContext = xCores[ xCoreID ].pxCurrentContext;
+    } while ( portGET_CORE_ID() != xCoreID ||
+              __atomic_load_n( &xCores[ xCoreID ].uxSwitches, __ATOMIC_ACQUIRE ) != uxSwitches );
+
+    return pxContext;
+}
+
+#else
+
+static inline Context_t *prvGetCurrentContext( void )
+{
+    return xCores[ 0 ].pxCurrentContext;
+}
+
+#endif /* configNUMBER_OF_CORES > 1 */
+
+/*
+ * Returns the context of the calling task, which can't move to another core
+ * as interrupts are masked.
+ */
+static inline Context_t *prvGetCurrentContextMasked( void )
+{
+    return xCores[ portGET_CORE_ID() ].pxCurrentContext;
+}
+
+static inline BaseType_t prvInterruptsPending( BaseType_t xCoreID )
+{
+    return ( __atomic_load_n( &xCores[ xCoreID ].uxPendingTicks, __ATOMIC_RELAXED ) != 0 ||
+             __atomic_load_n( &xCores[ xCoreID ].xPendingYield, __ATOMIC_RELAXED ) != pdFALSE );
+}
+
+static void __attribute__((noinline)) prvRestoreErrno( int iErrno )
+{
+    /* errno is thread local, its address may have changed with the core
+     * the task was resumed on. */
+    errno = iErrno;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * See header file for description.
+ */
+StackType_t *pxPortInitialiseStack( StackType_t *pxTopOfStack,
+                                    StackType_t *pxEndOfStack,
+                                    TaskFunction_t pxCode,
+                                    void *pvParameters )
+{
+    Context_t *context;
+    size_t ulStackSize;
+
+    (void)pthread_once( &hSigSetupThread, prvSetupSignalsAndSchedulerPolicy );
+
+    /*
+     * Store the additional task data at the start of the stack, aligned for
+     * the ucontext_t it contains.
+     */
+    context = (Context_t *)( ( (uintptr_t)( pxTopOfStack + 1 ) - sizeof( Context_t ) ) & ~(uintptr_t)15 );
+    pxTopOfStack = (StackType_t *)context - 1;
+    ulStackSize = ( (uintptr_t)context - (uintptr_t)pxEndOfStack ) & ~(uintptr_t)15;
+
+    context->pxCode = pxCode;
+    context->pvParams = pvParameters;
+    context->xDying = pdFALSE;
+    /* Interrupts are enabled by prvTaskStart() */
+    context->uxCriticalNesting = 1;
+    context->xInterruptsDisabled = pdFALSE;
+#if ( configNUMBER_OF_CORES > 1 )
+    context->xRunning = pdFALSE;
+#endif
+
+    prvInitialiseContext( context, pxEndOfStack, ulStackSize );
+
+    return pxTopOfStack;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Switches the calling thread to the first task of the core, returns once
+ * the scheduler has been ended.
+ */
+static void prvStartCore( BaseType_t xCoreID )
+{
+    Core_t *pxCore = &xCores[ xCoreID ];
+    Context_t *pxFirstContext;
+
+    pxFirstContext = prvGetContextFromTask( xTaskGetCurrentTaskHandleForCore( xCoreID ) );
+
+    /* Like any context which is switched away from */
+    pxCore->xSchedulerContext.uxCriticalNesting = 1;
+
+    prvSwitchContext( pxFirstContext, &pxCore->xSchedulerContext );
+}
+/*-----------------------------------------------------------*/
+
+#if ( configNUMBER_OF_CORES > 1 )
+
+static void *prvCoreThread( void *pvCoreID )
+{
+    BaseType_t xCoreID = (BaseType_t)(intptr_t)pvCoreID;
+    Core_t *pxCore = &xCores[ xCoreID ];
+
+    xThreadCoreID = xCoreID;
+    pxCore->xThread = pthread_self();
+
+    /* Like core 0 in vTaskStartScheduler(), interrupts stay disabled until
+     * the first task starts. */
+    pxCore->xSchedulerContext.xInterruptsDisabled = pdTRUE;
+    __atomic_store_n( &pxCore->xStarted, pdTRUE, __ATOMIC_RELEASE );
+
+    prvStartCore( xCoreID );
+
+    return NULL;
+}
+
+#endif /* configNUMBER_OF_CORES > 1 */
+/*-----------------------------------------------------------*/
+
+/*
+ * See header file for description.
+ */
+BaseType_t xPortStartScheduler( void )
+{
+#if ( configNUMBER_OF_CORES > 1 )
+    pthread_t xCoreThreads[ configNUMBER_OF_CORES ];
+    BaseType_t xCoreID;
+    int iRet;
+#endif
+
+    xCores[ 0 ].xThread = pthread_self();
+
+#if ( configNUMBER_OF_CORES > 1 )
+    __atomic_store_n( &xCores[ 0 ].xStarted, pdTRUE, __ATOMIC_RELEASE );
+
+    /* The other cores switch to their first task as soon as their thread
+     * runs. */
+    for ( xCoreID = 1; xCoreID < configNUMBER_OF_CORES; xCoreID++ )
+    {
+        iRet = pthread_create( &xCoreThreads[ xCoreID ], NULL, prvCoreThread, (void *)(intptr_t)xCoreID );
+        if ( iRet )
+        {
+            prvFatalError( "pthread_create", iRet );
+        }
+    }
+#endif
+
+    /* Start the timer that generates the tick ISR(SIGALRM).
+       Interrupts are disabled here already. */
+    prvSetupTimerInterrupt();
+
+    /* Start the first task, vPortEndScheduler() switches back here. */
+    prvStartCore( 0 );
+
+#if ( configNUMBER_OF_CORES > 1 )
+    for ( xCoreID = 1; xCoreID < configNUMBER_OF_CORES; xCoreID++ )
+    {
+        (void)pthread_join( xCoreThreads[ xCoreID ], NULL );
+    }
+#endif
+
+    /* Unlike in port.c there are no threads to cancel, the stacks of
+     * the idle and timer tasks are freed by the kernel. */
+    return 0;
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Abandons the current task, switching the calling core back to the
+ * context which started it.
+ */
+static void prvReturnToScheduler( void )
+{
+    Core_t *pxCore = &xCores[ portGET_CORE_ID() ];
+
+#if ( configNUMBER_OF_CORES > 1 )
+    pxCore->pxPreviousContext = NULL;
+    __atomic_store_n( &pxCore->uxSwitches, pxCore->uxSwitches + 1, __ATOMIC_RELEASE );
+#endif
+    pxCore->pxCurrentContext = &pxCore->xSchedulerContext;
+
+    /* The current task is never resumed. */
+    (void)setcontext( &pxCore->xSchedulerContext.xContext );
+    prvFatalError( "setcontext", errno );
+}
+
+void vPortEndScheduler( void )
+{
+    struct itimerval itimer;
+    struct sigaction sigtick;
+
+    /* Stop the timer and ignore any pending SIGALRMs that would end
+     * up running on the scheduler context when it is resumed. */
+    itimer.it_value.tv_sec = 0;
+    itimer.it_value.tv_usec = 0;
+
+    itimer.it_interval.tv_sec = 0;
+    itimer.it_interval.tv_usec = 0;
+    (void)setitimer( ITIMER_REAL, &itimer, NULL );
+
+    sigtick.sa_flags = 0;
+    sigtick.sa_handler = SIG_IGN;
+    sigemptyset( &sigtick.sa_mask );
+    sigaction( SIGALRM, &sigtick, NULL );
+
+#if ( configNUMBER_OF_CORES > 1 )
+    {
+        BaseType_t xCoreID;
+
+        /* The other cores return to their scheduler context on the
+         * inter-core interrupt, even if interrupts are masked. */
+        xSchedulerEnding = pdTRUE;
+
+        for ( xCoreID = 0; xCoreID < configNUMBER_OF_CORES; xCoreID++ )
+        {
+            if ( xCoreID != portGET_CORE_ID() && __atomic_load_n( &xCores[ xCoreID ].xStarted, __ATOMIC_ACQUIRE ) )
+            {
+                (void)pthread_kill( xCores[ xCoreID ].xThread, SIG_INTERCORE );
+            }
+        }
+    }
+#endif
+
+    prvReturnToScheduler();
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnterCritical( void )
+{
+    prvGetCurrentContext()->uxCriticalNesting++;
+    /* Keep the critical section from being moved before the increment */
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+}
+/*-----------------------------------------------------------*/
+
+void vPortExitCritical( void )
+{
+    Context_t *pxContext = prvGetCurrentContextMasked();
+
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+    pxContext->uxCriticalNesting--;
+
+    /* If we have reached 0 then handle the interrupts which were masked. */
+    if ( pxContext->uxCriticalNesting == 0 && !pxContext->xInterruptsDisabled )
+    {
+        prvRunPendingInterrupts( pxContext );
+    }
+}
+/*-----------------------------------------------------------*/
+
+#if ( configNUMBER_OF_CORES > 1 )
+
+void vPortEnterCriticalMultiCore( portMUX_TYPE *mux )
+{
+    /* The task stays on its core once interrupts are masked, so the
+     * spinlock is taken by the right core. */
+    vPortEnterCritical();
+    spinlock_acquire( mux, SPINLOCK_WAIT_FOREVER );
+}
+/*-----------------------------------------------------------*/
+
+void vPortExitCriticalMultiCore( portMUX_TYPE *mux )
+{
+    spinlock_release( mux );
+    vPortExitCritical();
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xPortEnterCriticalTimeout( portMUX_TYPE *mux, BaseType_t timeout )
+{
+    vPortEnterCritical();
+
+    if ( !spinlock_acquire( mux, timeout ) )
+    {
+        /* Timed out, unmask the interrupts again */
+        vPortExitCritical();
+        return pdFAIL;
+    }
+
+    return pdPASS;
+}
+/*-----------------------------------------------------------*/
+
+void vPortYieldOtherCore( BaseType_t coreid )
+{
+    __atomic_store_n( &xCores[ coreid ].xPendingYield, pdTRUE, __ATOMIC_RELEASE );
+
+    /* A core which hasn't started yet handles the request when its first
+     * task starts. The current core handles it once interrupts are
+     * unmasked. */
+    if ( coreid != portGET_CORE_ID() && __atomic_load_n( &xCores[ coreid ].xStarted, __ATOMIC_ACQUIRE ) )
+    {
+        (void)pthread_kill( xCores[ coreid ].xThread, SIG_INTERCORE );
+    }
+}
+/*-----------------------------------------------------------*/
+
+#endif /* configNUMBER_OF_CORES > 1 */
+
+void vPortYieldFromISR( void )
+{
+    Context_t *xContextToSuspend;
+    Context_t *xContextToResume;
+
+    xContextToSuspend = prvGetCurrentContextMasked();
+
+    vTaskSwitchContext();
+
+    xContextToResume = prvGetContextFromTask( xTaskGetCurrentTaskHandleForCore( portGET_CORE_ID() ) );
+
+    prvSwitchContext( xContextToResume, xContextToSuspend );
+}
+/*-----------------------------------------------------------*/
+
+void vPortYield( void )
+{
+    Context_t *pxContext;
+
+    vPortEnterCritical();
+
+    pxContext = prvGetCurrentContextMasked();
+
+    if ( pxContext->uxCriticalNesting > 1 || pxContext->xInterruptsDisabled )
+    {
+        /* The kernel yields from within critical sections, e.g. while
+         * holding the spinlock of a queue. Like the software interrupt on
+         * chip targets, the yield is pending until interrupts are unmasked. */
+        __atomic_store_n( &xCores[ portGET_CORE_ID() ].xPendingYield, pdTRUE, __ATOMIC_RELAXED );
+    }
+    else
+    {
+        vPortYieldFromISR();
+    }
+
+    vPortExitCritical();
+}
+/*-----------------------------------------------------------*/
+
+void vPortDisableInterrupts( void )
+{
+    prvGetCurrentContext()->xInterruptsDisabled = pdTRUE;
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+}
+/*-----------------------------------------------------------*/
+
+void vPortEnableInterrupts( void )
+{
+    /* Interrupts may be enabled already, so the task can't rely on
+     * staying on its core. */
+    Context_t *pxContext = prvGetCurrentContext();
+
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+    pxContext->xInterruptsDisabled = pdFALSE;
+
+    if ( pxContext->uxCriticalNesting == 0 )
+    {
+        prvRunPendingInterrupts( pxContext );
+    }
+}
+/*-----------------------------------------------------------*/
+
+#if ( configNUMBER_OF_CORES > 1 )
+
+BaseType_t xPortSetInterruptMask( void )
+{
+    /* Used by the kernel to keep a task on its core, e.g., while it looks
+     * up its own TCB. */
+    Context_t *pxContext = prvGetCurrentContext();
+    BaseType_t xWasDisabled = pxContext->xInterruptsDisabled;
+
+    pxContext->xInterruptsDisabled = pdTRUE;
+    __atomic_signal_fence( __ATOMIC_SEQ_CST );
+
+    return xWasDisabled;
+}
+/*-----------------------------------------------------------*/
+
+void vPortClearInterruptMask( BaseType_t xMask )
+{
+    if ( !xMask )
+    {
+        vPortEnableInterrupts();
+    }
+}
+/*-----------------------------------------------------------*/
+
+#else
+
+BaseType_t xPortSetInterruptMask( void )
+{
+    /* Interrupts are always disabled inside ISRs (signals
+       handlers). */
+    return pdTRUE;
+}
+/*-----------------------------------------------------------*/
+
+void vPortClearInterruptMask( BaseType_t xMask )
+{
+}
+/*-----------------------------------------------------------*/
+
+#endif /* configNUMBER_OF_CORES > 1 */
+
+/*
+ * Setup the systick timer to generate the tick interrupts at the required
+ * frequency.
+ */
+void prvSetupTimerInterrupt( void )
+{
+    struct itimerval itimer;
+    int iRet;
+
+    /* Initialise the structure with the current timer information. */
+    iRet = getitimer( ITIMER_REAL, &itimer );
+    if ( iRet )
+    {
+        prvFatalError( "getitimer", errno );
+    }
+
+    /* Set the interval between timer events. */
+    itimer.it_interval.tv_sec = 0;
+    itimer.it_interval.tv_usec = portTICK_RATE_MICROSECONDS;
+
+    /* Set the current count-down. */
+    itimer.it_value.tv_sec = 0;
+    itimer.it_value.tv_usec = portTICK_RATE_MICROSECONDS;
+
+    /* Set-up the timer interrupt. */
+    iRet = setitimer( ITIMER_REAL, &itimer, NULL );
+    if ( iRet )
+    {
+        prvFatalError( "setitimer", errno );
+    }
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Handles the ticks and yield requests which arrived for the current core
+ * and selects the next task if required. Must be called with interrupts
+ * masked.
+ */
+static void prvProcessPendingInterrupts( void )
+{
+    BaseType_t xCoreID = portGET_CORE_ID();
+    BaseType_t xSwitchRequired;
+    BaseType_t xTickInterrupt;
+    UBaseType_t uxTicks;
+
+    for ( ;; )
+    {
+        uxTicks = __atomic_exchange_n( &xCores[ xCoreID ].uxPendingTicks, 0, __ATOMIC_ACQUIRE );
+        xSwitchRequired = __atomic_exchange_n( &xCores[ xCoreID ].xPendingYield, pdFALSE, __ATOMIC_ACQUIRE );
+
+        if ( uxTicks == 0 && xSwitchRequired == pdFALSE )
+        {
+            break;
+        }
+
+        /* Like the SysTick handler of the chip ports, the ticks are traced
+         * as an interrupt. Pending yields are not, they are requested by
+         * the kernel from within critical sections. */
+        xTickInterrupt = ( uxTicks > 0 );
+        if ( xTickInterrupt )
+        {
+            traceISR_ENTER( portSYSTICK_INTR_ID );
+        }
+
+        while ( uxTicks-- > 0 )
+        {
+#if ( configNUMBER_OF_CORES > 1 )
+            if ( xCoreID != 0 )
+            {
+                xSwitchRequired |= xTaskIncrementTickOtherCores();
+            }
+            else
+#endif
+            {
+                xSwitchRequired |= xTaskIncrementTick();
+            }
+        }
+
+#if ( configUSE_PREEMPTION == 1 )
+        if ( xSwitchRequired != pdFALSE )
+        {
+            if ( xTickInterrupt )
+            {
+                traceISR_EXIT_TO_SCHEDULER();
+            }
+
+            /* Select Next Task. */
+            vPortYieldFromISR();
+
+            /* Resumed, possibly on another core */
+            xCoreID = portGET_CORE_ID();
+            continue;
+        }
+#endif
+
+        if ( xTickInterrupt )
+        {
+            traceISR_EXIT();
+        }
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvRunPendingInterrupts( Context_t *pxContext )
+{
+    if ( prvInterruptsPending( portGET_CORE_ID() ) )
+    {
+        pxContext->uxCriticalNesting++;
+        __atomic_signal_fence( __ATOMIC_SEQ_CST );
+
+        /* The interrupt handler may have run and handled the interrupts
+         * before they were masked again. */
+        prvProcessPendingInterrupts();
+
+        __atomic_signal_fence( __ATOMIC_SEQ_CST );
+        pxContext->uxCriticalNesting--;
+    }
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * Common part of the signal handlers, called once the interrupt has been
+ * recorded as pending for the current core.
+ */
+static void prvInterruptHandler( void )
+{
+    Context_t *pxContext = prvGetCurrentContextMasked();
+
+#if ( configNUMBER_OF_CORES > 1 )
+    if ( xSchedulerEnding )
+    {
+        if ( pxContext != &xCores[ portGET_CORE_ID() ].xSchedulerContext )
+        {
+            prvReturnToScheduler();
+        }
+        return;
+    }
+#endif
+
+    if ( pxContext->uxCriticalNesting != 0 || pxContext->xInterruptsDisabled )
+    {
+        /* Interrupts are masked, handle them once they're unmasked. Signals
+         * are blocked in this signal handler, so the task can't unmask them
+         * in between. */
+        return;
+    }
+
+    pxContext->uxCriticalNesting++;
+
+    prvProcessPendingInterrupts();
+
+    pxContext->uxCriticalNesting--;
+}
+/*-----------------------------------------------------------*/
+
+static void vPortSystemTickHandler( int sig )
+{
+    if ( !pthread_equal( pthread_self(), xCores[ 0 ].xThread ) )
+    {
+        /* A process directed signal may be delivered to any thread which
+         * doesn't block it, e.g., a pthread created by a task. */
+        (void)pthread_kill( xCores[ 0 ].xThread, sig );
+        return;
+    }
+
+#if ( configNUMBER_OF_CORES > 1 )
+    {
+        BaseType_t xCoreID;
+
+        /* Forward the tick to the other cores */
+        for ( xCoreID = 1; xCoreID < configNUMBER_OF_CORES; xCoreID++ )
+        {
+            if ( __atomic_load_n( &xCores[ xCoreID ].xStarted, __ATOMIC_ACQUIRE ) )
+            {
+                __atomic_fetch_add( &xCores[ xCoreID ].uxPendingTicks, 1, __ATOMIC_RELEASE );
+                (void)pthread_kill( xCores[ xCoreID ].xThread, SIG_INTERCORE );
+            }
+        }
+    }
+#endif
+
+    __atomic_fetch_add( &xCores[ 0 ].uxPendingTicks, 1, __ATOMIC_RELAXED );
+
+    prvInterruptHandler();
+}
+/*-----------------------------------------------------------*/
+
+#if ( configNUMBER_OF_CORES > 1 )
+
+static void vPortInterCoreHandler( int sig )
+{
+    (void)sig;
+
+    prvInterruptHandler();
+}
+
+#endif /* configNUMBER_OF_CORES > 1 */
+/*-----------------------------------------------------------*/
+
+void vPortThreadDying( void *pxTaskToDelete, volatile BaseType_t *pxPendYield )
+{
+    Context_t *pxContext = prvGetContextFromTask( pxTaskToDelete );
+
+    pxContext->xDying = pdTRUE;
+}
+
+void vPortCancelThread( void *pxTaskToDelete )
+{
+#if ( configNUMBER_OF_CORES > 1 )
+    Context_t *pxContext = prvGetContextFromTask( pxTaskToDelete );
+
+    /* The core which ran the task may still be switching away from it,
+     * i.e., running on its stack. */
+    while ( __atomic_load_n( &pxContext->xRunning, __ATOMIC_ACQUIRE ) )
+    {
+    }
+#endif
+
+    /*
+     * Nothing to release, the task's context lives on its stack which is
+     * freed by the kernel.
+     */
+    (void)pxTaskToDelete;
+}
+/*-----------------------------------------------------------*/
+
+#if ( configNUMBER_OF_CORES > 1 )
+
+/*
+ * Releases the context the core switched away from, which has been saved
+ * now. Called on the resumed context with interrupts masked.
+ */
+static void prvFinishSwitch( void )
+{
+    Core_t *pxCore = &xCores[ portGET_CORE_ID() ];
+
+    if ( pxCore->pxPreviousContext != NULL )
+    {
+        __atomic_store_n( &pxCore->pxPreviousContext->xRunning, pdFALSE, __ATOMIC_RELEASE );
+        pxCore->pxPreviousContext = NULL;
+    }
+}
+
+#endif /* configNUMBER_OF_CORES > 1 */
+/*-----------------------------------------------------------*/
+
+static void prvTaskStart( void )
+{
+    Context_t *pxContext = prvGetCurrentContextMasked();
+
+#if ( configNUMBER_OF_CORES > 1 )
+    prvFinishSwitch();
+#endif
+
+    /* Started for the first time, thus this task didn't previously call
+     * prvSwitchContext(). Enable interrupts for it. */
+    pxContext->uxCriticalNesting = 0;
+    pxContext->xInterruptsDisabled = pdFALSE;
+    prvRunPendingInterrupts( pxContext );
+
+    /* Call the task's entry point. */
+    pxContext->pxCode( pxContext->pvParams );
+
+    /* A function that implements a task must not exit or attempt to return to
+    * its caller as there is nothing to return to. If a task wants to exit it
+    * should instead call vTaskDelete( NULL ). Artificially force an assert()
+    * to be triggered if configASSERT() is defined, so application writers can
+    * catch the error. */
+    configASSERT( pdFALSE );
+}
+/*-----------------------------------------------------------*/
+
+static void prvSwitchContext( Context_t *pxContextToResume,
+                              Context_t *pxContextToSuspend )
+{
+    Core_t *pxCore = &xCores[ portGET_CORE_ID() ];
+    int iSavedErrno;
+
+    if ( pxContextToSuspend != pxContextToResume )
+    {
+#if ( configNUMBER_OF_CORES > 1 )
+        /* The task may just have been switched out by another core, which
+         * may not have saved its context yet. */
+        while ( __atomic_load_n( &pxContextToResume->xRunning, __ATOMIC_ACQUIRE ) )
+        {
+        }
+        pxContextToResume->xRunning = pdTRUE;
+        pxCore->pxPreviousContext = pxContextToSuspend;
+        __atomic_store_n( &pxCore->uxSwitches, pxCore->uxSwitches + 1, __ATOMIC_RELEASE );
+#endif
+        pxCore->pxCurrentContext = pxContextToResume;
+
+        if ( pxContextToSuspend->xDying )
+        {
+            /* The task is never resumed, so its context doesn't need to be
+             * saved. Its stack is freed by the idle task after the switch. */
+            (void)setcontext( &pxContextToResume->xContext );
+            prvFatalError( "setcontext", errno );
+        }
+
+        /*
+         * Switch tasks.
+         *
+         * The interrupt mask is kept in the context. errno is per-task, so
+         * save it on the stack of the current (suspending) task, restoring
+         * it when we switch back to this task.
+         */
+        iSavedErrno = errno;
+
+        if ( swapcontext( &pxContextToSuspend->xContext, &pxContextToResume->xContext ) )
+        {
+            prvFatalError( "swapcontext", errno );
+        }
+
+        prvRestoreErrno( iSavedErrno );
+
+#if ( configNUMBER_OF_CORES > 1 )
+        prvFinishSwitch();
+#endif
+    }
+}
+/*-----------------------------------------------------------*/
+
+static void prvSetupSignalsAndSchedulerPolicy( void )
+{
+    struct sigaction sigtick;
+    int iRet;
+
+    xCores[ 0 ].xThread = pthread_self();
+
+    /* The interrupt handlers mustn't be nested. System calls interrupted by
+     * an interrupt are restarted as it is not a signal the task is waiting
+     * for. */
+    sigtick.sa_flags = SA_RESTART;
+    sigtick.sa_handler = vPortSystemTickHandler;
+    sigfillset( &sigtick.sa_mask );
+
+    iRet = sigaction( SIGALRM, &sigtick, NULL );
+    if ( iRet )
+    {
+        prvFatalError( "sigaction", errno );
+    }
+
+#if ( configNUMBER_OF_CORES > 1 )
+    sigtick.sa_handler = vPortInterCoreHandler;
+
+    iRet = sigaction( SIG_INTERCORE, &sigtick, NULL );
+    if ( iRet )
+    {
+        prvFatalError( "sigaction", errno );
+    }
+#endif
+}
+/*-----------------------------------------------------------*/
+
+unsigned long ulPortGetRunTime( void )
+{
+    struct tms xTimes;
+
+    times( &xTimes );
+
+    return ( unsigned long ) xTimes.tms_utime;
+}
+/*-----------------------------------------------------------*/
@@ -230,6 +230,10 @@
         #undef INLINE /* to avoid redefinition */
     #endif /* CONFIG_SYSVIEW_ENABLE */
 
+    #if CONFIG_ESP_SCHED_PROF_ENABLE
+        #include "esp_private/sched_prof_freertos.h"
+    #endif /* CONFIG_ESP_SCHED_PROF_ENABLE */
+
     #if CONFIG_FREERTOS_SMP
 
 /* Default values for trace macros added to ESP-IDF implementation of SYSVIEW
@@ -14,16 +14,7 @@
 #include "esp_log.h"
 #include "heap_private.h"
 #include "esp_system.h"
-
-#ifdef CONFIG_HEAP_USE_HOOKS
-#define CALL_HOOK(hook, ...) {      \
-    if (hook != NULL) {             \
-        hook(__VA_ARGS__);          \
-    }                               \
-}
-#else
-#define CALL_HOOK(hook, ...) {}
-#endif
+#include "esp_heap_caps_slab.h"
 
 /* Forward declaration for base function, put in IRAM.
  * These functions don't check for errors after trying to allocate memory. */
@@ -114,14 +105,164 @@ bool heap_caps_match(const heap_t *heap, uint32_t caps)
 }
 
 
+/* Bookkeeping after memory was allocated in a heap, see heap_t. It is done after the heap lock was released
+   by multi_heap, so the fields are only accessed atomically. */
+HEAP_IRAM_ATTR static inline void heap_note_alloc(heap_t *heap)
+{
+    __atomic_fetch_add(&heap->seq, 1, __ATOMIC_RELEASE);
+}
+
+/* Bookkeeping after memory was freed in a heap, larger blocks may be available again */
+HEAP_IRAM_ATTR static inline void heap_note_free(heap_t *heap)
+{
+    __atomic_fetch_add(&heap->seq, 1, __ATOMIC_SEQ_CST);
+    // pairs with the fence in heap_note_alloc_failed(): either it sees the new seq or this sees its hint
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&heap->alloc_fail_hint, __ATOMIC_RELAXED) != 0) {
+        __atomic_store_n(&heap->alloc_fail_hint, 0, __ATOMIC_RELAXED);
+    }
+}
+
+/* Remember that an allocation of (heap-internal) size failed, larger allocations won't succeed either until
+   something is freed. seq is the value of heap->seq before the allocation was tried. */
+HEAP_IRAM_ATTR static void heap_note_alloc_failed(heap_t *heap, size_t size, uint32_t seq)
+{
+    const size_t fail_hint = __atomic_load_n(&heap->alloc_fail_hint, __ATOMIC_RELAXED);
+    if (fail_hint != 0 && size >= fail_hint) {
+        return;
+    }
+    __atomic_store_n(&heap->alloc_fail_hint, size, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&heap->seq, __ATOMIC_RELAXED) != seq) {
+        // the heap changed since the allocation was tried, memory may have been freed in the meantime
+        __atomic_store_n(&heap->alloc_fail_hint, 0, __ATOMIC_RELAXED);
+    }
+}
+
+/* Quick check whether an allocation of (heap-internal) size can succeed in a heap, based on its free
+   size and on the allocations which failed in it. May be wrong if the heap is used concurrently. */
+HEAP_IRAM_ATTR static inline bool heap_may_fit(const heap_t *heap, size_t size)
+{
+    const size_t fail_hint = __atomic_load_n(&heap->alloc_fail_hint, __ATOMIC_RELAXED);
+    return (fail_hint == 0 || size < fail_hint) && multi_heap_free_size(heap->heap) >= size;
+}
+
+typedef void *(*heap_alloc_fn_t)(heap_t *heap, size_t size, size_t alignment, uint32_t caps);
+
+/*
+Try the heaps which can satisfy all the requested capabilities in priority order, until alloc succeeds.
+
+With the capability index, each heap is only tried once, at the first priority where it has one of the
+requested capabilities. Heaps which are known to be too full for the allocation are skipped at first,
+and only tried when no other heap could satisfy the request.
+*/
+HEAP_IRAM_ATTR static void *heap_caps_alloc_prio_order(size_t size, size_t alignment, uint32_t caps, heap_alloc_fn_t alloc)
+{
+    void *ret = NULL;
+    uint32_t eligible;
+
+    if (heap_index_lookup(caps, &eligible)) {
+        uint32_t skipped[SOC_MEMORY_TYPE_NO_PRIOS] = { 0 };
+        for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+            uint32_t candidates = eligible & heap_index_prio_lookup(prio, caps);
+            eligible &= ~candidates;
+            for (; candidates != 0; candidates &= candidates - 1) {
+                heap_t *heap = heap_index.heaps[__builtin_ctz(candidates)];
+                if (heap->heap == NULL) {
+                    continue;
+                }
+                if (!heap_may_fit(heap, size)) {
+                    skipped[prio] |= candidates & -candidates;
+                    continue;
+                }
+                ret = alloc(heap, size, alignment, caps);
+                if (ret != NULL) {
+                    return ret;
+                }
+            }
+        }
+        for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+            for (uint32_t candidates = skipped[prio]; candidates != 0; candidates &= candidates - 1) {
+                ret = alloc(heap_index.heaps[__builtin_ctz(candidates)], size, alignment, caps);
+                if (ret != NULL) {
+                    return ret;
+                }
+            }
+        }
+        return NULL;
+    }
+
+    for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+        //Iterate over heaps and check capabilities at this priority
+        heap_t *heap;
+        SLIST_FOREACH(heap, &registered_heaps, next) {
+            if (heap->heap == NULL) {
+                continue;
+            }
+            if ((heap->caps[prio] & caps) != 0) {
+                //Heap has at least one of the caps requested. If caps has other bits set that this prio
+                //doesn't cover, see if they're available in other prios.
+                if ((get_all_caps(heap) & caps) == caps) {
+                    //This heap can satisfy all the requested capabilities. See if we can grab some memory using it.
+                    ret = alloc(heap, size, alignment, caps);
+                    if (ret != NULL) {
+                        return ret;
+                    }
+                }
+            }
+        }
+    }
+
+    //Nothing usable found.
+    return NULL;
+}
+
+HEAP_IRAM_ATTR static void *heap_caps_malloc_in_heap(heap_t *heap, size_t size, size_t alignment, uint32_t caps)
+{
+    void *ret;
+    size_t heap_size;
+    const uint32_t seq = __atomic_load_n(&heap->seq, __ATOMIC_ACQUIRE);
+    (void)alignment;
+
+    // If MALLOC_CAP_EXEC is requested but the DRAM and IRAM are on the same addresses (like on esp32c6)
+    // proceed as for a default allocation.
+    if ((caps & MALLOC_CAP_EXEC) && !esp_dram_match_iram() && esp_ptr_in_diram_dram((void *)heap->start)) {
+        //This is special, insofar that what we're going to get back is a DRAM address. If so,
+        //we need to 'invert' it (lowest address in DRAM == highest address in IRAM and vice-versa) and
+        //add a pointer to the DRAM equivalent before the address we're going to return.
+        heap_size = MULTI_HEAP_ADD_BLOCK_OWNER_SIZE(size) + 4;  // int overflow checked above
+        ret = multi_heap_malloc(heap->heap, heap_size);
+        if (ret != NULL) {
+            heap_note_alloc(heap);
+            MULTI_HEAP_SET_BLOCK_OWNER(ret);
+            ret = MULTI_HEAP_ADD_BLOCK_OWNER_OFFSET(ret);
+            uint32_t *iptr = dram_alloc_to_iram_addr(ret, size + 4);  // int overflow checked above
+            CALL_HOOK(esp_heap_trace_alloc_hook, iptr, size, caps);
+            return iptr;
+        }
+    } else {
+        //Just try to alloc, nothing special.
+        heap_size = MULTI_HEAP_ADD_BLOCK_OWNER_SIZE(size);
+        ret = multi_heap_malloc(heap->heap, heap_size);
+        if (ret != NULL) {
+            heap_note_alloc(heap);
+            MULTI_HEAP_SET_BLOCK_OWNER(ret);
+            ret = MULTI_HEAP_ADD_BLOCK_OWNER_OFFSET(ret);
+            CALL_HOOK(esp_heap_trace_alloc_hook, ret, size, caps);
+            return ret;
+        }
+    }
+
+    heap_note_alloc_failed(heap, heap_size, seq);
+    return NULL;
+}
+
 /*
 This function should not be called directly as it does not
 check for failure / call heap_caps_alloc_failed()
 */
 HEAP_IRAM_ATTR static void *heap_caps_malloc_base( size_t size, uint32_t caps)
 {
-    void *ret = NULL;
-
     // remove block owner size to HEAP_SIZE_MAX rather than adding the block owner size
     // to size to prevent overflows.
     if (size == 0 || size > MULTI_HEAP_REMOVE_BLOCK_OWNER_SIZE(HEAP_SIZE_MAX) ) {
@@ -148,52 +289,9 @@ HEAP_IRAM_ATTR static void *heap_caps_malloc_base( size_t size, uint32_t caps)
         size = (size + 3) & (~3); // int overflow checked above
     }
 
-    for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
-        //Iterate over heaps and check capabilities at this priority
-        heap_t *heap;
-        SLIST_FOREACH(heap, &registered_heaps, next) {
-            if (heap->heap == NULL) {
-                continue;
-            }
-            if ((heap->caps[prio] & caps) != 0) {
-                //Heap has at least one of the caps requested. If caps has other bits set that this prio
-                //doesn't cover, see if they're available in other prios.
-                if ((get_all_caps(heap) & caps) == caps) {
-                    //This heap can satisfy all the requested capabilities. See if we can grab some memory using it.
-                    // If MALLOC_CAP_EXEC is requested but the DRAM and IRAM are on the same addresses (like on esp32c6)
-                    // proceed as for a default allocation.
-                    if ((caps & MALLOC_CAP_EXEC) && !esp_dram_match_iram() && esp_ptr_in_diram_dram((void *)heap->start)) {
-                        //This is special, insofar that what we're going to get back is a DRAM address. If so,
-                        //we need to 'invert' it (lowest address in DRAM == highest address in IRAM and vice-versa) and
-                        //add a pointer to the DRAM equivalent before the address we're going to return.
-                        ret = multi_heap_malloc(heap->heap, MULTI_HEAP_ADD_BLOCK_OWNER_SIZE(size) + 4);  // int overflow checked above
-                        if (ret != NULL) {
-                            MULTI_HEAP_SET_BLOCK_OWNER(ret);
-                            ret = MULTI_HEAP_ADD_BLOCK_OWNER_OFFSET(ret);
-                            uint32_t *iptr = dram_alloc_to_iram_addr(ret, size + 4);  // int overflow checked above
-                            CALL_HOOK(esp_heap_trace_alloc_hook, iptr, size, caps);
-                            return iptr;
-                        }
-                    } else {
-                        //Just try to alloc, nothing special.
-                        ret = multi_heap_malloc(heap->heap, MULTI_HEAP_ADD_BLOCK_OWNER_SIZE(size));
-                        if (ret != NULL) {
-                            MULTI_HEAP_SET_BLOCK_OWNER(ret);
-                            ret = MULTI_HEAP_ADD_BLOCK_OWNER_OFFSET(ret);
-                            CALL_HOOK(esp_heap_trace_alloc_hook, ret, size, caps);
-                            return ret;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    //Nothing usable found.
-    return NULL;
+    return heap_caps_alloc_prio_order(size, 0, caps, heap_caps_malloc_in_heap);
 }
 
-
 /*
 Routine to allocate a bit of memory with certain capabilities. caps is a bitfield of MALLOC_CAP_* bits.
 */
@@ -391,6 +489,7 @@ HEAP_IRAM_ATTR void heap_caps_free( void *ptr)
     heap_t *heap = find_containing_heap(block_owner_ptr);
     assert(heap != NULL && "free() target pointer is outside heap areas");
     multi_heap_free(heap->heap, block_owner_ptr);
+    heap_note_free(heap);
 
     CALL_HOOK(esp_heap_trace_free_hook, ptr);
 }
@@ -455,6 +554,8 @@ HEAP_IRAM_ATTR static void *heap_caps_realloc_base( void *ptr, size_t size, uint
         // (which will resize the block if it can)
         void *r = multi_heap_realloc(heap->heap, ptr, MULTI_HEAP_ADD_BLOCK_OWNER_SIZE(size));
         if (r != NULL) {
+            // the block may have shrunk or moved within the heap
+            heap_note_free(heap);
             MULTI_HEAP_SET_BLOCK_OWNER(r);
             r = MULTI_HEAP_ADD_BLOCK_OWNER_OFFSET(r);
             CALL_HOOK(esp_heap_trace_alloc_hook, r, size, caps);
@@ -531,39 +632,63 @@ HEAP_IRAM_ATTR void *heap_caps_calloc( size_t n, size_t size, uint32_t caps)
     return ptr;
 }
 
-size_t heap_caps_get_total_size(uint32_t caps)
+typedef void (*heap_visit_fn_t)(heap_t *heap, void *arg);
+
+/* Call visit for each heap which has all of the capabilities, in registered_heaps order */
+static void heap_caps_foreach_match(uint32_t caps, heap_visit_fn_t visit, void *arg)
 {
-    size_t total_size = 0;
+    uint32_t slots;
+    if (heap_index_lookup(caps, &slots)) {
+        for (; slots != 0; slots &= slots - 1) {
+            heap_t *heap = heap_index.heaps[__builtin_ctz(slots)];
+            if (heap->heap != NULL) {
+                visit(heap, arg);
+            }
+        }
+        return;
+    }
+
     heap_t *heap;
     SLIST_FOREACH(heap, &registered_heaps, next) {
         if (heap_caps_match(heap, caps)) {
-            total_size += (heap->end - heap->start);
+            visit(heap, arg);
         }
     }
+}
+
+static void add_total_size(heap_t *heap, void *total_size)
+{
+    *(size_t *)total_size += heap->end - heap->start;
+}
+
+static void add_free_size(heap_t *heap, void *free_size)
+{
+    *(size_t *)free_size += multi_heap_free_size(heap->heap);
+}
+
+static void add_minimum_free_size(heap_t *heap, void *minimum_free_size)
+{
+    *(size_t *)minimum_free_size += multi_heap_minimum_free_size(heap->heap);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps)
+{
+    size_t total_size = 0;
+    heap_caps_foreach_match(caps, add_total_size, &total_size);
     return total_size;
 }
 
 size_t heap_caps_get_free_size( uint32_t caps )
 {
     size_t ret = 0;
-    heap_t *heap;
-    SLIST_FOREACH(heap, &registered_heaps, next) {
-        if (heap_caps_match(heap, caps)) {
-            ret += multi_heap_free_size(heap->heap);
-        }
-    }
+    heap_caps_foreach_match(caps, add_free_size, &ret);
     return ret;
 }
 
 size_t heap_caps_get_minimum_free_size( uint32_t caps )
 {
     size_t ret = 0;
-    heap_t *heap;
-    SLIST_FOREACH(heap, &registered_heaps, next) {
-        if (heap_caps_match(heap, caps)) {
-            ret += multi_heap_minimum_free_size(heap->heap);
-        }
-    }
+    heap_caps_foreach_match(caps, add_minimum_free_size, &ret);
     return ret;
 }
 
@@ -598,6 +723,7 @@ esp_err_t heap_caps_monitor_local_minimum_free_size_start(void)
     heap = SLIST_FIRST(&registered_heaps);
     for (size_t counter = 0; counter < min_free_bytes_monitoring.counter; counter++) {
         size_t old_minimum = multi_heap_reset_minimum_free_bytes(heap->heap);
+        __atomic_fetch_add(&heap->seq, 1, __ATOMIC_RELEASE);
 
         if (min_free_bytes_monitoring.values[counter] > old_minimum) {
             min_free_bytes_monitoring.values[counter] = old_minimum;
@@ -620,6 +746,7 @@ esp_err_t heap_caps_monitor_local_minimum_free_size_stop(void)
     heap_t *heap = SLIST_FIRST(&registered_heaps);
     for (size_t counter = 0; counter < min_free_bytes_monitoring.counter; counter++) {
         multi_heap_restore_minimum_free_bytes(heap->heap, min_free_bytes_monitoring.values[counter]);
+        __atomic_fetch_add(&heap->seq, 1, __ATOMIC_RELEASE);
 
         heap = SLIST_NEXT(heap, next);
     }
@@ -633,28 +760,55 @@ esp_err_t heap_caps_monitor_local_minimum_free_size_stop(void)
 }
 
 
-void heap_caps_get_info( multi_heap_info_t *info, uint32_t caps )
+/* Get the info of a heap. Walking all blocks of the heap is slow, so the result is kept until
+   memory is allocated or freed in the heap again.
+   heap_mux is also the multi_heap lock, which is taken after the per-core cache locks. So it is
+   only held to read or publish the kept result, never around multi_heap_get_info(). */
+static void heap_get_info(heap_t *heap, multi_heap_info_t *info)
 {
-    memset(info, 0, sizeof(multi_heap_info_t));
+    const uint32_t seq = __atomic_load_n(&heap->seq, __ATOMIC_ACQUIRE);
 
-    heap_t *heap;
-    SLIST_FOREACH(heap, &registered_heaps, next) {
-        if (heap_caps_match(heap, caps)) {
-            multi_heap_info_t hinfo;
-            multi_heap_get_info(heap->heap, &hinfo);
-
-            info->total_free_bytes += hinfo.total_free_bytes - MULTI_HEAP_BLOCK_OWNER_SIZE();
-            info->total_allocated_bytes += (hinfo.total_allocated_bytes -
-                                           hinfo.allocated_blocks * MULTI_HEAP_BLOCK_OWNER_SIZE());
-            info->largest_free_block = MAX(info->largest_free_block,
-                                           hinfo.largest_free_block);
-            info->largest_free_block -= info->largest_free_block ? MULTI_HEAP_BLOCK_OWNER_SIZE() : 0;
-            info->minimum_free_bytes += hinfo.minimum_free_bytes - MULTI_HEAP_BLOCK_OWNER_SIZE();
-            info->allocated_blocks += hinfo.allocated_blocks;
-            info->free_blocks += hinfo.free_blocks;
-            info->total_blocks += hinfo.total_blocks;
-        }
+    MULTI_HEAP_LOCK(&heap->heap_mux);
+    const bool valid = heap->info_valid && heap->info_seq == seq;
+    if (valid) {
+        *info = heap->info;
+    }
+    MULTI_HEAP_UNLOCK(&heap->heap_mux);
+    if (valid) {
+        return;
     }
+
+    // if the heap changes meanwhile, seq has moved on and the result is not used again
+    multi_heap_get_info(heap->heap, info);
+    MULTI_HEAP_LOCK(&heap->heap_mux);
+    heap->info = *info;
+    heap->info_seq = seq;
+    heap->info_valid = true;
+    MULTI_HEAP_UNLOCK(&heap->heap_mux);
+}
+
+static void add_info(heap_t *heap, void *arg)
+{
+    multi_heap_info_t *info = (multi_heap_info_t *)arg;
+    multi_heap_info_t hinfo;
+    heap_get_info(heap, &hinfo);
+
+    info->total_free_bytes += hinfo.total_free_bytes - MULTI_HEAP_BLOCK_OWNER_SIZE();
+    info->total_allocated_bytes += (hinfo.total_allocated_bytes -
+                                   hinfo.allocated_blocks * MULTI_HEAP_BLOCK_OWNER_SIZE());
+    info->largest_free_block = MAX(info->largest_free_block,
+                                   hinfo.largest_free_block);
+    info->largest_free_block -= info->largest_free_block ? MULTI_HEAP_BLOCK_OWNER_SIZE() : 0;
+    info->minimum_free_bytes += hinfo.minimum_free_bytes - MULTI_HEAP_BLOCK_OWNER_SIZE();
+    info->allocated_blocks += hinfo.allocated_blocks;
+    info->free_blocks += hinfo.free_blocks;
+    info->total_blocks += hinfo.total_blocks;
+}
+
+void heap_caps_get_info( multi_heap_info_t *info, uint32_t caps )
+{
+    memset(info, 0, sizeof(multi_heap_info_t));
+    heap_caps_foreach_match(caps, add_info, info);
 }
 
 void heap_caps_print_heap_info( uint32_t caps )
@@ -677,6 +831,7 @@ void heap_caps_print_heap_info( uint32_t caps )
     heap_caps_get_info(&info, caps);
 
     printf("    free %d allocated %d min_free %d largest_free_block %d\n", info.total_free_bytes, info.total_allocated_bytes, info.minimum_free_bytes, info.largest_free_block);
+    heap_caps_slab_print_info(caps);
 }
 
 bool heap_caps_check_integrity(uint32_t caps, bool print_errors)
@@ -737,35 +892,23 @@ size_t heap_caps_get_allocated_size( void *ptr )
     return MULTI_HEAP_REMOVE_BLOCK_OWNER_SIZE(size);
 }
 
-static HEAP_IRAM_ATTR void *heap_caps_aligned_alloc_base(size_t alignment, size_t size, uint32_t caps)
+HEAP_IRAM_ATTR static void *heap_caps_aligned_alloc_in_heap(heap_t *heap, size_t size, size_t alignment, uint32_t caps)
 {
-    for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
-        //Iterate over heaps and check capabilities at this priority
-        heap_t *heap;
-        SLIST_FOREACH(heap, &registered_heaps, next) {
-            if (heap->heap == NULL) {
-                continue;
-            }
-            if ((heap->caps[prio] & caps) != 0) {
-                //Heap has at least one of the caps requested. If caps has other bits set that this prio
-                //doesn't cover, see if they're available in other prios.
-                if ((get_all_caps(heap) & caps) == caps) {
-                    // Just try to alloc, nothing special. Provide the size of the block owner
-                    // as an offset to prevent a miscalculation of the alignment.
-                    void *ret = multi_heap_aligned_alloc_offs(heap->heap, MULTI_HEAP_ADD_BLOCK_OWNER_SIZE(size), alignment, MULTI_HEAP_BLOCK_OWNER_SIZE());
-                    if (ret != NULL) {
-                        MULTI_HEAP_SET_BLOCK_OWNER(ret);
-                        ret = MULTI_HEAP_ADD_BLOCK_OWNER_OFFSET(ret);
-                        CALL_HOOK(esp_heap_trace_alloc_hook, ret, size, caps);
-                        return ret;
-                    }
-                }
-            }
-        }
+    // Just try to alloc, nothing special. Provide the size of the block owner
+    // as an offset to prevent a miscalculation of the alignment.
+    void *ret = multi_heap_aligned_alloc_offs(heap->heap, MULTI_HEAP_ADD_BLOCK_OWNER_SIZE(size), alignment, MULTI_HEAP_BLOCK_OWNER_SIZE());
+    if (ret != NULL) {
+        heap_note_alloc(heap);
+        MULTI_HEAP_SET_BLOCK_OWNER(ret);
+        ret = MULTI_HEAP_ADD_BLOCK_OWNER_OFFSET(ret);
+        CALL_HOOK(esp_heap_trace_alloc_hook, ret, size, caps);
     }
+    return ret;
+}
 
-    //Nothing usable found.
-    return NULL;
+static HEAP_IRAM_ATTR void *heap_caps_aligned_alloc_base(size_t alignment, size_t size, uint32_t caps)
+{
+    return heap_caps_alloc_prio_order(size, alignment, caps, heap_caps_aligned_alloc_in_heap);
 }
 
 static HEAP_IRAM_ATTR esp_err_t heap_caps_aligned_check_args(size_t alignment, size_t size, uint32_t caps, const char *funcname)
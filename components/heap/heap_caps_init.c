@@ -21,6 +21,30 @@ static const char *TAG = "heap_init";
 /* Linked-list of registered heaps */
 struct registered_heap_ll registered_heaps;
 
+/* Capability index of registered_heaps */
+heap_index_t heap_index = { .next_slot = HEAP_INDEX_SLOTS - 1 };
+
+void heap_index_add(heap_t *heap)
+{
+    if (heap_index.next_slot < 0) {
+        heap_index.overflow = true;
+        return;
+    }
+    const int slot = heap_index.next_slot--;
+    const uint32_t bit = 1UL << slot;
+    for (int cap = 0; cap < HEAP_INDEX_CAP_BITS; cap++) {
+        for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+            if (heap->caps[prio] & (1UL << cap)) {
+                heap_index.all_caps[cap] |= bit;
+                heap_index.prio_caps[prio][cap] |= bit;
+            }
+        }
+    }
+    heap_index.heaps[slot] = heap;
+    /* publish the slot last, lookups don't take a lock */
+    __atomic_fetch_or(&heap_index.slots, bit, __ATOMIC_RELEASE);
+}
+
 ESP_SYSTEM_INIT_FN(init_heap, CORE, BIT(0), 100)
 {
     heap_caps_init();
@@ -106,6 +130,7 @@ void heap_caps_init(void)
         heap_idx++;
         assert(heap_idx <= num_heaps);
 
+        memset(heap, 0, sizeof(heap_t));
         memcpy(heap->caps, type->caps, sizeof(heap->caps));
         heap->start = region->start;
         heap->end = region->start + region->size;
@@ -154,6 +179,11 @@ void heap_caps_init(void)
             SLIST_INSERT_AFTER(&heaps_array[i-1], &heaps_array[i], next);
         }
     }
+
+    /* Index the heaps in the reverse order, as if each one was inserted at the head of the list */
+    for (size_t i = num_heaps; i > 0; i--) {
+        heap_index_add(&heaps_array[i - 1]);
+    }
 }
 
 esp_err_t heap_caps_add_region(intptr_t start, intptr_t end)
@@ -234,6 +264,7 @@ esp_err_t heap_caps_add_region_with_caps(const uint32_t caps[], intptr_t start,
         err = ESP_ERR_NO_MEM;
         goto done;
     }
+    memset(p_new, 0, sizeof(heap_t));
     memcpy(p_new->caps, caps, sizeof(p_new->caps));
     p_new->start = start;
     p_new->end = end;
@@ -251,6 +282,7 @@ esp_err_t heap_caps_add_region_with_caps(const uint32_t caps[], intptr_t start,
        only for writers. */
     static multi_heap_lock_t registered_heaps_write_lock = MULTI_HEAP_LOCK_STATIC_INITIALIZER;
     MULTI_HEAP_LOCK(&registered_heaps_write_lock);
+    heap_index_add(p_new);
     SLIST_INSERT_HEAD(&registered_heaps, p_new, next);
     MULTI_HEAP_UNLOCK(&registered_heaps_write_lock);
 
@@ -0,0 +1,318 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/param.h>
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_caps_slab.h"
+#include "heap_private.h"
+#include "freertos/FreeRTOS.h"
+
+/* Per-core cache of free objects.
+
+   A magazine is only accessed by the core owning it, with interrupts masked, so no lock is needed.
+   When it runs empty it is refilled with half its capacity from the shared free list, when it is full
+   half of it is returned to the shared free list. This amortizes the slab lock over several operations.
+*/
+typedef struct {
+    size_t count;
+    void *objs[];
+} slab_magazine_t;
+
+struct heap_caps_slab {
+    multi_heap_lock_t lock;
+    void *free_list;            ///< Free objects not held in magazines, linked through their first word
+    size_t free_count;          ///< Number of objects in free_list
+    size_t min_free_count;      ///< Lowest number of free objects (including magazines) since creation
+    size_t obj_size;
+    size_t stride;              ///< Distance between objects, obj_size rounded up to pointer alignment
+    size_t count;
+    uint32_t caps;
+    uint8_t *objs;
+    size_t magazine_size;
+    slab_magazine_t *magazines[portNUM_PROCESSORS];
+    SLIST_ENTRY(heap_caps_slab) next;
+};
+
+/* All slabs, for heap_caps_slab_print_info() */
+static SLIST_HEAD(slab_ll, heap_caps_slab) s_slabs = SLIST_HEAD_INITIALIZER(s_slabs);
+static multi_heap_lock_t s_slabs_lock = MULTI_HEAP_LOCK_STATIC_INITIALIZER;
+
+heap_caps_slab_handle_t heap_caps_slab_create(size_t obj_size, size_t count, uint32_t caps)
+{
+    const heap_caps_slab_config_t config = {
+        .obj_size = obj_size,
+        .count = count,
+        .caps = caps,
+        .magazine_size = 0,
+    };
+    return heap_caps_slab_create_with_config(&config);
+}
+
+heap_caps_slab_handle_t heap_caps_slab_create_with_config(const heap_caps_slab_config_t *config)
+{
+    if (config == NULL || config->obj_size == 0 || config->count == 0) {
+        return NULL;
+    }
+
+    /* Free objects hold the free list link, so they must be at least pointer sized and aligned */
+    const size_t align = sizeof(void *);
+    if (config->obj_size > SIZE_MAX - align) {
+        return NULL;
+    }
+    const size_t stride = (MAX(config->obj_size, align) + align - 1) & ~(align - 1);
+    if (config->count > SIZE_MAX / stride) {
+        return NULL;
+    }
+
+    size_t magazine_bytes = 0;
+    if (config->magazine_size > 0) {
+        if (config->magazine_size > (SIZE_MAX / portNUM_PROCESSORS - sizeof(slab_magazine_t)) / sizeof(void *)) {
+            return NULL;
+        }
+        magazine_bytes = sizeof(slab_magazine_t) + config->magazine_size * sizeof(void *);
+    }
+
+    /* Bookkeeping is always in internal memory, it is accessed from ISRs and must not live in the objects' memory */
+    heap_caps_slab_handle_t slab = heap_caps_calloc(1, sizeof(struct heap_caps_slab) + magazine_bytes * portNUM_PROCESSORS,
+                                                    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (slab == NULL) {
+        return NULL;
+    }
+    slab->objs = heap_caps_malloc(stride * config->count, config->caps);
+    if (slab->objs == NULL) {
+        heap_caps_free(slab);
+        return NULL;
+    }
+
+    MULTI_HEAP_LOCK_INIT(&slab->lock);
+    slab->obj_size = config->obj_size;
+    slab->stride = stride;
+    slab->count = config->count;
+    slab->caps = config->caps;
+    slab->magazine_size = config->magazine_size;
+    if (magazine_bytes > 0) {
+        uint8_t *mag = (uint8_t *)(slab + 1);
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            slab->magazines[core] = (slab_magazine_t *)(mag + core * magazine_bytes);
+        }
+    }
+
+    /* Link the free list in address order, so a fresh slab hands out objects from its start */
+    for (size_t i = config->count; i > 0; i--) {
+        void **obj = (void **)(slab->objs + (i - 1) * stride);
+        *obj = slab->free_list;
+        slab->free_list = obj;
+    }
+    slab->free_count = config->count;
+    slab->min_free_count = config->count;
+
+    MULTI_HEAP_LOCK(&s_slabs_lock);
+    SLIST_INSERT_HEAD(&s_slabs, slab, next);
+    MULTI_HEAP_UNLOCK(&s_slabs_lock);
+
+    return slab;
+}
+
+void heap_caps_slab_delete(heap_caps_slab_handle_t slab)
+{
+    if (slab == NULL) {
+        return;
+    }
+    MULTI_HEAP_LOCK(&s_slabs_lock);
+    SLIST_REMOVE(&s_slabs, slab, heap_caps_slab, next);
+    MULTI_HEAP_UNLOCK(&s_slabs_lock);
+
+    heap_caps_free(slab->objs);
+    heap_caps_free(slab);
+}
+
+/* Number of free objects, including the ones cached in magazines. Magazine counts of other cores are read
+   without synchronization, the result is exact when no other core is using the slab. */
+static HEAP_IRAM_ATTR size_t slab_free_objects(heap_caps_slab_handle_t slab)
+{
+    size_t free_objects = slab->free_count;
+    if (slab->magazine_size > 0) {
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            free_objects += slab->magazines[core]->count;
+        }
+    }
+    return free_objects;
+}
+
+/* Pop an object from the shared free list, slab lock must be held */
+static inline HEAP_IRAM_ATTR void *slab_pop(heap_caps_slab_handle_t slab)
+{
+    void **obj = slab->free_list;
+    if (obj != NULL) {
+        slab->free_list = *obj;
+        slab->free_count--;
+    }
+    return obj;
+}
+
+/* Push an object to the shared free list, slab lock must be held */
+static inline HEAP_IRAM_ATTR void slab_push(heap_caps_slab_handle_t slab, void *obj)
+{
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->free_count++;
+}
+
+static inline HEAP_IRAM_ATTR void slab_update_min_free(heap_caps_slab_handle_t slab)
+{
+    size_t free_objects = slab_free_objects(slab);
+    if (free_objects < slab->min_free_count) {
+        slab->min_free_count = free_objects;
+    }
+}
+
+static HEAP_IRAM_ATTR void *slab_magazine_alloc(heap_caps_slab_handle_t slab)
+{
+    void *obj = NULL;
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    slab_magazine_t *mag = slab->magazines[xPortGetCoreID()];
+
+    if (mag->count > 0) {
+        obj = mag->objs[--mag->count];
+    } else {
+        const size_t batch = MAX(slab->magazine_size / 2, 1);
+        MULTI_HEAP_LOCK(&slab->lock);
+        while (mag->count < batch && (obj = slab_pop(slab)) != NULL) {
+            mag->objs[mag->count++] = obj;
+        }
+        obj = (mag->count > 0) ? mag->objs[--mag->count] : NULL;
+        /* only updated on refill, so the minimum is exact to within the magazine capacity */
+        slab_update_min_free(slab);
+        MULTI_HEAP_UNLOCK(&slab->lock);
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+    return obj;
+}
+
+static HEAP_IRAM_ATTR void slab_magazine_free(heap_caps_slab_handle_t slab, void *obj)
+{
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    slab_magazine_t *mag = slab->magazines[xPortGetCoreID()];
+
+    if (mag->count == slab->magazine_size) {
+        const size_t batch = MAX(slab->magazine_size / 2, 1);
+        MULTI_HEAP_LOCK(&slab->lock);
+        for (size_t i = 0; i < batch; i++) {
+            slab_push(slab, mag->objs[--mag->count]);
+        }
+        MULTI_HEAP_UNLOCK(&slab->lock);
+    }
+    mag->objs[mag->count++] = obj;
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+}
+
+HEAP_IRAM_ATTR void *heap_caps_slab_alloc(heap_caps_slab_handle_t slab)
+{
+    assert(slab != NULL);
+    void *obj;
+
+    if (slab->magazine_size > 0) {
+        obj = slab_magazine_alloc(slab);
+    } else {
+        MULTI_HEAP_LOCK(&slab->lock);
+        obj = slab_pop(slab);
+        slab_update_min_free(slab);
+        MULTI_HEAP_UNLOCK(&slab->lock);
+    }
+
+    if (obj != NULL) {
+        CALL_HOOK(esp_heap_trace_alloc_hook, obj, slab->obj_size, slab->caps);
+    }
+    return obj;
+}
+
+HEAP_IRAM_ATTR void heap_caps_slab_free(heap_caps_slab_handle_t slab, void *obj)
+{
+    assert(slab != NULL);
+    if (obj == NULL) {
+        return;
+    }
+
+    const uintptr_t offset = (uintptr_t)obj - (uintptr_t)slab->objs;
+    assert(offset < slab->stride * slab->count && offset % slab->stride == 0
+           && "heap_caps_slab_free() target pointer is not an object of this slab");
+    (void)offset;
+
+    if (slab->magazine_size > 0) {
+        slab_magazine_free(slab, obj);
+    } else {
+        MULTI_HEAP_LOCK(&slab->lock);
+        slab_push(slab, obj);
+        MULTI_HEAP_UNLOCK(&slab->lock);
+    }
+
+    CALL_HOOK(esp_heap_trace_free_hook, obj);
+}
+
+HEAP_IRAM_ATTR size_t heap_caps_slab_get_obj_size(heap_caps_slab_handle_t slab)
+{
+    assert(slab != NULL);
+    return slab->obj_size;
+}
+
+void heap_caps_slab_get_info(heap_caps_slab_handle_t slab, multi_heap_info_t *info)
+{
+    assert(slab != NULL && info != NULL);
+    memset(info, 0, sizeof(multi_heap_info_t));
+
+    MULTI_HEAP_LOCK(&slab->lock);
+    const size_t free_objects = slab_free_objects(slab);
+    const size_t min_free_objects = slab->min_free_count;
+    MULTI_HEAP_UNLOCK(&slab->lock);
+
+    info->total_free_bytes = free_objects * slab->obj_size;
+    info->total_allocated_bytes = (slab->count - free_objects) * slab->obj_size;
+    info->largest_free_block = (free_objects > 0) ? slab->obj_size : 0;
+    info->minimum_free_bytes = min_free_objects * slab->obj_size;
+    info->allocated_blocks = slab->count - free_objects;
+    info->free_blocks = free_objects;
+    info->total_blocks = slab->count;
+}
+
+void heap_caps_slab_print_info(uint32_t caps)
+{
+    /* Can't print while holding the registry spinlock, so look up each slab again by index. Slabs
+       created or deleted meanwhile may be skipped or printed twice, this is only a diagnostic summary. */
+    for (size_t index = 0; ; index++) {
+        multi_heap_info_t info;
+        heap_caps_slab_handle_t slab;
+        void *objs = NULL;
+        size_t obj_size = 0;
+        size_t i = 0;
+
+        MULTI_HEAP_LOCK(&s_slabs_lock);
+        SLIST_FOREACH(slab, &s_slabs, next) {
+            if ((slab->caps & caps) == caps && i++ == index) {
+                heap_caps_slab_get_info(slab, &info);
+                objs = slab->objs;
+                obj_size = slab->obj_size;
+                break;
+            }
+        }
+        MULTI_HEAP_UNLOCK(&s_slabs_lock);
+
+        if (slab == NULL) {
+            break;
+        }
+        if (index == 0) {
+            printf("  Slabs:\n");
+        }
+        printf("    At %p obj_size %d objects %d free %d min_free %d\n",
+               objs, obj_size, info.total_blocks, info.free_blocks, info.minimum_free_bytes / obj_size);
+    }
+}
@@ -29,6 +29,11 @@ typedef struct heap_t_ {
     intptr_t end;
     multi_heap_lock_t heap_mux;
     multi_heap_handle_t heap;
+    size_t alloc_fail_hint;     ///< Smallest size which failed to allocate since the last free in this heap, 0 if none. Only a hint, not updated atomically with the heap. Accessed with atomics only.
+    uint32_t seq;               ///< Incremented whenever memory is allocated or freed in this heap. Accessed with atomics only.
+    uint32_t info_seq;          ///< Value of seq when info was last computed
+    bool info_valid;            ///< info holds the result of multi_heap_get_info() at info_seq
+    multi_heap_info_t info;
     SLIST_ENTRY(heap_t_) next;
 } heap_t;
 
@@ -42,6 +47,60 @@ extern SLIST_HEAD(registered_heap_ll, heap_t_) registered_heaps;
 
 bool heap_caps_match(const heap_t *heap, uint32_t caps);
 
+/* Capability index of the registered heaps, so that heaps matching some capabilities are found
+   without walking registered_heaps and checking each heap.
+
+   Each heap gets a slot in the index. Heaps take slots from the highest down in the order they are
+   inserted at the head of registered_heaps, so visiting the bits of a slot mask from the lowest to
+   the highest visits the heaps in list order.
+
+   Lookups fall back to walking registered_heaps if there are more heaps than slots, or if the
+   capabilities contain bits which are not indexed.
+*/
+#define HEAP_INDEX_SLOTS        32
+#define HEAP_INDEX_CAP_BITS     17      // MALLOC_CAP_EXEC to MALLOC_CAP_TCM
+#define HEAP_INDEX_CAPS_MASK    ((1UL << HEAP_INDEX_CAP_BITS) - 1)
+
+typedef struct {
+    uint32_t slots;             ///< Bit n set if slot n holds a heap. Updated last when a heap is added.
+    bool overflow;              ///< Some heaps are not in the index
+    int next_slot;              ///< Slot for the next heap, counting down. -1 if full.
+    heap_t *heaps[HEAP_INDEX_SLOTS];
+    uint32_t all_caps[HEAP_INDEX_CAP_BITS];                             ///< Bit n set if the heap in slot n has the capability at any priority
+    uint32_t prio_caps[SOC_MEMORY_TYPE_NO_PRIOS][HEAP_INDEX_CAP_BITS];  ///< Bit n set if the heap in slot n has the capability at this priority
+} heap_index_t;
+
+extern heap_index_t heap_index;
+
+/* Add a heap to the index, the heap must be inserted at the head of registered_heaps right after.
+   Callers must serialize calls. */
+void heap_index_add(heap_t *heap);
+
+/* Get the slots of all heaps having all of the capabilities.
+   Returns false if the index can't be used, callers need to walk registered_heaps instead. */
+inline static bool heap_index_lookup(uint32_t caps, uint32_t *slots)
+{
+    if (heap_index.overflow || (caps & ~HEAP_INDEX_CAPS_MASK) != 0) {
+        return false;
+    }
+    uint32_t mask = __atomic_load_n(&heap_index.slots, __ATOMIC_ACQUIRE);
+    for (uint32_t c = caps; c != 0; c &= c - 1) {
+        mask &= heap_index.all_caps[__builtin_ctz(c)];
+    }
+    *slots = mask;
+    return true;
+}
+
+/* Get the slots of all heaps having at least one of the capabilities at the given priority */
+inline static uint32_t heap_index_prio_lookup(int prio, uint32_t caps)
+{
+    uint32_t mask = 0;
+    for (uint32_t c = caps & HEAP_INDEX_CAPS_MASK; c != 0; c &= c - 1) {
+        mask |= heap_index.prio_caps[prio][__builtin_ctz(c)];
+    }
+    return mask;
+}
+
 /* return all possible capabilities (across all priorities) for a given heap */
 inline static uint32_t get_all_caps(const heap_t *heap)
 {
@@ -64,6 +123,17 @@ void *heap_caps_realloc_default(void *p, size_t size);
 void *heap_caps_malloc_default(size_t size);
 void *heap_caps_aligned_alloc_default(size_t alignment, size_t size);
 
+/* Call an allocation hook (see esp_heap_trace_alloc_hook() and esp_heap_trace_free_hook()) if it is defined */
+#ifdef CONFIG_HEAP_USE_HOOKS
+#define CALL_HOOK(hook, ...) {      \
+    if (hook != NULL) {             \
+        hook(__VA_ARGS__);          \
+    }                               \
+}
+#else
+#define CALL_HOOK(hook, ...) {}
+#endif
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,555 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <sdkconfig.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include "esp_log.h"
+
+#define HEAP_TRACE_SRCFILE /* don't warn on inclusion here */
+#include "esp_heap_trace.h"
+#undef HEAP_TRACE_SRCFILE
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+
+static __attribute__((unused)) const char* TAG = "heaptrace";
+
+#define STACK_DEPTH CONFIG_HEAP_TRACING_STACK_DEPTH
+
+#if CONFIG_HEAP_TRACING_SAMPLING
+
+/* Sampling heap profiler
+
+   Every core counts down the bytes allocated on it, an allocation which reaches zero is sampled and
+   the countdown is restarted with a random interval averaging sample_interval bytes. Only sampled
+   allocations read their call stack and take the trace lock, everything else is a few instructions.
+
+   Sampled allocations are aggregated by call stack in the callsite table. Each sample stands for
+   MAX(size, sample_interval) bytes: an allocation smaller than the interval is sampled with a
+   probability of about size / sample_interval, so this keeps the expected byte count right.
+
+   To attribute frees, the addresses of sampled allocations are kept in the live sample table. Every
+   free has to look its address up there, this is done without the lock: the table is protected by a
+   sequence counter which writers make odd while they modify it, readers retry if it changed.
+*/
+
+#define LIVE_SAMPLES        CONFIG_HEAP_TRACE_SAMPLING_LIVE_SAMPLES
+#define LIVE_SAMPLES_MAX    (LIVE_SAMPLES * 3 / 4) // limit the load factor to keep probe sequences short
+#define NOT_FOUND           SIZE_MAX
+
+typedef struct {
+    void *address;          // NULL if the slot is empty
+    uint32_t callsite;      // index in callsites.buffer
+    size_t weight;          // estimated bytes the sample stands for
+} live_sample_t;
+
+typedef struct {
+    size_t bytes_until_sample;
+    uint32_t rng;
+    size_t allocations;
+    size_t frees;
+} sampler_t;
+
+static portMUX_TYPE trace_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool tracing;
+static heap_trace_mode_t mode;
+static size_t sample_interval;
+
+/* Aggregated call stacks, open addressing on the call stack hash. Entries are only removed by
+   heap_trace_start(), an empty slot has alloc_count 0. */
+static struct {
+    heap_trace_callsite_t *buffer;
+    size_t capacity;
+    size_t count;
+} callsites;
+
+static live_sample_t *live_samples;
+static size_t live_count;
+static uint32_t live_seq;
+
+/* Only accessed by the owning core, with interrupts masked */
+static sampler_t samplers[portNUM_PROCESSORS];
+
+static size_t total_samples;
+static size_t dropped_samples;
+
+static void heap_trace_dump_base(bool leaks_only);
+static void live_write_begin(void);
+static void live_write_end(void);
+
+esp_err_t heap_trace_init_sampling(heap_trace_callsite_t *callsite_buffer, size_t num_callsites, size_t interval)
+{
+    if (tracing) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (callsite_buffer == NULL || num_callsites == 0 || interval == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (live_samples == NULL) {
+        ESP_LOGI(TAG, "live samples: allocating %" PRIu32 " bytes (Internal RAM)\n",
+                 (uint32_t)(sizeof(live_sample_t) * LIVE_SAMPLES));
+        live_samples = heap_caps_calloc(LIVE_SAMPLES, sizeof(live_sample_t), MALLOC_CAP_INTERNAL);
+        if (live_samples == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    callsites.buffer = callsite_buffer;
+    callsites.capacity = num_callsites;
+    callsites.count = 0;
+    sample_interval = interval;
+
+    return ESP_OK;
+}
+
+/* Random distance to the next sample, uniformly distributed with a mean of sample_interval.
+   Randomizing avoids always sampling the same allocation of a periodic allocation pattern. The gap is not
+   exponentially distributed, so the profile is an approximation, not an unbiased estimate. */
+static HEAP_IRAM_ATTR size_t next_sample_distance(sampler_t *sampler)
+{
+    uint32_t x = sampler->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sampler->rng = x;
+    return sample_interval / 2 + x % sample_interval;
+}
+
+static esp_err_t set_tracing(bool enable)
+{
+    if (tracing == enable) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    tracing = enable;
+    return ESP_OK;
+}
+
+esp_err_t heap_trace_start(heap_trace_mode_t mode_param)
+{
+    if (callsites.buffer == NULL || live_samples == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&trace_mux);
+
+    set_tracing(false);
+    mode = mode_param;
+
+    memset(callsites.buffer, 0, sizeof(heap_trace_callsite_t) * callsites.capacity);
+    callsites.count = 0;
+
+    live_write_begin();
+    memset(live_samples, 0, sizeof(live_sample_t) * LIVE_SAMPLES);
+    live_count = 0;
+    live_write_end();
+
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        samplers[i].rng = (esp_cpu_get_cycle_count() ^ (0x9e3779b9 * (i + 1))) | 1;
+        samplers[i].bytes_until_sample = next_sample_distance(&samplers[i]);
+        samplers[i].allocations = 0;
+        samplers[i].frees = 0;
+    }
+    total_samples = 0;
+    dropped_samples = 0;
+
+    const esp_err_t ret_val = set_tracing(true);
+
+    portEXIT_CRITICAL(&trace_mux);
+    return ret_val;
+}
+
+esp_err_t heap_trace_stop(void)
+{
+    portENTER_CRITICAL(&trace_mux);
+    const esp_err_t ret_val = set_tracing(false);
+    portEXIT_CRITICAL(&trace_mux);
+    return ret_val;
+}
+
+esp_err_t heap_trace_resume(void)
+{
+    portENTER_CRITICAL(&trace_mux);
+    const esp_err_t ret_val = set_tracing(true);
+    portEXIT_CRITICAL(&trace_mux);
+    return ret_val;
+}
+
+size_t heap_trace_get_count(void)
+{
+    return callsites.count;
+}
+
+esp_err_t heap_trace_get(size_t index, heap_trace_record_t *record)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t heap_trace_get_callsite(size_t index, heap_trace_callsite_t *callsite)
+{
+    if (callsites.buffer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (callsite == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t result = ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&trace_mux);
+    for (size_t i = 0; i < callsites.capacity; i++) {
+        if (callsites.buffer[i].alloc_count != 0 && index-- == 0) {
+            memcpy(callsite, &callsites.buffer[i], sizeof(heap_trace_callsite_t));
+            result = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&trace_mux);
+
+    return result;
+}
+
+esp_err_t heap_trace_summary(heap_trace_summary_t *summary)
+{
+    if (summary == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&trace_mux);
+    summary->mode = mode;
+    summary->total_allocations = 0;
+    summary->total_frees = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        summary->total_allocations += samplers[i].allocations;
+        summary->total_frees += samplers[i].frees;
+    }
+    summary->count = callsites.count;
+    summary->capacity = callsites.capacity;
+    summary->high_water_mark = callsites.count; // callsites are never removed
+    summary->has_overflowed = dropped_samples > 0;
+    portEXIT_CRITICAL(&trace_mux);
+
+    return ESP_OK;
+}
+
+void heap_trace_dump(void)
+{
+    heap_trace_dump_base(mode == HEAP_TRACE_LEAKS);
+}
+
+void heap_trace_dump_caps(const uint32_t caps)
+{
+    /* samples are aggregated by call stack, not by memory type */
+    heap_trace_dump_base(mode == HEAP_TRACE_LEAKS);
+}
+
+/* The dump is printed one callsite at a time, the lock is not held while printing. Every callsite is
+   one line starting with HEAPPROF, which tools/esp_app_trace/heap_profile_proc.py turns into a flame graph.
+*/
+static void heap_trace_dump_base(bool leaks_only)
+{
+    heap_trace_summary_t summary;
+    size_t live_bytes = 0;
+    size_t live_allocs = 0;
+
+    if (callsites.buffer == NULL) {
+        return;
+    }
+    heap_trace_summary(&summary);
+
+    esp_rom_printf("====== Heap Profile: %"PRIu32" callsites (%"PRIu32" capacity), sample interval %"PRIu32" bytes ======\n",
+                   summary.count, summary.capacity, sample_interval);
+    esp_rom_printf("# HEAPPROF alloc_count alloc_bytes live_count live_bytes callers\n");
+
+    for (size_t i = 0; i < callsites.capacity; i++) {
+        heap_trace_callsite_t cs;
+
+        portENTER_CRITICAL(&trace_mux);
+        memcpy(&cs, &callsites.buffer[i], sizeof(heap_trace_callsite_t));
+        portEXIT_CRITICAL(&trace_mux);
+
+        if (cs.alloc_count == 0 || (leaks_only && cs.live_count == 0)) {
+            continue;
+        }
+        live_bytes += cs.live_bytes;
+        live_allocs += cs.live_count;
+
+        esp_rom_printf("HEAPPROF %"PRIu32" %"PRIu32" %"PRIu32" %"PRIu32" ",
+                       cs.alloc_count, cs.alloc_bytes, cs.live_count, cs.live_bytes);
+        for (int j = 0; j < STACK_DEPTH && cs.alloced_by[j] != 0; j++) {
+            esp_rom_printf("%s%p", (j > 0) ? ":" : "", cs.alloced_by[j]);
+        }
+        esp_rom_printf("\n");
+    }
+
+    esp_rom_printf("====== Heap Profile Summary ======\n");
+    esp_rom_printf("Mode: %s\n", (mode == HEAP_TRACE_ALL) ? "Heap Trace All" : "Heap Trace Leaks");
+    esp_rom_printf("%"PRIu32" bytes estimated alive (%"PRIu32" sampled allocations)\n", live_bytes, live_allocs);
+    esp_rom_printf("%"PRIu32" samples of %"PRIu32" allocations, %"PRIu32" frees\n",
+                   total_samples, summary.total_allocations, summary.total_frees);
+    if (summary.has_overflowed) {
+        esp_rom_printf("(NB: %"PRIu32" samples were dropped because the callsite or live sample table was full, "
+                       "so the profile is incomplete.)\n", dropped_samples);
+    }
+    esp_rom_printf("================================\n");
+}
+
+static HEAP_IRAM_ATTR size_t live_hash(const void *p)
+{
+    static const uint32_t fnv_prime = 16777619UL;
+    return ((((uint32_t)p >> 3) +
+             ((uint32_t)p >> 5) +
+             ((uint32_t)p >> 7)) * fnv_prime) % (uint32_t)LIVE_SAMPLES;
+}
+
+/* Index of the live sample for address p, or NOT_FOUND. Also safe to call without the lock inside a
+   live_seq read section, the probe sequence is bounded even if the table changes meanwhile. */
+static HEAP_IRAM_ATTR size_t live_find(const void *p)
+{
+    size_t i = live_hash(p);
+    for (size_t n = 0; n < LIVE_SAMPLES; n++) {
+        const void *address = live_samples[i].address;
+        if (address == p) {
+            return i;
+        }
+        if (address == NULL) {
+            break;
+        }
+        i = (i + 1) % LIVE_SAMPLES;
+    }
+    return NOT_FOUND;
+}
+
+static HEAP_IRAM_ATTR void live_write_begin(void)
+{
+    __atomic_store_n(&live_seq, live_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static HEAP_IRAM_ATTR void live_write_end(void)
+{
+    __atomic_store_n(&live_seq, live_seq + 1, __ATOMIC_RELEASE);
+}
+
+static HEAP_IRAM_ATTR bool live_contains(const void *p)
+{
+    uint32_t seq;
+    bool found;
+    do {
+        while ((seq = __atomic_load_n(&live_seq, __ATOMIC_ACQUIRE)) & 1) {
+            /* writers hold the trace lock with interrupts masked, so this is always a writer on another core */
+        }
+        found = (live_find(p) != NOT_FOUND);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&live_seq, __ATOMIC_RELAXED));
+    return found;
+}
+
+/* Remove the live sample at index i, moving later entries of the probe sequence back
+   so that no tombstones are needed. Lock must be held, inside a live_seq write section. */
+static HEAP_IRAM_ATTR void live_remove_at(size_t i)
+{
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) % LIVE_SAMPLES;
+        if (live_samples[j].address == NULL) {
+            break;
+        }
+        const size_t home = live_hash(live_samples[j].address);
+        /* the entry at j can move to i unless its home slot is cyclically in (i, j] */
+        const bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            live_samples[i] = live_samples[j];
+            i = j;
+        }
+    }
+    live_samples[i].address = NULL;
+    live_count--;
+}
+
+/* Drop the live sample at index i, and its share of the callsite's live bytes. Lock must be held. */
+static HEAP_IRAM_ATTR void live_release(size_t i)
+{
+    heap_trace_callsite_t *cs = &callsites.buffer[live_samples[i].callsite];
+    cs->live_count--;
+    cs->live_bytes -= live_samples[i].weight;
+
+    live_write_begin();
+    live_remove_at(i);
+    live_write_end();
+}
+
+static HEAP_IRAM_ATTR bool live_add(void *p, uint32_t callsite, size_t weight)
+{
+    /* the address may still be listed if its free was missed while tracing was stopped */
+    size_t i = live_find(p);
+    if (i != NOT_FOUND) {
+        live_release(i);
+    }
+
+    if (live_count >= LIVE_SAMPLES_MAX) {
+        return false;
+    }
+
+    i = live_hash(p);
+    while (live_samples[i].address != NULL) {
+        i = (i + 1) % LIVE_SAMPLES;
+    }
+
+    live_write_begin();
+    live_samples[i].callsite = callsite;
+    live_samples[i].weight = weight;
+    live_samples[i].address = p;
+    live_count++;
+    live_write_end();
+    return true;
+}
+
+static HEAP_IRAM_ATTR uint32_t callsite_hash(void * const *callers)
+{
+    uint32_t hash = 2166136261UL; // FNV-1a
+    for (int i = 0; i < STACK_DEPTH; i++) {
+        hash = (hash ^ (uint32_t)callers[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+/* Index of the callsite for this call stack, adding it if necessary. NOT_FOUND if the table is full. */
+static HEAP_IRAM_ATTR size_t callsite_find_or_add(void * const *callers)
+{
+    const uint32_t hash = callsite_hash(callers);
+    size_t i = hash % callsites.capacity;
+
+    for (size_t n = 0; n < callsites.capacity; n++) {
+        heap_trace_callsite_t *cs = &callsites.buffer[i];
+        if (cs->alloc_count == 0) {
+            cs->hash = hash;
+            memcpy(cs->alloced_by, callers, sizeof(void *) * STACK_DEPTH);
+            callsites.count++;
+            return i;
+        }
+        if (cs->hash == hash && memcmp(cs->alloced_by, callers, sizeof(void *) * STACK_DEPTH) == 0) {
+            return i;
+        }
+        i = (i + 1) % callsites.capacity;
+    }
+    return NOT_FOUND;
+}
+
+/* Decide whether an allocation is sampled. Called for every allocation, so keep it short. */
+static HEAP_IRAM_ATTR bool skip_allocation(void *p, size_t size)
+{
+    if (!tracing || p == NULL) {
+        return true;
+    }
+
+    bool skip = true;
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    sampler_t *sampler = &samplers[xPortGetCoreID()];
+
+    sampler->allocations++;
+    if (size >= sampler->bytes_until_sample) {
+        sampler->bytes_until_sample = next_sample_distance(sampler);
+        skip = false;
+    } else {
+        sampler->bytes_until_sample -= size;
+    }
+
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+    return skip;
+}
+
+/* Decide whether a free needs to be recorded, i.e. it frees a sampled allocation */
+static HEAP_IRAM_ATTR bool skip_free(void *p)
+{
+    if (!tracing || p == NULL) {
+        return true;
+    }
+
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    samplers[xPortGetCoreID()].frees++;
+    const bool skip = (live_count == 0 || !live_contains(p));
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+
+    return skip;
+}
+
+#define TRACE_SKIP_ALLOCATION(p, size) skip_allocation(p, size)
+#define TRACE_SKIP_FREE(p) skip_free(p)
+
+/* Add a sampled allocation to the profile */
+static HEAP_IRAM_ATTR void record_allocation(const heap_trace_record_t *r_allocation)
+{
+    if (!tracing || r_allocation->address == NULL) {
+        return;
+    }
+
+    const size_t weight = MAX(r_allocation->size, sample_interval);
+
+    portENTER_CRITICAL(&trace_mux);
+
+    if (tracing) {
+        total_samples++;
+        const size_t idx = callsite_find_or_add(r_allocation->alloced_by);
+        if (idx == NOT_FOUND) {
+            dropped_samples++;
+        } else {
+            heap_trace_callsite_t *cs = &callsites.buffer[idx];
+            cs->alloc_count++;
+            cs->alloc_bytes += weight;
+            if (live_add(r_allocation->address, idx, weight)) {
+                cs->live_count++;
+                cs->live_bytes += weight;
+            } else {
+                dropped_samples++;
+            }
+        }
+    }
+
+    portEXIT_CRITICAL(&trace_mux);
+}
+
+/* Record the free of a sampled allocation. The call stack of the free is not used. */
+static HEAP_IRAM_ATTR void record_free(void *p, void **callers)
+{
+    if (!tracing || p == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&trace_mux);
+
+    if (tracing) {
+        const size_t i = live_find(p);
+        if (i != NOT_FOUND) {
+            live_release(i);
+        }
+    }
+
+    portEXIT_CRITICAL(&trace_mux);
+}
+
+#include "heap_trace.inc"
+
+#else // CONFIG_HEAP_TRACING_SAMPLING
+
+/* The sampling API is declared for all heap tracing destinations, so it fails at run time rather than at link time
+   when the sampling profiler isn't selected */
+
+esp_err_t heap_trace_init_sampling(heap_trace_callsite_t *callsite_buffer, size_t num_callsites, size_t sample_interval)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t heap_trace_get_callsite(size_t index, heap_trace_callsite_t *callsite)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif // CONFIG_HEAP_TRACING_SAMPLING
@@ -0,0 +1,139 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "multi_heap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Handle of a slab of fixed-size objects
+ *
+ * A slab preallocates memory for a fixed number of objects of the same size with the given capabilities.
+ * Objects are then allocated and freed in constant time, without per-object heap headers and without
+ * fragmenting the heap.
+ */
+typedef struct heap_caps_slab *heap_caps_slab_handle_t;
+
+/**
+ * @brief Slab configuration
+ */
+typedef struct {
+    size_t obj_size;        /*!< Size of each object in bytes */
+    size_t count;           /*!< Number of objects in the slab */
+    uint32_t caps;          /*!< Bitwise OR of MALLOC_CAP_* flags for the object memory */
+    size_t magazine_size;   /*!< Number of free objects cached per CPU core, 0 to disable per-core magazines.
+                                 Allocations and frees served from the magazine of the current core don't take
+                                 the slab lock, which avoids contention between cores on a busy slab. Objects in
+                                 magazines are only available to the core owning the magazine, so a slab with
+                                 magazines may report out of memory while other cores still hold free objects
+                                 in their magazines. */
+} heap_caps_slab_config_t;
+
+/**
+ * @brief Create a slab of fixed-size objects
+ *
+ * Equivalent to heap_caps_slab_create_with_config() with per-core magazines disabled.
+ *
+ * @param obj_size  Size of each object in bytes
+ * @param count     Number of objects
+ * @param caps      Bitwise OR of MALLOC_CAP_* flags indicating the type of memory for the objects
+ *
+ * @return Handle of the slab, NULL if arguments are invalid or memory could not be allocated
+ */
+heap_caps_slab_handle_t heap_caps_slab_create(size_t obj_size, size_t count, uint32_t caps);
+
+/**
+ * @brief Create a slab of fixed-size objects
+ *
+ * Memory for all objects is allocated at once with heap_caps_malloc() and the given capabilities.
+ * The slab bookkeeping is allocated from internal memory. Objects have the same alignment as memory
+ * returned by heap_caps_malloc().
+ *
+ * @param config  Slab configuration
+ *
+ * @return Handle of the slab, NULL if arguments are invalid or memory could not be allocated
+ */
+heap_caps_slab_handle_t heap_caps_slab_create_with_config(const heap_caps_slab_config_t *config);
+
+/**
+ * @brief Delete a slab and free its memory
+ *
+ * All objects must have been returned with heap_caps_slab_free() before, any remaining objects
+ * become invalid.
+ *
+ * @param slab  Slab handle, may be NULL
+ */
+void heap_caps_slab_delete(heap_caps_slab_handle_t slab);
+
+/**
+ * @brief Allocate an object from a slab
+ *
+ * The object contents are not initialized. This function can be called from an ISR.
+ *
+ * @param slab  Slab handle
+ *
+ * @return Pointer to the object, NULL if the slab has no free objects
+ */
+void *heap_caps_slab_alloc(heap_caps_slab_handle_t slab);
+
+/**
+ * @brief Return an object to the slab it was allocated from
+ *
+ * This function can be called from an ISR.
+ *
+ * @note The app will crash with an assertion failure if obj doesn't belong to the slab.
+ *
+ * @param slab  Slab handle
+ * @param obj   Object previously returned by heap_caps_slab_alloc() for the same slab. Can be NULL.
+ */
+void heap_caps_slab_free(heap_caps_slab_handle_t slab, void *obj);
+
+/**
+ * @brief Get the object size of a slab
+ *
+ * @param slab  Slab handle
+ *
+ * @return Object size in bytes, as passed on creation
+ */
+size_t heap_caps_slab_get_obj_size(heap_caps_slab_handle_t slab);
+
+/**
+ * @brief Get usage information of a slab
+ *
+ * The information is reported in the same format as heap_caps_get_info(), each object counts as one block:
+ *
+ * - ``total_free_bytes``, ``total_allocated_bytes``: free and allocated objects, multiplied by the object size
+ * - ``largest_free_block``: the object size if at least one object is free, 0 otherwise
+ * - ``minimum_free_bytes``: lowest number of free objects since creation, multiplied by the object size.
+ *   With per-core magazines this is only sampled when a magazine is refilled, so it may be higher than the
+ *   real minimum by up to the magazine capacity of each core.
+ * - ``allocated_blocks``, ``free_blocks``, ``total_blocks``: object counts
+ *
+ * The memory of the slab itself is reported as a single allocated block by heap_caps_get_info().
+ *
+ * @param slab  Slab handle
+ * @param info  Pointer to a structure which will be filled with the slab usage
+ */
+void heap_caps_slab_get_info(heap_caps_slab_handle_t slab, multi_heap_info_t *info);
+
+/**
+ * @brief Print a summary of all slabs with the given capabilities to stdout
+ *
+ * heap_caps_print_heap_info() also calls this function.
+ *
+ * @param caps  Bitwise OR of MALLOC_CAP_* flags. Slabs created with all of these capabilities are printed.
+ */
+void heap_caps_slab_print_info(uint32_t caps);
+
+#ifdef __cplusplus
+}
+#endif
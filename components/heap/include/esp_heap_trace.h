@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -61,6 +61,21 @@ typedef struct {
 #endif
 } heap_trace_summary_t;
 
+/**
+ * @brief Aggregated allocations of one call stack, as recorded by the sampling heap profiler.
+ *
+ * Byte counts are estimates: each sampled allocation stands for the bytes allocated since the previous
+ * sample, so they are only accurate for call stacks which allocate a multiple of the sample interval.
+ */
+typedef struct {
+    uint32_t hash;                    ///< Hash of the call stack
+    size_t alloc_count;               ///< Number of sampled allocations made from this call stack
+    size_t alloc_bytes;               ///< Estimated number of bytes allocated from this call stack
+    size_t live_count;                ///< Number of sampled allocations which were not freed yet
+    size_t live_bytes;                ///< Estimated number of bytes allocated from this call stack and not freed yet
+    void *alloced_by[CONFIG_HEAP_TRACING_STACK_DEPTH]; ///< Call stack of the allocations
+} heap_trace_callsite_t;
+
 /**
  * @brief Initialise heap tracing in standalone mode.
  *
@@ -89,6 +104,48 @@ esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t
  */
 esp_err_t heap_trace_init_tohost(void);
 
+/**
+ * @brief Initialise heap tracing in sampling profiler mode.
+ *
+ * This function must be called before any other heap tracing functions.
+ *
+ * Instead of recording every allocation, roughly one allocation per sample_interval bytes allocated is
+ * sampled. The call stacks of sampled allocations are aggregated into the callsite buffer, so the memory
+ * used doesn't grow with the number of allocations and the CPU overhead of unsampled allocations and frees
+ * is small enough to keep the profiler running all the time.
+ *
+ * A table of CONFIG_HEAP_TRACE_SAMPLING_LIVE_SAMPLES sampled allocations which are not freed yet is
+ * allocated from internal memory on the first call.
+ *
+ * @param callsite_buffer Buffer for the aggregated call stacks. Must be in internal RAM if allocations are
+ * made from ISRs.
+ * @param num_callsites Size of the callsite buffer, as number of callsite structures.
+ * @param sample_interval Average number of bytes allocated between two samples. 1 records every allocation.
+ * @return
+ *  - ESP_ERR_NOT_SUPPORTED Project was compiled without the sampling profiler selected in menuconfig.
+ *  - ESP_ERR_INVALID_STATE Heap tracing is currently in progress.
+ *  - ESP_ERR_INVALID_ARG callsite_buffer is NULL or num_callsites or sample_interval is 0.
+ *  - ESP_ERR_NO_MEM The table of live samples could not be allocated.
+ *  - ESP_OK Heap tracing initialised successfully.
+ */
+esp_err_t heap_trace_init_sampling(heap_trace_callsite_t *callsite_buffer, size_t num_callsites, size_t sample_interval);
+
+/**
+ * @brief Return an aggregated call stack recorded by the sampling heap profiler
+ *
+ * Callsites are numbered from 0 to heap_trace_get_count() - 1. It is safe to call this function while
+ * heap tracing is running, but the numbering changes when new call stacks are added.
+ *
+ * @param index Index (zero-based) of the callsite to return.
+ * @param[out] callsite Callsite where the data will be copied.
+ * @return
+ * - ESP_ERR_NOT_SUPPORTED Project was compiled without the sampling profiler selected in menuconfig.
+ * - ESP_ERR_INVALID_STATE Heap tracing was not initialised.
+ * - ESP_ERR_INVALID_ARG callsite is NULL or index is out of bounds.
+ * - ESP_OK Callsite returned successfully.
+ */
+esp_err_t heap_trace_get_callsite(size_t index, heap_trace_callsite_t *callsite);
+
 /**
  * @brief Start heap tracing. All heap allocations & frees will be traced, until heap_trace_stop() is called.
  *
@@ -135,6 +192,8 @@ esp_err_t heap_trace_resume(void);
 /**
  * @brief Return number of records in the heap trace buffer
  *
+ * In sampling profiler mode, this is the number of aggregated call stacks.
+ *
  * It is safe to call this function while heap tracing is running.
  */
 size_t heap_trace_get_count(void);
@@ -149,7 +208,8 @@ size_t heap_trace_get_count(void);
  * @param index Index (zero-based) of the record to return.
  * @param[out] record Record where the heap trace record will be copied.
  * @return
- * - ESP_ERR_NOT_SUPPORTED Project was compiled without heap tracing enabled in menuconfig.
+ * - ESP_ERR_NOT_SUPPORTED Project was compiled without heap tracing enabled in menuconfig, or with the sampling
+ *   profiler which doesn't keep individual records (see heap_trace_get_callsite()).
  * - ESP_ERR_INVALID_STATE Heap tracing was not initialised.
  * - ESP_ERR_INVALID_ARG Index is out of bounds for current heap trace record count.
  * - ESP_OK Record returned successfully.
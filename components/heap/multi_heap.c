@@ -77,6 +77,30 @@ void *multi_heap_get_block_address(multi_heap_block_handle_t block)
 #define ALIGN_UP_BY(num, align) (((num) + ((align) - 1)) & ~((align) - 1))
 
 
+#ifdef MULTI_HEAP_CACHE
+/* Cached blocks are sorted into size classes of MULTI_HEAP_CACHE_GRANULE bytes.
+   Class N holds blocks with a usable size of at least N * MULTI_HEAP_CACHE_GRANULE bytes. */
+#define MULTI_HEAP_CACHE_GRANULE 8
+#define MULTI_HEAP_CACHE_CLASSES (MULTI_HEAP_CACHE_MAX_SIZE / MULTI_HEAP_CACHE_GRANULE + 1)
+/* Number of blocks moved between TLSF and a cache slot at once */
+#define MULTI_HEAP_CACHE_BATCH (MULTI_HEAP_CACHE_DEPTH / 2)
+
+_Static_assert(MULTI_HEAP_CACHE_MAX_SIZE % MULTI_HEAP_CACHE_GRANULE == 0, "cache max size must be a multiple of the granule");
+_Static_assert(MULTI_HEAP_CACHE_BATCH > 0, "cache depth must be at least 2");
+
+typedef struct {
+    void *head;     // singly linked list, the link is stored in the first word of each block
+    size_t count;
+} cache_class_t;
+
+typedef struct {
+    multi_heap_lock_t lock;
+    size_t free_bytes;  // bytes held by this slot, accounted the same way as heap_t::free_bytes
+    size_t blocks;
+    cache_class_t classes[MULTI_HEAP_CACHE_CLASSES];
+} cache_slot_t;
+#endif // MULTI_HEAP_CACHE
+
 typedef struct multi_heap_info {
     void *lock;
     size_t free_bytes;
@@ -85,6 +109,38 @@ typedef struct multi_heap_info {
     void* heap_data;
 } heap_t;
 
+#ifdef MULTI_HEAP_CACHE
+/* The cache slots are placed at the end of the heap region, right after the TLSF pool */
+#define MULTI_HEAP_CACHE_SIZE (sizeof(cache_slot_t) * MULTI_HEAP_CACHE_SLOTS)
+
+static inline __attribute__((always_inline)) cache_slot_t *heap_cache(const heap_t *heap)
+{
+    return (cache_slot_t *)((uintptr_t)heap + sizeof(heap_t) + heap->pool_size);
+}
+#endif
+
+/* Free bytes of the heap, including blocks held in the per-core caches.
+   The slot counters are read without taking the slot locks. */
+static inline __attribute__((always_inline)) size_t heap_free_bytes(const heap_t *heap)
+{
+    size_t free_bytes = heap->free_bytes;
+#ifdef MULTI_HEAP_CACHE
+    for (int i = 0; i < MULTI_HEAP_CACHE_SLOTS; i++) {
+        free_bytes += heap_cache(heap)[i].free_bytes;
+    }
+#endif
+    return free_bytes;
+}
+
+/* Must be called with the heap lock held */
+static inline __attribute__((always_inline)) void heap_update_minimum_free_bytes(heap_t *heap)
+{
+    const size_t free_bytes = heap_free_bytes(heap);
+    if (free_bytes < heap->minimum_free_bytes) {
+        heap->minimum_free_bytes = free_bytes;
+    }
+}
+
 #if CONFIG_HEAP_TLSF_USE_ROM_IMPL
 
 void _multi_heap_lock(void *lock)
@@ -140,6 +196,12 @@ multi_heap_handle_t multi_heap_register_impl(void *start_ptr, size_t size)
 
     heap_t *result = (heap_t *)start_ptr;
     size -= sizeof(heap_t);
+#ifdef MULTI_HEAP_CACHE
+    if (size < MULTI_HEAP_CACHE_SIZE) {
+        return NULL;
+    }
+    size = ALIGN(size - MULTI_HEAP_CACHE_SIZE);
+#endif
 
     /* Do not specify any maximum size for the allocations so that the default configuration is used */
     const size_t max_bytes = 0;
@@ -153,6 +215,13 @@ multi_heap_handle_t multi_heap_register_impl(void *start_ptr, size_t size)
     result->free_bytes = size - tlsf_size(result->heap_data);
     result->pool_size = size;
     result->minimum_free_bytes = result->free_bytes;
+#ifdef MULTI_HEAP_CACHE
+    cache_slot_t *cache = heap_cache(result);
+    memset(cache, 0, MULTI_HEAP_CACHE_SIZE);
+    for (int i = 0; i < MULTI_HEAP_CACHE_SLOTS; i++) {
+        MULTI_HEAP_LOCK_INIT(&cache[i].lock);
+    }
+#endif
     return result;
 }
 
@@ -200,27 +269,259 @@ bool multi_heap_is_free(multi_heap_block_handle_t block)
     return block_is_free(block);
 }
 
-void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
+#ifdef MULTI_HEAP_CACHE
+/* Per-core block cache
+ *
+ * Each cache slot keeps short free lists of small blocks which are still allocated from the
+ * point of view of TLSF. Cache hits only take the slot lock, which is private to one core,
+ * so cores no longer serialize on the heap lock for small allocations. Blocks are moved
+ * between TLSF and a slot in batches of MULTI_HEAP_CACHE_BATCH under a single heap lock.
+ *
+ * Lock order is always slot lock(s) in ascending slot index, then the heap lock.
+ */
+
+static inline __attribute__((always_inline)) size_t cache_block_bytes(void *p)
 {
-    if (size == 0 || heap == NULL) {
-        return NULL;
+    return tlsf_block_size(p) + tlsf_alloc_overhead();
+}
+
+/* Must be called with the slot lock held */
+static inline __attribute__((always_inline)) void cache_push(cache_slot_t *slot, cache_class_t *cls, void *p, size_t bytes)
+{
+    *(void **)p = cls->head;
+    cls->head = p;
+    cls->count++;
+    slot->free_bytes += bytes;
+    slot->blocks++;
+}
+
+/* Must be called with the slot lock held */
+static inline __attribute__((always_inline)) void *cache_pop(heap_t *heap, cache_slot_t *slot, cache_class_t *cls)
+{
+    void *p = cls->head;
+    if (p != NULL) {
+        cls->head = *(void **)p;
+        /* The link lives in freed memory, catch a use-after-free overwriting it */
+        MULTI_HEAP_ASSERT(cls->head == NULL ||
+                          (uintptr_t)cls->head - (uintptr_t)heap < sizeof(heap_t) + heap->pool_size,
+                          (uintptr_t)p);
+        cls->count--;
+        slot->free_bytes -= cache_block_bytes(p);
+        slot->blocks--;
     }
+    return p;
+}
 
+/* Return up to `count` blocks of a class to TLSF. Must be called with the slot lock held. */
+__attribute__((noinline)) static void cache_flush_class(heap_t *heap, cache_slot_t *slot, cache_class_t *cls, size_t count)
+{
+    multi_heap_internal_lock(heap);
+    while (count-- > 0 && cls->head != NULL) {
+        void *p = cache_pop(heap, slot, cls);
+        heap->free_bytes += cache_block_bytes(p);
+        tlsf_free(heap->heap_data, p);
+    }
+    multi_heap_internal_unlock(heap);
+}
+
+/* Allocate a batch of blocks of class `index` from TLSF, keep all but the returned one in the slot.
+   Must be called with the slot lock held. */
+__attribute__((noinline)) static void *cache_refill(heap_t *heap, cache_slot_t *slot, size_t index)
+{
+    cache_class_t *cls = &slot->classes[index];
+    void *result = NULL;
 
+    multi_heap_internal_lock(heap);
+    for (int i = 0; i < MULTI_HEAP_CACHE_BATCH; i++) {
+        void *p = tlsf_malloc(heap->heap_data, index * MULTI_HEAP_CACHE_GRANULE);
+        if (p == NULL) {
+            break;
+        }
+        const size_t bytes = cache_block_bytes(p);
+        heap->free_bytes -= bytes;
+        if (result == NULL) {
+            result = p;
+        } else {
+            cache_push(slot, cls, p, bytes);
+        }
+    }
+    heap_update_minimum_free_bytes(heap);
+    multi_heap_internal_unlock(heap);
+
+    return result;
+}
+
+static inline __attribute__((always_inline)) void *cache_malloc(heap_t *heap, size_t size)
+{
+    const size_t index = (size + MULTI_HEAP_CACHE_GRANULE - 1) / MULTI_HEAP_CACHE_GRANULE;
+    /* The task may migrate to another core after reading the slot index, the slot lock
+       keeps this correct, only slightly less efficient */
+    cache_slot_t *slot = &heap_cache(heap)[MULTI_HEAP_CACHE_SLOT()];
+    multi_heap_lock_t *lock = &slot->lock;
+
+    MULTI_HEAP_LOCK(lock);
+    void *result = cache_pop(heap, slot, &slot->classes[index]);
+    if (result == NULL) {
+        result = cache_refill(heap, slot, index);
+    }
+    MULTI_HEAP_UNLOCK(lock);
+
+    return result;
+}
+
+/* Returns false if the block is too large to be cached */
+static inline __attribute__((always_inline)) bool cache_free(heap_t *heap, void *p)
+{
+    const size_t block_size = tlsf_block_size(p);
+    if (block_size > MULTI_HEAP_CACHE_MAX_SIZE) {
+        return false;
+    }
+
+    cache_slot_t *slot = &heap_cache(heap)[MULTI_HEAP_CACHE_SLOT()];
+    cache_class_t *cls = &slot->classes[block_size / MULTI_HEAP_CACHE_GRANULE];
+    multi_heap_lock_t *lock = &slot->lock;
+
+    MULTI_HEAP_LOCK(lock);
+    cache_push(slot, cls, p, block_size + tlsf_alloc_overhead());
+    if (cls->count > MULTI_HEAP_CACHE_DEPTH) {
+        cache_flush_class(heap, slot, cls, MULTI_HEAP_CACHE_BATCH);
+    }
+    MULTI_HEAP_UNLOCK(lock);
+
+    return true;
+}
+
+/* Return all cached blocks of all slots to TLSF, returns the number of blocks flushed */
+__attribute__((noinline)) static size_t cache_flush_all(heap_t *heap)
+{
+    size_t flushed = 0;
+
+    for (int i = 0; i < MULTI_HEAP_CACHE_SLOTS; i++) {
+        cache_slot_t *slot = &heap_cache(heap)[i];
+        multi_heap_lock_t *lock = &slot->lock;
+
+        MULTI_HEAP_LOCK(lock);
+        flushed += slot->blocks;
+        for (int c = 0; c < MULTI_HEAP_CACHE_CLASSES && slot->blocks > 0; c++) {
+            if (slot->classes[c].count > 0) {
+                cache_flush_class(heap, slot, &slot->classes[c], slot->classes[c].count);
+            }
+        }
+        MULTI_HEAP_UNLOCK(lock);
+    }
+
+    return flushed;
+}
+
+/* Same as cache_flush_all(), for callers holding the heap lock. The lock is released while
+   flushing to respect the lock order, so the heap may change in between. */
+static inline __attribute__((always_inline)) size_t cache_flush_all_relock(heap_t *heap)
+{
+    multi_heap_internal_unlock(heap);
+    const size_t flushed = cache_flush_all(heap);
+    multi_heap_internal_lock(heap);
+    return flushed;
+}
+
+static void cache_lock_all(heap_t *heap)
+{
+    for (int i = 0; i < MULTI_HEAP_CACHE_SLOTS; i++) {
+        multi_heap_lock_t *lock = &heap_cache(heap)[i].lock;
+        MULTI_HEAP_LOCK(lock);
+    }
+}
+
+static void cache_unlock_all(heap_t *heap)
+{
+    for (int i = MULTI_HEAP_CACHE_SLOTS - 1; i >= 0; i--) {
+        multi_heap_lock_t *lock = &heap_cache(heap)[i].lock;
+        MULTI_HEAP_UNLOCK(lock);
+    }
+}
+
+/* Check that every cached block belongs to this heap and is still allocated in TLSF.
+   Must be called with all slot locks held. */
+static bool cache_check(heap_t *heap, bool print_errors)
+{
+    bool valid = true;
+
+    for (int i = 0; i < MULTI_HEAP_CACHE_SLOTS; i++) {
+        size_t blocks = 0;
+        for (int c = 0; c < MULTI_HEAP_CACHE_CLASSES; c++) {
+            const cache_class_t *cls = &heap_cache(heap)[i].classes[c];
+            size_t count = 0;
+            for (void *p = cls->head; p != NULL && count <= cls->count; p = *(void **)p) {
+                const uintptr_t pool = (uintptr_t)tlsf_get_pool(heap->heap_data);
+                if ((uintptr_t)p < pool || (uintptr_t)p >= pool + heap->pool_size
+                    || block_is_free(block_from_ptr(p))
+                    || tlsf_block_size(p) < c * MULTI_HEAP_CACHE_GRANULE) {
+                    if (print_errors) {
+                        MULTI_HEAP_STDERR_PRINTF("CORRUPT HEAP: invalid block %p in cache slot %d\n", p, i);
+                    }
+                    valid = false;
+                    break;
+                }
+                count++;
+            }
+            if (count != cls->count) {
+                if (print_errors) {
+                    MULTI_HEAP_STDERR_PRINTF("CORRUPT HEAP: cache slot %d class %d holds %d blocks, expected %d\n",
+                                             i, c, count, cls->count);
+                }
+                valid = false;
+            }
+            blocks += cls->count;
+        }
+        if (blocks != heap_cache(heap)[i].blocks) {
+            valid = false;
+        }
+    }
+
+    return valid;
+}
+#endif // MULTI_HEAP_CACHE
+
+static inline __attribute__((always_inline)) void *heap_tlsf_malloc(heap_t *heap, size_t size)
+{
     multi_heap_internal_lock(heap);
     void *result = tlsf_malloc(heap->heap_data, size);
     if(result) {
         heap->free_bytes -= tlsf_block_size(result);
         heap->free_bytes -= tlsf_alloc_overhead();
-        if (heap->free_bytes < heap->minimum_free_bytes) {
-            heap->minimum_free_bytes = heap->free_bytes;
-        }
+        heap_update_minimum_free_bytes(heap);
     }
     multi_heap_internal_unlock(heap);
 
     return result;
 }
 
+void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
+{
+    if (size == 0 || heap == NULL) {
+        return NULL;
+    }
+
+#ifdef MULTI_HEAP_CACHE
+    if (size <= MULTI_HEAP_CACHE_MAX_SIZE) {
+        void *result = cache_malloc(heap, size);
+        if (result != NULL) {
+            return result;
+        }
+    }
+#endif
+
+    void *result = heap_tlsf_malloc(heap, size);
+
+#ifdef MULTI_HEAP_CACHE
+    /* Memory held in the caches may be what's missing, return it to TLSF and retry */
+    if (result == NULL && cache_flush_all(heap) > 0) {
+        result = heap_tlsf_malloc(heap, size);
+    }
+#endif
+
+    return result;
+}
+
 void multi_heap_free_impl(multi_heap_handle_t heap, void *p)
 {
     if (heap == NULL || p == NULL) {
@@ -229,6 +530,12 @@ void multi_heap_free_impl(multi_heap_handle_t heap, void *p)
 
     assert_valid_block(heap, block_from_ptr(p));
 
+#ifdef MULTI_HEAP_CACHE
+    if (cache_free(heap, p)) {
+        return;
+    }
+#endif
+
     multi_heap_internal_lock(heap);
     heap->free_bytes += tlsf_block_size(p);
     heap->free_bytes += tlsf_alloc_overhead();
@@ -253,14 +560,17 @@ void *multi_heap_realloc_impl(multi_heap_handle_t heap, void *p, size_t size)
     multi_heap_internal_lock(heap);
     size_t previous_block_size =  tlsf_block_size(p);
     void *result = tlsf_realloc(heap->heap_data, p, size);
+#ifdef MULTI_HEAP_CACHE
+    if (result == NULL && size > 0 && cache_flush_all_relock(heap) > 0) {
+        result = tlsf_realloc(heap->heap_data, p, size);
+    }
+#endif
     if(result) {
         /* No need to subtract the tlsf_alloc_overhead() as it has already
          * been subtracted when allocating the block at first with malloc */
         heap->free_bytes += previous_block_size;
         heap->free_bytes -= tlsf_block_size(result);
-        if (heap->free_bytes < heap->minimum_free_bytes) {
-            heap->minimum_free_bytes = heap->free_bytes;
-        }
+        heap_update_minimum_free_bytes(heap);
     }
 
     multi_heap_internal_unlock(heap);
@@ -285,12 +595,15 @@ void *multi_heap_aligned_alloc_impl_offs(multi_heap_handle_t heap, size_t size,
 
     multi_heap_internal_lock(heap);
     void *result = tlsf_memalign_offs(heap->heap_data, alignment, size, offset);
+#ifdef MULTI_HEAP_CACHE
+    if (result == NULL && cache_flush_all_relock(heap) > 0) {
+        result = tlsf_memalign_offs(heap->heap_data, alignment, size, offset);
+    }
+#endif
     if(result) {
         heap->free_bytes -= tlsf_block_size(result);
         heap->free_bytes -= tlsf_alloc_overhead();
-        if(heap->free_bytes < heap->minimum_free_bytes) {
-            heap->minimum_free_bytes = heap->free_bytes;
-        }
+        heap_update_minimum_free_bytes(heap);
     }
     multi_heap_internal_unlock(heap);
 
@@ -335,6 +648,9 @@ bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
     bool valid = true;
     assert(heap != NULL);
 
+#ifdef MULTI_HEAP_CACHE
+    cache_lock_all(heap);
+#endif
     multi_heap_internal_lock(heap);
 
 #ifdef MULTI_HEAP_POISONING
@@ -351,7 +667,16 @@ bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
         valid = false;
     }
 
+#ifdef MULTI_HEAP_CACHE
+    if (!cache_check(heap, print_errors)) {
+        valid = false;
+    }
+#endif
+
     multi_heap_internal_unlock(heap);
+#ifdef MULTI_HEAP_CACHE
+    cache_unlock_all(heap);
+#endif
     return valid;
 }
 
@@ -371,6 +696,12 @@ void multi_heap_dump(multi_heap_handle_t heap)
     multi_heap_internal_lock(heap);
     MULTI_HEAP_STDERR_PRINTF("Showing data for heap: %p \n", (void *)heap);
     tlsf_walk_pool(tlsf_get_pool(heap->heap_data), multi_heap_dump_tlsf, NULL);
+#ifdef MULTI_HEAP_CACHE
+    for (int i = 0; i < MULTI_HEAP_CACHE_SLOTS; i++) {
+        MULTI_HEAP_STDERR_PRINTF("Cache slot %d: %d blocks, %d bytes (counted as free) \n",
+                                 i, heap_cache(heap)[i].blocks, heap_cache(heap)[i].free_bytes);
+    }
+#endif
     multi_heap_internal_unlock(heap);
 }
 
@@ -380,7 +711,7 @@ size_t multi_heap_free_size_impl(multi_heap_handle_t heap)
         return 0;
     }
 
-    return heap->free_bytes;
+    return heap_free_bytes(heap);
 }
 
 size_t multi_heap_minimum_free_size_impl(multi_heap_handle_t heap)
@@ -419,25 +750,50 @@ void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info)
         return;
     }
 
+#ifdef MULTI_HEAP_CACHE
+    cache_lock_all(heap);
+#endif
     multi_heap_internal_lock(heap);
     tlsf_walk_pool(tlsf_get_pool(heap->heap_data), multi_heap_get_info_tlsf, info);
+#ifdef MULTI_HEAP_CACHE
+    /* Cached blocks are allocated as far as TLSF is concerned, report them as free */
+    for (int i = 0; i < MULTI_HEAP_CACHE_SLOTS; i++) {
+        info->allocated_blocks -= heap_cache(heap)[i].blocks;
+        info->free_blocks += heap_cache(heap)[i].blocks;
+    }
+#endif
     /* TLSF has an overhead per block. Calculate the total amount of overhead, it shall not be
      * part of the allocated bytes */
     overhead = info->allocated_blocks * tlsf_alloc_overhead();
-    info->total_allocated_bytes = (heap->pool_size - tlsf_size(heap->heap_data)) - heap->free_bytes - overhead;
+    info->total_allocated_bytes = (heap->pool_size - tlsf_size(heap->heap_data)) - heap_free_bytes(heap) - overhead;
     info->minimum_free_bytes = heap->minimum_free_bytes;
-    info->total_free_bytes = heap->free_bytes;
+    info->total_free_bytes = heap_free_bytes(heap);
     info->largest_free_block = tlsf_fit_size(heap->heap_data, info->largest_free_block);
     multi_heap_internal_unlock(heap);
+#ifdef MULTI_HEAP_CACHE
+    cache_unlock_all(heap);
+#endif
 }
 
 #endif // CONFIG_HEAP_TLSF_USE_ROM_IMPL
 
+size_t multi_heap_flush_cache(multi_heap_handle_t heap)
+{
+#ifdef MULTI_HEAP_CACHE
+    if (heap != NULL) {
+        return cache_flush_all(heap);
+    }
+#else
+    (void) heap;
+#endif
+    return 0;
+}
+
 size_t multi_heap_reset_minimum_free_bytes(multi_heap_handle_t heap)
 {
     multi_heap_internal_lock(heap);
     const size_t old_minimum = heap->minimum_free_bytes;
-    heap->minimum_free_bytes = heap->free_bytes;
+    heap->minimum_free_bytes = heap_free_bytes(heap);
     multi_heap_internal_unlock(heap);
     return old_minimum;
 }
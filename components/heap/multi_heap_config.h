@@ -21,3 +21,21 @@
 #define MULTI_HEAP_POISONING
 #define MULTI_HEAP_POISONING_SLOW
 #endif
+
+/* The per-core block cache stores free list links inside cached blocks, so it can't be combined
+   with heap poisoning, and it relies on the heap_t layout of the IDF TLSF implementation. */
+#if defined(CONFIG_HEAP_PER_CORE_CACHE) && !defined(MULTI_HEAP_POISONING) && !CONFIG_HEAP_TLSF_USE_ROM_IMPL
+#define MULTI_HEAP_CACHE
+
+#ifdef CONFIG_HEAP_PER_CORE_CACHE_MAX_SIZE
+#define MULTI_HEAP_CACHE_MAX_SIZE CONFIG_HEAP_PER_CORE_CACHE_MAX_SIZE
+#else
+#define MULTI_HEAP_CACHE_MAX_SIZE 128
+#endif
+
+#ifdef CONFIG_HEAP_PER_CORE_CACHE_DEPTH
+#define MULTI_HEAP_CACHE_DEPTH CONFIG_HEAP_PER_CORE_CACHE_DEPTH
+#else
+#define MULTI_HEAP_CACHE_DEPTH 8
+#endif
+#endif
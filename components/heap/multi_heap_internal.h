@@ -74,6 +74,11 @@ void multi_heap_internal_lock(multi_heap_handle_t heap);
 
 void multi_heap_internal_unlock(multi_heap_handle_t heap);
 
+/* Return all blocks held in the per-core caches of a heap to TLSF (CONFIG_HEAP_PER_CORE_CACHE).
+   Returns the number of blocks returned, 0 if the cache is disabled.
+*/
+size_t multi_heap_flush_cache(multi_heap_handle_t heap);
+
 /* Some internal functions for heap debugging code to use */
 
 /* Get the handle to the first (fixed free) block in a heap */
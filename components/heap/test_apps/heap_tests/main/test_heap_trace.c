@@ -6,7 +6,7 @@
 /*
  Generic test for heap tracing support
 
- Only compiled in if CONFIG_HEAP_TRACING is set
+ Only compiled in if CONFIG_HEAP_TRACING_STANDALONE is set
 */
 
 #include <esp_types.h>
@@ -20,9 +20,10 @@
 #include "freertos/task.h"
 
 #include "esp_heap_caps.h"
+#include "esp_heap_caps_slab.h"
 
-#ifdef CONFIG_HEAP_TRACING
-// only compile in heap tracing tests if tracing is enabled
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
+// only compile in heap tracing tests if standalone tracing is enabled
 
 #include "esp_heap_trace.h"
 
@@ -205,6 +206,40 @@ TEST_CASE("check for summary value validity", "[heap-trace]") {
     heap_trace_stop();
 }
 
+TEST_CASE("heap trace records slab allocations", "[heap-trace]")
+{
+    heap_trace_record_t recs[8];
+    heap_trace_record_t rec;
+    const size_t obj_size = 24;
+
+    heap_caps_slab_handle_t slab = heap_caps_slab_create(obj_size, 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    TEST_ASSERT_NOT_NULL(slab);
+
+    heap_trace_init_standalone(recs, 8);
+    heap_trace_start(HEAP_TRACE_LEAKS);
+
+    void *a = heap_caps_slab_alloc(slab);
+    void *b = heap_caps_slab_alloc(slab);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+
+    TEST_ASSERT_EQUAL(2, heap_trace_get_count());
+    heap_trace_get(0, &rec);
+    TEST_ASSERT_EQUAL_PTR(a, rec.address);
+    TEST_ASSERT_EQUAL(obj_size, rec.size);
+
+    heap_caps_slab_free(slab, a);
+    TEST_ASSERT_EQUAL(1, heap_trace_get_count());
+    heap_trace_get(0, &rec);
+    TEST_ASSERT_EQUAL_PTR(b, rec.address);
+
+    heap_caps_slab_free(slab, b);
+    TEST_ASSERT_EQUAL(0, heap_trace_get_count());
+
+    heap_trace_stop();
+    heap_caps_slab_delete(slab);
+}
+
 #ifdef CONFIG_SPIRAM
 void* allocate_pointer(uint32_t caps)
 {
@@ -0,0 +1,147 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+/*
+ Tests for the sampling heap profiler
+
+ Only compiled in if CONFIG_HEAP_TRACING_SAMPLING is set
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "unity.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_heap_caps.h"
+#include "esp_cpu.h"
+
+#ifdef CONFIG_HEAP_TRACING_SAMPLING
+
+#include "esp_heap_trace.h"
+
+#define NUM_CALLSITES 32
+
+static heap_trace_callsite_t callsites[NUM_CALLSITES];
+
+static void get_live_totals(size_t *live_count, size_t *live_bytes, size_t *alloc_bytes)
+{
+    heap_trace_callsite_t cs;
+    *live_count = 0;
+    *live_bytes = 0;
+    *alloc_bytes = 0;
+    for (size_t i = 0; heap_trace_get_callsite(i, &cs) == ESP_OK; i++) {
+        *live_count += cs.live_count;
+        *live_bytes += cs.live_bytes;
+        *alloc_bytes += cs.alloc_bytes;
+    }
+}
+
+TEST_CASE("heap trace sampling rejects invalid arguments", "[heap-trace]")
+{
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, heap_trace_init_sampling(NULL, NUM_CALLSITES, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, heap_trace_init_sampling(callsites, 0, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, heap_trace_init_sampling(callsites, NUM_CALLSITES, 0));
+
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_init_sampling(callsites, NUM_CALLSITES, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_start(HEAP_TRACE_ALL));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, heap_trace_init_sampling(callsites, NUM_CALLSITES, 1));
+
+    heap_trace_record_t rec;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, heap_trace_get(0, &rec));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, heap_trace_get_callsite(0, NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_stop());
+}
+
+TEST_CASE("heap trace sampling records every allocation with interval 1", "[heap-trace]")
+{
+    const size_t alloc_size = 100;
+    const size_t num_allocs = 10;
+    void *ptrs[num_allocs];
+    size_t live_count, live_bytes, alloc_bytes;
+
+    printf("Sampling exact test\n"); // Print something before trace starts, or stdout allocations skew total counts
+    fflush(stdout);
+
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_init_sampling(callsites, NUM_CALLSITES, 1));
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_start(HEAP_TRACE_LEAKS));
+
+    for (size_t i = 0; i < num_allocs; i++) {
+        ptrs[i] = malloc(alloc_size);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+    }
+
+    get_live_totals(&live_count, &live_bytes, &alloc_bytes);
+    TEST_ASSERT_EQUAL(num_allocs, live_count);
+    TEST_ASSERT_EQUAL(num_allocs * alloc_size, live_bytes);
+    TEST_ASSERT_EQUAL(num_allocs * alloc_size, alloc_bytes);
+    TEST_ASSERT(heap_trace_get_count() >= 1);
+
+    heap_trace_dump();
+
+    /* realloc is traced as free followed by an allocation */
+    ptrs[0] = realloc(ptrs[0], 2 * alloc_size);
+    TEST_ASSERT_NOT_NULL(ptrs[0]);
+    get_live_totals(&live_count, &live_bytes, &alloc_bytes);
+    TEST_ASSERT_EQUAL(num_allocs, live_count);
+    TEST_ASSERT_EQUAL((num_allocs + 1) * alloc_size, live_bytes);
+
+    for (size_t i = 0; i < num_allocs; i++) {
+        free(ptrs[i]);
+    }
+
+    get_live_totals(&live_count, &live_bytes, &alloc_bytes);
+    TEST_ASSERT_EQUAL(0, live_count);
+    TEST_ASSERT_EQUAL(0, live_bytes);
+
+    heap_trace_summary_t summary;
+    heap_trace_summary(&summary);
+    TEST_ASSERT_EQUAL(num_allocs + 1, summary.total_allocations);
+    TEST_ASSERT_EQUAL(num_allocs + 1, summary.total_frees);
+    TEST_ASSERT_FALSE(summary.has_overflowed);
+
+    heap_trace_stop();
+}
+
+TEST_CASE("heap trace sampling estimates allocated bytes", "[heap-trace]")
+{
+    const size_t sample_interval = 1024;
+    const size_t alloc_size = 100;
+    const size_t num_allocs = 4000;
+    size_t live_count, live_bytes, alloc_bytes;
+
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_init_sampling(callsites, NUM_CALLSITES, sample_interval));
+    TEST_ASSERT_EQUAL(ESP_OK, heap_trace_start(HEAP_TRACE_ALL));
+
+    uint32_t traced_cycles = 0;
+    for (size_t i = 0; i < num_allocs; i++) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        free(malloc(alloc_size));
+        traced_cycles += esp_cpu_get_cycle_count() - start;
+    }
+
+    get_live_totals(&live_count, &live_bytes, &alloc_bytes);
+    heap_trace_stop();
+
+    uint32_t untraced_cycles = 0;
+    for (size_t i = 0; i < num_allocs; i++) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        free(malloc(alloc_size));
+        untraced_cycles += esp_cpu_get_cycle_count() - start;
+    }
+
+    printf("estimated %u of %u bytes, %"PRIu32" cycles per malloc+free sampled, %"PRIu32" not tracing\n",
+           alloc_bytes, num_allocs * alloc_size, traced_cycles / num_allocs, untraced_cycles / num_allocs);
+
+    /* about 390 samples are expected, the estimate is well within 25% */
+    TEST_ASSERT_EQUAL(0, live_count);
+    TEST_ASSERT_INT_WITHIN(num_allocs * alloc_size / 4, num_allocs * alloc_size, alloc_bytes);
+}
+
+#endif // CONFIG_HEAP_TRACING_SAMPLING
@@ -354,3 +354,60 @@ TEST_CASE("test memory protection features", "[heap][mem_prot]")
     TEST_ASSERT_NULL(iram_ptr);
 #endif // CONFIG_ESP_SYSTEM_MEMPROT_FEATURE
 }
+
+TEST_CASE("allocation skips exhausted heaps and retries them once memory is freed", "[heap]")
+{
+    const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    void *ptrs[16] = { 0 };
+    size_t sizes[16] = { 0 };
+    int num = 0;
+
+    /* take the largest block of each heap until the largest remaining block is small */
+    printf("Exhausting internal heaps\n");
+    while (num < 16) {
+        sizes[num] = heap_caps_get_largest_free_block(caps);
+        if (sizes[num] < 1024) {
+            break;
+        }
+        ptrs[num] = heap_caps_malloc(sizes[num], caps);
+        TEST_ASSERT_NOT_NULL(ptrs[num]);
+        num++;
+    }
+    TEST_ASSERT_GREATER_THAN(0, num);
+
+    /* this fails in every heap, and must not prevent the heaps from being used again */
+    TEST_ASSERT_NULL(heap_caps_malloc(sizes[0], caps));
+
+    for (int i = 0; i < num; i++) {
+        heap_caps_free(ptrs[i]);
+    }
+    for (int i = 0; i < num; i++) {
+        ptrs[i] = heap_caps_malloc(sizes[i], caps);
+        TEST_ASSERT_NOT_NULL(ptrs[i]);
+    }
+    for (int i = 0; i < num; i++) {
+        heap_caps_free(ptrs[i]);
+    }
+}
+
+TEST_CASE("heap_caps_get_info is updated after every allocation and free", "[heap]")
+{
+    const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    multi_heap_info_t before, during, after;
+
+    heap_caps_get_info(&before, caps);
+    heap_caps_get_info(&during, caps);
+    TEST_ASSERT_EQUAL(before.allocated_blocks, during.allocated_blocks);
+    TEST_ASSERT_EQUAL(before.total_free_bytes, during.total_free_bytes);
+
+    void *p = heap_caps_malloc(100, caps);
+    TEST_ASSERT_NOT_NULL(p);
+    heap_caps_get_info(&during, caps);
+    TEST_ASSERT_EQUAL(before.allocated_blocks + 1, during.allocated_blocks);
+    TEST_ASSERT_LESS_THAN(before.total_free_bytes, during.total_free_bytes);
+
+    heap_caps_free(p);
+    heap_caps_get_info(&after, caps);
+    TEST_ASSERT_EQUAL(before.allocated_blocks, after.allocated_blocks);
+    TEST_ASSERT_EQUAL(before.total_free_bytes, after.total_free_bytes);
+}
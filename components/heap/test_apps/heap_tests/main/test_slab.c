@@ -0,0 +1,189 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+/*
+ Tests for the fixed-size object slab allocator.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_caps_slab.h"
+
+#define SLAB_OBJ_SIZE   13
+#define SLAB_OBJ_COUNT  32
+
+TEST_CASE("slab allocator hands out every object exactly once", "[heap][slab]")
+{
+    void *objs[SLAB_OBJ_COUNT];
+    multi_heap_info_t info;
+
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap_caps_slab_handle_t slab = heap_caps_slab_create(SLAB_OBJ_SIZE, SLAB_OBJ_COUNT, MALLOC_CAP_8BIT);
+    TEST_ASSERT_NOT_NULL(slab);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_SIZE, heap_caps_slab_get_obj_size(slab));
+    TEST_ASSERT(heap_caps_get_free_size(MALLOC_CAP_8BIT) < free_before - SLAB_OBJ_SIZE * SLAB_OBJ_COUNT);
+
+    for (int i = 0; i < SLAB_OBJ_COUNT; i++) {
+        objs[i] = heap_caps_slab_alloc(slab);
+        TEST_ASSERT_NOT_NULL(objs[i]);
+        TEST_ASSERT_EQUAL(0, (intptr_t)objs[i] % sizeof(void *));
+        memset(objs[i], i, SLAB_OBJ_SIZE);
+    }
+    TEST_ASSERT_NULL(heap_caps_slab_alloc(slab));
+
+    /* no two objects overlap */
+    for (int i = 0; i < SLAB_OBJ_COUNT; i++) {
+        for (int j = 0; j < SLAB_OBJ_SIZE; j++) {
+            TEST_ASSERT_EQUAL_HEX8(i, ((uint8_t *)objs[i])[j]);
+        }
+    }
+
+    heap_caps_slab_get_info(slab, &info);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_COUNT, info.allocated_blocks);
+    TEST_ASSERT_EQUAL(0, info.free_blocks);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_COUNT, info.total_blocks);
+    TEST_ASSERT_EQUAL(0, info.largest_free_block);
+    TEST_ASSERT_EQUAL(0, info.minimum_free_bytes);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_SIZE * SLAB_OBJ_COUNT, info.total_allocated_bytes);
+
+    for (int i = 0; i < SLAB_OBJ_COUNT; i += 2) {
+        heap_caps_slab_free(slab, objs[i]);
+    }
+    heap_caps_slab_free(slab, NULL);
+
+    heap_caps_slab_get_info(slab, &info);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_COUNT / 2, info.allocated_blocks);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_COUNT / 2, info.free_blocks);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_SIZE, info.largest_free_block);
+    TEST_ASSERT_EQUAL(SLAB_OBJ_SIZE * SLAB_OBJ_COUNT / 2, info.total_free_bytes);
+    TEST_ASSERT_EQUAL(0, info.minimum_free_bytes);
+
+    /* freed objects are handed out again */
+    for (int i = 0; i < SLAB_OBJ_COUNT; i += 2) {
+        objs[i] = heap_caps_slab_alloc(slab);
+        TEST_ASSERT_NOT_NULL(objs[i]);
+    }
+    TEST_ASSERT_NULL(heap_caps_slab_alloc(slab));
+
+    for (int i = 0; i < SLAB_OBJ_COUNT; i++) {
+        heap_caps_slab_free(slab, objs[i]);
+    }
+    heap_caps_slab_print_info(MALLOC_CAP_8BIT);
+    heap_caps_slab_delete(slab);
+
+    TEST_ASSERT_EQUAL(free_before, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+}
+
+TEST_CASE("slab allocator rejects invalid arguments", "[heap][slab]")
+{
+    TEST_ASSERT_NULL(heap_caps_slab_create(0, SLAB_OBJ_COUNT, MALLOC_CAP_8BIT));
+    TEST_ASSERT_NULL(heap_caps_slab_create(SLAB_OBJ_SIZE, 0, MALLOC_CAP_8BIT));
+    TEST_ASSERT_NULL(heap_caps_slab_create(SIZE_MAX, 2, MALLOC_CAP_8BIT));
+    TEST_ASSERT_NULL(heap_caps_slab_create(SIZE_MAX / 4, 8, MALLOC_CAP_8BIT));
+    TEST_ASSERT_NULL(heap_caps_slab_create(SLAB_OBJ_SIZE, SLAB_OBJ_COUNT, MALLOC_CAP_8BIT | MALLOC_CAP_EXEC));
+    TEST_ASSERT_NULL(heap_caps_slab_create_with_config(NULL));
+    heap_caps_slab_delete(NULL);
+}
+
+TEST_CASE("slab allocator can be used from an ISR context", "[heap][slab]")
+{
+    heap_caps_slab_handle_t slab = heap_caps_slab_create(SLAB_OBJ_SIZE, SLAB_OBJ_COUNT, MALLOC_CAP_INTERNAL);
+    TEST_ASSERT_NOT_NULL(slab);
+
+    /* interrupts masked, as in an ISR */
+    UBaseType_t state = portSET_INTERRUPT_MASK_FROM_ISR();
+    void *obj = heap_caps_slab_alloc(slab);
+    heap_caps_slab_free(slab, obj);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(state);
+
+    TEST_ASSERT_NOT_NULL(obj);
+    heap_caps_slab_delete(slab);
+}
+
+#define MAGAZINE_SIZE       8
+#define STRESS_OBJ_COUNT    64
+#define STRESS_WINDOW       8
+#define STRESS_ITERATIONS   20000
+
+typedef struct {
+    heap_caps_slab_handle_t slab;
+    SemaphoreHandle_t done;
+    uint32_t tag;
+    bool failed;
+} slab_stress_arg_t;
+
+static void slab_stress_task(void *arg)
+{
+    slab_stress_arg_t *stress = (slab_stress_arg_t *)arg;
+    uint32_t *window[STRESS_WINDOW] = { 0 };
+
+    for (int i = 0; i < STRESS_ITERATIONS; i++) {
+        const int slot = i % STRESS_WINDOW;
+        if (window[slot] != NULL) {
+            /* nobody else wrote to the object while this task owned it */
+            if (*window[slot] != stress->tag + i - STRESS_WINDOW) {
+                stress->failed = true;
+            }
+            heap_caps_slab_free(stress->slab, window[slot]);
+        }
+        window[slot] = heap_caps_slab_alloc(stress->slab);
+        if (window[slot] == NULL) {
+            stress->failed = true;
+            break;
+        }
+        *window[slot] = stress->tag + i;
+    }
+
+    for (int i = 0; i < STRESS_WINDOW; i++) {
+        heap_caps_slab_free(stress->slab, window[i]);
+    }
+    xSemaphoreGive(stress->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("slab allocator with per-core magazines under concurrent use", "[heap][slab]")
+{
+    const heap_caps_slab_config_t config = {
+        .obj_size = sizeof(uint32_t),
+        .count = STRESS_OBJ_COUNT,
+        .caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+        .magazine_size = MAGAZINE_SIZE,
+    };
+    heap_caps_slab_handle_t slab = heap_caps_slab_create_with_config(&config);
+    TEST_ASSERT_NOT_NULL(slab);
+
+    slab_stress_arg_t args[portNUM_PROCESSORS];
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(portNUM_PROCESSORS, 0);
+    TEST_ASSERT_NOT_NULL(done);
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        args[core].slab = slab;
+        args[core].done = done;
+        args[core].tag = core << 24;
+        args[core].failed = false;
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(slab_stress_task, "slab_stress", 2048, &args[core],
+                                                          uxTaskPriorityGet(NULL) - 1, NULL, core));
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        TEST_ASSERT_TRUE(xSemaphoreTake(done, pdMS_TO_TICKS(10000)));
+        TEST_ASSERT_FALSE(args[core].failed);
+    }
+    vSemaphoreDelete(done);
+
+    /* objects held in magazines still count as free */
+    multi_heap_info_t info;
+    heap_caps_slab_get_info(slab, &info);
+    TEST_ASSERT_EQUAL(0, info.allocated_blocks);
+    TEST_ASSERT_EQUAL(STRESS_OBJ_COUNT, info.free_blocks);
+    TEST_ASSERT(info.minimum_free_bytes < STRESS_OBJ_COUNT * sizeof(uint32_t));
+
+    heap_caps_slab_delete(slab);
+}
@@ -1,4 +1,4 @@
-# SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+# SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: CC0-1.0
 
 import pytest
@@ -115,6 +115,20 @@ def test_heap_trace_dump(dut: Dut) -> None:
     dut.expect_unity_test_output(timeout=100)
 
 
+@pytest.mark.generic
+@pytest.mark.esp32
+@pytest.mark.parametrize(
+    'config',
+    [
+        'heap_trace_sampling'
+    ]
+)
+def test_heap_trace_sampling(dut: Dut) -> None:
+    dut.expect_exact('Press ENTER to see the list of tests')
+    dut.write('[heap-trace]')
+    dut.expect_unity_test_output(timeout=100)
+
+
 @pytest.mark.generic
 @pytest.mark.supported_targets
 @pytest.mark.parametrize(
@@ -0,0 +1,311 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "catch.hpp"
+#include "multi_heap.h"
+
+#include "../multi_heap_config.h"
+extern "C" {
+#include "../multi_heap_internal.h"
+}
+
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <chrono>
+
+#ifdef MULTI_HEAP_CACHE
+
+TEST_CASE("multi_heap cache keeps get_info accounting exact", "[multi_heap][cache]")
+{
+    static uint8_t heap_mem[64 * 1024];
+    void *p[200];
+    const size_t num = sizeof(p) / sizeof(p[0]);
+
+    multi_heap_handle_t heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+    REQUIRE( heap != NULL );
+    const size_t initial_free = multi_heap_free_size(heap);
+
+    for (size_t i = 0; i < num; i++) {
+        p[i] = multi_heap_malloc(heap, 1 + (i * 7) % MULTI_HEAP_CACHE_MAX_SIZE);
+        REQUIRE( p[i] != NULL );
+    }
+    /* free every other block, most of them end up in the cache */
+    for (size_t i = 0; i < num; i += 2) {
+        multi_heap_free(heap, p[i]);
+        p[i] = NULL;
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+
+    multi_heap_info_t info;
+    size_t allocated_bytes = 0;
+    size_t allocated_blocks = 0;
+    for (size_t i = 0; i < num; i++) {
+        if (p[i] != NULL) {
+            allocated_bytes += multi_heap_get_allocated_size(heap, p[i]);
+            allocated_blocks++;
+        }
+    }
+    multi_heap_get_info(heap, &info);
+    REQUIRE( info.allocated_blocks == allocated_blocks );
+    REQUIRE( info.total_allocated_bytes == allocated_bytes );
+    REQUIRE( info.total_free_bytes == multi_heap_free_size(heap) );
+    REQUIRE( info.minimum_free_bytes <= info.total_free_bytes );
+    REQUIRE( info.total_blocks == info.allocated_blocks + info.free_blocks );
+
+    for (size_t i = 1; i < num; i += 2) {
+        multi_heap_free(heap, p[i]);
+    }
+
+    /* everything is free again, even though some blocks are still cached */
+    multi_heap_get_info(heap, &info);
+    REQUIRE( info.allocated_blocks == 0 );
+    REQUIRE( info.total_allocated_bytes == 0 );
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+
+    REQUIRE( multi_heap_flush_cache(heap) > 0 );
+    REQUIRE( multi_heap_flush_cache(heap) == 0 );
+    REQUIRE( multi_heap_check(heap, true) );
+    multi_heap_get_info(heap, &info);
+    REQUIRE( info.free_blocks == 1 );
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+}
+
+TEST_CASE("multi_heap cache is flushed when the heap runs out of memory", "[multi_heap][cache]")
+{
+    static uint8_t heap_mem[8 * 1024];
+    void *p[1024];
+    size_t num = 0;
+
+    multi_heap_handle_t heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+    REQUIRE( heap != NULL );
+    const size_t initial_free = multi_heap_free_size(heap);
+
+    while (num < sizeof(p) / sizeof(p[0]) && (p[num] = multi_heap_malloc(heap, 16)) != NULL) {
+        num++;
+    }
+    REQUIRE( num > MULTI_HEAP_CACHE_DEPTH );
+    for (size_t i = 0; i < num; i++) {
+        multi_heap_free(heap, p[i]);
+    }
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+
+    /* the cached blocks are scattered through the heap, this only fits once they are returned */
+    void *large = multi_heap_malloc(heap, initial_free / 2);
+    REQUIRE( large != NULL );
+    REQUIRE( multi_heap_check(heap, true) );
+    multi_heap_free(heap, large);
+    REQUIRE( multi_heap_free_size(heap) == initial_free );
+}
+
+/* heap_caps_get_info() keeps the last result of multi_heap_get_info() under the heap lock, which
+ * is also the lock registered with multi_heap. Do the same here while other threads refill and
+ * flush their caches: multi_heap_get_info() takes the cache locks before the heap lock, so it must
+ * not be called with the heap lock held.
+ */
+
+#define INFO_REFILL_THREADS 2
+#define INFO_READS 20000
+
+typedef struct {
+    multi_heap_handle_t heap;
+    pthread_mutex_t *lock;
+    multi_heap_info_t info;
+    volatile bool stop;
+    volatile bool done;
+    bool failed;
+} info_arg_t;
+
+static void *info_refill_thread(void *arg)
+{
+    info_arg_t *info_arg = (info_arg_t *)arg;
+    void *p[4 * MULTI_HEAP_CACHE_DEPTH];
+
+    while (!info_arg->stop) {
+        /* more blocks than the cache holds, so it is refilled and flushed every round */
+        for (size_t i = 0; i < sizeof(p) / sizeof(p[0]); i++) {
+            p[i] = multi_heap_malloc(info_arg->heap, 16);
+            if (p[i] == NULL) {
+                info_arg->failed = true;
+            }
+        }
+        for (size_t i = 0; i < sizeof(p) / sizeof(p[0]); i++) {
+            multi_heap_free(info_arg->heap, p[i]);
+        }
+    }
+    return NULL;
+}
+
+static void *info_read_thread(void *arg)
+{
+    info_arg_t *info_arg = (info_arg_t *)arg;
+    multi_heap_info_t info;
+
+    for (int i = 0; i < INFO_READS; i++) {
+        multi_heap_get_info(info_arg->heap, &info);
+        pthread_mutex_lock(info_arg->lock);
+        info_arg->info = info;
+        pthread_mutex_unlock(info_arg->lock);
+    }
+    info_arg->done = true;
+    return NULL;
+}
+
+TEST_CASE("multi_heap get_info while other threads refill their caches", "[multi_heap][cache]")
+{
+    static uint8_t heap_mem[64 * 1024];
+    static pthread_mutex_t lock;
+    pthread_mutexattr_t attr;
+    pthread_t refill_tid[INFO_REFILL_THREADS];
+    pthread_t read_tid;
+    info_arg_t arg = {};
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock, &attr);
+    arg.heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+    REQUIRE( arg.heap != NULL );
+    multi_heap_set_lock(arg.heap, &lock);
+    arg.lock = &lock;
+    const size_t initial_free = multi_heap_free_size(arg.heap);
+
+    for (int t = 0; t < INFO_REFILL_THREADS; t++) {
+        REQUIRE( pthread_create(&refill_tid[t], NULL, info_refill_thread, &arg) == 0 );
+    }
+    REQUIRE( pthread_create(&read_tid, NULL, info_read_thread, &arg) == 0 );
+
+    /* a lock order inversion deadlocks the threads, don't wait for them forever */
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (!arg.done && std::chrono::steady_clock::now() < deadline) {
+        usleep(10000);
+    }
+    REQUIRE( arg.done );
+
+    arg.stop = true;
+    for (int t = 0; t < INFO_REFILL_THREADS; t++) {
+        pthread_join(refill_tid[t], NULL);
+    }
+    pthread_join(read_tid, NULL);
+    REQUIRE_FALSE( arg.failed );
+    REQUIRE( multi_heap_check(arg.heap, true) );
+
+    multi_heap_info_t info;
+    multi_heap_get_info(arg.heap, &info);
+    REQUIRE( info.allocated_blocks == 0 );
+    REQUIRE( multi_heap_free_size(arg.heap) == initial_free );
+    pthread_mutex_destroy(&lock);
+    pthread_mutexattr_destroy(&attr);
+}
+
+#endif // MULTI_HEAP_CACHE
+
+/* Contention and throughput benchmark.
+ *
+ * Several threads allocate and free small blocks on one heap protected by a mutex. Each thread
+ * keeps a window of live blocks so that allocation and free are interleaved, as with network
+ * buffers. Run the suite with and without -DCONFIG_HEAP_PER_CORE_CACHE (see test_all_configs.sh)
+ * to compare the results.
+ */
+
+#define BENCH_WINDOW 32
+#define BENCH_ITERATIONS 200000
+#define BENCH_MAX_THREADS 4
+
+typedef struct {
+    multi_heap_handle_t heap;
+    uint32_t seed;
+    bool failed;
+} bench_arg_t;
+
+static void *bench_thread(void *arg)
+{
+    bench_arg_t *bench = (bench_arg_t *)arg;
+    uint8_t *window[BENCH_WINDOW] = { 0 };
+    size_t sizes[BENCH_WINDOW] = { 0 };
+    uint32_t seed = bench->seed;
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        const int slot = i % BENCH_WINDOW;
+        if (window[slot] != NULL) {
+            /* check nobody else wrote to the block while it was allocated */
+            if (window[slot][0] != (uint8_t)sizes[slot] || window[slot][sizes[slot] - 1] != (uint8_t)sizes[slot]) {
+                bench->failed = true;
+            }
+            multi_heap_free(bench->heap, window[slot]);
+        }
+        seed = seed * 1103515245 + 12345;
+        sizes[slot] = 8 + (seed >> 16) % 121;
+        window[slot] = (uint8_t *)multi_heap_malloc(bench->heap, sizes[slot]);
+        if (window[slot] == NULL) {
+            bench->failed = true;
+            break;
+        }
+        memset(window[slot], (uint8_t)sizes[slot], sizes[slot]);
+    }
+
+    for (int i = 0; i < BENCH_WINDOW; i++) {
+        multi_heap_free(bench->heap, window[i]);
+    }
+    return NULL;
+}
+
+TEST_CASE("multi_heap concurrent small allocation throughput", "[multi_heap][benchmark]")
+{
+    static uint8_t heap_mem[256 * 1024];
+    pthread_mutex_t lock;
+    pthread_mutexattr_t attr;
+
+    /* heap locks must be recursive, heap poisoning takes the lock around the implementation */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock, &attr);
+
+#ifdef MULTI_HEAP_CACHE
+    printf("Per-core cache enabled: max size %d, depth %d\n", MULTI_HEAP_CACHE_MAX_SIZE, MULTI_HEAP_CACHE_DEPTH);
+#else
+    printf("Per-core cache disabled\n");
+#endif
+
+    for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        multi_heap_handle_t heap = multi_heap_register(heap_mem, sizeof(heap_mem));
+        REQUIRE( heap != NULL );
+        multi_heap_set_lock(heap, &lock);
+        const size_t initial_free = multi_heap_free_size(heap);
+
+        pthread_t tid[BENCH_MAX_THREADS];
+        bench_arg_t args[BENCH_MAX_THREADS];
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++) {
+            args[t].heap = heap;
+            args[t].seed = t + 1;
+            args[t].failed = false;
+            REQUIRE( pthread_create(&tid[t], NULL, bench_thread, &args[t]) == 0 );
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(tid[t], NULL);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        for (int t = 0; t < threads; t++) {
+            REQUIRE_FALSE( args[t].failed );
+        }
+        REQUIRE( multi_heap_check(heap, true) );
+
+        multi_heap_info_t info;
+        multi_heap_get_info(heap, &info);
+        REQUIRE( info.allocated_blocks == 0 );
+        REQUIRE( info.total_allocated_bytes == 0 );
+        REQUIRE( multi_heap_free_size(heap) == initial_free );
+
+        const double us = std::chrono::duration<double, std::micro>(end - start).count();
+        const double ops = 2.0 * BENCH_ITERATIONS * threads;
+        printf("%d thread(s): %.0f malloc+free ops/s, %.3f us/op\n", threads, ops * 1e6 / us, us / ops);
+    }
+
+    pthread_mutex_destroy(&lock);
+    pthread_mutexattr_destroy(&attr);
+}
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "esp_err.h"
 #include "esp_attr.h"
 #include "esp_cpu.h"
@@ -55,10 +56,22 @@ typedef struct {
 
 /** pthread mutex FreeRTOS wrapper */
 typedef struct {
-    SemaphoreHandle_t   sem;        ///< Handle of the task waiting to join
+    SemaphoreHandle_t   sem;        ///< FreeRTOS mutex, or semaphore the waiting tasks block on if CONFIG_PTHREAD_MUTEX_FAST_PATH
     int                 type;       ///< Mutex type. Currently supported PTHREAD_MUTEX_NORMAL and PTHREAD_MUTEX_RECURSIVE
+#if CONFIG_PTHREAD_MUTEX_FAST_PATH
+    atomic_uint         state;      ///< MUTEX_UNLOCKED, MUTEX_LOCKED or MUTEX_CONTENDED
+    TaskHandle_t        owner;      ///< Task holding the mutex, only set for recursive and error checking mutexes
+    unsigned            count;      ///< Number of times a recursive mutex is locked by its owner
+#endif
 } esp_pthread_mutex_t;
 
+#if CONFIG_PTHREAD_MUTEX_FAST_PATH
+/* Mutex states, a task only blocks on the semaphore if the mutex is contended */
+#define MUTEX_UNLOCKED  0
+#define MUTEX_LOCKED    1
+#define MUTEX_CONTENDED 2   // Locked, and tasks may be waiting for it
+#endif
+
 static SemaphoreHandle_t s_threads_mux  = NULL;
 portMUX_TYPE pthread_lazy_init_lock  = portMUX_INITIALIZER_UNLOCKED; // Used for mutexes and cond vars and rwlocks
 static SLIST_HEAD(esp_thread_list_head, esp_pthread_entry) s_threads_list
@@ -110,22 +123,15 @@ static void *pthread_get_handle_by_desc(esp_pthread_t *item, void *desc)
     return NULL;
 }
 
-static void *pthread_get_desc_by_handle(esp_pthread_t *item, void *hnd)
-{
-    if (hnd == item->handle) {
-        return item;
-    }
-    return NULL;
-}
-
 static inline TaskHandle_t pthread_find_handle(pthread_t thread)
 {
     return pthread_list_find_item(pthread_get_handle_by_desc, (void *)thread);
 }
 
-static esp_pthread_t *pthread_find(TaskHandle_t task_handle)
+static inline esp_pthread_t *pthread_find_current(void)
 {
-    return pthread_list_find_item(pthread_get_desc_by_handle, task_handle);
+    // The pthread is saved in the thread local storage of its task, so it's found without taking s_threads_mux
+    return pthread_internal_local_storage_get_thread();
 }
 
 static void pthread_delete(esp_pthread_t *pthread)
@@ -379,6 +385,15 @@ int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
     }
     pthread->handle = xHandle;
 
+    if (pthread_internal_local_storage_set_thread(xHandle, pthread) != 0) {
+        ESP_LOGE(TAG, "Failed to allocate thread local storage!");
+        // the task is still waiting for the start notification
+        vTaskDelete(xHandle);
+        free(pthread);
+        free(task_arg);
+        return ENOMEM;
+    }
+
     if (xSemaphoreTake(s_threads_mux, portMAX_DELAY) != pdTRUE) {
         assert(false && "Failed to lock threads list!");
     }
@@ -422,7 +437,7 @@ int pthread_join(pthread_t thread, void **retval)
         // join to self not allowed
         ret = EDEADLK;
     } else {
-        esp_pthread_t *cur_pthread = pthread_find(xTaskGetCurrentTaskHandle());
+        esp_pthread_t *cur_pthread = pthread_find_current();
         if (cur_pthread && cur_pthread->join_task == handle) {
             // join to each other not allowed
             ret = EDEADLK;
@@ -496,16 +511,17 @@ int pthread_detach(pthread_t thread)
 void pthread_exit(void *value_ptr)
 {
     bool detached = false;
+    /* the pthread is found before its thread local storage is freed */
+    esp_pthread_t *pthread = pthread_find_current();
+    if (!pthread) {
+        assert(false && "Failed to find pthread for current task!");
+    }
     /* clean up thread local storage before task deletion */
     pthread_internal_local_storage_destructor_callback(NULL);
 
     if (xSemaphoreTake(s_threads_mux, portMAX_DELAY) != pdTRUE) {
         assert(false && "Failed to lock threads list!");
     }
-    esp_pthread_t *pthread = pthread_find(xTaskGetCurrentTaskHandle());
-    if (!pthread) {
-        assert(false && "Failed to find pthread for current task!");
-    }
     if (pthread->task_arg) {
         free(pthread->task_arg);
     }
@@ -556,14 +572,10 @@ int sched_yield(void)
 
 pthread_t pthread_self(void)
 {
-    if (xSemaphoreTake(s_threads_mux, portMAX_DELAY) != pdTRUE) {
-        assert(false && "Failed to lock threads list!");
-    }
-    esp_pthread_t *pthread = pthread_find(xTaskGetCurrentTaskHandle());
+    esp_pthread_t *pthread = pthread_find_current();
     if (!pthread) {
         assert(false && "Failed to find current thread ID!");
     }
-    xSemaphoreGive(s_threads_mux);
     return (pthread_t)pthread;
 }
 
@@ -625,11 +637,18 @@ int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
     }
     mux->type = type;
 
+#if CONFIG_PTHREAD_MUTEX_FAST_PATH
+    atomic_init(&mux->state, MUTEX_UNLOCKED);
+    mux->owner = NULL;
+    mux->count = 0;
+    mux->sem = xSemaphoreCreateBinary();
+#else
     if (mux->type == PTHREAD_MUTEX_RECURSIVE) {
         mux->sem = xSemaphoreCreateRecursiveMutex();
     } else {
         mux->sem = xSemaphoreCreateMutex();
     }
+#endif
     if (!mux->sem) {
         free(mux);
         return EAGAIN;
@@ -664,6 +683,8 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex)
         return EBUSY;
     }
 
+#if !CONFIG_PTHREAD_MUTEX_FAST_PATH
+    // with the fast path, nobody waits on the semaphore as the mutex was unlocked
     if (mux->type == PTHREAD_MUTEX_RECURSIVE) {
         res = xSemaphoreGiveRecursive(mux->sem);
     } else {
@@ -672,12 +693,68 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex)
     if (res != pdTRUE) {
         assert(false && "Failed to release mutex!");
     }
+#endif
     vSemaphoreDelete(mux->sem);
     free(mux);
 
     return 0;
 }
 
+#if CONFIG_PTHREAD_MUTEX_FAST_PATH
+/* Wait until the mutex is unlocked and lock it, state is the state it was locked in */
+static int pthread_mutex_lock_contended(esp_pthread_mutex_t *mux, unsigned state, TickType_t tmo)
+{
+    TimeOut_t timeout;
+
+    if (tmo == 0) {
+        return EBUSY;
+    }
+    vTaskSetTimeOutState(&timeout);
+
+    // The owner gives the semaphore when unlocking a contended mutex. A task which locks the mutex here keeps it
+    // contended, as other tasks may still be waiting.
+    if (state != MUTEX_CONTENDED) {
+        state = atomic_exchange(&mux->state, MUTEX_CONTENDED);
+    }
+    while (state != MUTEX_UNLOCKED) {
+        if (xTaskCheckForTimeOut(&timeout, &tmo) != pdFALSE ||
+                xSemaphoreTake(mux->sem, tmo) != pdTRUE) {
+            return EBUSY;
+        }
+        state = atomic_exchange(&mux->state, MUTEX_CONTENDED);
+    }
+    return 0;
+}
+
+static int pthread_mutex_lock_internal(esp_pthread_mutex_t *mux, TickType_t tmo)
+{
+    if (!mux) {
+        return EINVAL;
+    }
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (mux->type != PTHREAD_MUTEX_NORMAL && mux->owner == self) {
+        if (mux->type == PTHREAD_MUTEX_ERRORCHECK) {
+            return EDEADLK;
+        }
+        mux->count++;
+        return 0;
+    }
+
+    unsigned state = MUTEX_UNLOCKED;
+    if (!atomic_compare_exchange_strong(&mux->state, &state, MUTEX_LOCKED)) {
+        int res = pthread_mutex_lock_contended(mux, state, tmo);
+        if (res != 0) {
+            return res;
+        }
+    }
+    if (mux->type != PTHREAD_MUTEX_NORMAL) {
+        mux->owner = self;
+        mux->count = 1;
+    }
+    return 0;
+}
+#else
 static int pthread_mutex_lock_internal(esp_pthread_mutex_t *mux, TickType_t tmo)
 {
     if (!mux) {
@@ -701,6 +778,7 @@ static int pthread_mutex_lock_internal(esp_pthread_mutex_t *mux, TickType_t tmo)
 
     return 0;
 }
+#endif // CONFIG_PTHREAD_MUTEX_FAST_PATH
 
 static int pthread_mutex_init_if_static(pthread_mutex_t *mutex)
 {
@@ -773,6 +851,26 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex)
         return EINVAL;
     }
 
+#if CONFIG_PTHREAD_MUTEX_FAST_PATH
+    if (mux->type != PTHREAD_MUTEX_NORMAL) {
+        if (mux->owner != xTaskGetCurrentTaskHandle()) {
+            return EPERM;
+        }
+        if (--mux->count > 0) {
+            return 0;
+        }
+        mux->owner = NULL;
+    }
+
+    unsigned state = atomic_exchange(&mux->state, MUTEX_UNLOCKED);
+    if (state == MUTEX_UNLOCKED) {
+        assert(false && "Failed to unlock mutex!");
+    } else if (state == MUTEX_CONTENDED) {
+        // wake up one of the waiting tasks
+        xSemaphoreGive(mux->sem);
+    }
+    return 0;
+#else
     if (((mux->type == PTHREAD_MUTEX_RECURSIVE) ||
             (mux->type == PTHREAD_MUTEX_ERRORCHECK)) &&
             (xSemaphoreGetMutexHolder(mux->sem) != xTaskGetCurrentTaskHandle())) {
@@ -789,6 +887,7 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex)
         assert(false && "Failed to unlock mutex!");
     }
     return 0;
+#endif // CONFIG_PTHREAD_MUTEX_FAST_PATH
 }
 
 int pthread_mutexattr_init(pthread_mutexattr_t *attr)
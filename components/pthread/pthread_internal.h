@@ -1,10 +1,18 @@
 /*
- * SPDX-FileCopyrightText: 2017-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2017-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 #pragma once
 
+struct esp_pthread_entry;
+
 void pthread_internal_local_storage_destructor_callback(TaskHandle_t handle);
 
+/* Save the pthread running in a task in its thread local storage, so it can be found without searching */
+int pthread_internal_local_storage_set_thread(TaskHandle_t handle, struct esp_pthread_entry *pthread);
+
+/* Return the pthread running in the current task, or NULL if the task isn't a pthread */
+struct esp_pthread_entry *pthread_internal_local_storage_get_thread(void);
+
 extern portMUX_TYPE pthread_lazy_init_lock;
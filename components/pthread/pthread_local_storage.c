@@ -5,13 +5,13 @@
  */
 #include <errno.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include "esp_err.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "sys/lock.h"
-#include "sys/queue.h"
 
 #include "pthread_internal.h"
 
@@ -22,82 +22,115 @@
 
 #define PTHREAD_TLS_INDEX 0
 
+#define KEY_BLOCK_SIZE      16  // Number of keys allocated at once
+#define KEY_BLOCKS          16  // Maximum number of key blocks, limits the number of keys to 256
+#define INLINE_VALUES       CONFIG_PTHREAD_TLS_INLINE_VALUES
+
 typedef void (*pthread_destructor_t)(void*);
 
-/* This is a very naive implementation of key-indexed thread local storage, using two linked lists
-   (one is a global list of registered keys, one per thread for thread local storage values).
+/* Keys and thread-specific values are both indexed by the key number, so lookups don't depend on the number of
+   keys or values.
+
+   A key is an index into the table of keys (plus 1, so 0 is never a valid key). The table is split into blocks which
+   are allocated when needed and never freed, so pthread_getspecific() can read it without a lock. Each key has a
+   sequence number which is odd while the key is in use, and incremented both when the key is created and deleted.
 
-   It won't work well if lots of keys & thread-local values are stored (O(n) lookup for both),
-   but it should work for small amounts of data.
+   Each thread has a thread_data_t saved as its FreeRTOS thread local storage pointer. The values of the first keys
+   are stored inline, the others in an overflow array grown as needed. A value records the sequence number of its key
+   when it was set, so values left over from a deleted key are ignored when the key number is reused.
 */
-typedef struct key_entry_t_ {
-    pthread_key_t key;
+typedef struct {
+    uint32_t seq;
     pthread_destructor_t destructor;
-    SLIST_ENTRY(key_entry_t_) next;
 } key_entry_t;
 
-// List of all keys created with pthread_key_create()
-SLIST_HEAD(key_list_t, key_entry_t_) s_keys = SLIST_HEAD_INITIALIZER(s_keys);
+// Blocks of keys created with pthread_key_create()
+static key_entry_t *s_key_blocks[KEY_BLOCKS];
 
 static portMUX_TYPE s_keys_lock = portMUX_INITIALIZER_UNLOCKED;
 
-// List of all value entries associated with a thread via pthread_setspecific()
-typedef struct value_entry_t_ {
-    pthread_key_t key;
+typedef struct {
+    uint32_t seq;           // Sequence number of the key when the value was set
     void *value;
-    SLIST_ENTRY(value_entry_t_) next;
 } value_entry_t;
 
-// Type for the head of the list, as saved as a FreeRTOS thread local storage pointer
-SLIST_HEAD(values_list_t_, value_entry_t_);
-typedef struct values_list_t_ values_list_t;
+typedef struct {
+    struct esp_pthread_entry *pthread;      // The pthread running in the task, NULL for other tasks
+    size_t num_overflow;                    // Number of values in the overflow array
+    value_entry_t *overflow;                // Values of the keys following the inline ones
+    value_entry_t values[INLINE_VALUES];    // Values of the first keys
+} thread_data_t;
 
-int pthread_key_create(pthread_key_t *key, pthread_destructor_t destructor)
+static inline key_entry_t *get_key(pthread_key_t key)
 {
-    key_entry_t *new_key = malloc(sizeof(key_entry_t));
-    if (new_key == NULL) {
-        return ENOMEM;
-    }
+    uint32_t idx = key - 1;
 
-    portENTER_CRITICAL(&s_keys_lock);
-
-    const key_entry_t *head = SLIST_FIRST(&s_keys);
-    new_key->key = (head == NULL) ? 1 : (head->key + 1);
-    new_key->destructor = destructor;
-    *key = new_key->key;
-
-    SLIST_INSERT_HEAD(&s_keys, new_key, next);
-
-    portEXIT_CRITICAL(&s_keys_lock);
-    return 0;
+    if (idx >= KEY_BLOCK_SIZE * KEY_BLOCKS) {
+        return NULL;
+    }
+    key_entry_t *block = s_key_blocks[idx / KEY_BLOCK_SIZE];
+    if (block == NULL) {
+        return NULL;
+    }
+    return &block[idx % KEY_BLOCK_SIZE];
 }
 
-static key_entry_t *find_key(pthread_key_t key)
+int pthread_key_create(pthread_key_t *key, pthread_destructor_t destructor)
 {
-    portENTER_CRITICAL(&s_keys_lock);
-    key_entry_t *result = NULL;;
-    SLIST_FOREACH(result, &s_keys, next) {
-        if (result->key == key) {
-            break;
+    key_entry_t *new_block = NULL;
+
+    while (true) {
+        int free_block = -1;
+
+        portENTER_CRITICAL(&s_keys_lock);
+        for (int i = 0; i < KEY_BLOCKS; i++) {
+            key_entry_t *block = s_key_blocks[i];
+            if (block == NULL) {
+                if (new_block == NULL) {
+                    free_block = i;
+                    break;
+                }
+                // Publish the new block, it was zeroed so all its keys are unused
+                s_key_blocks[i] = block = new_block;
+                new_block = NULL;
+            }
+            for (int j = 0; j < KEY_BLOCK_SIZE; j++) {
+                if ((block[j].seq & 1) == 0) {
+                    block[j].seq++;
+                    block[j].destructor = destructor;
+                    *key = i * KEY_BLOCK_SIZE + j + 1;
+                    portEXIT_CRITICAL(&s_keys_lock);
+                    free(new_block);
+                    return 0;
+                }
+            }
+        }
+        portEXIT_CRITICAL(&s_keys_lock);
+
+        if (free_block < 0) {
+            free(new_block);
+            return EAGAIN;
+        }
+        // All allocated keys are in use, allocate another block outside of the critical section and retry
+        new_block = calloc(KEY_BLOCK_SIZE, sizeof(key_entry_t));
+        if (new_block == NULL) {
+            return ENOMEM;
         }
     }
-    portEXIT_CRITICAL(&s_keys_lock);
-    return result;
 }
 
 int pthread_key_delete(pthread_key_t key)
 {
-
     portENTER_CRITICAL(&s_keys_lock);
 
-    /* Ideally, we would also walk all tasks' thread local storage value_list here
-       and delete any values associated with this key. We do not do this...
+    /* Ideally, we would also walk all tasks' thread local storage values here and delete any values associated with
+       this key. We do not do this, but the values are ignored from now on as the sequence number of the key changes...
     */
 
-    key_entry_t *entry = find_key(key);
-    if (entry != NULL) {
-        SLIST_REMOVE(&s_keys, entry, key_entry_t_, next);
-        free(entry);
+    key_entry_t *entry = get_key(key);
+    if (entry != NULL && (entry->seq & 1) != 0) {
+        entry->seq++;
+        entry->destructor = NULL;
     }
 
     portEXIT_CRITICAL(&s_keys_lock);
@@ -105,6 +138,20 @@ int pthread_key_delete(pthread_key_t key)
     return 0;
 }
 
+static value_entry_t *find_value(thread_data_t *tls, pthread_key_t key)
+{
+    uint32_t idx = key - 1;
+
+    if (idx < INLINE_VALUES) {
+        return &tls->values[idx];
+    }
+    idx -= INLINE_VALUES;
+    if (idx < tls->num_overflow) {
+        return &tls->overflow[idx];
+    }
+    return NULL;
+}
+
 /* Clean up callback for deleted tasks.
 
    This is called from one of two places:
@@ -124,26 +171,40 @@ int pthread_key_delete(pthread_key_t key)
 */
 static void pthread_cleanup_thread_specific_data_callback(int index, void *v_tls)
 {
-    values_list_t *tls = (values_list_t *)v_tls;
+    thread_data_t *tls = (thread_data_t *)v_tls;
+    bool called;
     assert(tls != NULL);
 
-    /* Walk the list, freeing all entries and calling destructors if they are registered */
-    while (1) {
-        value_entry_t *entry = SLIST_FIRST(tls);
-        if (entry == NULL) {
-            break;
-        }
-        SLIST_REMOVE_HEAD(tls, next);
-
-        // This is a little slow, walking the linked list of keys once per value,
-        // but assumes that the thread's value list will have less entries
-        // than the keys list
-        key_entry_t *key = find_key(entry->key);
-        if (key != NULL && key->destructor != NULL) {
-            key->destructor(entry->value);
+    /* Walk the values in key order, calling destructors if they are registered, until no more non-NULL values are
+       left. A destructor may set new values, which are then destroyed by the next walk, after the existing ones.
+    */
+    do {
+        called = false;
+        for (pthread_key_t key = 1; key <= INLINE_VALUES + tls->num_overflow; key++) {
+            // The overflow array may be reallocated by a destructor, so the entry is looked up every time
+            value_entry_t *entry = find_value(tls, key);
+            void *value = entry->value;
+            if (value == NULL) {
+                continue;
+            }
+            entry->value = NULL;
+
+            pthread_destructor_t destructor = NULL;
+            portENTER_CRITICAL(&s_keys_lock);
+            key_entry_t *key_entry = get_key(key);
+            if (key_entry != NULL && key_entry->seq == entry->seq) {
+                destructor = key_entry->destructor;
+            }
+            portEXIT_CRITICAL(&s_keys_lock);
+
+            if (destructor != NULL) {
+                destructor(value);
+                called = true;
+            }
         }
-        free(entry);
-    }
+    } while (called);
+
+    free(tls->overflow);
     free(tls);
 }
 
@@ -157,9 +218,9 @@ void pthread_internal_local_storage_destructor_callback(TaskHandle_t handle)
            calling it again...
         */
 #if !defined(CONFIG_FREERTOS_TLSP_DELETION_CALLBACKS)
-        vTaskSetThreadLocalStoragePointer(NULL, PTHREAD_TLS_INDEX, NULL);
+        vTaskSetThreadLocalStoragePointer(handle, PTHREAD_TLS_INDEX, NULL);
 #else
-        vTaskSetThreadLocalStoragePointerAndDelCallback(NULL,
+        vTaskSetThreadLocalStoragePointerAndDelCallback(handle,
                                                         PTHREAD_TLS_INDEX,
                                                         NULL,
                                                         NULL);
@@ -167,89 +228,102 @@ void pthread_internal_local_storage_destructor_callback(TaskHandle_t handle)
     }
 }
 
-static value_entry_t *find_value(const values_list_t *list, pthread_key_t key)
+static thread_data_t *get_thread_data(TaskHandle_t handle)
 {
-    value_entry_t *result = NULL;;
-    SLIST_FOREACH(result, list, next) {
-        if (result->key == key) {
-            break;
+    thread_data_t *tls = pvTaskGetThreadLocalStoragePointer(handle, PTHREAD_TLS_INDEX);
+    if (tls == NULL) {
+        tls = calloc(1, sizeof(thread_data_t));
+        if (tls == NULL) {
+            return NULL;
         }
+#if !defined(CONFIG_FREERTOS_TLSP_DELETION_CALLBACKS)
+        vTaskSetThreadLocalStoragePointer(handle, PTHREAD_TLS_INDEX, tls);
+#else
+        vTaskSetThreadLocalStoragePointerAndDelCallback(handle,
+                                                        PTHREAD_TLS_INDEX,
+                                                        tls,
+                                                        pthread_cleanup_thread_specific_data_callback);
+#endif /* CONFIG_FREERTOS_TLSP_DELETION_CALLBACKS */
+    }
+    return tls;
+}
+
+int pthread_internal_local_storage_set_thread(TaskHandle_t handle, struct esp_pthread_entry *pthread)
+{
+    thread_data_t *tls = get_thread_data(handle);
+    if (tls == NULL) {
+        return ENOMEM;
+    }
+    tls->pthread = pthread;
+    return 0;
+}
+
+struct esp_pthread_entry *pthread_internal_local_storage_get_thread(void)
+{
+    thread_data_t *tls = pvTaskGetThreadLocalStoragePointer(NULL, PTHREAD_TLS_INDEX);
+    if (tls == NULL) {
+        return NULL;
     }
-    return result;
+    return tls->pthread;
 }
 
 void *pthread_getspecific(pthread_key_t key)
 {
-    values_list_t *tls = (values_list_t *) pvTaskGetThreadLocalStoragePointer(NULL, PTHREAD_TLS_INDEX);
+    thread_data_t *tls = pvTaskGetThreadLocalStoragePointer(NULL, PTHREAD_TLS_INDEX);
     if (tls == NULL) {
         return NULL;
     }
 
     value_entry_t *entry = find_value(tls, key);
-    if (entry != NULL) {
-        return entry->value;
+    if (entry == NULL || entry->value == NULL) {
+        return NULL;
     }
-    return NULL;
+    // Ignore values set before the key was deleted
+    key_entry_t *key_entry = get_key(key);
+    if (key_entry == NULL || key_entry->seq != entry->seq) {
+        return NULL;
+    }
+    return entry->value;
 }
 
 int pthread_setspecific(pthread_key_t key, const void *value)
 {
-    key_entry_t *key_entry = find_key(key);
+    key_entry_t *key_entry = get_key(key);
     if (key_entry == NULL) {
         return ENOENT; // this situation is undefined by pthreads standard
     }
+    uint32_t seq = key_entry->seq;
+    if ((seq & 1) == 0) {
+        return ENOENT;
+    }
 
-    values_list_t *tls = pvTaskGetThreadLocalStoragePointer(NULL, PTHREAD_TLS_INDEX);
+    thread_data_t *tls = get_thread_data(NULL);
     if (tls == NULL) {
-        tls = calloc(1, sizeof(values_list_t));
-        if (tls == NULL) {
-            return ENOMEM;
-        }
-#if !defined(CONFIG_FREERTOS_TLSP_DELETION_CALLBACKS)
-        vTaskSetThreadLocalStoragePointer(NULL, PTHREAD_TLS_INDEX, tls);
-#else
-        vTaskSetThreadLocalStoragePointerAndDelCallback(NULL,
-                                                        PTHREAD_TLS_INDEX,
-                                                        tls,
-                                                        pthread_cleanup_thread_specific_data_callback);
-#endif /* CONFIG_FREERTOS_TLSP_DELETION_CALLBACKS */
+        return ENOMEM;
     }
 
     value_entry_t *entry = find_value(tls, key);
-    if (entry != NULL) {
-        if (value != NULL) {
-            // cast on next line is necessary as pthreads API uses
-            // 'const void *' here but elsewhere uses 'void *'
-            entry->value = (void *) value;
-        } else { // value == NULL, remove the entry
-            SLIST_REMOVE(tls, entry, value_entry_t_, next);
-            free(entry);
+    if (entry == NULL) {
+        if (value == NULL) {
+            return 0;
         }
-    } else if (value != NULL) {
-        entry = malloc(sizeof(value_entry_t));
-        if (entry == NULL) {
+        // grow the overflow array up to this key, the new values are NULL
+        size_t num_overflow = key - INLINE_VALUES;
+        value_entry_t *overflow = realloc(tls->overflow, num_overflow * sizeof(value_entry_t));
+        if (overflow == NULL) {
             return ENOMEM;
         }
-        entry->key = key;
-        entry->value = (void *) value; // see note above about cast
-
-        // insert the new entry at the end of the list. this is important because
-        // a destructor may call pthread_setspecific() to add a new non-NULL value
-        // to the list, and this should be processed after all other entries.
-        //
-        // See pthread_cleanup_thread_specific_data_callback()
-        value_entry_t *last_entry = NULL;
-        value_entry_t *it;
-        SLIST_FOREACH(it, tls, next) {
-            last_entry = it;
-        }
-        if (last_entry == NULL) {
-            SLIST_INSERT_HEAD(tls, entry, next);
-        } else {
-            SLIST_INSERT_AFTER(last_entry, entry, next);
-        }
+        memset(&overflow[tls->num_overflow], 0, (num_overflow - tls->num_overflow) * sizeof(value_entry_t));
+        tls->overflow = overflow;
+        tls->num_overflow = num_overflow;
+        entry = find_value(tls, key);
     }
 
+    entry->seq = seq;
+    // cast on next line is necessary as pthreads API uses
+    // 'const void *' here but elsewhere uses 'void *'
+    entry->value = (void *) value;
+
     return 0;
 }
 
@@ -8,6 +8,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdbool.h>
 #include <stdatomic.h>
 #include "esp_err.h"
 #include "esp_attr.h"
@@ -26,22 +27,24 @@ const static char *TAG = "pthread_rw_lock";
 /** pthread rw_mutex FreeRTOS wrapper */
 typedef struct {
     /**
-     *
+     * Tasks waiting for the lock, only used if the lock is contended
      */
     pthread_cond_t cv;
 
     pthread_mutex_t resource_mutex;
 
     /**
-     * Number of current readers holding this lock, negative number means waiting readers
+     * RWLOCK_WRITER if a writer holds the lock, RWLOCK_WAITERS if tasks may be waiting on cv,
+     * and the number of readers holding the lock
      */
-    int8_t active_readers;
-
-    uint8_t active_writers;
-    uint8_t waiting_writers;
+    atomic_uint state;
 
 } esp_pthread_rwlock_t;
 
+#define RWLOCK_WRITER   (1U << 31)
+#define RWLOCK_WAITERS  (1U << 30)
+#define RWLOCK_READERS  (RWLOCK_WAITERS - 1)
+
 #define WRITER_QUEUE_SIZE 4
 #define READER_QUEUE_SIZE 4
 
@@ -76,9 +79,7 @@ int pthread_rwlock_init(pthread_rwlock_t *rwlock,
         return ENOMEM;
     }
 
-    esp_rwlock->active_readers = 0;
-    esp_rwlock->active_writers = 0;
-    esp_rwlock->waiting_writers = 0;
+    atomic_init(&esp_rwlock->state, 0);
 
     *rwlock = (pthread_rwlock_t) esp_rwlock;
 
@@ -120,7 +121,7 @@ int pthread_rwlock_destroy(pthread_rwlock_t *rwlock)
     // TODO: necessary?
     pthread_mutex_lock(&esp_rwlock->resource_mutex);
 
-    if (esp_rwlock->active_readers != 0 || esp_rwlock->active_writers > 0 || esp_rwlock->waiting_writers > 0) {
+    if (atomic_load(&esp_rwlock->state) != 0) {
         pthread_mutex_unlock(&esp_rwlock->resource_mutex);
         return EBUSY;
     }
@@ -157,32 +158,47 @@ static int checkrw_lock(pthread_rwlock_t *rwlock)
     return 0;
 }
 
-int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
+/* Readers only take the lock if no writer holds it, even if writers are waiting for it */
+static bool try_rdlock(esp_pthread_rwlock_t *esp_rwlock)
 {
-    esp_pthread_rwlock_t *esp_rwlock;
-    int res;
+    unsigned state = atomic_load(&esp_rwlock->state);
 
-    res = checkrw_lock(rwlock);
-    if (res != 0) {
-        return res;
+    while ((state & RWLOCK_WRITER) == 0) {
+        if (atomic_compare_exchange_weak(&esp_rwlock->state, &state, state + 1)) {
+            return true;
+        }
     }
+    return false;
+}
 
-    esp_rwlock = (esp_pthread_rwlock_t *)*rwlock;
-    res = pthread_mutex_lock(&esp_rwlock->resource_mutex);
+static bool try_wrlock(esp_pthread_rwlock_t *esp_rwlock)
+{
+    unsigned state = atomic_load(&esp_rwlock->state);
+
+    while ((state & ~RWLOCK_WAITERS) == 0) {
+        if (atomic_compare_exchange_weak(&esp_rwlock->state, &state, state | RWLOCK_WRITER)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Slow path of rdlock and wrlock, the task blocks on the condition variable until try_lock succeeds */
+static int wait_for_lock(esp_pthread_rwlock_t *esp_rwlock, bool (*try_lock)(esp_pthread_rwlock_t *))
+{
+    int res = pthread_mutex_lock(&esp_rwlock->resource_mutex);
     if (res != 0) {
         return res;
     }
 
-    if (esp_rwlock->active_writers == 0) {
-        esp_rwlock->active_readers++;
-    } else {
-        while (true) {
-            pthread_cond_wait(&esp_rwlock->cv, &esp_rwlock->resource_mutex);
-            if (esp_rwlock->active_writers == 0 && esp_rwlock->waiting_writers == 0) {
-                esp_rwlock->active_readers++;
-                break;
-            }
+    while (true) {
+        // Set RWLOCK_WAITERS before trying again, so the task releasing the lock knows it has to wake us up.
+        // It needs resource_mutex to do so, which is only released once we are waiting on cv.
+        atomic_fetch_or(&esp_rwlock->state, RWLOCK_WAITERS);
+        if (try_lock(esp_rwlock)) {
+            break;
         }
+        pthread_cond_wait(&esp_rwlock->cv, &esp_rwlock->resource_mutex);
     }
 
     pthread_mutex_unlock(&esp_rwlock->resource_mutex);
@@ -190,7 +206,7 @@ int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
     return 0;
 }
 
-int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
 {
     esp_pthread_rwlock_t *esp_rwlock;
     int res;
@@ -201,24 +217,13 @@ int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
     }
 
     esp_rwlock = (esp_pthread_rwlock_t *)*rwlock;
-    res = pthread_mutex_trylock(&esp_rwlock->resource_mutex);
-    if (res != 0) {
-        return res;
+    if (try_rdlock(esp_rwlock)) {
+        return 0;
     }
-
-    if (esp_rwlock->active_writers == 0) {
-        esp_rwlock->active_readers++;
-        res = 0;
-    } else {
-        res = EBUSY;
-    }
-
-    pthread_mutex_unlock(&esp_rwlock->resource_mutex);
-
-    return res;
+    return wait_for_lock(esp_rwlock, try_rdlock);
 }
 
-int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
 {
     esp_pthread_rwlock_t *esp_rwlock;
     int res;
@@ -229,21 +234,24 @@ int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
     }
 
     esp_rwlock = (esp_pthread_rwlock_t *)*rwlock;
-    res = pthread_mutex_lock(&esp_rwlock->resource_mutex);
+    return try_rdlock(esp_rwlock) ? 0 : EBUSY;
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+{
+    esp_pthread_rwlock_t *esp_rwlock;
+    int res;
+
+    res = checkrw_lock(rwlock);
     if (res != 0) {
         return res;
     }
 
-    esp_rwlock->waiting_writers++;
-    while (esp_rwlock->active_readers > 0 || esp_rwlock->active_writers > 0) {
-        pthread_cond_wait(&esp_rwlock->cv, &esp_rwlock->resource_mutex);
+    esp_rwlock = (esp_pthread_rwlock_t *)*rwlock;
+    if (try_wrlock(esp_rwlock)) {
+        return 0;
     }
-    esp_rwlock->waiting_writers--;
-    esp_rwlock->active_writers++;
-
-    pthread_mutex_unlock(&esp_rwlock->resource_mutex);
-
-    return 0;
+    return wait_for_lock(esp_rwlock, try_wrlock);
 }
 
 int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock)
@@ -257,28 +265,13 @@ int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock)
     }
 
     esp_rwlock = (esp_pthread_rwlock_t *)*rwlock;
-    res = pthread_mutex_trylock(&esp_rwlock->resource_mutex);
-    if (res != 0) {
-        return res;
-    }
-
-    if (esp_rwlock->active_readers > 0 ||
-            esp_rwlock->active_writers > 0 ||
-            esp_rwlock->waiting_writers > 0) { // the last check for waiting_writers is to avoid skipping the queue
-        res = EBUSY;
-    } else {
-        esp_rwlock->active_writers++;
-        res = 0;
-    }
-
-    pthread_mutex_unlock(&esp_rwlock->resource_mutex);
-
-    return res;
+    return try_wrlock(esp_rwlock) ? 0 : EBUSY;
 }
 
 int pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
 {
     esp_pthread_rwlock_t *esp_rwlock;
+    unsigned state;
     int res;
 
     res = checkrw_lock(rwlock);
@@ -287,26 +280,25 @@ int pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
     }
 
     esp_rwlock = (esp_pthread_rwlock_t *)*rwlock;
-    res = pthread_mutex_lock(&esp_rwlock->resource_mutex);
-    if (res != 0) {
-        return res;
-    }
-
-    assert(!(esp_rwlock->active_readers > 0 && esp_rwlock->active_writers > 0));
+    state = atomic_load(&esp_rwlock->state);
 
-    if (esp_rwlock->active_readers > 0) {
+    if (state & RWLOCK_WRITER) {
+        // we are the writer
+        state = atomic_fetch_and(&esp_rwlock->state, ~RWLOCK_WRITER) & ~RWLOCK_WRITER;
+    } else if (state & RWLOCK_READERS) {
         // we are a reader
-        esp_rwlock->active_readers--;
-        if (esp_rwlock->active_readers == 0) {
-            pthread_cond_broadcast(&esp_rwlock->cv);
-        }
+        state = atomic_fetch_sub(&esp_rwlock->state, 1) - 1;
     } else {
-        // we are a writer
-        esp_rwlock->active_writers = 0;
-        pthread_cond_broadcast(&esp_rwlock->cv);
+        return EPERM;
     }
 
-    pthread_mutex_unlock(&esp_rwlock->resource_mutex);
+    // wake up the waiting tasks once the lock is free
+    if ((state & RWLOCK_WAITERS) && (state & (RWLOCK_WRITER | RWLOCK_READERS)) == 0) {
+        pthread_mutex_lock(&esp_rwlock->resource_mutex);
+        atomic_fetch_and(&esp_rwlock->state, ~RWLOCK_WAITERS);
+        pthread_cond_broadcast(&esp_rwlock->cv);
+        pthread_mutex_unlock(&esp_rwlock->resource_mutex);
+    }
 
     return 0;
 }
@@ -11,7 +11,9 @@
 #include "esp_pthread.h"
 #include <pthread.h>
 
+#include "esp_timer.h"
 #include "unity.h"
+#include "test_utils.h"
 
 TEST_CASE("esp_pthread_get_default_config creates correct stack memory capabilities", "[set_cfg]")
 {
@@ -325,3 +327,87 @@ TEST_CASE("pthread mutex trylock timedlock", "[pthread]")
         pthread_mutex_destroy(&mutex);
     }
 }
+
+#define CONTENDED_THREADS       4
+#define CONTENDED_ITERATIONS    2000
+
+typedef struct {
+    pthread_mutex_t mutex;
+    volatile int counter;
+} contended_mutex_arg_t;
+
+static void *increment_counter(void *arg)
+{
+    contended_mutex_arg_t *ctx = arg;
+
+    for (int i = 0; i < CONTENDED_ITERATIONS; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_mutex_lock(&ctx->mutex));
+        int counter = ctx->counter;
+        ctx->counter = counter + 1;
+        TEST_ASSERT_EQUAL_INT(0, pthread_mutex_unlock(&ctx->mutex));
+        // Sleep now and then outside the mutex, so the threads get out of step and the lower priority tasks
+        // get to run. Sleeping while holding it would serialize all sleeps and make the test take seconds.
+        if ((i % 64) == 0) {
+            vTaskDelay(1);
+        }
+    }
+    return NULL;
+}
+
+static void test_mutex_contended(int mutex_type)
+{
+    contended_mutex_arg_t ctx = { .counter = 0 };
+    pthread_mutexattr_t attr;
+    pthread_t threads[CONTENDED_THREADS];
+
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutexattr_init(&attr));
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutexattr_settype(&attr, mutex_type));
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutex_init(&ctx.mutex, &attr));
+    pthread_mutexattr_destroy(&attr);
+
+    for (int i = 0; i < CONTENDED_THREADS; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&threads[i], NULL, increment_counter, &ctx));
+    }
+    for (int i = 0; i < CONTENDED_THREADS; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_join(threads[i], NULL));
+    }
+    TEST_ASSERT_EQUAL_INT(CONTENDED_THREADS * CONTENDED_ITERATIONS, ctx.counter);
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutex_destroy(&ctx.mutex));
+}
+
+TEST_CASE("pthread mutex contended", "[pthread]")
+{
+    test_mutex_contended(PTHREAD_MUTEX_NORMAL);
+    test_mutex_contended(PTHREAD_MUTEX_ERRORCHECK);
+    test_mutex_contended(PTHREAD_MUTEX_RECURSIVE);
+}
+
+#define PERF_ITERATIONS 100000
+
+TEST_CASE("pthread mutex performance", "[pthread]")
+{
+    pthread_mutexattr_t attr;
+    pthread_mutex_t mutex;
+    int64_t start;
+
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutex_init(&mutex, NULL));
+    start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        pthread_mutex_lock(&mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+    IDF_LOG_PERFORMANCE("pthread_mutex_lock_unlock", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutex_destroy(&mutex));
+
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutexattr_init(&attr));
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE));
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutex_init(&mutex, &attr));
+    pthread_mutexattr_destroy(&attr);
+    start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        pthread_mutex_lock(&mutex);
+        pthread_mutex_unlock(&mutex);
+    }
+    IDF_LOG_PERFORMANCE("pthread_recursive_mutex_lock_unlock", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+    TEST_ASSERT_EQUAL_INT(0, pthread_mutex_destroy(&mutex));
+}
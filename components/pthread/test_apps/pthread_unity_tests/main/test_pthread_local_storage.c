@@ -4,13 +4,16 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 // Test pthread_create_key, pthread_delete_key, pthread_setspecific, pthread_getspecific
+#include <errno.h>
 #include <pthread.h>
 #include <inttypes.h>
+#include <stdatomic.h>
 #include "unity.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "test_utils.h"
 #include "esp_random.h"
+#include "esp_timer.h"
 
 TEST_CASE("pthread local storage basics", "[thread-specific]")
 {
@@ -253,3 +256,117 @@ static void *s_test_repeat_destructor_thread(void *vp_state)
     }
     pthread_exit(NULL);
 }
+
+TEST_CASE("pthread local storage value of deleted key", "[thread-specific]")
+{
+    pthread_key_t key;
+    pthread_key_t new_key;
+    int val = 3;
+
+    TEST_ASSERT_EQUAL(0, pthread_key_create(&key, NULL));
+    TEST_ASSERT_EQUAL(0, pthread_setspecific(key, &val));
+    TEST_ASSERT_EQUAL(0, pthread_key_delete(key));
+    TEST_ASSERT_EQUAL(ENOENT, pthread_setspecific(key, &val));
+
+    // The key number is reused, but not the value set before it was deleted
+    TEST_ASSERT_EQUAL(0, pthread_key_create(&new_key, NULL));
+    TEST_ASSERT_EQUAL(key, new_key);
+    TEST_ASSERT_NULL(pthread_getspecific(new_key));
+
+    TEST_ASSERT_EQUAL(0, pthread_key_delete(new_key));
+}
+
+#define MANY_KEYS 40
+
+// the destructors of both threads may run at the same time on different cores
+static atomic_uint s_many_keys_destructed;
+
+static void many_keys_destructor(void *value)
+{
+    atomic_fetch_add(&s_many_keys_destructed, 1);
+}
+
+static void *many_keys_thread(void *arg)
+{
+    pthread_key_t *keys = arg;
+
+    for (int i = 0; i < MANY_KEYS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_setspecific(keys[i], &keys[i]));
+    }
+    for (int i = 0; i < MANY_KEYS; i++) {
+        TEST_ASSERT_EQUAL_PTR(&keys[i], pthread_getspecific(keys[i]));
+    }
+    return NULL;
+}
+
+TEST_CASE("pthread local storage many keys", "[thread-specific]")
+{
+    pthread_key_t keys[MANY_KEYS];
+    pthread_t threads[2];
+
+    for (int i = 0; i < MANY_KEYS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_key_create(&keys[i], many_keys_destructor));
+    }
+
+    atomic_store(&s_many_keys_destructed, 0);
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, many_keys_thread, keys));
+    }
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_join(threads[i], NULL));
+    }
+    TEST_ASSERT_EQUAL(2 * MANY_KEYS, atomic_load(&s_many_keys_destructed));
+
+    for (int i = 0; i < MANY_KEYS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_key_delete(keys[i]));
+    }
+}
+
+#define PERF_ITERATIONS 100000
+
+static void *perf_thread(void *arg)
+{
+    pthread_key_t *keys = arg;
+    pthread_key_t key = keys[MANY_KEYS - 1]; // last key, whose value is in the overflow array
+    void *volatile value;
+    int64_t start;
+
+    TEST_ASSERT_EQUAL(0, pthread_setspecific(key, &key));
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        value = pthread_getspecific(key);
+    }
+    IDF_LOG_PERFORMANCE("pthread_getspecific", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+    TEST_ASSERT_EQUAL_PTR(&key, value);
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        pthread_setspecific(key, &keys[i % MANY_KEYS]);
+    }
+    IDF_LOG_PERFORMANCE("pthread_setspecific", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        value = (void *)pthread_self();
+    }
+    IDF_LOG_PERFORMANCE("pthread_self", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+    return NULL;
+}
+
+TEST_CASE("pthread local storage performance", "[thread-specific]")
+{
+    pthread_key_t keys[MANY_KEYS];
+    pthread_t thread;
+
+    for (int i = 0; i < MANY_KEYS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_key_create(&keys[i], NULL));
+    }
+
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, perf_thread, keys));
+    TEST_ASSERT_EQUAL(0, pthread_join(thread, NULL));
+
+    for (int i = 0; i < MANY_KEYS; i++) {
+        TEST_ASSERT_EQUAL(0, pthread_key_delete(keys[i]));
+    }
+}
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2021-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
@@ -18,6 +18,7 @@
 #include <pthread.h>
 
 #include "unity.h"
+#include "test_utils.h"
 
 TEST_CASE("pthread_rwlock_init invalid arg", "[pthread][rwlock]")
 {
@@ -379,3 +380,96 @@ TEST_CASE("trywrlock lock statically initialized lock", "[pthread][rwlock]")
     TEST_ASSERT_EQUAL_INT(pthread_rwlock_unlock(&rwlock), 0);
     TEST_ASSERT_EQUAL_INT(pthread_rwlock_destroy(&rwlock), 0);
 }
+
+#define STRESS_READERS      4
+#define STRESS_WRITERS      2
+#define STRESS_ITERATIONS   2000
+
+struct StressArgs {
+    pthread_rwlock_t rwlock;
+    volatile int first;
+    volatile int second;
+    atomic_int readers;
+};
+
+static void *stress_reader(void *arg)
+{
+    struct StressArgs *args = (struct StressArgs*) arg;
+
+    for (int i = 0; i < STRESS_ITERATIONS; i++) {
+        TEST_ASSERT_EQUAL_INT(pthread_rwlock_rdlock(&args->rwlock), 0);
+        atomic_fetch_add(&args->readers, 1);
+        TEST_ASSERT_EQUAL_INT(args->first, args->second);
+        if ((i % 64) == 0) {
+            vTaskDelay(1);
+        }
+        TEST_ASSERT_EQUAL_INT(args->first, args->second);
+        atomic_fetch_sub(&args->readers, 1);
+        TEST_ASSERT_EQUAL_INT(pthread_rwlock_unlock(&args->rwlock), 0);
+    }
+    return NULL;
+}
+
+static void *stress_writer(void *arg)
+{
+    struct StressArgs *args = (struct StressArgs*) arg;
+
+    for (int i = 0; i < STRESS_ITERATIONS; i++) {
+        TEST_ASSERT_EQUAL_INT(pthread_rwlock_wrlock(&args->rwlock), 0);
+        TEST_ASSERT_EQUAL_INT(atomic_load(&args->readers), 0);
+        args->first++;
+        if ((i % 64) == 0) {
+            vTaskDelay(1);
+        }
+        args->second++;
+        TEST_ASSERT_EQUAL_INT(pthread_rwlock_unlock(&args->rwlock), 0);
+    }
+    return NULL;
+}
+
+TEST_CASE("readers and writers stress", "[pthread][rwlock]")
+{
+    struct StressArgs args = { .first = 0, .second = 0 };
+    pthread_t threads[STRESS_READERS + STRESS_WRITERS];
+
+    atomic_init(&args.readers, 0);
+    TEST_ASSERT_EQUAL_INT(pthread_rwlock_init(&args.rwlock, NULL), 0);
+
+    for (int i = 0; i < STRESS_READERS + STRESS_WRITERS; i++) {
+        void *(*func)(void *) = i < STRESS_WRITERS ? stress_writer : stress_reader;
+        TEST_ASSERT_EQUAL_INT(pthread_create(&threads[i], NULL, func, &args), 0);
+    }
+    for (int i = 0; i < STRESS_READERS + STRESS_WRITERS; i++) {
+        TEST_ASSERT_EQUAL_INT(pthread_join(threads[i], NULL), 0);
+    }
+
+    TEST_ASSERT_EQUAL_INT(STRESS_WRITERS * STRESS_ITERATIONS, args.first);
+    TEST_ASSERT_EQUAL_INT(args.first, args.second);
+    TEST_ASSERT_EQUAL_INT(pthread_rwlock_destroy(&args.rwlock), 0);
+}
+
+#define PERF_ITERATIONS 100000
+
+TEST_CASE("rwlock performance", "[pthread][rwlock]")
+{
+    pthread_rwlock_t rwlock;
+    int64_t start;
+
+    TEST_ASSERT_EQUAL_INT(pthread_rwlock_init(&rwlock, NULL), 0);
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        pthread_rwlock_rdlock(&rwlock);
+        pthread_rwlock_unlock(&rwlock);
+    }
+    IDF_LOG_PERFORMANCE("pthread_rwlock_rdlock_unlock", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < PERF_ITERATIONS; i++) {
+        pthread_rwlock_wrlock(&rwlock);
+        pthread_rwlock_unlock(&rwlock);
+    }
+    IDF_LOG_PERFORMANCE("pthread_rwlock_wrlock_unlock", "%d ns", (int)((esp_timer_get_time() - start) * 1000 / PERF_ITERATIONS));
+
+    TEST_ASSERT_EQUAL_INT(pthread_rwlock_destroy(&rwlock), 0);
+}
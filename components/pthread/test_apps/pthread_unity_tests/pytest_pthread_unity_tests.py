@@ -1,4 +1,4 @@
-# SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+# SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: CC0-1.0
 
 import pytest
@@ -11,6 +11,7 @@ from pytest_embedded import Dut
     'config',
     [
         'default',
+        'mutex_fast_path',
     ],
     indirect=True,
 )
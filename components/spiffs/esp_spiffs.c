@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -22,11 +22,14 @@
 #include "esp_vfs.h"
 #include "esp_err.h"
 #include "esp_rom_spiflash.h"
+#include "esp_timer.h"
 
 #include "spiffs_api.h"
 
 static const char* TAG = "SPIFFS";
 
+#define SPIFFS_GC_IDLE_MS_DEFAULT 100
+
 #ifdef CONFIG_SPIFFS_USE_MTIME
 #ifdef CONFIG_SPIFFS_MTIME_WIDE_64_BITS
 typedef time_t spiffs_time_t;
@@ -91,11 +94,25 @@ static void esp_spiffs_free(esp_spiffs_t ** efs)
     }
     *efs = NULL;
 
+    if (e->gc_task) {
+        e->gc_task_stop = true;
+        xTaskNotifyGive(e->gc_task);
+        xSemaphoreTake(e->gc_task_done, portMAX_DELAY);
+    }
+    if (e->gc_task_done) {
+        vSemaphoreDelete(e->gc_task_done);
+    }
     if (e->fs) {
         SPIFFS_unmount(e->fs);
         free(e->fs);
     }
     vSemaphoreDelete(e->lock);
+    if (e->ix_maps) {
+        for (uint32_t i = 0; i < e->ix_maps_cnt; i++) {
+            free(e->ix_maps[i].map_buf);
+        }
+        free(e->ix_maps);
+    }
     free(e->fds);
     free(e->cache);
     free(e->work);
@@ -132,6 +149,113 @@ static esp_err_t esp_spiffs_get_empty(int * index){
     return ESP_ERR_NOT_FOUND;
 }
 
+static s32_t esp_spiffs_erase(spiffs *fs, uint32_t addr, uint32_t size)
+{
+    esp_spiffs_t *efs = (esp_spiffs_t *)fs->user_data;
+    int64_t start = esp_timer_get_time();
+    s32_t res = spiffs_api_erase(fs, addr, size);
+    // Called with the FS lock held, so the statistics can be updated here
+    if (efs->gc_task != NULL && xTaskGetCurrentTaskHandle() == efs->gc_task) {
+        efs->gc_stats.bg_erased_blocks += size / efs->cfg.log_block_size;
+    } else {
+        efs->gc_stats.fg_erased_blocks += size / efs->cfg.log_block_size;
+        efs->gc_stats.fg_erase_time_us += esp_timer_get_time() - start;
+    }
+    return res;
+}
+
+static bool esp_spiffs_gc_needed(esp_spiffs_t *efs)
+{
+    spiffs *fs = efs->fs;
+    xSemaphoreTake(efs->lock, portMAX_DELAY);
+    const uint32_t deleted = fs->stats_p_deleted;
+    const uint32_t in_use = fs->stats_p_allocated + deleted;
+    const bool low_free = (size_t) fs->free_blocks * efs->cfg.log_block_size < efs->gc_free_watermark;
+    const bool dirty = efs->gc_dirty_percent != 0 && (uint64_t) deleted * 100 > (uint64_t) in_use * efs->gc_dirty_percent;
+    xSemaphoreGive(efs->lock);
+    return deleted != 0 && (low_free || dirty);
+}
+
+/* Cleans the block with the most deleted pages and returns.
+ * SPIFFS_gc only starts collecting when asked for more than the free space and stops as soon as
+ * the request is satisfied, so asking for one page more than is free cleans exactly one block.
+ */
+static s32_t esp_spiffs_gc_step(esp_spiffs_t *efs)
+{
+    spiffs *fs = efs->fs;
+    xSemaphoreTake(efs->lock, portMAX_DELAY);
+    const s32_t free_pages = (SPIFFS_PAGES_PER_BLOCK(fs) - SPIFFS_OBJ_LOOKUP_PAGES(fs)) * (fs->block_count - 2)
+                             - fs->stats_p_allocated - fs->stats_p_deleted;
+    xSemaphoreGive(efs->lock);
+
+    int64_t start = esp_timer_get_time();
+    s32_t res = SPIFFS_gc(fs, (free_pages + 1) * SPIFFS_DATA_PAGE_SIZE(fs));
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (res != SPIFFS_OK) {
+        SPIFFS_clearerr(fs);
+        if (res != SPIFFS_ERR_FULL && res != SPIFFS_ERR_NO_DELETED_BLOCKS && res != SPIFFS_ERR_NOT_MOUNTED) {
+            ESP_LOGW(TAG, "background gc failed, %" PRId32, res);
+        }
+        return res;
+    }
+
+    xSemaphoreTake(efs->lock, portMAX_DELAY);
+    efs->gc_stats.bg_gc_steps++;
+    efs->gc_stats.bg_gc_time_us += elapsed;
+    xSemaphoreGive(efs->lock);
+    return res;
+}
+
+static void esp_spiffs_gc_task(void *arg)
+{
+    esp_spiffs_t *efs = (esp_spiffs_t *)arg;
+    uint32_t op_count = efs->op_count;
+
+    while (!efs->gc_task_stop) {
+        ulTaskNotifyTake(pdTRUE, efs->gc_idle_ticks);
+        if (efs->op_count != op_count) {
+            // the file system was used during the last period
+            op_count = efs->op_count;
+            continue;
+        }
+        while (!efs->gc_task_stop && esp_spiffs_gc_needed(efs)) {
+            if (esp_spiffs_gc_step(efs) != SPIFFS_OK) {
+                break;
+            }
+            // SPIFFS_gc counts as one call, anything more means the application is using the file system
+            if (efs->op_count != op_count + 1) {
+                break;
+            }
+            op_count = efs->op_count;
+        }
+        op_count = efs->op_count;
+    }
+
+    xSemaphoreGive(efs->gc_task_done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t esp_spiffs_gc_task_start(esp_spiffs_t *efs, const esp_vfs_spiffs_conf_t *conf)
+{
+    efs->gc_free_watermark = conf->gc_free_watermark;
+    efs->gc_dirty_percent = conf->gc_dirty_percent;
+    efs->gc_idle_ticks = pdMS_TO_TICKS(conf->gc_idle_ms ? conf->gc_idle_ms : SPIFFS_GC_IDLE_MS_DEFAULT);
+    if (efs->gc_idle_ticks == 0) {
+        efs->gc_idle_ticks = 1;
+    }
+
+    efs->gc_task_done = xSemaphoreCreateBinary();
+    if (efs->gc_task_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(esp_spiffs_gc_task, "spiffs_gc", CONFIG_SPIFFS_GC_TASK_STACK_SIZE, efs,
+                    CONFIG_SPIFFS_GC_TASK_PRIORITY, &efs->gc_task) != pdPASS) {
+        efs->gc_task = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
 static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
 {
     int index;
@@ -209,7 +333,7 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
         return ESP_ERR_NO_MEM;
     }
 
-    efs->cfg.hal_erase_f       = spiffs_api_erase;
+    efs->cfg.hal_erase_f       = esp_spiffs_erase;
     efs->cfg.hal_read_f        = spiffs_api_read;
     efs->cfg.hal_write_f       = spiffs_api_write;
     efs->cfg.log_block_size    = flash_erase_sector_size;
@@ -235,6 +359,17 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
         return ESP_ERR_NO_MEM;
     }
 
+    if (conf->ix_map_size) {
+        efs->ix_maps_cnt = conf->max_files;
+        efs->ix_maps = calloc(efs->ix_maps_cnt, sizeof(esp_spiffs_ix_map_t));
+        if (efs->ix_maps == NULL) {
+            ESP_LOGE(TAG, "index map buffer could not be allocated");
+            esp_spiffs_free(&efs);
+            return ESP_ERR_NO_MEM;
+        }
+        efs->ix_map_size = conf->ix_map_size;
+    }
+
 #if SPIFFS_CACHE
     efs->cache_sz = sizeof(spiffs_cache) + conf->max_files * (sizeof(spiffs_cache_page)
                           + efs->cfg.log_page_size);
@@ -286,6 +421,14 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
         esp_spiffs_free(&efs);
         return ESP_FAIL;
     }
+
+    if (conf->gc_free_watermark) {
+        if (esp_spiffs_gc_task_start(efs, conf) != ESP_OK) {
+            ESP_LOGE(TAG, "background gc task could not be created");
+            esp_spiffs_free(&efs);
+            return ESP_ERR_NO_MEM;
+        }
+    }
     _efs[index] = efs;
     return ESP_OK;
 }
@@ -399,6 +542,21 @@ esp_err_t esp_spiffs_gc(const char* partition_label, size_t size_to_gc)
     return ESP_OK;
 }
 
+esp_err_t esp_spiffs_gc_get_stats(const char* partition_label, esp_spiffs_gc_stats_t *stats)
+{
+    int index;
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(_efs[index]->lock, portMAX_DELAY);
+    *stats = _efs[index]->gc_stats;
+    xSemaphoreGive(_efs[index]->lock);
+    return ESP_OK;
+}
+
 esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t * conf)
 {
     assert(conf->base_path);
@@ -546,6 +704,7 @@ static int vfs_spiffs_open(void* ctx, const char * path, int flags, int mode)
     if (!(spiffs_flags & SPIFFS_RDONLY)) {
         vfs_spiffs_update_mtime(efs->fs, fd);
     }
+    spiffs_api_ix_map_open(efs->fs, fd);
     return fd;
 }
 
@@ -576,6 +735,7 @@ static ssize_t vfs_spiffs_read(void* ctx, int fd, void * dst, size_t size)
 static int vfs_spiffs_close(void* ctx, int fd)
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
+    spiffs_api_ix_map_close(efs->fs, fd);
     int res = SPIFFS_close(efs->fs, fd);
     if (res < 0) {
         errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
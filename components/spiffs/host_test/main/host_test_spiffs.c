@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2016-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2016-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -17,6 +17,7 @@
 #include "Mockqueue.h"
 
 #include "esp_partition.h"
+#include "esp_private/partition_linux.h"
 #include "spiffs.h"
 #include "spiffs_nucleus.h"
 #include "spiffs_api.h"
@@ -274,10 +275,117 @@ TEST(spiffs, can_read_spiffs_image)
     deinit_spiffs(&fs);
 }
 
+#define IX_MAP_FILE_SIZE    (512 * 1024)
+#define IX_MAP_CHUNK_SIZE   4096
+#define IX_MAP_SEEKS        200
+
+static void write_ix_map_test_file(spiffs *fs)
+{
+    uint32_t *chunk = (uint32_t *) malloc(IX_MAP_CHUNK_SIZE);
+    TEST_ASSERT_NOT_NULL(chunk);
+
+    spiffs_file file = SPIFFS_open(fs, "big.log", SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_RDWR, 0);
+    TEST_ASSERT_TRUE(file > 0);
+    spiffs_file scratch = SPIFFS_open(fs, "scratch.log", SPIFFS_O_CREAT | SPIFFS_O_TRUNC | SPIFFS_O_RDWR, 0);
+    TEST_ASSERT_TRUE(scratch > 0);
+
+    // Interleave the pages of the file with pages of a file deleted afterwards,
+    // so that garbage collection has to move pages of the file around.
+    for (uint32_t offset = 0; offset < IX_MAP_FILE_SIZE; offset += IX_MAP_CHUNK_SIZE) {
+        for (uint32_t i = 0; i < IX_MAP_CHUNK_SIZE / sizeof(uint32_t); i++) {
+            chunk[i] = offset + i * sizeof(uint32_t);
+        }
+        TEST_ASSERT_EQUAL(IX_MAP_CHUNK_SIZE, SPIFFS_write(fs, file, chunk, IX_MAP_CHUNK_SIZE));
+        TEST_ASSERT_EQUAL(IX_MAP_CHUNK_SIZE / 4, SPIFFS_write(fs, scratch, chunk, IX_MAP_CHUNK_SIZE / 4));
+    }
+
+    TEST_ASSERT_TRUE(SPIFFS_close(fs, file) >= SPIFFS_OK);
+    TEST_ASSERT_TRUE(SPIFFS_fremove(fs, scratch) >= SPIFFS_OK);
+    free(chunk);
+}
+
+// Reads a word at random offsets and returns the number of flash reads it took
+static size_t random_seeks(spiffs *fs, spiffs_file file, unsigned seed)
+{
+    srand(seed);
+    esp_partition_clear_stats();
+    for (int i = 0; i < IX_MAP_SEEKS; i++) {
+        uint32_t offset = (rand() % (IX_MAP_FILE_SIZE / sizeof(uint32_t))) * sizeof(uint32_t);
+        uint32_t value;
+        TEST_ASSERT_EQUAL(offset, SPIFFS_lseek(fs, file, offset, SPIFFS_SEEK_SET));
+        TEST_ASSERT_EQUAL(sizeof(value), SPIFFS_read(fs, file, &value, sizeof(value)));
+        TEST_ASSERT_EQUAL_HEX32(offset, value);
+    }
+    return esp_partition_get_read_ops();
+}
+
+TEST(spiffs, ix_map_speeds_up_random_seeks_and_survives_gc)
+{
+    spiffs fs;
+    const uint32_t max_files = 2;
+
+    // Start from an empty file system
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "storage");
+    TEST_ASSERT_NOT_NULL(partition);
+    esp_partition_erase_range(partition, 0, partition->size);
+
+    init_spiffs(&fs, max_files);
+    write_ix_map_test_file(&fs);
+
+    esp_spiffs_t *efs = (esp_spiffs_t *) fs.user_data;
+
+    // Without the index map
+    spiffs_file file = SPIFFS_open(&fs, "big.log", SPIFFS_RDONLY, 0);
+    TEST_ASSERT_TRUE(file > 0);
+    spiffs_api_ix_map_open(&fs, file);
+    size_t unmapped_reads = random_seeks(&fs, file, 1);
+    spiffs_api_ix_map_close(&fs, file);
+    TEST_ASSERT_TRUE(SPIFFS_close(&fs, file) >= SPIFFS_OK);
+
+    // With the index map, as set up by esp_spiffs_init
+    efs->ix_map_size = IX_MAP_FILE_SIZE;
+    efs->ix_maps_cnt = max_files;
+    efs->ix_maps = (esp_spiffs_ix_map_t *) calloc(max_files, sizeof(esp_spiffs_ix_map_t));
+    TEST_ASSERT_NOT_NULL(efs->ix_maps);
+
+    file = SPIFFS_open(&fs, "big.log", SPIFFS_RDONLY, 0);
+    TEST_ASSERT_TRUE(file > 0);
+    esp_partition_clear_stats();
+    spiffs_api_ix_map_open(&fs, file);
+    size_t map_reads = esp_partition_get_read_ops();
+    TEST_ASSERT_NOT_NULL(efs->ix_maps[file - 1].map_buf);
+    size_t mapped_reads = random_seeks(&fs, file, 1);
+
+    printf("%d random seeks: %zu flash reads without index map, %zu with index map (+%zu to build it)\n",
+           IX_MAP_SEEKS, unmapped_reads, mapped_reads, map_reads);
+    TEST_ASSERT_TRUE(mapped_reads < unmapped_reads);
+
+    // Garbage collection moves pages of the open file, SPIFFS has to update the map.
+    // SPIFFS_gc only collects when asked for more than the free space, every block
+    // holds deleted pages of the scratch file, so this cleans at least one of them.
+    const s32_t free_pages = (SPIFFS_PAGES_PER_BLOCK(&fs) - SPIFFS_OBJ_LOOKUP_PAGES(&fs)) * (fs.block_count - 2)
+                             - fs.stats_p_allocated - fs.stats_p_deleted;
+    TEST_ASSERT_TRUE(fs.stats_p_deleted > 0);
+    esp_partition_clear_stats();
+    TEST_ASSERT_EQUAL(SPIFFS_OK, SPIFFS_gc(&fs, (free_pages + 1) * SPIFFS_DATA_PAGE_SIZE(&fs)));
+    TEST_ASSERT_TRUE(esp_partition_get_erase_ops() > 0);
+    // The moved pages are read through the updated map
+    TEST_ASSERT_NOT_NULL(efs->ix_maps[file - 1].map_buf);
+    TEST_ASSERT_TRUE(random_seeks(&fs, file, 2) < unmapped_reads);
+
+    spiffs_api_ix_map_close(&fs, file);
+    TEST_ASSERT_NULL(efs->ix_maps[file - 1].map_buf);
+    TEST_ASSERT_TRUE(SPIFFS_close(&fs, file) >= SPIFFS_OK);
+
+    free(efs->ix_maps);
+    deinit_spiffs(&fs);
+}
+
 TEST_GROUP_RUNNER(spiffs)
 {
     RUN_TEST_CASE(spiffs, format_disk_open_file_write_and_read_file);
     RUN_TEST_CASE(spiffs, can_read_spiffs_image);
+    RUN_TEST_CASE(spiffs, ix_map_speeds_up_random_seeks_and_survives_gc);
 }
 
 static void run_all_tests(void)
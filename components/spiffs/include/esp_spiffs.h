@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -8,6 +8,8 @@
 #define _ESP_SPIFFS_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -22,8 +24,30 @@ typedef struct {
         const char* partition_label;    /*!< Optional, label of SPIFFS partition to use. If set to NULL, first partition with subtype=spiffs will be used. */
         size_t max_files;               /*!< Maximum files that could be open at the same time. */
         bool format_if_mount_failed;    /*!< If true, it will format the file system if it fails to mount. */
+        size_t ix_map_size;             /*!< Optional, number of bytes from the start of each open file whose object index is kept in RAM.
+                                             Seeking and reading within this range does not walk the object index pages on flash.
+                                             Costs about 2 bytes per data page (CONFIG_SPIFFS_PAGE_SIZE - 5 bytes) per open file,
+                                             and a scan of the object lookup pages when the file is opened. 0 disables the map. */
+        size_t gc_free_watermark;       /*!< Optional, starts a background garbage collection task for the partition if not 0.
+                                             The task runs GC steps while less than this many bytes are left in erased blocks,
+                                             so that writes do not have to run GC inline. */
+        uint8_t gc_dirty_percent;       /*!< Optional, the background task also runs GC steps while deleted pages make up more
+                                             than this percentage of the pages in use. 0 only uses gc_free_watermark. */
+        uint32_t gc_idle_ms;            /*!< Optional, time without any file system call before the background task runs
+                                             GC steps, in milliseconds. 0 uses a default of 100 ms. */
 } esp_vfs_spiffs_conf_t;
 
+/**
+ * @brief Garbage collection statistics of a mounted SPIFFS partition
+ */
+typedef struct {
+    uint32_t bg_gc_steps;               /*!< GC steps run by the background task, each step cleans one block */
+    uint32_t bg_erased_blocks;          /*!< Blocks erased by the background task */
+    uint64_t bg_gc_time_us;             /*!< Time spent in background GC steps. This is the write stall time avoided */
+    uint32_t fg_erased_blocks;          /*!< Blocks erased while serving file system calls, i.e. by GC inside writes and by format */
+    uint64_t fg_erase_time_us;          /*!< Time spent erasing blocks while serving file system calls */
+} esp_spiffs_gc_stats_t;
+
 /**
  * Register and mount SPIFFS to VFS with given path prefix.
  *
@@ -124,6 +148,21 @@ esp_err_t esp_spiffs_check(const char* partition_label);
  */
 esp_err_t esp_spiffs_gc(const char* partition_label, size_t size_to_gc);
 
+/**
+ * @brief Get garbage collection statistics of a SPIFFS partition
+ *
+ * Statistics are collected for every mounted partition. The background GC fields
+ * stay zero unless the partition was registered with gc_free_watermark set.
+ *
+ * @param partition_label  Same label as passed to esp_vfs_spiffs_register.
+ * @param[out] stats       Statistics since the partition was mounted
+ * @return
+ *          - ESP_OK on success
+ *          - ESP_ERR_INVALID_ARG if stats is NULL
+ *          - ESP_ERR_INVALID_STATE if the partition is not mounted
+ */
+esp_err_t esp_spiffs_gc_get_stats(const char* partition_label, esp_spiffs_gc_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,9 +1,10 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 #include "esp_partition.h"
@@ -15,6 +16,7 @@ static const char* TAG = "SPIFFS";
 void spiffs_api_lock(spiffs *fs)
 {
     (void) xSemaphoreTake(((esp_spiffs_t *)(fs->user_data))->lock, portMAX_DELAY);
+    ((esp_spiffs_t *)(fs->user_data))->op_count++;
 }
 
 void spiffs_api_unlock(spiffs *fs)
@@ -55,6 +57,53 @@ s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size)
     return 0;
 }
 
+static esp_spiffs_ix_map_t *spiffs_api_get_ix_map(spiffs *fs, spiffs_file fh)
+{
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+    if (efs->ix_maps == NULL || fh <= 0 || (uint32_t)fh > efs->ix_maps_cnt) {
+        return NULL;
+    }
+    return &efs->ix_maps[fh - 1];
+}
+
+void spiffs_api_ix_map_open(spiffs *fs, spiffs_file fh)
+{
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+    esp_spiffs_ix_map_t *ix_map = spiffs_api_get_ix_map(fs, fh);
+    if (ix_map == NULL || efs->ix_map_size == 0) {
+        return;
+    }
+
+    // The buffer of a file deleted while open is still around, SPIFFS closed the handle by itself
+    free(ix_map->map_buf);
+    s32_t entries = SPIFFS_bytes_to_ix_map_entries(fs, efs->ix_map_size);
+    ix_map->map_buf = calloc(entries, sizeof(spiffs_page_ix));
+    if (ix_map->map_buf == NULL) {
+        ESP_LOGW(TAG, "no memory to map index of file %d", fh);
+        return;
+    }
+    if (SPIFFS_ix_map(fs, fh, &ix_map->map, 0, efs->ix_map_size, ix_map->map_buf) < 0) {
+        ESP_LOGW(TAG, "failed to map index of file %d, err %" PRId32, fh, SPIFFS_errno(fs));
+        SPIFFS_clearerr(fs);
+        free(ix_map->map_buf);
+        ix_map->map_buf = NULL;
+    }
+}
+
+void spiffs_api_ix_map_close(spiffs *fs, spiffs_file fh)
+{
+    esp_spiffs_ix_map_t *ix_map = spiffs_api_get_ix_map(fs, fh);
+    if (ix_map == NULL || ix_map->map_buf == NULL) {
+        return;
+    }
+    if (SPIFFS_ix_unmap(fs, fh) < 0) {
+        // file was deleted while open and its handle already released by SPIFFS
+        SPIFFS_clearerr(fs);
+    }
+    free(ix_map->map_buf);
+    ix_map->map_buf = NULL;
+}
+
 void spiffs_api_check(spiffs *fs, spiffs_check_type type,
                             spiffs_check_report report, uint32_t arg1, uint32_t arg2)
 {
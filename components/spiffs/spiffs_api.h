@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -13,6 +13,7 @@
 #include "freertos/semphr.h"
 #include "spiffs.h"
 #include "esp_compiler.h"
+#include "esp_spiffs.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,6 +21,14 @@ extern "C" {
 
 #define ESP_SPIFFS_PATH_MAX 15
 
+/**
+ * @brief Object index map of an open file
+ */
+typedef struct {
+    spiffs_ix_map map;                      /*!< Map descriptor owned by SPIFFS while the file is open */
+    spiffs_page_ix *map_buf;                /*!< Page index of every mapped data page */
+} esp_spiffs_ix_map_t;
+
 /**
  * @brief SPIFFS definition structure
  */
@@ -35,6 +44,17 @@ typedef struct {
     uint32_t fds_sz;                        /*!< File Descriptor Buffer Length */
     uint8_t *cache;                         /*!< Cache Buffer */
     uint32_t cache_sz;                      /*!< Cache Buffer Length */
+    size_t ix_map_size;                     /*!< Bytes from the start of a file covered by its index map, 0 if disabled */
+    esp_spiffs_ix_map_t *ix_maps;           /*!< Index maps of open files, indexed by file handle - 1 */
+    uint32_t ix_maps_cnt;                   /*!< Number of entries in ix_maps */
+    volatile uint32_t op_count;             /*!< Number of SPIFFS API calls, used to detect idle periods */
+    TaskHandle_t gc_task;                   /*!< Background GC task, NULL if not enabled */
+    SemaphoreHandle_t gc_task_done;         /*!< Given by the background GC task when it exits */
+    volatile bool gc_task_stop;             /*!< Requests the background GC task to exit */
+    size_t gc_free_watermark;               /*!< Erased bytes below which background GC runs */
+    uint8_t gc_dirty_percent;               /*!< Percentage of deleted pages above which background GC runs */
+    TickType_t gc_idle_ticks;               /*!< Idle time before background GC runs */
+    esp_spiffs_gc_stats_t gc_stats;         /*!< GC statistics, protected by lock */
 } esp_spiffs_t;
 
 s32_t spiffs_api_read(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *dst);
@@ -43,6 +63,23 @@ s32_t spiffs_api_write(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *src);
 
 s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size);
 
+/**
+ * @brief Map the object index of a freshly opened file
+ *
+ * Page addresses of the first ix_map_size bytes of the file are looked up once and kept in RAM,
+ * so seeking and reading within that range does not have to walk the object index pages on flash.
+ * SPIFFS keeps the map up to date when the file is written and when garbage collection moves pages.
+ * Failing to map the file is not an error, accesses then fall back to the object index on flash.
+ */
+void spiffs_api_ix_map_open(spiffs *fs, spiffs_file fh);
+
+/**
+ * @brief Release the object index map of a file
+ *
+ * Must be called before the file is closed, while the handle can not be reused by another open.
+ */
+void spiffs_api_ix_map_close(spiffs *fs, spiffs_file fh);
+
 void spiffs_api_check(spiffs *fs, spiffs_check_type type,
                             spiffs_check_report report, uint32_t arg1, uint32_t arg2);
 
@@ -1,11 +1,12 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #include "sdkconfig.h"
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -24,6 +25,7 @@
 #include "esp_partition.h"
 #include "esp_random.h"
 #include "esp_rom_sys.h"
+#include "esp_timer.h"
 
 const char* spiffs_test_hello_str = "Hello, World!\n";
 const char* spiffs_test_partition_label = "storage";
@@ -926,3 +928,89 @@ TEST_CASE("SPIFFS garbage-collect", "[spiffs][timeout=60]")
 
     test_teardown();
 }
+
+/* Writes the file in 4 kB chunks and returns the longest time a single write took, in us */
+static int64_t test_spiffs_write_max_latency(const char* filename, const void* buf, size_t buf_size, size_t file_size)
+{
+    int64_t max_latency = 0;
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC);
+    TEST_ASSERT_NOT_EQUAL(-1, fd);
+    for (size_t offset = 0; offset < file_size; offset += buf_size) {
+        int64_t start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(buf_size, write(fd, buf, buf_size));
+        int64_t latency = esp_timer_get_time() - start;
+        if (latency > max_latency) {
+            max_latency = latency;
+        }
+    }
+    TEST_ASSERT_EQUAL(0, close(fd));
+    return max_latency;
+}
+
+static void test_spiffs_rewrite_file(const char* filename, const void* buf, size_t buf_size, size_t file_size,
+                                     bool wait_for_gc, esp_spiffs_gc_stats_t* stats)
+{
+    test_spiffs_write_max_latency(filename, buf, buf_size, file_size);
+    TEST_ASSERT_EQUAL(0, unlink(filename));
+
+    if (wait_for_gc) {
+        // wait until the background task stops making progress
+        uint32_t steps = UINT32_MAX;
+        for (int i = 0; i < 100 && steps != stats->bg_gc_steps; i++) {
+            steps = stats->bg_gc_steps;
+            vTaskDelay(pdMS_TO_TICKS(200));
+            TEST_ESP_OK(esp_spiffs_gc_get_stats(spiffs_test_partition_label, stats));
+        }
+    }
+
+    TEST_ESP_OK(esp_spiffs_gc_get_stats(spiffs_test_partition_label, stats));
+    const uint32_t fg_erased_before = stats->fg_erased_blocks;
+    int64_t max_latency = test_spiffs_write_max_latency(filename, buf, buf_size, file_size);
+    TEST_ESP_OK(esp_spiffs_gc_get_stats(spiffs_test_partition_label, stats));
+    TEST_ASSERT_EQUAL(0, unlink(filename));
+
+    printf("rewrite %s background GC: longest write %"PRId64" us, %"PRIu32" blocks erased inline (%"PRIu64" us), "
+           "%"PRIu32" in background (%"PRIu32" steps, %"PRIu64" us)\n",
+           wait_for_gc ? "with" : "without", max_latency, stats->fg_erased_blocks - fg_erased_before,
+           stats->fg_erase_time_us, stats->bg_erased_blocks, stats->bg_gc_steps, stats->bg_gc_time_us);
+    stats->fg_erased_blocks -= fg_erased_before;
+}
+
+TEST_CASE("SPIFFS background garbage collection avoids write stalls", "[spiffs][timeout=60]")
+{
+    const esp_partition_t* part = get_partition();
+    const size_t buf_size = 4096;
+    const size_t file_size = part->size / 2;
+    const char* file = "/spiffs/gc.bin";
+    esp_spiffs_gc_stats_t stats = { 0 };
+
+    void* buf = malloc(buf_size);
+    TEST_ASSERT_NOT_NULL(buf);
+    esp_fill_random(buf, buf_size);
+
+    // Without the background task, rewriting the file has to erase blocks inline
+    TEST_ESP_OK(esp_partition_erase_range(part, 0, part->size));
+    test_setup();
+    test_spiffs_rewrite_file(file, buf, buf_size, file_size, false, &stats);
+    TEST_ASSERT_NOT_EQUAL(0, stats.fg_erased_blocks);
+    TEST_ASSERT_EQUAL(0, stats.bg_gc_steps);
+    test_teardown();
+
+    TEST_ESP_OK(esp_partition_erase_range(part, 0, part->size));
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = "/spiffs",
+        .partition_label = spiffs_test_partition_label,
+        .max_files = 5,
+        .format_if_mount_failed = true,
+        .gc_free_watermark = part->size,
+        .gc_idle_ms = 20,
+    };
+    TEST_ESP_OK(esp_vfs_spiffs_register(&conf));
+    test_spiffs_rewrite_file(file, buf, buf_size, file_size, true, &stats);
+    TEST_ASSERT_NOT_EQUAL(0, stats.bg_gc_steps);
+    TEST_ASSERT_NOT_EQUAL(0, stats.bg_erased_blocks);
+    TEST_ASSERT_EQUAL(0, stats.fg_erased_blocks);
+    test_teardown();
+
+    free(buf);
+}
@@ -21,7 +21,7 @@ void unity_utils_record_free_mem(void)
 
 void unity_utils_setup_heap_record(size_t num_heap_records)
 {
-#ifdef CONFIG_HEAP_TRACING
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
     static heap_trace_record_t *record_buffer;
     if (!record_buffer) {
         record_buffer = malloc(sizeof(heap_trace_record_t) * num_heap_records);
@@ -77,6 +77,20 @@ typedef struct
     void *sem;              /*!< semaphore instance */
 } esp_vfs_select_sem_t;
 
+/**
+ * @brief Registration of a file descriptor in a poll set, see esp_vfs_poll_add()
+ *
+ * Passed to the poll_start and poll_stop VFS driver functions. The driver keeps
+ * it between these two calls and passes it to esp_vfs_poll_notify() when the
+ * state of the file descriptor changes.
+ */
+typedef struct esp_vfs_poll_watch esp_vfs_poll_watch_t;
+
+/**
+ * @brief Handle of a poll set created by esp_vfs_poll_create()
+ */
+typedef struct esp_vfs_poll_set *esp_vfs_poll_handle_t;
+
 /**
  * @brief VFS definition structure
  *
@@ -256,6 +270,12 @@ typedef struct
     void* (*get_socket_select_semaphore)(void);
     /** get_socket_select_semaphore returns semaphore allocated in the socket driver; set only for the socket driver */
     esp_err_t (*end_select)(void *end_select_args);
+    /** poll_start is called once when the FD is added to a poll set; the driver calls esp_vfs_poll_notify() with the given watch whenever the FD may have become ready, until poll_stop is called. Optional, poll sets fall back to start_select/end_select otherwise */
+    esp_err_t (*poll_start)(int fd, esp_vfs_poll_watch_t *watch);
+    /** poll_ready returns the events (POLLIN, POLLOUT, POLLERR, POLLNVAL) currently pending on the FD without blocking; required if poll_start is set */
+    short (*poll_ready)(int fd);
+    /** poll_stop is called when the FD is removed from a poll set; the driver must not use the watch once this returns */
+    esp_err_t (*poll_stop)(int fd, esp_vfs_poll_watch_t *watch);
 #endif // CONFIG_VFS_SUPPORT_SELECT || defined __DOXYGEN__
 } esp_vfs_t;
 
@@ -445,6 +465,111 @@ void esp_vfs_select_triggered(esp_vfs_select_sem_t sem);
  */
 void esp_vfs_select_triggered_isr(esp_vfs_select_sem_t sem, BaseType_t *woken);
 
+/**
+ * @brief Create a poll set
+ *
+ * A poll set is a persistent alternative to select() for event loops which wait
+ * on the same file descriptors over and over again. File descriptors are added
+ * to the set once, after which the VFS drivers signal readiness incrementally and
+ * esp_vfs_poll_wait() only looks at the file descriptors which were signalled.
+ *
+ * File descriptors of drivers which implement poll_start/poll_ready/poll_stop
+ * (e.g. eventfd) are handled natively. File descriptors of drivers which only
+ * implement start_select/end_select (e.g. UART) are supported too, but each
+ * esp_vfs_poll_wait() wakeup restarts select on them. Sockets are not supported.
+ *
+ * @param[out] handle  handle of the new poll set
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if handle is NULL
+ *      - ESP_ERR_NO_MEM if out of memory
+ */
+esp_err_t esp_vfs_poll_create(esp_vfs_poll_handle_t *handle);
+
+/**
+ * @brief Delete a poll set
+ *
+ * All file descriptors are removed from the set. Must not be called while
+ * another task is waiting in esp_vfs_poll_wait() on the same set.
+ *
+ * @param handle  poll set to delete
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if handle is NULL
+ */
+esp_err_t esp_vfs_poll_delete(esp_vfs_poll_handle_t handle);
+
+/**
+ * @brief Add a file descriptor to a poll set
+ *
+ * @param handle  poll set
+ * @param fd      file descriptor
+ * @param events  POLLIN and/or POLLOUT; POLLERR and POLLNVAL are always reported
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if fd is not open or events are invalid
+ *      - ESP_ERR_INVALID_STATE if fd is already in the set
+ *      - ESP_ERR_NOT_SUPPORTED if the VFS driver of fd supports neither poll sets nor select
+ *      - ESP_ERR_NO_MEM if out of memory
+ *      - error returned by the poll_start function of the VFS driver
+ */
+esp_err_t esp_vfs_poll_add(esp_vfs_poll_handle_t handle, int fd, short events);
+
+/**
+ * @brief Remove a file descriptor from a poll set
+ *
+ * File descriptors should be removed from all poll sets before they are closed.
+ * Closed file descriptors which were not removed are reported as POLLNVAL or
+ * POLLERR until they are removed.
+ *
+ * @param handle  poll set
+ * @param fd      file descriptor
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if handle is NULL or fd is invalid
+ *      - ESP_ERR_NOT_FOUND if fd is not in the set
+ */
+esp_err_t esp_vfs_poll_remove(esp_vfs_poll_handle_t handle, int fd);
+
+/**
+ * @brief Wait until file descriptors of a poll set are ready
+ *
+ * Readiness is level-triggered: a file descriptor is reported by every call as
+ * long as the condition persists, like with poll().
+ *
+ * @param handle      poll set
+ * @param[out] fds    array receiving the ready file descriptors in the fd field and
+ *                    their pending events in the revents field
+ * @param max_fds     size of the fds array
+ * @param timeout_ms  timeout in milliseconds, 0 to return immediately, negative to wait forever
+ *
+ * @return  number of entries written to fds, 0 on timeout, or -1 with errno set on error
+ */
+int esp_vfs_poll_wait(esp_vfs_poll_handle_t handle, struct pollfd *fds, int max_fds, int timeout_ms);
+
+/**
+ * @brief Notification from a VFS driver that the state of a polled file descriptor has changed
+ *
+ * Called by the VFS driver between poll_start and poll_stop, e.g. when data arrives
+ * or the file descriptor is closed. The poll set re-evaluates the file descriptor
+ * by poll_ready, so spurious notifications are harmless.
+ *
+ * @param watch  watch passed to the driver by poll_start
+ */
+void esp_vfs_poll_notify(esp_vfs_poll_watch_t *watch);
+
+/**
+ * @brief Notification from a VFS driver that the state of a polled file descriptor has changed (ISR version)
+ *
+ * @param watch  watch passed to the driver by poll_start
+ * @param woken  is set to pdTRUE if the function wakes up a task with higher priority
+ */
+void esp_vfs_poll_notify_isr(esp_vfs_poll_watch_t *watch, BaseType_t *woken);
+
 /**
  *
  * @brief Implements the VFS layer of POSIX pread()
@@ -20,6 +20,7 @@
 #include "esp_err.h"
 
 #define EFD_SUPPORT_ISR (1 << 4)
+#define EFD_SEMAPHORE   (1 << 5)
 
 #ifdef __cplusplus
 extern "C" {
@@ -55,12 +56,17 @@ esp_err_t esp_vfs_eventfd_unregister(void);
 /*
  * @brief Creates an event file descirptor.
  *
- * The behavior of read, write and select is the same as man(2) eventfd with
- * EFD_SEMAPHORE **NOT** specified. A new flag EFD_SUPPORT_ISR has been added.
- * This flag is required to write to event fds in interrupt handlers. Accessing
- * the control blocks of event fds with EFD_SUPPORT_ISR will cause interrupts to
- * be temporarily blocked (e.g. during read, write and beginning and ending of
- * the * select).
+ * The behavior of read, write and select is the same as man(2) eventfd, except
+ * that read never blocks. With EFD_SEMAPHORE, read decrements the counter by one
+ * and returns 1, or fails with EAGAIN if the counter is zero. A new flag
+ * EFD_SUPPORT_ISR has been added. This flag is required to write to event fds in
+ * interrupt handlers. Accessing the control blocks of event fds with
+ * EFD_SUPPORT_ISR will cause interrupts to be temporarily blocked (e.g. during
+ * write while a select is pending, and beginning and ending of the select).
+ * Read and write update the counter in a short critical section on a spinlock
+ * of the fd, so they only contend with other operations on the same fd.
+ * Writing only takes the recursive lock of the fd when a select or poll set
+ * waits on it.
  *
  * @return The file descriptor if successful, -1 if error happens.
  */
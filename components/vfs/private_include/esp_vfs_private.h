@@ -72,6 +72,16 @@ const vfs_entry_t *get_vfs_for_path(const char *path);
  */
 const vfs_entry_t *get_vfs_for_index(int index);
 
+/**
+ * Get vfs entry and local fd for the given global fd, without taking the FD table lock.
+ *
+ * @param fd global file descriptor
+ * @param[out] local_fd file descriptor local to the VFS, -1 if fd is not open
+ *
+ * @return Pointer to the `vfs_entry_t` the fd belongs to, NULL if fd is not open.
+ */
+const vfs_entry_t *get_vfs_for_fd(int fd, int *local_fd);
+
 #ifdef __cplusplus
 }
 #endif
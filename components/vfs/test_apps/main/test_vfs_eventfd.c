@@ -5,9 +5,13 @@
  */
 
 #include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <sys/select.h>
 #include "freertos/FreeRTOS.h"
 #include "unity.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
 #include "driver/gptimer.h"
 #include "esp_vfs.h"
 #include "esp_vfs_eventfd.h"
@@ -394,3 +398,298 @@ TEST_CASE("eventfd select block", "[vfs][eventfd]")
     TEST_ASSERT_EQUAL(0, close(fd_write));
     TEST_ESP_OK(esp_vfs_eventfd_unregister());
 }
+
+TEST_CASE("eventfd poll set", "[vfs][eventfd]")
+{
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    TEST_ESP_OK(esp_vfs_eventfd_register(&config));
+
+    int fd0 = eventfd(0, 0);
+    int fd1 = eventfd(0, EFD_SUPPORT_ISR);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd0);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd1);
+
+    esp_vfs_poll_handle_t poll_set;
+    TEST_ESP_OK(esp_vfs_poll_create(&poll_set));
+    TEST_ESP_OK(esp_vfs_poll_add(poll_set, fd0, POLLIN));
+    TEST_ESP_OK(esp_vfs_poll_add(poll_set, fd1, POLLIN));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, esp_vfs_poll_add(poll_set, fd0, POLLIN));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_vfs_poll_add(poll_set, MAX_FDS - 1, POLLIN));
+
+    struct pollfd ready[2];
+    TEST_ASSERT_EQUAL(0, esp_vfs_poll_wait(poll_set, ready, 2, 0));
+
+    uint64_t val = 1;
+    TEST_ASSERT_EQUAL(sizeof(val), write(fd1, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL(1, esp_vfs_poll_wait(poll_set, ready, 2, 0));
+    TEST_ASSERT_EQUAL(fd1, ready[0].fd);
+    TEST_ASSERT_EQUAL(POLLIN, ready[0].revents);
+
+    // level-triggered: reported until the event is read
+    TEST_ASSERT_EQUAL(1, esp_vfs_poll_wait(poll_set, ready, 2, 0));
+    TEST_ASSERT_EQUAL(sizeof(val), read(fd1, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL(0, esp_vfs_poll_wait(poll_set, ready, 2, 0));
+
+    // signalled from another task while waiting
+    xTaskCreate(signal_task, "signal_task", 2048, &fd0, 5, NULL);
+    TEST_ASSERT_EQUAL(1, esp_vfs_poll_wait(poll_set, ready, 2, 2000));
+    TEST_ASSERT_EQUAL(fd0, ready[0].fd);
+    TEST_ASSERT_EQUAL(POLLIN, ready[0].revents);
+
+    TEST_ASSERT_EQUAL(sizeof(val), write(fd1, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL(1, esp_vfs_poll_wait(poll_set, ready, 1, 0));
+    TEST_ASSERT_EQUAL(2, esp_vfs_poll_wait(poll_set, ready, 2, 0));
+
+    // event fds are always writable
+    TEST_ESP_OK(esp_vfs_poll_remove(poll_set, fd0));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, esp_vfs_poll_remove(poll_set, fd0));
+    TEST_ESP_OK(esp_vfs_poll_add(poll_set, fd0, POLLOUT));
+    TEST_ASSERT_EQUAL(sizeof(val), read(fd0, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL(sizeof(val), read(fd1, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL(1, esp_vfs_poll_wait(poll_set, ready, 2, 0));
+    TEST_ASSERT_EQUAL(fd0, ready[0].fd);
+    TEST_ASSERT_EQUAL(POLLOUT, ready[0].revents);
+
+    TEST_ESP_OK(esp_vfs_poll_delete(poll_set));
+    TEST_ASSERT_EQUAL(0, close(fd0));
+    TEST_ASSERT_EQUAL(0, close(fd1));
+    TEST_ESP_OK(esp_vfs_eventfd_unregister());
+}
+
+TEST_CASE("eventfd poll set signal from ISR", "[vfs][eventfd]")
+{
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    TEST_ESP_OK(esp_vfs_eventfd_register(&config));
+
+    int fd = eventfd(0, EFD_SUPPORT_ISR);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    esp_vfs_poll_handle_t poll_set;
+    TEST_ESP_OK(esp_vfs_poll_create(&poll_set));
+    TEST_ESP_OK(esp_vfs_poll_add(poll_set, fd, POLLIN));
+
+    gptimer_handle_t gptimer = NULL;
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    TEST_ESP_OK(gptimer_new_timer(&timer_config, &gptimer));
+    gptimer_alarm_config_t alarm_config = {
+        .reload_count = 0,
+        .alarm_count = 200000,
+    };
+    gptimer_event_callbacks_t cbs = {
+        .on_alarm = eventfd_select_test_isr,
+    };
+    TEST_ESP_OK(gptimer_register_event_callbacks(gptimer, &cbs, &fd));
+    TEST_ESP_OK(gptimer_set_alarm_action(gptimer, &alarm_config));
+    TEST_ESP_OK(gptimer_enable(gptimer));
+    TEST_ESP_OK(gptimer_start(gptimer));
+
+    struct pollfd ready;
+    TEST_ASSERT_EQUAL(1, esp_vfs_poll_wait(poll_set, &ready, 1, 2000));
+    TEST_ASSERT_EQUAL(fd, ready.fd);
+    TEST_ASSERT_EQUAL(POLLIN, ready.revents);
+
+    TEST_ESP_OK(esp_vfs_poll_delete(poll_set));
+    TEST_ASSERT_EQUAL(0, close(fd));
+    TEST_ESP_OK(esp_vfs_eventfd_unregister());
+    TEST_ESP_OK(gptimer_disable(gptimer));
+    TEST_ESP_OK(gptimer_del_timer(gptimer));
+}
+
+TEST_CASE("eventfd poll set closed fd", "[vfs][eventfd]")
+{
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    TEST_ESP_OK(esp_vfs_eventfd_register(&config));
+
+    int fd = eventfd(0, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    esp_vfs_poll_handle_t poll_set;
+    TEST_ESP_OK(esp_vfs_poll_create(&poll_set));
+    TEST_ESP_OK(esp_vfs_poll_add(poll_set, fd, POLLIN));
+
+    xTaskCreate(close_task, "close_task", 2048, &fd, 5, NULL);
+    struct pollfd ready;
+    TEST_ASSERT_EQUAL(1, esp_vfs_poll_wait(poll_set, &ready, 1, 2000));
+    TEST_ASSERT_EQUAL(fd, ready.fd);
+    TEST_ASSERT_EQUAL(POLLNVAL, ready.revents);
+
+    // the event fd is not reused while the poll set still refers to it
+    TEST_ESP_OK(esp_vfs_poll_remove(poll_set, fd));
+    TEST_ASSERT_EQUAL(0, esp_vfs_poll_wait(poll_set, &ready, 1, 0));
+    TEST_ESP_OK(esp_vfs_poll_delete(poll_set));
+    TEST_ESP_OK(esp_vfs_eventfd_unregister());
+}
+
+#define POLL_BENCH_FDS          16
+#define POLL_BENCH_ITERATIONS   1000
+
+TEST_CASE("eventfd poll set compared to select", "[vfs][eventfd]")
+{
+    esp_vfs_eventfd_config_t config = { .max_fds = POLL_BENCH_FDS };
+    TEST_ESP_OK(esp_vfs_eventfd_register(&config));
+
+    int fds[POLL_BENCH_FDS];
+    int max_fd = 0;
+    esp_vfs_poll_handle_t poll_set;
+    TEST_ESP_OK(esp_vfs_poll_create(&poll_set));
+    for (int i = 0; i < POLL_BENCH_FDS; i++) {
+        fds[i] = eventfd(0, 0);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, fds[i]);
+        max_fd = fds[i] > max_fd ? fds[i] : max_fd;
+        TEST_ESP_OK(esp_vfs_poll_add(poll_set, fds[i], POLLIN));
+    }
+
+    uint64_t val = 1;
+    struct timeval zero_time = { 0 };
+    uint32_t select_cycles = 0;
+    for (int i = 0; i < POLL_BENCH_ITERATIONS; i++) {
+        const int fd = fds[i % POLL_BENCH_FDS];
+        TEST_ASSERT_EQUAL(sizeof(val), write(fd, &val, sizeof(val)));
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        for (int j = 0; j < POLL_BENCH_FDS; j++) {
+            FD_SET(fds[j], &read_fds);
+        }
+        uint32_t start = esp_cpu_get_cycle_count();
+        int ret = select(max_fd + 1, &read_fds, NULL, NULL, &zero_time);
+        select_cycles += esp_cpu_get_cycle_count() - start;
+        TEST_ASSERT_EQUAL(1, ret);
+        TEST_ASSERT(FD_ISSET(fd, &read_fds));
+        TEST_ASSERT_EQUAL(sizeof(val), read(fd, &val, sizeof(val)));
+    }
+
+    uint32_t poll_cycles = 0;
+    for (int i = 0; i < POLL_BENCH_ITERATIONS; i++) {
+        const int fd = fds[i % POLL_BENCH_FDS];
+        TEST_ASSERT_EQUAL(sizeof(val), write(fd, &val, sizeof(val)));
+        struct pollfd ready;
+        uint32_t start = esp_cpu_get_cycle_count();
+        int ret = esp_vfs_poll_wait(poll_set, &ready, 1, 0);
+        poll_cycles += esp_cpu_get_cycle_count() - start;
+        TEST_ASSERT_EQUAL(1, ret);
+        TEST_ASSERT_EQUAL(fd, ready.fd);
+        TEST_ASSERT_EQUAL(sizeof(val), read(fd, &val, sizeof(val)));
+    }
+
+    printf("%d event fds: %"PRIu32" cycles per select, %"PRIu32" cycles per esp_vfs_poll_wait\n",
+           POLL_BENCH_FDS, select_cycles / POLL_BENCH_ITERATIONS, poll_cycles / POLL_BENCH_ITERATIONS);
+
+    TEST_ESP_OK(esp_vfs_poll_delete(poll_set));
+    for (int i = 0; i < POLL_BENCH_FDS; i++) {
+        TEST_ASSERT_EQUAL(0, close(fds[i]));
+    }
+    TEST_ESP_OK(esp_vfs_eventfd_unregister());
+}
+
+TEST_CASE("eventfd semaphore mode", "[vfs][eventfd]")
+{
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    TEST_ESP_OK(esp_vfs_eventfd_register(&config));
+
+    int fd = eventfd(2, EFD_SEMAPHORE);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+
+    struct timeval zero_time = { 0 };
+    fd_set read_fds;
+    uint64_t val = 0;
+    for (int i = 0; i < 2; i++) {
+        FD_ZERO(&read_fds);
+        FD_SET(fd, &read_fds);
+        TEST_ASSERT_EQUAL(1, select(fd + 1, &read_fds, NULL, NULL, &zero_time));
+        TEST_ASSERT_EQUAL(sizeof(val), read(fd, &val, sizeof(val)));
+        TEST_ASSERT_EQUAL(1, val);
+    }
+    TEST_ASSERT_LESS_THAN(0, read(fd, &val, sizeof(val)));
+    TEST_ASSERT_EQUAL(EAGAIN, errno);
+    FD_ZERO(&read_fds);
+    FD_SET(fd, &read_fds);
+    TEST_ASSERT_EQUAL(0, select(fd + 1, &read_fds, NULL, NULL, &zero_time));
+
+    val = 3;
+    TEST_ASSERT_EQUAL(sizeof(val), write(fd, &val, sizeof(val)));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(sizeof(val), read(fd, &val, sizeof(val)));
+        TEST_ASSERT_EQUAL(1, val);
+    }
+    TEST_ASSERT_LESS_THAN(0, read(fd, &val, sizeof(val)));
+
+    TEST_ASSERT_EQUAL(0, close(fd));
+    TEST_ESP_OK(esp_vfs_eventfd_unregister());
+}
+
+#define LATENCY_ITERATIONS  200
+
+typedef struct {
+    int fd;
+    volatile int64_t write_time;
+    int failed_writes;
+    SemaphoreHandle_t done;
+} latency_producer_args_t;
+
+static void latency_producer_task(void *arg)
+{
+    latency_producer_args_t *args = (latency_producer_args_t *)arg;
+    uint64_t val = 1;
+    for (int i = 0; i < LATENCY_ITERATIONS; i++) {
+        vTaskDelay(1);
+        args->write_time = esp_timer_get_time();
+        // not asserted here, Unity can't handle a failure outside of the test task
+        if (write(args->fd, &val, sizeof(val)) != sizeof(val)) {
+            args->failed_writes++;
+        }
+    }
+    xSemaphoreGive(args->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("eventfd write to select wakeup latency", "[vfs][eventfd]")
+{
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    TEST_ESP_OK(esp_vfs_eventfd_register(&config));
+
+    latency_producer_args_t args = {
+        .fd = eventfd(0, EFD_SEMAPHORE),
+        .done = xSemaphoreCreateBinary(),
+    };
+    TEST_ASSERT_GREATER_OR_EQUAL(0, args.fd);
+    TEST_ASSERT_NOT_NULL(args.done);
+
+    // uncontended write, nobody is waiting on the event fd
+    uint64_t val = 1;
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < LATENCY_ITERATIONS; i++) {
+        TEST_ASSERT_EQUAL(sizeof(val), write(args.fd, &val, sizeof(val)));
+    }
+    uint32_t write_cycles = (esp_cpu_get_cycle_count() - start) / LATENCY_ITERATIONS;
+    for (int i = 0; i < LATENCY_ITERATIONS; i++) {
+        TEST_ASSERT_EQUAL(sizeof(val), read(args.fd, &val, sizeof(val)));
+    }
+
+    // the producer runs on the other core if there is one
+    xTaskCreatePinnedToCore(latency_producer_task, "producer", 4096, &args, uxTaskPriorityGet(NULL),
+                            NULL, portNUM_PROCESSORS - 1 - xPortGetCoreID());
+    int64_t total_us = 0;
+    int64_t max_us = 0;
+    for (int i = 0; i < LATENCY_ITERATIONS; i++) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(args.fd, &read_fds);
+        struct timeval wait_time = { .tv_sec = 1 };
+        TEST_ASSERT_EQUAL(1, select(args.fd + 1, &read_fds, NULL, NULL, &wait_time));
+        int64_t latency_us = esp_timer_get_time() - args.write_time;
+        TEST_ASSERT_EQUAL(sizeof(val), read(args.fd, &val, sizeof(val)));
+        total_us += latency_us;
+        max_us = latency_us > max_us ? latency_us : max_us;
+    }
+    TEST_ASSERT_TRUE(xSemaphoreTake(args.done, pdMS_TO_TICKS(1000)));
+    TEST_ASSERT_EQUAL(0, args.failed_writes);
+
+    printf("eventfd: %"PRIu32" cycles per write without waiters, write to select wakeup %"PRId64" us average, %"PRId64" us max\n",
+           write_cycles, total_us / LATENCY_ITERATIONS, max_us);
+
+    vSemaphoreDelete(args.done);
+    TEST_ASSERT_EQUAL(0, close(args.fd));
+    TEST_ESP_OK(esp_vfs_eventfd_unregister());
+}
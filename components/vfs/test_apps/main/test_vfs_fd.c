@@ -1,11 +1,13 @@
 /*
- * SPDX-FileCopyrightText: 2015-2022 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 
 #include "sdkconfig.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -289,3 +291,110 @@ TEST_CASE("esp_vfs_register_fd_range checks for overlap", "[vfs]")
     TEST_ESP_OK(esp_vfs_unregister("/test"));
     TEST_ESP_ERR(ESP_ERR_INVALID_ARG, err);
 }
+
+#define STRESS_TEST_FILES_PER_TASK  4
+#define STRESS_TEST_TASKS           4
+#define STRESS_TEST_ITERATIONS      5000
+
+typedef struct {
+    int first_local_fd;
+    int iterations;
+    int errors;
+    int held_fd;    // opened by the test and read while other tasks open and close FDs
+    SemaphoreHandle_t done;
+} stress_test_task_param_t;
+
+static int stress_test_vfs_open(const char *path, int flags, int mode)
+{
+    // "/<n>" opens local FD n
+    return atoi(path + 1);
+}
+
+static int stress_test_vfs_close(int fd)
+{
+    return 0;
+}
+
+static ssize_t stress_test_vfs_read(int fd, void *dst, size_t size)
+{
+    // every read returns the local FD, so that a wrong FD table lookup is detected
+    memset(dst, fd, size);
+    return size;
+}
+
+static void stress_task(void *arg)
+{
+    stress_test_task_param_t *param = (stress_test_task_param_t *) arg;
+    int fds[STRESS_TEST_FILES_PER_TASK];
+    char path[16];
+    uint8_t data;
+
+    for (int i = 0; i < param->iterations; ++i) {
+        for (int j = 0; j < STRESS_TEST_FILES_PER_TASK; ++j) {
+            snprintf(path, sizeof(path), VFS_PREF1 "/%d", param->first_local_fd + j);
+            fds[j] = open(path, O_RDONLY);
+            if (fds[j] < 0) {
+                param->errors++;
+            }
+        }
+        for (int j = 0; j < STRESS_TEST_FILES_PER_TASK; ++j) {
+            if (fds[j] < 0) {
+                continue;
+            }
+            if (read(fds[j], &data, 1) != 1 || data != param->first_local_fd + j) {
+                param->errors++;
+            }
+            if (read(param->held_fd, &data, 1) != 1 || data != 0) {
+                param->errors++;
+            }
+            close(fds[j]);
+        }
+    }
+    xSemaphoreGive(param->done);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("FD table lookups stay consistent under concurrent open/read/close", "[vfs]")
+{
+    esp_vfs_t desc = {
+        .flags = ESP_VFS_FLAG_DEFAULT,
+        .open = stress_test_vfs_open,
+        .close = stress_test_vfs_close,
+        .read = stress_test_vfs_read,
+    };
+    TEST_ESP_OK( esp_vfs_register(VFS_PREF1, &desc, NULL) );
+
+    const int held_fd = open(VFS_PREF1 "/0", O_RDONLY);
+    TEST_ASSERT_NOT_EQUAL(-1, held_fd);
+
+    SemaphoreHandle_t done = xSemaphoreCreateCounting(STRESS_TEST_TASKS, 0);
+    TEST_ASSERT_NOT_NULL(done);
+    stress_test_task_param_t params[STRESS_TEST_TASKS];
+
+    const TickType_t start = xTaskGetTickCount();
+    for (int i = 0; i < STRESS_TEST_TASKS; ++i) {
+        params[i] = (stress_test_task_param_t) {
+            .first_local_fd = 1 + i * STRESS_TEST_FILES_PER_TASK,
+            .iterations = STRESS_TEST_ITERATIONS,
+            .held_fd = held_fd,
+            .done = done,
+        };
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreatePinnedToCore(stress_task, "stress", CONCURRENT_TEST_STACK_SIZE, &params[i],
+                                                          3, NULL, i % CONFIG_FREERTOS_NUMBER_OF_CORES));
+    }
+    for (int i = 0; i < STRESS_TEST_TASKS; ++i) {
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(done, pdMS_TO_TICKS(60000)));
+    }
+    const uint32_t elapsed_ms = pdTICKS_TO_MS(xTaskGetTickCount() - start);
+    vSemaphoreDelete(done);
+
+    const int ops = STRESS_TEST_TASKS * STRESS_TEST_ITERATIONS * STRESS_TEST_FILES_PER_TASK * 4;
+    printf("%d open/read/read/close operations from %d tasks in %"PRIu32" ms\n",
+           ops, STRESS_TEST_TASKS, elapsed_ms);
+
+    for (int i = 0; i < STRESS_TEST_TASKS; ++i) {
+        TEST_ASSERT_EQUAL(0, params[i].errors);
+    }
+    TEST_ASSERT_EQUAL(0, close(held_fd));
+    TEST_ESP_OK( esp_vfs_unregister(VFS_PREF1) );
+}
@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -60,8 +60,18 @@ typedef struct {
     uint8_t _reserved :5;
     vfs_index_t vfs_index;
     local_fd_t local_fd;
+    uint8_t _reserved2;
 } fd_table_t;
 
+/* FD table entries are published as one 32-bit word, so that they can be read without taking s_fd_table_lock.
+ * The lock is only held to allocate, modify or free entries.
+ */
+typedef union {
+    fd_table_t entry;
+    uint32_t word;
+} fd_table_slot_t;
+_Static_assert(sizeof(fd_table_t) == sizeof(uint32_t), "fd_table_t must fit into one word");
+
 typedef struct {
     bool isset; // none or at least one bit is set in the following 3 fd sets
     fd_set readfds;
@@ -72,9 +82,27 @@ typedef struct {
 static vfs_entry_t* s_vfs[VFS_MAX_COUNT] = { 0 };
 static size_t s_vfs_count = 0;
 
-static fd_table_t s_fd_table[MAX_FDS] = { [0 ... MAX_FDS-1] = FD_TABLE_ENTRY_UNUSED };
+static fd_table_slot_t s_fd_table[MAX_FDS] = { [0 ... MAX_FDS-1] = { .entry = FD_TABLE_ENTRY_UNUSED } };
 static _lock_t s_fd_table_lock;
 
+static inline fd_table_t fd_table_get(int fd)
+{
+    fd_table_slot_t slot = { .word = __atomic_load_n(&s_fd_table[fd].word, __ATOMIC_ACQUIRE) };
+    return slot.entry;
+}
+
+/* Must be called with s_fd_table_lock held */
+static inline void fd_table_set(int fd, fd_table_t entry)
+{
+    fd_table_slot_t slot = { .entry = entry };
+    __atomic_store_n(&s_fd_table[fd].word, slot.word, __ATOMIC_RELEASE);
+}
+
+static inline bool fd_table_is_free(int fd)
+{
+    return fd_table_get(fd).vfs_index == -1;
+}
+
 esp_err_t esp_vfs_register_common(const char* base_path, size_t len, const esp_vfs_t* vfs, void* ctx, int *vfs_index)
 {
     if (len != LEN_PATH_PREFIX_IGNORED) {
@@ -140,21 +168,19 @@ esp_err_t esp_vfs_register_fd_range(const esp_vfs_t *vfs, void *ctx, int min_fd,
     if (ret == ESP_OK) {
         _lock_acquire(&s_fd_table_lock);
         for (int i = min_fd; i < max_fd; ++i) {
-            if (s_fd_table[i].vfs_index != -1) {
+            if (!fd_table_is_free(i)) {
                 free(s_vfs[index]);
                 s_vfs[index] = NULL;
                 for (int j = min_fd; j < i; ++j) {
-                    if (s_fd_table[j].vfs_index == index) {
-                        s_fd_table[j] = FD_TABLE_ENTRY_UNUSED;
+                    if (fd_table_get(j).vfs_index == index) {
+                        fd_table_set(j, FD_TABLE_ENTRY_UNUSED);
                     }
                 }
                 _lock_release(&s_fd_table_lock);
                 ESP_LOGD(TAG, "esp_vfs_register_fd_range cannot set fd %d (used by other VFS)", i);
                 return ESP_ERR_INVALID_ARG;
             }
-            s_fd_table[i].permanent = true;
-            s_fd_table[i].vfs_index = index;
-            s_fd_table[i].local_fd = i;
+            fd_table_set(i, (fd_table_t) { .permanent = true, .vfs_index = index, .local_fd = i });
         }
         _lock_release(&s_fd_table_lock);
 
@@ -186,8 +212,8 @@ esp_err_t esp_vfs_unregister_with_id(esp_vfs_id_t vfs_id)
     _lock_acquire(&s_fd_table_lock);
     // Delete all references from the FD lookup-table
     for (int j = 0; j < VFS_MAX_COUNT; ++j) {
-        if (s_fd_table[j].vfs_index == vfs_id) {
-            s_fd_table[j] = FD_TABLE_ENTRY_UNUSED;
+        if (fd_table_get(j).vfs_index == vfs_id) {
+            fd_table_set(j, FD_TABLE_ENTRY_UNUSED);
         }
     }
     _lock_release(&s_fd_table_lock);
@@ -227,14 +253,12 @@ esp_err_t esp_vfs_register_fd_with_local_fd(esp_vfs_id_t vfs_id, int local_fd, b
     esp_err_t ret = ESP_ERR_NO_MEM;
     _lock_acquire(&s_fd_table_lock);
     for (int i = 0; i < MAX_FDS; ++i) {
-        if (s_fd_table[i].vfs_index == -1) {
-            s_fd_table[i].permanent = permanent;
-            s_fd_table[i].vfs_index = vfs_id;
-            if (local_fd >= 0) {
-                s_fd_table[i].local_fd = local_fd;
-            } else {
-                s_fd_table[i].local_fd = i;
-            }
+        if (fd_table_is_free(i)) {
+            fd_table_set(i, (fd_table_t) {
+                .permanent = permanent,
+                .vfs_index = vfs_id,
+                .local_fd = local_fd >= 0 ? local_fd : i,
+            });
             *fd = i;
             ret = ESP_OK;
             break;
@@ -258,9 +282,9 @@ esp_err_t esp_vfs_unregister_fd(esp_vfs_id_t vfs_id, int fd)
     }
 
     _lock_acquire(&s_fd_table_lock);
-    fd_table_t *item = s_fd_table + fd;
-    if (item->permanent == true && item->vfs_index == vfs_id && item->local_fd == fd) {
-        *item = FD_TABLE_ENTRY_UNUSED;
+    const fd_table_t item = fd_table_get(fd);
+    if (item.permanent == true && item.vfs_index == vfs_id && item.local_fd == fd) {
+        fd_table_set(fd, FD_TABLE_ENTRY_UNUSED);
         ret = ESP_OK;
     }
     _lock_release(&s_fd_table_lock);
@@ -307,25 +331,19 @@ static inline bool fd_valid(int fd)
     return (fd < MAX_FDS) && (fd >= 0);
 }
 
-static const vfs_entry_t *get_vfs_for_fd(int fd)
+/* Lock-free lookup, the VFS and the local FD come from the same FD table entry */
+const vfs_entry_t *get_vfs_for_fd(int fd, int *local_fd)
 {
-    const vfs_entry_t *vfs = NULL;
-    if (fd_valid(fd)) {
-        const int index = s_fd_table[fd].vfs_index; // single read -> no locking is required
-        vfs = get_vfs_for_index(index);
+    *local_fd = -1;
+    if (!fd_valid(fd)) {
+        return NULL;
     }
-    return vfs;
-}
-
-static inline int get_local_fd(const vfs_entry_t *vfs, int fd)
-{
-    int local_fd = -1;
-
-    if (vfs && fd_valid(fd)) {
-        local_fd = s_fd_table[fd].local_fd; // single read -> no locking is required
+    const fd_table_t entry = fd_table_get(fd);
+    const vfs_entry_t *vfs = get_vfs_for_index(entry.vfs_index);
+    if (vfs) {
+        *local_fd = entry.local_fd;
     }
-
-    return local_fd;
+    return vfs;
 }
 
 static const char* translate_path(const vfs_entry_t* vfs, const char* src_path)
@@ -451,10 +469,12 @@ int esp_vfs_open(struct _reent *r, const char * path, int flags, int mode)
     if (fd_within_vfs >= 0) {
         _lock_acquire(&s_fd_table_lock);
         for (int i = 0; i < MAX_FDS; ++i) {
-            if (s_fd_table[i].vfs_index == -1) {
-                s_fd_table[i].permanent = false;
-                s_fd_table[i].vfs_index = vfs->offset;
-                s_fd_table[i].local_fd = fd_within_vfs;
+            if (fd_table_is_free(i)) {
+                fd_table_set(i, (fd_table_t) {
+                    .permanent = false,
+                    .vfs_index = vfs->offset,
+                    .local_fd = fd_within_vfs,
+                });
                 _lock_release(&s_fd_table_lock);
                 return i;
             }
@@ -472,8 +492,8 @@ int esp_vfs_open(struct _reent *r, const char * path, int flags, int mode)
 
 ssize_t esp_vfs_write(struct _reent *r, int fd, const void * data, size_t size)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -485,8 +505,8 @@ ssize_t esp_vfs_write(struct _reent *r, int fd, const void * data, size_t size)
 
 off_t esp_vfs_lseek(struct _reent *r, int fd, off_t size, int mode)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -498,8 +518,8 @@ off_t esp_vfs_lseek(struct _reent *r, int fd, off_t size, int mode)
 
 ssize_t esp_vfs_read(struct _reent *r, int fd, void * dst, size_t size)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -512,8 +532,8 @@ ssize_t esp_vfs_read(struct _reent *r, int fd, void * dst, size_t size)
 ssize_t esp_vfs_pread(int fd, void *dst, size_t size, off_t offset)
 {
     struct _reent *r = __getreent();
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -526,8 +546,8 @@ ssize_t esp_vfs_pread(int fd, void *dst, size_t size, off_t offset)
 ssize_t esp_vfs_pwrite(int fd, const void *src, size_t size, off_t offset)
 {
     struct _reent *r = __getreent();
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -539,8 +559,8 @@ ssize_t esp_vfs_pwrite(int fd, const void *src, size_t size, off_t offset)
 
 int esp_vfs_close(struct _reent *r, int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -549,11 +569,13 @@ int esp_vfs_close(struct _reent *r, int fd)
     CHECK_AND_CALL(ret, r, vfs, close, local_fd);
 
     _lock_acquire(&s_fd_table_lock);
-    if (!s_fd_table[fd].permanent) {
-        if (s_fd_table[fd].has_pending_select) {
-            s_fd_table[fd].has_pending_close = true;
+    fd_table_t entry = fd_table_get(fd);
+    if (!entry.permanent) {
+        if (entry.has_pending_select) {
+            entry.has_pending_close = true;
+            fd_table_set(fd, entry);
         } else {
-            s_fd_table[fd] = FD_TABLE_ENTRY_UNUSED;
+            fd_table_set(fd, FD_TABLE_ENTRY_UNUSED);
         }
     }
     _lock_release(&s_fd_table_lock);
@@ -562,8 +584,8 @@ int esp_vfs_close(struct _reent *r, int fd)
 
 int esp_vfs_fstat(struct _reent *r, int fd, struct stat * st)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -575,8 +597,8 @@ int esp_vfs_fstat(struct _reent *r, int fd, struct stat * st)
 
 int esp_vfs_fcntl_r(struct _reent *r, int fd, int cmd, int arg)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
         return -1;
@@ -588,8 +610,8 @@ int esp_vfs_fcntl_r(struct _reent *r, int fd, int cmd, int arg)
 
 int esp_vfs_ioctl(int fd, int cmd, ...)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -605,8 +627,8 @@ int esp_vfs_ioctl(int fd, int cmd, ...)
 
 int esp_vfs_fsync(int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -861,8 +883,8 @@ int esp_vfs_truncate(const char *path, off_t length)
 
 int esp_vfs_ftruncate(int fd, off_t length)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -907,8 +929,9 @@ static int set_global_fd_sets(const fds_triple_t *vfs_fds_triple, int size, fd_s
         const fds_triple_t *item = &vfs_fds_triple[i];
         if (item->isset) {
             for (int fd = 0; fd < MAX_FDS; ++fd) {
-                if (s_fd_table[fd].vfs_index == i) {
-                    const int local_fd = s_fd_table[fd].local_fd; // single read -> no locking is required
+                const fd_table_t entry = fd_table_get(fd);
+                if (entry.vfs_index == i) {
+                    const int local_fd = entry.local_fd;
                     if (readfds && esp_vfs_safe_fd_isset(local_fd, &item->readfds)) {
                         ESP_LOGD(TAG, "FD %d in readfds was set from VFS ID %d", fd, i);
                         FD_SET(fd, readfds);
@@ -983,14 +1006,19 @@ int esp_vfs_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds
 
     int (*socket_select)(int, fd_set *, fd_set *, fd_set *, struct timeval *) = NULL;
     for (int fd = 0; fd < nfds; ++fd) {
-        _lock_acquire(&s_fd_table_lock);
-        const bool is_socket_fd = s_fd_table[fd].permanent;
-        const int vfs_index = s_fd_table[fd].vfs_index;
-        const int local_fd = s_fd_table[fd].local_fd;
+        fd_table_t entry;
         if (esp_vfs_safe_fd_isset(fd, errorfds)) {
-            s_fd_table[fd].has_pending_select = true;
+            _lock_acquire(&s_fd_table_lock);
+            entry = fd_table_get(fd);
+            entry.has_pending_select = true;
+            fd_table_set(fd, entry);
+            _lock_release(&s_fd_table_lock);
+        } else {
+            entry = fd_table_get(fd);
         }
-        _lock_release(&s_fd_table_lock);
+        const bool is_socket_fd = entry.permanent;
+        const int vfs_index = entry.vfs_index;
+        const int local_fd = entry.local_fd;
 
         if (vfs_index < 0) {
             continue;
@@ -1146,8 +1174,8 @@ int esp_vfs_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *errorfds
     }
     _lock_acquire(&s_fd_table_lock);
     for (int fd = 0; fd < nfds; ++fd) {
-        if (s_fd_table[fd].has_pending_close) {
-            s_fd_table[fd] = FD_TABLE_ENTRY_UNUSED;
+        if (fd_table_get(fd).has_pending_close) {
+            fd_table_set(fd, FD_TABLE_ENTRY_UNUSED);
         }
     }
     _lock_release(&s_fd_table_lock);
@@ -1208,8 +1236,8 @@ void esp_vfs_select_triggered_isr(esp_vfs_select_sem_t sem, BaseType_t *woken)
 
 int tcgetattr(int fd, struct termios *p)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1222,8 +1250,8 @@ int tcgetattr(int fd, struct termios *p)
 
 int tcsetattr(int fd, int optional_actions, const struct termios *p)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1236,8 +1264,8 @@ int tcsetattr(int fd, int optional_actions, const struct termios *p)
 
 int tcdrain(int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1250,8 +1278,8 @@ int tcdrain(int fd)
 
 int tcflush(int fd, int select)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1264,8 +1292,8 @@ int tcflush(int fd, int select)
 
 int tcflow(int fd, int action)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1278,8 +1306,8 @@ int tcflow(int fd, int action)
 
 pid_t tcgetsid(int fd)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
@@ -1292,8 +1320,8 @@ pid_t tcgetsid(int fd)
 
 int tcsendbreak(int fd, int duration)
 {
-    const vfs_entry_t* vfs = get_vfs_for_fd(fd);
-    const int local_fd = get_local_fd(vfs, fd);
+    int local_fd;
+    const vfs_entry_t* vfs = get_vfs_for_fd(fd, &local_fd);
     struct _reent* r = __getreent();
     if (vfs == NULL || local_fd < 0) {
         __errno_r(r) = EBADF;
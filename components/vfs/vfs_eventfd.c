@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2021-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2021-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -39,6 +39,17 @@
  * This list contains all the pending selects on this file descriptor from
  * different select() calls.
  *
+ * Poll sets watching a file descriptor are kept in event_context_t::poll_watches
+ * from poll_start until poll_stop. They are notified under the same conditions
+ * as the pending selects.
+ *
+ * The fd, the counter and the heads of the lists above are protected by the
+ * data_spin_lock of the event fd, which read() and write() only hold for a few
+ * instructions. The lists are changed under both locks, so the writer only
+ * takes the recursive lock to walk them when it sees a waiter. Waiters are
+ * linked and check the counter in the same critical section, so either the
+ * writer sees the waiter or the waiter sees the new counter.
+ *
  */
 typedef struct event_select_args_t {
     int                         fd;
@@ -52,15 +63,24 @@ typedef struct event_select_args_t {
     struct event_select_args_t  *next_in_args;
 } event_select_args_t;
 
+typedef struct event_poll_watch_t {
+    esp_vfs_poll_watch_t        *watch;
+    struct event_poll_watch_t   *next;
+} event_poll_watch_t;
+
 typedef struct {
     int                     fd;
     bool                    support_isr;
-    volatile bool           is_set;
-    volatile uint64_t       value;
+    bool                    semaphore;
+    // protected by data_spin_lock only
+    bool                    is_set;
+    uint64_t                value;
     // a double-linked list for all pending select args with this fd
     event_select_args_t     *select_args;
+    // poll sets watching this fd
+    event_poll_watch_t      *poll_watches;
     _lock_t                 lock;
-    // only for event fds that support ISR.
+    // protects the fields above, interrupts are only kept disabled while waking up waiters for event fds that support ISR
     portMUX_TYPE            data_spin_lock;
 } event_context_t;
 
@@ -69,6 +89,21 @@ esp_vfs_id_t s_eventfd_vfs_id = -1;
 static size_t s_event_size;
 static event_context_t *s_events;
 
+// must be called with data_spin_lock held
+static inline bool event_is_readable(event_context_t *event)
+{
+    if (event->semaphore) {
+        return event->value != 0;
+    }
+    return event->is_set;
+}
+
+// must be called with data_spin_lock held
+static inline bool event_has_waiters(event_context_t *event)
+{
+    return event->select_args != NULL || event->poll_watches != NULL;
+}
+
 static void trigger_select_for_event(event_context_t *event)
 {
     event_select_args_t *select_args = event->select_args;
@@ -76,6 +111,11 @@ static void trigger_select_for_event(event_context_t *event)
         esp_vfs_select_triggered(select_args->signal_sem);
         select_args = select_args->next_in_fd;
     }
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+    for (event_poll_watch_t *poll_watch = event->poll_watches; poll_watch != NULL; poll_watch = poll_watch->next) {
+        esp_vfs_poll_notify(poll_watch->watch);
+    }
+#endif
 }
 
 static void trigger_select_for_event_isr(event_context_t *event, BaseType_t *task_woken)
@@ -87,9 +127,30 @@ static void trigger_select_for_event_isr(event_context_t *event, BaseType_t *tas
         *task_woken = (local_woken || *task_woken);
         select_args = select_args->next_in_fd;
     }
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+    for (event_poll_watch_t *poll_watch = event->poll_watches; poll_watch != NULL; poll_watch = poll_watch->next) {
+        BaseType_t local_woken = pdFALSE;
+        esp_vfs_poll_notify_isr(poll_watch->watch, &local_woken);
+        *task_woken = (local_woken || *task_woken);
+    }
+#endif
+}
+
+// wakes up the waiters from a task, must be called with the recursive lock held
+static void event_wake_waiters(event_context_t *event)
+{
+    if (event->support_isr) {
+        portENTER_CRITICAL(&event->data_spin_lock);
+    }
+    trigger_select_for_event(event);
+    if (event->support_isr) {
+        portEXIT_CRITICAL(&event->data_spin_lock);
+    }
 }
 
 #ifdef CONFIG_VFS_SUPPORT_SELECT
+static esp_err_t event_end_select(void *end_select_args);
+
 static esp_err_t event_start_select(int                  nfds,
                                     fd_set              *readfds,
                                     fd_set              *writefds,
@@ -105,14 +166,18 @@ static esp_err_t event_start_select(int                  nfds,
     // FIXME: end_select_args should be a list to all select args
 
     for (int i = 0; i < nfds; i++) {
+        if (!FD_ISSET(i, readfds) && !FD_ISSET(i, writefds) && !FD_ISSET(i, exceptfds)) {
+            continue;
+        }
+        event_select_args_t *event_select_args =
+            (event_select_args_t *)malloc(sizeof(event_select_args_t));
+        if (event_select_args == NULL) {
+            error = ESP_ERR_NO_MEM;
+            break;
+        }
         _lock_acquire_recursive(&s_events[i].lock);
-        if (s_events[i].fd == i && (FD_ISSET(i, readfds) || FD_ISSET(i, writefds) || FD_ISSET(i, exceptfds))) {
-            if (s_events[i].support_isr) {
-                portENTER_CRITICAL(&s_events[i].data_spin_lock);
-            }
-
-            event_select_args_t *event_select_args =
-                (event_select_args_t *)malloc(sizeof(event_select_args_t));
+        portENTER_CRITICAL(&s_events[i].data_spin_lock);
+        if (s_events[i].fd == i) {
             event_select_args->fd = i;
             event_select_args->signal_sem = signal_sem;
 
@@ -127,16 +192,7 @@ static esp_err_t event_start_select(int                  nfds,
             if (FD_ISSET(i, writefds)) {
                 should_trigger = true;
             }
-            if (FD_ISSET(i, readfds)) {
-                event_select_args->read_fds = readfds;
-                if (s_events[i].is_set) {
-                    should_trigger = true;
-                } else {
-                    FD_CLR(i, readfds);
-                }
-            } else {
-                event_select_args->read_fds = NULL;
-            }
+            event_select_args->read_fds = FD_ISSET(i, readfds) ? readfds : NULL;
             event_select_args->prev_in_fd = NULL;
             event_select_args->next_in_fd = s_events[i].select_args;
             if (s_events[i].select_args) {
@@ -146,11 +202,23 @@ static esp_err_t event_start_select(int                  nfds,
             select_args_list = event_select_args;
             s_events[i].select_args = event_select_args;
 
-            if (s_events[i].support_isr) {
-                portEXIT_CRITICAL(&s_events[i].data_spin_lock);
+            if (event_select_args->read_fds) {
+                if (event_is_readable(&s_events[i])) {
+                    should_trigger = true;
+                } else {
+                    FD_CLR(i, readfds);
+                }
             }
+            event_select_args = NULL;
         }
+        portEXIT_CRITICAL(&s_events[i].data_spin_lock);
         _lock_release_recursive(&s_events[i].lock);
+        free(event_select_args);
+    }
+
+    if (error != ESP_OK) {
+        event_end_select(select_args_list);
+        return error;
     }
 
     *end_select_args = select_args_list;
@@ -170,16 +238,14 @@ static esp_err_t event_end_select(void *end_select_args)
         event_context_t *event = &s_events[select_args->fd];
 
         _lock_acquire_recursive(&event->lock);
-        if (event->support_isr) {
-            portENTER_CRITICAL(&event->data_spin_lock);
-        }
+        portENTER_CRITICAL(&event->data_spin_lock);
 
         if (event->fd != select_args->fd) { // already closed
             if (select_args->error_fds) {
                 FD_SET(select_args->fd, select_args->error_fds);
             }
         } else {
-            if (select_args->read_fds && event->is_set) {
+            if (select_args->read_fds && event_is_readable(event)) {
                 FD_SET(select_args->fd, select_args->read_fds);
             }
         }
@@ -195,15 +261,13 @@ static esp_err_t event_end_select(void *end_select_args)
         if (next_in_fd != NULL) {
             next_in_fd->prev_in_fd = prev_in_fd;
         }
-        if (prev_in_fd == NULL && next_in_fd == NULL) { // The last pending select
+        if (prev_in_fd == NULL && next_in_fd == NULL && event->poll_watches == NULL) { // The last pending select
             if (event->fd == FD_PENDING_SELECT) {
                 event->fd = FD_INVALID;
             }
         }
 
-        if (event->support_isr) {
-            portEXIT_CRITICAL(&event->data_spin_lock);
-        }
+        portEXIT_CRITICAL(&event->data_spin_lock);
         _lock_release_recursive(&event->lock);
 
         free(select_args);
@@ -212,72 +276,122 @@ static esp_err_t event_end_select(void *end_select_args)
 
     return ESP_OK;
 }
-#endif // CONFIG_VFS_SUPPORT_SELECT
 
-static ssize_t signal_event_fd_from_isr(int fd, const void *data, size_t size)
+static esp_err_t event_poll_start(int fd, esp_vfs_poll_watch_t *watch)
 {
-    BaseType_t task_woken = pdFALSE;
-    const uint64_t *val = (const uint64_t *)data;
-    ssize_t ret = size;
-
-    portENTER_CRITICAL_ISR(&s_events[fd].data_spin_lock);
+    if (fd >= s_event_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    event_poll_watch_t *poll_watch = (event_poll_watch_t *)malloc(sizeof(event_poll_watch_t));
+    if (poll_watch == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    poll_watch->watch = watch;
 
-    if (s_events[fd].fd == fd) {
-        s_events[fd].is_set = true;
-        s_events[fd].value += *val;
-        trigger_select_for_event_isr(&s_events[fd], &task_woken);
+    esp_err_t error = ESP_OK;
+    event_context_t *event = &s_events[fd];
+    _lock_acquire_recursive(&event->lock);
+    portENTER_CRITICAL(&event->data_spin_lock);
+    if (event->fd == fd) {
+        // the poll set checks the event fd after poll_start returns, so a later write sees the watch
+        poll_watch->next = event->poll_watches;
+        event->poll_watches = poll_watch;
+        poll_watch = NULL;
     } else {
-        errno = EBADF;
-        ret = -1;
+        error = ESP_ERR_INVALID_STATE;
     }
+    portEXIT_CRITICAL(&event->data_spin_lock);
+    _lock_release_recursive(&event->lock);
+    free(poll_watch);
+    return error;
+}
 
-    portEXIT_CRITICAL_ISR(&s_events[fd].data_spin_lock);
+static short event_poll_ready(int fd)
+{
+    if (fd >= s_event_size) {
+        return POLLNVAL;
+    }
+    short revents;
+    event_context_t *event = &s_events[fd];
+    portENTER_CRITICAL(&event->data_spin_lock);
+    if (event->fd != fd) { // already closed
+        revents = POLLNVAL;
+    } else {
+        // event fds are always writable
+        revents = POLLOUT | (event_is_readable(event) ? POLLIN : 0);
+    }
+    portEXIT_CRITICAL(&event->data_spin_lock);
+    return revents;
+}
 
-    if (task_woken) {
-        portYIELD_FROM_ISR();
+static esp_err_t event_poll_stop(int fd, esp_vfs_poll_watch_t *watch)
+{
+    if (fd >= s_event_size) {
+        return ESP_ERR_INVALID_ARG;
     }
-    return ret;
+    event_poll_watch_t *poll_watch = NULL;
+    event_context_t *event = &s_events[fd];
+    _lock_acquire_recursive(&event->lock);
+    portENTER_CRITICAL(&event->data_spin_lock);
+    for (event_poll_watch_t **link = &event->poll_watches; *link != NULL; link = &(*link)->next) {
+        if ((*link)->watch == watch) {
+            poll_watch = *link;
+            *link = poll_watch->next;
+            break;
+        }
+    }
+    if (event->poll_watches == NULL && event->select_args == NULL && event->fd == FD_PENDING_SELECT) {
+        event->fd = FD_INVALID;
+    }
+    portEXIT_CRITICAL(&event->data_spin_lock);
+    _lock_release_recursive(&event->lock);
+
+    free(poll_watch);
+    return poll_watch ? ESP_OK : ESP_ERR_NOT_FOUND;
 }
+#endif // CONFIG_VFS_SUPPORT_SELECT
 
 static ssize_t event_write(int fd, const void *data, size_t size)
 {
-    ssize_t ret = -1;
-
     if (fd >= s_event_size || data == NULL || size != sizeof(uint64_t)) {
         errno = EINVAL;
-        return ret;
-    }
-    if (size != sizeof(uint64_t)) {
-        errno = EINVAL;
-        return ret;
+        return -1;
     }
 
-    if (!xPortCanYield()) {
-        ret = signal_event_fd_from_isr(fd, data, size);
-    } else {
-        const uint64_t *val = (const uint64_t *)data;
+    event_context_t *event = &s_events[fd];
+    const bool in_isr = !xPortCanYield();
+    bool has_waiters;
 
-        _lock_acquire_recursive(&s_events[fd].lock);
-        if (s_events[fd].support_isr) {
-            portENTER_CRITICAL(&s_events[fd].data_spin_lock);
-        }
-
-        if (s_events[fd].fd == fd) {
-            s_events[fd].is_set = true;
-            s_events[fd].value += *val;
-            ret = size;
-            trigger_select_for_event(&s_events[fd]);
-        } else {
-            errno = EBADF;
-            ret = -1;
+    // the fd is checked in the same critical section as the counter is updated, so a write racing with close()
+    // can't update the counter of an event fd created later in the same slot
+    portENTER_CRITICAL_SAFE(&event->data_spin_lock);
+    if (event->fd != fd) {
+        portEXIT_CRITICAL_SAFE(&event->data_spin_lock);
+        errno = EBADF;
+        return -1;
+    }
+    event->value += *(const uint64_t *)data;
+    event->is_set = true;
+    has_waiters = event_has_waiters(event);
+    if (has_waiters && in_isr) {
+        BaseType_t task_woken = pdFALSE;
+        trigger_select_for_event_isr(event, &task_woken);
+        portEXIT_CRITICAL_ISR(&event->data_spin_lock);
+        if (task_woken) {
+            portYIELD_FROM_ISR();
         }
+        return size;
+    }
+    portEXIT_CRITICAL_SAFE(&event->data_spin_lock);
 
-        if (s_events[fd].support_isr) {
-            portEXIT_CRITICAL(&s_events[fd].data_spin_lock);
-        }
-        _lock_release_recursive(&s_events[fd].lock);
+    // the waiter lists only change under the recursive lock, take it only if there is somebody to wake up.
+    // If the fd is closed and reused meanwhile, the waiters of the new fd only get a spurious wakeup.
+    if (has_waiters) {
+        _lock_acquire_recursive(&event->lock);
+        event_wake_waiters(event);
+        _lock_release_recursive(&event->lock);
     }
-    return ret;
+    return size;
 }
 
 static ssize_t event_read(int fd, void *data, size_t size)
@@ -290,26 +404,26 @@ static ssize_t event_read(int fd, void *data, size_t size)
     }
 
     uint64_t *val = (uint64_t *)data;
+    event_context_t *event = &s_events[fd];
 
-    _lock_acquire_recursive(&s_events[fd].lock);
-    if (s_events[fd].support_isr) {
-        portENTER_CRITICAL(&s_events[fd].data_spin_lock);
-    }
-
-    if (s_events[fd].fd == fd) {
-        *val = s_events[fd].value;
-        s_events[fd].is_set = false;
-        ret = size;
-        s_events[fd].value = 0;
-    } else {
+    portENTER_CRITICAL_SAFE(&event->data_spin_lock);
+    if (event->fd != fd) {
         errno = EBADF;
-        ret = -1;
-    }
-
-    if (s_events[fd].support_isr) {
-        portEXIT_CRITICAL(&s_events[fd].data_spin_lock);
+    } else if (event->semaphore) {
+        if (event->value != 0) {
+            event->value--;
+            *val = 1;
+            ret = size;
+        } else {
+            errno = EAGAIN;
+        }
+    } else {
+        *val = event->value;
+        event->value = 0;
+        event->is_set = false;
+        ret = size;
     }
-    _lock_release_recursive(&s_events[fd].lock);
+    portEXIT_CRITICAL_SAFE(&event->data_spin_lock);
 
     return ret;
 }
@@ -323,26 +437,23 @@ static int event_close(int fd)
         return ret;
     }
 
-    _lock_acquire_recursive(&s_events[fd].lock);
-    if (s_events[fd].fd == fd) {
-        if (s_events[fd].support_isr) {
-            portENTER_CRITICAL(&s_events[fd].data_spin_lock);
-        }
-        if (s_events[fd].select_args == NULL) {
-            s_events[fd].fd = FD_INVALID;
-        } else {
-            s_events[fd].fd = FD_PENDING_SELECT;
-            trigger_select_for_event(&s_events[fd]);
-        }
-        s_events[fd].value = 0;
-        if (s_events[fd].support_isr) {
-            portEXIT_CRITICAL(&s_events[fd].data_spin_lock);
-        }
+    event_context_t *event = &s_events[fd];
+    bool has_waiters = false;
+    _lock_acquire_recursive(&event->lock);
+    portENTER_CRITICAL(&event->data_spin_lock);
+    if (event->fd == fd) {
+        has_waiters = event_has_waiters(event);
+        event->fd = has_waiters ? FD_PENDING_SELECT : FD_INVALID;
+        event->value = 0;
         ret = 0;
     } else {
         errno = EBADF;
     }
-    _lock_release_recursive(&s_events[fd].lock);
+    portEXIT_CRITICAL(&event->data_spin_lock);
+    if (has_waiters) {
+        event_wake_waiters(event);
+    }
+    _lock_release_recursive(&event->lock);
 
     return ret;
 }
@@ -360,6 +471,7 @@ esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *config)
     s_events = (event_context_t *)calloc(s_event_size, sizeof(event_context_t));
     for (size_t i = 0; i < s_event_size; i++) {
         _lock_init_recursive(&s_events[i].lock);
+        portMUX_INITIALIZE(&s_events[i].data_spin_lock);
         s_events[i].fd = FD_INVALID;
     }
 
@@ -371,6 +483,9 @@ esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *config)
 #ifdef CONFIG_VFS_SUPPORT_SELECT
         .start_select = &event_start_select,
         .end_select   = &event_end_select,
+        .poll_start   = &event_poll_start,
+        .poll_ready   = &event_poll_ready,
+        .poll_stop    = &event_poll_stop,
 #endif
     };
     return esp_vfs_register_with_id(&vfs, NULL, &s_eventfd_vfs_id);
@@ -398,7 +513,7 @@ int eventfd(unsigned int initval, int flags)
     int global_fd = FD_INVALID;
     esp_err_t error = ESP_OK;
 
-    if ((flags & (~EFD_SUPPORT_ISR)) != 0) {
+    if ((flags & ~(EFD_SUPPORT_ISR | EFD_SEMAPHORE)) != 0) {
         errno = EINVAL;
         return FD_INVALID;
     }
@@ -417,21 +532,16 @@ int eventfd(unsigned int initval, int flags)
                 break;
             }
 
-            bool support_isr = flags & EFD_SUPPORT_ISR;
             fd = i;
-            s_events[i].fd = i;
-            s_events[i].support_isr = support_isr;
-            portMUX_INITIALIZE(&s_events[i].data_spin_lock);
-
-            if (support_isr) {
-                portENTER_CRITICAL(&s_events[i].data_spin_lock);
-            }
+            portENTER_CRITICAL(&s_events[i].data_spin_lock);
+            s_events[i].support_isr = flags & EFD_SUPPORT_ISR;
+            s_events[i].semaphore = flags & EFD_SEMAPHORE;
             s_events[i].is_set = false;
             s_events[i].value = initval;
             s_events[i].select_args = NULL;
-            if (support_isr) {
-                portEXIT_CRITICAL(&s_events[i].data_spin_lock);
-            }
+            s_events[i].poll_watches = NULL;
+            s_events[i].fd = i;
+            portEXIT_CRITICAL(&s_events[i].data_spin_lock);
             _lock_release_recursive(&s_events[i].lock);
             break;
         }
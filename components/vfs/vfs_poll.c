@@ -0,0 +1,444 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/lock.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_vfs.h"
+#include "esp_vfs_private.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_VFS_SUPPORT_SELECT
+
+#define POLL_EVENTS_ALWAYS      (POLLERR | POLLHUP | POLLNVAL)
+
+typedef struct esp_vfs_poll_set esp_vfs_poll_set_t;
+
+/*
+ * About poll sets
+ *
+ * Each FD added to a poll set gets a watch. FDs of drivers implementing poll_start/poll_ready/poll_stop are
+ * "native": the driver keeps the watch and calls esp_vfs_poll_notify() when the FD may have become ready, which
+ * puts the watch on the pending list of the set and wakes up the waiting task. esp_vfs_poll_wait() only asks the
+ * drivers of pending watches for the current state of their FDs, watches found ready stay pending, so that
+ * readiness is level-triggered like with poll().
+ *
+ * FDs of drivers implementing only start_select/end_select are grouped by VFS, each group is one select
+ * started by esp_vfs_poll_wait() with the semaphore of the set and restarted after every wakeup.
+ */
+struct esp_vfs_poll_watch {
+    esp_vfs_poll_set_t *set;
+    int fd;                                     // global FD
+    int local_fd;
+    int vfs_index;
+    short events;
+    bool fallback;                              // driver only implements start_select/end_select
+    bool pending;                               // protected by set->spinlock
+    struct esp_vfs_poll_watch *next_pending;    // protected by set->spinlock
+};
+
+typedef struct {
+    fd_set readfds;
+    fd_set writefds;
+    fd_set errorfds;
+    void *end_select_args;
+    bool armed;
+} poll_fallback_t;
+
+struct esp_vfs_poll_set {
+    SemaphoreHandle_t sem;                      // given by the drivers, taken by esp_vfs_poll_wait()
+    _lock_t lock;                               // serializes add, remove and wait
+    portMUX_TYPE spinlock;                      // protects the pending list
+    esp_vfs_poll_watch_t *pending_head;
+    esp_vfs_poll_watch_t *pending_tail;
+    esp_vfs_poll_watch_t *watches[MAX_FDS];     // indexed by global FD
+    poll_fallback_t *fallback[CONFIG_VFS_MAX_COUNT];
+};
+
+/* Must be called with set->spinlock held, returns true if the watch was not pending before */
+static inline bool poll_watch_enqueue(esp_vfs_poll_set_t *set, esp_vfs_poll_watch_t *watch)
+{
+    if (watch->pending) {
+        return false;
+    }
+    watch->pending = true;
+    watch->next_pending = NULL;
+    if (set->pending_tail) {
+        set->pending_tail->next_pending = watch;
+    } else {
+        set->pending_head = watch;
+    }
+    set->pending_tail = watch;
+    return true;
+}
+
+/* Must be called with set->spinlock held */
+static void poll_watch_dequeue(esp_vfs_poll_set_t *set, esp_vfs_poll_watch_t *watch)
+{
+    esp_vfs_poll_watch_t *prev = NULL;
+    for (esp_vfs_poll_watch_t *it = set->pending_head; it != NULL; prev = it, it = it->next_pending) {
+        if (it == watch) {
+            if (prev) {
+                prev->next_pending = it->next_pending;
+            } else {
+                set->pending_head = it->next_pending;
+            }
+            if (set->pending_tail == it) {
+                set->pending_tail = prev;
+            }
+            break;
+        }
+    }
+    watch->pending = false;
+}
+
+void esp_vfs_poll_notify(esp_vfs_poll_watch_t *watch)
+{
+    esp_vfs_poll_set_t *set = watch->set;
+    portENTER_CRITICAL(&set->spinlock);
+    const bool queued = poll_watch_enqueue(set, watch);
+    portEXIT_CRITICAL(&set->spinlock);
+    // an already pending watch is going to be looked at anyway
+    if (queued) {
+        xSemaphoreGive(set->sem);
+    }
+}
+
+void esp_vfs_poll_notify_isr(esp_vfs_poll_watch_t *watch, BaseType_t *woken)
+{
+    esp_vfs_poll_set_t *set = watch->set;
+    portENTER_CRITICAL_ISR(&set->spinlock);
+    const bool queued = poll_watch_enqueue(set, watch);
+    portEXIT_CRITICAL_ISR(&set->spinlock);
+    if (queued) {
+        xSemaphoreGiveFromISR(set->sem, woken);
+    }
+}
+
+static bool poll_fallback_in_use(const esp_vfs_poll_set_t *set, int vfs_index)
+{
+    for (int fd = 0; fd < MAX_FDS; ++fd) {
+        const esp_vfs_poll_watch_t *watch = set->watches[fd];
+        if (watch != NULL && watch->fallback && watch->vfs_index == vfs_index) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void poll_fallback_disarm(int vfs_index, poll_fallback_t *fb)
+{
+    if (!fb->armed) {
+        return;
+    }
+    const vfs_entry_t *vfs = get_vfs_for_index(vfs_index);
+    if (vfs != NULL) {
+        vfs->vfs.end_select(fb->end_select_args);
+    }
+    fb->end_select_args = NULL;
+    fb->armed = false;
+}
+
+static esp_err_t poll_fallback_arm(esp_vfs_poll_set_t *set, int vfs_index, poll_fallback_t *fb)
+{
+    const vfs_entry_t *vfs = get_vfs_for_index(vfs_index);
+    int nfds = 0;
+
+    FD_ZERO(&fb->readfds);
+    FD_ZERO(&fb->writefds);
+    FD_ZERO(&fb->errorfds);
+    for (int fd = 0; fd < MAX_FDS; ++fd) {
+        const esp_vfs_poll_watch_t *watch = set->watches[fd];
+        if (watch == NULL || !watch->fallback || watch->vfs_index != vfs_index) {
+            continue;
+        }
+        if (watch->events & POLLIN) {
+            FD_SET(watch->local_fd, &fb->readfds);
+        }
+        if (watch->events & POLLOUT) {
+            FD_SET(watch->local_fd, &fb->writefds);
+        }
+        FD_SET(watch->local_fd, &fb->errorfds);
+        nfds = MAX(nfds, watch->local_fd + 1);
+    }
+    if (vfs == NULL || nfds == 0) {
+        return ESP_OK;
+    }
+
+    const esp_vfs_select_sem_t sem = {
+        .is_sem_local = true,
+        .sem = set->sem,
+    };
+    esp_err_t err = vfs->vfs.start_select(nfds, &fb->readfds, &fb->writefds, &fb->errorfds, sem, &fb->end_select_args);
+    if (err == ESP_OK) {
+        fb->armed = true;
+    }
+    return err;
+}
+
+/* Translates the result of the last select of a fallback group, must be called after poll_fallback_disarm() */
+static int poll_fallback_report(const esp_vfs_poll_set_t *set, int vfs_index, const poll_fallback_t *fb,
+                                struct pollfd *fds, int max_fds, int n)
+{
+    for (int fd = 0; fd < MAX_FDS && n < max_fds; ++fd) {
+        const esp_vfs_poll_watch_t *watch = set->watches[fd];
+        if (watch == NULL || !watch->fallback || watch->vfs_index != vfs_index) {
+            continue;
+        }
+        short revents = 0;
+        if ((watch->events & POLLIN) && FD_ISSET(watch->local_fd, &fb->readfds)) {
+            revents |= POLLIN;
+        }
+        if ((watch->events & POLLOUT) && FD_ISSET(watch->local_fd, &fb->writefds)) {
+            revents |= POLLOUT;
+        }
+        if (FD_ISSET(watch->local_fd, &fb->errorfds)) {
+            revents |= POLLERR;
+        }
+        if (revents) {
+            fds[n++] = (struct pollfd) { .fd = watch->fd, .events = watch->events, .revents = revents };
+        }
+    }
+    return n;
+}
+
+static int poll_collect_native(esp_vfs_poll_set_t *set, struct pollfd *fds, int max_fds, int n)
+{
+    esp_vfs_poll_watch_t *pending[MAX_FDS];
+    int pending_count = 0;
+
+    // take the whole list, watches notified from now on are queued again for the next call
+    portENTER_CRITICAL(&set->spinlock);
+    for (esp_vfs_poll_watch_t *watch = set->pending_head; watch != NULL; watch = watch->next_pending) {
+        watch->pending = false;
+        pending[pending_count++] = watch;
+    }
+    set->pending_head = NULL;
+    set->pending_tail = NULL;
+    portEXIT_CRITICAL(&set->spinlock);
+
+    for (int i = 0; i < pending_count; ++i) {
+        esp_vfs_poll_watch_t *watch = pending[i];
+        const vfs_entry_t *vfs = get_vfs_for_index(watch->vfs_index);
+        short revents = vfs ? vfs->vfs.poll_ready(watch->local_fd) : POLLNVAL;
+        revents &= watch->events | POLL_EVENTS_ALWAYS;
+        if (revents == 0) {
+            continue;
+        }
+        if (n < max_fds) {
+            fds[n++] = (struct pollfd) { .fd = watch->fd, .events = watch->events, .revents = revents };
+        }
+        // still ready, look at it again in the next call
+        portENTER_CRITICAL(&set->spinlock);
+        poll_watch_enqueue(set, watch);
+        portEXIT_CRITICAL(&set->spinlock);
+    }
+    return n;
+}
+
+static void poll_watch_free(esp_vfs_poll_set_t *set, esp_vfs_poll_watch_t *watch)
+{
+    const int vfs_index = watch->vfs_index;
+
+    set->watches[watch->fd] = NULL;
+    if (watch->fallback) {
+        poll_fallback_t *fb = set->fallback[vfs_index];
+        // the next esp_vfs_poll_wait() starts select again without this FD
+        poll_fallback_disarm(vfs_index, fb);
+        if (!poll_fallback_in_use(set, vfs_index)) {
+            free(fb);
+            set->fallback[vfs_index] = NULL;
+        }
+    } else {
+        const vfs_entry_t *vfs = get_vfs_for_index(vfs_index);
+        if (vfs != NULL) {
+            vfs->vfs.poll_stop(watch->local_fd, watch);
+        }
+        portENTER_CRITICAL(&set->spinlock);
+        poll_watch_dequeue(set, watch);
+        portEXIT_CRITICAL(&set->spinlock);
+    }
+    free(watch);
+}
+
+esp_err_t esp_vfs_poll_create(esp_vfs_poll_handle_t *handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_vfs_poll_set_t *set = heap_caps_calloc(1, sizeof(esp_vfs_poll_set_t), VFS_MALLOC_FLAGS);
+    if (set == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    set->sem = xSemaphoreCreateBinary();
+    if (set->sem == NULL) {
+        free(set);
+        return ESP_ERR_NO_MEM;
+    }
+    _lock_init(&set->lock);
+    portMUX_INITIALIZE(&set->spinlock);
+    *handle = set;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_poll_delete(esp_vfs_poll_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _lock_acquire(&handle->lock);
+    for (int fd = 0; fd < MAX_FDS; ++fd) {
+        if (handle->watches[fd] != NULL) {
+            poll_watch_free(handle, handle->watches[fd]);
+        }
+    }
+    _lock_release(&handle->lock);
+    _lock_close(&handle->lock);
+    vSemaphoreDelete(handle->sem);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_poll_add(esp_vfs_poll_handle_t handle, int fd, short events)
+{
+    int local_fd;
+    const vfs_entry_t *vfs = get_vfs_for_fd(fd, &local_fd);
+    if (handle == NULL || vfs == NULL || (events & ~(POLLIN | POLLOUT | POLL_EVENTS_ALWAYS)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const bool native = vfs->vfs.poll_start != NULL && vfs->vfs.poll_ready != NULL && vfs->vfs.poll_stop != NULL;
+    if (!native && (vfs->vfs.start_select == NULL || vfs->vfs.end_select == NULL)) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t err = ESP_OK;
+    esp_vfs_poll_watch_t *watch = NULL;
+    _lock_acquire(&handle->lock);
+    if (handle->watches[fd] != NULL) {
+        err = ESP_ERR_INVALID_STATE;
+        goto out;
+    }
+    watch = heap_caps_calloc(1, sizeof(esp_vfs_poll_watch_t), VFS_MALLOC_FLAGS);
+    if (watch == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    watch->set = handle;
+    watch->fd = fd;
+    watch->local_fd = local_fd;
+    watch->vfs_index = vfs->offset;
+    watch->events = events;
+    watch->fallback = !native;
+
+    if (native) {
+        err = vfs->vfs.poll_start(local_fd, watch);
+        if (err != ESP_OK) {
+            free(watch);
+            goto out;
+        }
+        handle->watches[fd] = watch;
+        // the FD might be ready already
+        esp_vfs_poll_notify(watch);
+    } else {
+        poll_fallback_t *fb = handle->fallback[vfs->offset];
+        if (fb == NULL) {
+            fb = heap_caps_calloc(1, sizeof(poll_fallback_t), VFS_MALLOC_FLAGS);
+            if (fb == NULL) {
+                free(watch);
+                err = ESP_ERR_NO_MEM;
+                goto out;
+            }
+            handle->fallback[vfs->offset] = fb;
+        }
+        handle->watches[fd] = watch;
+        // wake up a waiting task to start select with this FD
+        poll_fallback_disarm(vfs->offset, fb);
+        xSemaphoreGive(handle->sem);
+    }
+out:
+    _lock_release(&handle->lock);
+    return err;
+}
+
+esp_err_t esp_vfs_poll_remove(esp_vfs_poll_handle_t handle, int fd)
+{
+    if (handle == NULL || fd < 0 || fd >= MAX_FDS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    _lock_acquire(&handle->lock);
+    esp_vfs_poll_watch_t *watch = handle->watches[fd];
+    if (watch == NULL) {
+        err = ESP_ERR_NOT_FOUND;
+    } else {
+        const bool fallback = watch->fallback;
+        poll_watch_free(handle, watch);
+        if (fallback) {
+            // wake up a waiting task to restart select without this FD
+            xSemaphoreGive(handle->sem);
+        }
+    }
+    _lock_release(&handle->lock);
+    return err;
+}
+
+static int poll_collect(esp_vfs_poll_set_t *set, struct pollfd *fds, int max_fds)
+{
+    int n = poll_collect_native(set, fds, max_fds, 0);
+
+    for (int i = 0; i < CONFIG_VFS_MAX_COUNT; ++i) {
+        poll_fallback_t *fb = set->fallback[i];
+        if (fb == NULL) {
+            continue;
+        }
+        if (fb->armed) {
+            poll_fallback_disarm(i, fb);
+            n = poll_fallback_report(set, i, fb, fds, max_fds, n);
+        }
+        if (poll_fallback_arm(set, i, fb) != ESP_OK) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+int esp_vfs_poll_wait(esp_vfs_poll_handle_t handle, struct pollfd *fds, int max_fds, int timeout_ms)
+{
+    if (handle == NULL || fds == NULL || max_fds <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    TickType_t ticks_to_wait = portMAX_DELAY;
+    if (timeout_ms >= 0) {
+        ticks_to_wait = (timeout_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    }
+    TimeOut_t timeout;
+    vTaskSetTimeOutState(&timeout);
+
+    while (true) {
+        _lock_acquire(&handle->lock);
+        const int ret = poll_collect(handle, fds, max_fds);
+        _lock_release(&handle->lock);
+
+        if (ret < 0) {
+            errno = EINTR;
+            return -1;
+        }
+        if (ret > 0 || xTaskCheckForTimeOut(&timeout, &ticks_to_wait) == pdTRUE) {
+            return ret;
+        }
+        xSemaphoreTake(handle->sem, ticks_to_wait);
+    }
+}
+
+#endif // CONFIG_VFS_SUPPORT_SELECT
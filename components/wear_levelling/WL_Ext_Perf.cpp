@@ -1,5 +1,5 @@
 /*
- * SPDX-FileCopyrightText: 2015-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
@@ -170,11 +170,8 @@ esp_err_t WL_Ext_Perf::erase_range(size_t start_address, size_t size)
     // Clear rest_check_count sectors
     if (rest_check_count > 0) {
         rest_check_count = rest_check_count / this->flash_fat_sector_size_factor;
-        size_t start_sector = rest_check_start / this->flash_sector_size;
-        for (size_t i = 0; i < rest_check_count; i++) {
-            result = WL_Flash::erase_sector(start_sector + i);
-            WL_EXT_RESULT_CHECK(result);
-        }
+        result = WL_Flash::erase_range(rest_check_start, rest_check_count * this->flash_sector_size);
+        WL_EXT_RESULT_CHECK(result);
     }
 
     // Clear post_check_count sectors
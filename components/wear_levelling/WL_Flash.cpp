@@ -1,9 +1,10 @@
 /*
- * SPDX-FileCopyrightText: 2015-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2015-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <stdio.h>
+#include "sdkconfig.h"
 #include "esp_random.h"
 #include "esp_log.h"
 #include "Partition.h"
@@ -244,25 +245,31 @@ esp_err_t WL_Flash::init()
 esp_err_t WL_Flash::recoverPos()
 {
     esp_err_t result = ESP_OK;
-    size_t position = 0;
     ESP_LOGV(TAG, "%s start", __func__);
-    for (size_t i = 0; i < this->state.wl_part_max_sec_pos; i++) {
+    // The dummy sector position records are written one after another and every record is validated
+    // by OkBuffSet, so the valid records form a prefix of the list and the first invalid one
+    // (the current position) can be found by a binary search instead of reading all of them.
+    size_t low = 0;
+    size_t high = this->state.wl_part_max_sec_pos;
+    while (low < high) {
         bool pos_bits;
-        position = i;
-        result = this->partition->read(this->addr_state1 + sizeof(wl_state_t) + i * this->cfg.wl_pos_update_record_size, this->temp_buff, this->cfg.wl_pos_update_record_size);
-        pos_bits = this->OkBuffSet(i);
+        size_t position = low + (high - low) / 2;
+        result = this->partition->read(this->addr_state1 + sizeof(wl_state_t) + position * this->cfg.wl_pos_update_record_size, this->temp_buff, this->cfg.wl_pos_update_record_size);
         WL_RESULT_CHECK(result);
+        pos_bits = this->OkBuffSet(position);
         ESP_LOGV(TAG, "%s - check pos: result=0x%08" PRIx32 ", position= %" PRIu32 ", pos_bits= 0x%08" PRIx32 , __func__, (uint32_t) result, (uint32_t) position, (uint32_t) pos_bits);
-        if (pos_bits == false) {
-            break; // we have found position
+        if (pos_bits == true) {
+            low = position + 1;
+        } else {
+            high = position;
         }
     }
 
-    this->state.wl_dummy_sec_pos = position;
+    this->state.wl_dummy_sec_pos = low;
     if (this->state.wl_dummy_sec_pos == this->state.wl_part_max_sec_pos) {
         this->state.wl_dummy_sec_pos--;
     }
-    ESP_LOGD(TAG, "%s - this->state.wl_dummy_sec_pos= 0x%08" PRIx32 ", position= 0x%08" PRIx32 ", result= 0x%08" PRIx32 ", wl_part_max_sec_pos= 0x%08" PRIx32 , __func__, (uint32_t)this->state.wl_dummy_sec_pos, (uint32_t)position, (uint32_t)result, (uint32_t)this->state.wl_part_max_sec_pos);
+    ESP_LOGD(TAG, "%s - this->state.wl_dummy_sec_pos= 0x%08" PRIx32 ", position= 0x%08" PRIx32 ", result= 0x%08" PRIx32 ", wl_part_max_sec_pos= 0x%08" PRIx32 , __func__, (uint32_t)this->state.wl_dummy_sec_pos, (uint32_t)low, (uint32_t)result, (uint32_t)this->state.wl_part_max_sec_pos);
     ESP_LOGV(TAG, "%s done", __func__);
     return result;
 }
@@ -523,6 +530,25 @@ size_t WL_Flash::calcAddr(size_t addr)
     return result;
 }
 
+// Returns how many bytes (up to size) starting from the logical address addr are mapped
+// to a continuous area of the flash. The mapping done by calcAddr is linear except at
+// the dummy sector and at the end of the flash area, so the range can be accessed with
+// a single flash operation as long as it does not cross one of these two points.
+size_t WL_Flash::calcRunSize(size_t addr, size_t size)
+{
+#if CONFIG_WL_WRITE_COMBINING
+    size_t offset = (this->flash_size - this->state.wl_dummy_sec_move_count * this->cfg.wl_page_size + addr) % this->flash_size;
+    size_t dummy_addr = this->state.wl_dummy_sec_pos * this->cfg.wl_page_size;
+    size_t run_size = (offset < dummy_addr) ? dummy_addr - offset : this->flash_size - offset;
+#else
+    size_t run_size = this->cfg.wl_page_size - addr % this->cfg.wl_page_size;
+#endif // CONFIG_WL_WRITE_COMBINING
+    if (run_size > size) {
+        run_size = size;
+    }
+    return run_size;
+}
+
 
 size_t WL_Flash::get_flash_size()
 {
@@ -564,10 +590,29 @@ esp_err_t WL_Flash::erase_range(size_t start_address, size_t size)
     ESP_LOGD(TAG, "%s - start_address= 0x%08" PRIx32 ", size= 0x%08" PRIx32 , __func__, (uint32_t) start_address, (uint32_t) size);
     size_t erase_count = (size + this->cfg.flash_sector_size - 1) / this->cfg.flash_sector_size;
     size_t start_sector = start_address / this->cfg.flash_sector_size;
+#if CONFIG_WL_WRITE_COMBINING
+    // Count the erase cycles of all the sectors first, moving the dummy sector as many times as erase_sector would.
+    // The range is then erased using the final mapping. Content of the range is undefined until the erase
+    // is finished either way, and the sectors outside of the range are only touched by the (power-fail safe) moves.
+    for (size_t i = 0; i < erase_count; i++) {
+        result = this->updateWL();
+        WL_RESULT_CHECK(result);
+    }
+    size_t addr = start_sector * this->cfg.flash_sector_size;
+    size_t end_addr = addr + erase_count * this->cfg.flash_sector_size;
+    while (addr < end_addr) {
+        size_t run_size = this->calcRunSize(addr, end_addr - addr);
+        size_t virt_addr = this->calcAddr(addr);
+        result = this->partition->erase_range(this->cfg.wl_partition_start_addr + virt_addr, run_size);
+        WL_RESULT_CHECK(result);
+        addr += run_size;
+    }
+#else
     for (size_t i = 0; i < erase_count; i++) {
         result = this->erase_sector(start_sector + i);
         WL_RESULT_CHECK(result);
     }
+#endif // CONFIG_WL_WRITE_COMBINING
     ESP_LOGV(TAG, "%s - result= 0x%08x" , __func__, result);
     return result;
 }
@@ -579,15 +624,14 @@ esp_err_t WL_Flash::write(size_t dest_addr, const void *src, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - dest_addr= 0x%08" PRIx32 ", size= 0x%08" PRIx32 , __func__, (uint32_t) dest_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.wl_page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(dest_addr + i * this->cfg.wl_page_size);
-        result = this->partition->write(this->cfg.wl_partition_start_addr + virt_addr, &((uint8_t *)src)[i * this->cfg.wl_page_size], this->cfg.wl_page_size);
+    size_t done = 0;
+    while (done < size) {
+        size_t run_size = this->calcRunSize(dest_addr + done, size - done);
+        size_t virt_addr = this->calcAddr(dest_addr + done);
+        result = this->partition->write(this->cfg.wl_partition_start_addr + virt_addr, &((uint8_t *)src)[done], run_size);
         WL_RESULT_CHECK(result);
+        done += run_size;
     }
-    size_t virt_addr_last = this->calcAddr(dest_addr + count * this->cfg.wl_page_size);
-    result = this->partition->write(this->cfg.wl_partition_start_addr + virt_addr_last, &((uint8_t *)src)[count * this->cfg.wl_page_size], size - count * this->cfg.wl_page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
@@ -598,16 +642,15 @@ esp_err_t WL_Flash::read(size_t src_addr, void *dest, size_t size)
         return ESP_ERR_INVALID_STATE;
     }
     ESP_LOGD(TAG, "%s - src_addr= 0x%08" PRIx32 ", size= 0x%08" PRIx32 , __func__, (uint32_t) src_addr, (uint32_t) size);
-    uint32_t count = (size - 1) / this->cfg.wl_page_size;
-    for (size_t i = 0; i < count; i++) {
-        size_t virt_addr = this->calcAddr(src_addr + i * this->cfg.wl_page_size);
-        ESP_LOGV(TAG, "%s - real_addr= 0x%08" PRIx32 ", size= 0x%08" PRIx32 , __func__, (uint32_t) (this->cfg.wl_partition_start_addr + virt_addr), (uint32_t) size);
-        result = this->partition->read(this->cfg.wl_partition_start_addr + virt_addr, &((uint8_t *)dest)[i * this->cfg.wl_page_size], this->cfg.wl_page_size);
+    size_t done = 0;
+    while (done < size) {
+        size_t run_size = this->calcRunSize(src_addr + done, size - done);
+        size_t virt_addr = this->calcAddr(src_addr + done);
+        ESP_LOGV(TAG, "%s - real_addr= 0x%08" PRIx32 ", size= 0x%08" PRIx32 , __func__, (uint32_t) (this->cfg.wl_partition_start_addr + virt_addr), (uint32_t) run_size);
+        result = this->partition->read(this->cfg.wl_partition_start_addr + virt_addr, &((uint8_t *)dest)[done], run_size);
         WL_RESULT_CHECK(result);
+        done += run_size;
     }
-    size_t virt_addr_last = this->calcAddr(src_addr + count * this->cfg.wl_page_size);
-    result = this->partition->read(this->cfg.wl_partition_start_addr + virt_addr_last, &((uint8_t *)dest)[count * this->cfg.wl_page_size], size - count * this->cfg.wl_page_size);
-    WL_RESULT_CHECK(result);
     return result;
 }
 
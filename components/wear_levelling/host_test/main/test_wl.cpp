@@ -1,11 +1,12 @@
 /*
- * SPDX-FileCopyrightText: 2016-2023 Espressif Systems (Shanghai) CO LTD
+ * SPDX-FileCopyrightText: 2016-2024 Espressif Systems (Shanghai) CO LTD
  *
  * SPDX-License-Identifier: Apache-2.0
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include "esp_partition.h"
 #include "esp_private/partition_linux.h"
@@ -99,6 +100,101 @@ TEST_CASE("write and read back data", "[wear_levelling]")
     free(read);
 }
 
+typedef struct {
+    size_t erase_time;
+    size_t write_ops;
+    size_t write_time;
+    size_t read_ops;
+    size_t read_time;
+} sequential_access_stats_t;
+
+// Erases, writes and reads back the whole wear-levelled area, either by one call per sector
+// (as if every sector was accessed by a separate flash operation) or by one call for the whole area
+static void sequential_access(wl_handle_t wl_handle, uint8_t *data, uint8_t *read, bool per_sector, sequential_access_stats_t *stats)
+{
+    size_t size = wl_size(wl_handle);
+    size_t step = per_sector ? wl_sector_size(wl_handle) : size;
+
+    esp_partition_clear_stats();
+    for (size_t addr = 0; addr < size; addr += step) {
+        REQUIRE(wl_erase_range(wl_handle, addr, step) == ESP_OK);
+    }
+    stats->erase_time = esp_partition_get_total_time();
+
+    esp_partition_clear_stats();
+    for (size_t addr = 0; addr < size; addr += step) {
+        REQUIRE(wl_write(wl_handle, addr, data + addr, step) == ESP_OK);
+    }
+    stats->write_ops = esp_partition_get_write_ops();
+    stats->write_time = esp_partition_get_total_time();
+
+    esp_partition_clear_stats();
+    for (size_t addr = 0; addr < size; addr += step) {
+        REQUIRE(wl_read(wl_handle, addr, read + addr, step) == ESP_OK);
+    }
+    stats->read_ops = esp_partition_get_read_ops();
+    stats->read_time = esp_partition_get_total_time();
+
+    REQUIRE(memcmp(data, read, size) == 0);
+
+    printf("%s: erase %" PRIu32 " us, write %" PRIu32 " ops %" PRIu32 " us, read %" PRIu32 " ops %" PRIu32 " us\n",
+           per_sector ? "sector by sector" : "whole area at once", (uint32_t) stats->erase_time,
+           (uint32_t) stats->write_ops, (uint32_t) stats->write_time, (uint32_t) stats->read_ops, (uint32_t) stats->read_time);
+}
+
+TEST_CASE("sequential access is combined into few flash operations", "[wear_levelling]")
+{
+    wl_handle_t wl_handle;
+    sequential_access_stats_t per_sector, combined;
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    // Typical SPI NOR flash: 64 KB block erase takes about a quarter of the time of erasing its 16 sectors one by one
+    esp_partition_flash_model_t model;
+    esp_partition_get_flash_model(&model);
+    model.block_size = 0x10000;
+    model.block_erase_time = 4 * model.sector_erase_time;
+    REQUIRE(esp_partition_set_flash_model(&model) == ESP_OK);
+
+    REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+
+    size_t size = wl_size(wl_handle);
+    size_t sector_size = wl_sector_size(wl_handle);
+    uint8_t *data = (uint8_t *) malloc(size);
+    uint8_t *read = (uint8_t *) malloc(size);
+    REQUIRE(data != NULL);
+    REQUIRE(read != NULL);
+    for (size_t i = 0; i < size / sizeof(uint32_t); i++) {
+        ((uint32_t *) data)[i] = i;
+    }
+
+    sequential_access(wl_handle, data, read, true, &per_sector);
+    sequential_access(wl_handle, data, read, false, &combined);
+
+    REQUIRE(per_sector.write_ops == size / sector_size);
+    REQUIRE(per_sector.read_ops == size / sector_size);
+#if CONFIG_WL_WRITE_COMBINING
+    // The area is split at most at the dummy sector and at the end of the flash
+    REQUIRE(combined.write_ops <= 2);
+    REQUIRE(combined.read_ops <= 2);
+    REQUIRE(combined.erase_time < per_sector.erase_time);
+    REQUIRE(combined.write_time <= per_sector.write_time);
+    REQUIRE(combined.read_time <= per_sector.read_time);
+#endif // CONFIG_WL_WRITE_COMBINING
+
+    // Data written at once is read back the same sector by sector
+    for (size_t addr = 0; addr < size; addr += sector_size) {
+        REQUIRE(wl_read(wl_handle, addr, read + addr, sector_size) == ESP_OK);
+    }
+    REQUIRE(memcmp(data, read, size) == 0);
+
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+    REQUIRE(esp_partition_set_flash_model(NULL) == ESP_OK);
+
+    free(data);
+    free(read);
+}
+
 TEST_CASE("power down test", "[wear_levelling]")
 {
     esp_err_t result;
@@ -421,3 +517,66 @@ TEST_CASE("power down between WL status 1 and WL status 2 update", "[wear_levell
 
     free(tmp_state);
 }
+
+TEST_CASE("mount finds the dummy sector position by reading few records", "[wear_levelling]")
+{
+    esp_err_t result;
+    wl_handle_t wl_handle;
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "storage");
+
+    size_t offset_state_1, offset_state_2, size_state = 0;
+    calculate_wl_state_address_info(partition, &offset_state_1, &offset_state_2, &size_state);
+
+    // Start with a new WL instance and move the dummy sector by erasing the whole area several times
+    REQUIRE(esp_partition_erase_range(partition, 0, partition->size) == ESP_OK);
+    REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+    for (int i = 0; i < 10; i++) {
+        REQUIRE(wl_erase_range(wl_handle, 0, wl_size(wl_handle)) == ESP_OK);
+    }
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+
+    // Legacy mount: both states are read, then the position records one by one until the first one not set
+    esp_partition_clear_stats();
+    WL_State_s state;
+    result = esp_partition_read(partition, offset_state_1, &state, sizeof(state));
+    REQUIRE(result == ESP_OK);
+    result = esp_partition_read(partition, offset_state_2, &state, sizeof(state));
+    REQUIRE(result == ESP_OK);
+    uint32_t pos = 0;
+    for (; pos < state.wl_part_max_sec_pos; pos++) {
+        uint32_t record[4];
+        result = esp_partition_read(partition, offset_state_1 + sizeof(wl_state_t) + pos * sizeof(record), record, sizeof(record));
+        REQUIRE(result == ESP_OK);
+        bool pos_bits = true;
+        for (uint32_t i = 0; i < 4; i++) {
+            uint32_t data = state.wl_device_id + pos * 4 + i;
+            if (record[i] != crc32::crc32_le(WL_CFG_CRC_CONST, (uint8_t *)&data, sizeof(data))) {
+                pos_bits = false;
+            }
+        }
+        if (!pos_bits) {
+            break;
+        }
+    }
+    size_t legacy_read_ops = esp_partition_get_read_ops();
+    size_t legacy_time = esp_partition_get_total_time();
+
+    esp_partition_clear_stats();
+    REQUIRE(wl_mount(partition, &wl_handle) == ESP_OK);
+    size_t mount_read_ops = esp_partition_get_read_ops();
+    size_t mount_time = esp_partition_get_total_time();
+    REQUIRE(wl_unmount(wl_handle) == ESP_OK);
+
+    printf("dummy sector at %" PRIu32 " of %" PRIu32 ": legacy mount %" PRIu32 " reads %" PRIu32 " us, mount %" PRIu32 " reads %" PRIu32 " us\n",
+           pos, state.wl_part_max_sec_pos, (uint32_t) legacy_read_ops, (uint32_t) legacy_time, (uint32_t) mount_read_ops, (uint32_t) mount_time);
+
+    // Two states and at most log2(n) + 1 position records
+    uint32_t max_record_reads = 1;
+    while ((1UL << (max_record_reads - 1)) < state.wl_part_max_sec_pos) {
+        max_record_reads++;
+    }
+    REQUIRE(pos > 100);
+    REQUIRE(mount_read_ops <= 2 + max_record_reads);
+    REQUIRE(mount_time < legacy_time);
+}
@@ -1,4 +1,4 @@
-# SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+# SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: Apache-2.0
 import copy
 import json
@@ -36,6 +36,11 @@ SYSVIEW_EVTID_NAME_RESOURCE       = 25
 SYSVIEW_EVTID_PRINT_FORMATTED     = 26
 SYSVIEW_EVTID_NUMMODULES          = 27
 SYSVIEW_EVENT_ID_PREDEF_MAX       = SYSVIEW_EVTID_NUMMODULES
+SYSVIEW_EVTID_EX                  = 31
+
+# Sub-IDs of the extended events
+SYSVIEW_EVTID_EX_MARK             = 0
+SYSVIEW_EVTID_EX_NAME_MARKER      = 1
 
 SYSVIEW_EVENT_ID_MAX             = 200
 
@@ -70,7 +75,8 @@ _sysview_events_map = {
     'SYS_INIT': SYSVIEW_EVTID_INIT,
     'SYS_NAME_RESOURCE': SYSVIEW_EVTID_NAME_RESOURCE,
     'SYS_PRINT_FORMATTED': SYSVIEW_EVTID_PRINT_FORMATTED,
-    'SYS_NUMMODULES': SYSVIEW_EVTID_NUMMODULES
+    'SYS_NUMMODULES': SYSVIEW_EVTID_NUMMODULES,
+    'SYS_EX': SYSVIEW_EVTID_EX
 }
 
 _os_events_map = {}
@@ -526,6 +532,33 @@ class SysViewPredefinedEvent(SysViewEvent):
         # self.name = 'SysViewPredefinedEvent'
 
 
+class SysViewExtendedEvent(SysViewPredefinedEvent):
+    """
+        Extended SystemView events class. These events share the same ID and are distinguished by the sub-ID
+        at the start of their payload.
+    """
+    _ex_events_fmt = {
+        SYSVIEW_EVTID_EX_MARK:          ('svMark', [SysViewEventParamSimple('marker_id', _decode_u32)]),
+        SYSVIEW_EVTID_EX_NAME_MARKER:   ('svNameMarker', [SysViewEventParamSimple('marker_id', _decode_u32),
+                                                          SysViewEventParamSimple('name', _decode_str)]),
+    }
+
+    def _read_payload(self, reader, events_fmt_map):
+        """
+            see SysViewEvent._read_payload()
+        """
+        sz,self.ex_id = _decode_u32(reader)
+        if self.ex_id not in self._ex_events_fmt:
+            # skip the events which are not supported yet (heap ones)
+            self.name = 'svEx'
+            reader.forward(self.plen - sz)
+            return
+        plen = self.plen
+        self.plen -= sz
+        SysViewPredefinedEvent._read_payload(self, reader, {self.id: self._ex_events_fmt[self.ex_id]})
+        self.plen = plen
+
+
 class SysViewOSEvent(SysViewEvent):
     """
         OS related SystemView events class.
@@ -720,6 +753,8 @@ class SysViewTraceDataParser(apptrace.TraceDataProcessor):
                 core_id = self.core_id
         if evt_id <= SYSVIEW_EVENT_ID_PREDEF_MAX:
             return SysViewPredefinedEvent(evt_id, core_id, reader)
+        elif evt_id == SYSVIEW_EVTID_EX:
+            return SysViewExtendedEvent(evt_id, core_id, reader)
         elif evt_id < SYSVIEW_MODULE_EVENT_OFFSET:
             return SysViewOSEvent(evt_id, core_id, reader, os_evt_map)
         else:
@@ -1236,6 +1271,175 @@ class SysViewTraceDataJsonEncoder(json.JSONEncoder):
         return json.JSONEncoder.default(self, obj)
 
 
+class SysViewChromeTraceExporter:
+    """
+        Converts processed SystemView events to the Chrome Trace Event format, which can be opened with
+        chrome://tracing or Perfetto UI (https://ui.perfetto.dev).
+
+        Every core gets a track showing the tasks and ISRs running on it. Every task gets a track with its spans
+        (SEGGER_SYSVIEW_MarkStart/MarkStop), OS API calls, markers, log messages and heap operations.
+        The amount of allocated heap memory is shown as a counter.
+    """
+    CORES_PID = 1
+    TASKS_PID = 2
+
+    def __init__(self, proc):
+        """
+            Constructor.
+
+            Parameters
+            ----------
+            proc : SysViewMultiStreamTraceDataProcessor
+                processor the events have been merged by, it must be created with 'keep_all_events' set.
+        """
+        self.proc = proc
+        self.tasks_info = {}
+        self.irqs_info = {}
+        for t in proc.traces.values():
+            self.tasks_info.update(t.tasks_info)
+            self.irqs_info.update(t.irqs_info)
+        self.trace_events = []
+        self.marker_names = {}
+        # task running on every core and the number of nested ISRs above it
+        self.core_tasks = {}
+        self.core_isrs = {}
+        # tracks of the open spans for every span ID
+        self.spans = {}
+        self.cores_seen = set()
+        self.tasks_seen = set()
+        self.heap_blocks = {}
+        self.heap_used = 0
+        self.last_ts = 0
+
+    def _add_event(self, ph, name, ts, pid, tid, args=None):
+        evt = {'ph': ph, 'name': name, 'ts': ts, 'pid': pid, 'tid': tid}
+        if ph == 'i':
+            evt['s'] = 't'
+        if args:
+            evt['args'] = args
+        self.trace_events.append(evt)
+
+    def _add_metadata(self, name, pid, tid, value):
+        evt = {'ph': 'M', 'name': name, 'pid': pid, 'args': value}
+        if tid is not None:
+            evt['tid'] = tid
+        self.trace_events.append(evt)
+
+    def _event_track(self, core_id):
+        """
+            Returns the track (pid, tid) of events happening on the core: the task track or the core track if
+            the core is in ISR or its task is unknown.
+        """
+        tid = self.core_tasks.get(core_id)
+        if tid is None or self.core_isrs.get(core_id, 0):
+            return (self.CORES_PID, core_id)
+        return (self.TASKS_PID, tid)
+
+    def _exit_isrs(self, core_id, ts):
+        while self.core_isrs.get(core_id, 0):
+            self._add_event('E', '', ts, self.CORES_PID, core_id)
+            self.core_isrs[core_id] -= 1
+
+    def _stop_task(self, core_id, ts):
+        self._exit_isrs(core_id, ts)
+        if self.core_tasks.get(core_id) is not None:
+            self._add_event('E', '', ts, self.CORES_PID, core_id)
+            self.core_tasks[core_id] = None
+
+    def _process_heap_event(self, event, ts, track):
+        addr = event.params['addr'].value
+        args = {'addr': '0x{:x}'.format(addr),
+                'callers': ['0x{:x}'.format(a) for a in event.params['callers'].value]}
+        if 'size' in event.params:
+            size = event.params['size'].value
+            args['size'] = size
+            self.heap_blocks[addr] = size
+            self.heap_used += size
+            self._add_event('i', 'alloc', ts, track[0], track[1], args)
+        else:
+            self.heap_used -= self.heap_blocks.pop(addr, 0)
+            self._add_event('i', 'free', ts, track[0], track[1], args)
+        self._add_event('C', 'heap', ts, self.TASKS_PID, 0, {'allocated': self.heap_used})
+
+    def _process_event(self, event):
+        ts = event.ts * 1000000
+        self.last_ts = ts
+        core_id = event.core_id
+        self.cores_seen.add(core_id)
+        if isinstance(event, SysViewHeapEvent):
+            self._process_heap_event(event, ts, self._event_track(core_id))
+            return
+        if event.id == SYSVIEW_EVTID_ISR_ENTER:
+            irq = event.params['irq_num'].value
+            self._add_event('B', self.irqs_info.get(irq, 'IRQ %d' % irq), ts, self.CORES_PID, core_id)
+            self.core_isrs[core_id] = self.core_isrs.get(core_id, 0) + 1
+        elif event.id == SYSVIEW_EVTID_ISR_EXIT or event.id == SYSVIEW_EVTID_ISR_TO_SCHEDULER:
+            if self.core_isrs.get(core_id, 0):
+                self._add_event('E', '', ts, self.CORES_PID, core_id)
+                self.core_isrs[core_id] -= 1
+        elif event.id == SYSVIEW_EVTID_TASK_START_EXEC:
+            tid = event.params['tid'].value
+            self._stop_task(core_id, ts)
+            self._add_event('B', self.tasks_info.get(tid, '0x%x' % tid), ts, self.CORES_PID, core_id)
+            self.core_tasks[core_id] = tid
+            self.tasks_seen.add(tid)
+        elif event.id == SYSVIEW_EVTID_TASK_STOP_EXEC or event.id == SYSVIEW_EVTID_IDLE:
+            self._stop_task(core_id, ts)
+        elif event.id == SYSVIEW_EVTID_TASK_STOP_READY:
+            if self.core_tasks.get(core_id) == event.params['tid'].value:
+                self._stop_task(core_id, ts)
+        elif event.id == SYSVIEW_EVTID_MARK_START:
+            span_id = event.params['user_id'].value
+            track = self._event_track(core_id)
+            self.spans.setdefault(span_id, []).append(track)
+            self._add_event('B', self.marker_names.get(span_id, 'span %d' % span_id), ts, track[0], track[1])
+        elif event.id == SYSVIEW_EVTID_MARK_STOP:
+            tracks = self.spans.get(event.params['user_id'].value)
+            if tracks:
+                track = tracks.pop()
+                self._add_event('E', '', ts, track[0], track[1])
+        elif event.id == SYSVIEW_EVTID_EX and event.name == 'svNameMarker':
+            self.marker_names[event.params['marker_id'].value] = event.params['name'].value
+        elif event.id == SYSVIEW_EVTID_EX and event.name == 'svMark':
+            marker_id = event.params['marker_id'].value
+            track = self._event_track(core_id)
+            self._add_event('i', self.marker_names.get(marker_id, 'mark %d' % marker_id), ts, track[0], track[1])
+        elif event.id == SYSVIEW_EVTID_PRINT_FORMATTED:
+            track = self._event_track(core_id)
+            self._add_event('i', 'log', ts, track[0], track[1],
+                            {'msg': event.params['msg'].value, 'lvl': event.params['lvl'].value})
+        elif isinstance(event, SysViewOSEvent):
+            track = self._event_track(core_id)
+            args = {}
+            for p in event.params:
+                args[p] = event.params[p].value
+            self._add_event('i', event.name, ts, track[0], track[1], args)
+
+    def export(self):
+        """
+            Returns
+            -------
+            dict
+                trace in Chrome Trace Event format, ready to be serialized by json.dump()
+        """
+        for event in self.proc.events:
+            self._process_event(event)
+        # close everything still open at the end of the trace
+        for tracks in self.spans.values():
+            while tracks:
+                track = tracks.pop()
+                self._add_event('E', '', self.last_ts, track[0], track[1])
+        for core_id in self.cores_seen:
+            self._stop_task(core_id, self.last_ts)
+        self._add_metadata('process_name', self.CORES_PID, None, {'name': 'Cores'})
+        self._add_metadata('process_name', self.TASKS_PID, None, {'name': 'Tasks'})
+        for core_id in sorted(self.cores_seen):
+            self._add_metadata('thread_name', self.CORES_PID, core_id, {'name': 'Core %d' % core_id})
+        for tid in sorted(self.tasks_seen):
+            self._add_metadata('thread_name', self.TASKS_PID, tid, {'name': self.tasks_info.get(tid, '0x%x' % tid)})
+        return {'traceEvents': self.trace_events, 'displayTimeUnit': 'ns'}
+
+
 class SysViewHeapTraceDataParser(SysViewTraceDataExtEventParser):
     """
         SystemView trace data parser supporting heap events.
@@ -0,0 +1,120 @@
+#!/usr/bin/env python
+# SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+# SPDX-License-Identifier: Apache-2.0
+#
+# Converts the output of heap_trace_dump() in sampling profiler mode (CONFIG_HEAP_TRACING_SAMPLING)
+# to the "collapsed stack" format read by flame graph tools, e.g. flamegraph.pl or speedscope:
+#
+#   heap_profile_proc.py -b build/app.elf monitor.log > heap.folded
+#   flamegraph.pl --countname bytes heap.folded > heap.svg
+#
+
+import argparse
+import bisect
+import re
+import sys
+from collections import OrderedDict
+from typing import Dict, Iterable, List, Optional, TextIO, Tuple
+
+PROFILE_LINE_RE = re.compile(r'HEAPPROF (\d+) (\d+) (\d+) (\d+) ?((?:0x[0-9a-fA-F]+:?)*)')
+METRICS = OrderedDict([
+    ('live_bytes', 3),
+    ('live_count', 2),
+    ('alloc_bytes', 1),
+    ('alloc_count', 0),
+])
+
+
+class HeapProfileCallsite(object):
+    def __init__(self, counts: List[int], callers: List[int]) -> None:
+        self.counts = counts
+        self.callers = callers
+
+
+def parse_profile(lines: Iterable[str]) -> List[HeapProfileCallsite]:
+    """ Returns the callsites of the last dump found in the log """
+    callsites = []  # type: List[HeapProfileCallsite]
+    for line in lines:
+        if '====== Heap Profile:' in line:
+            callsites = []
+            continue
+        m = PROFILE_LINE_RE.search(line)
+        if m is None:
+            continue
+        counts = [int(m.group(i)) for i in range(1, 5)]
+        callers = [int(pc, 16) for pc in m.group(5).split(':') if pc]
+        callsites.append(HeapProfileCallsite(counts, callers))
+    return callsites
+
+
+class SymbolResolver(object):
+    """ Maps code addresses to function names using the ELF symbol table """
+
+    def __init__(self, elf_path: Optional[str]) -> None:
+        self.addrs = []  # type: List[int]
+        self.syms = []  # type: List[Tuple[int, int, str]]
+        if elf_path is None:
+            return
+        from elftools.elf.elffile import ELFFile
+        from elftools.elf.sections import SymbolTableSection
+        with open(elf_path, 'rb') as f:
+            elf = ELFFile(f)
+            funcs = {}  # type: Dict[int, Tuple[int, str]]
+            for section in elf.iter_sections():
+                if not isinstance(section, SymbolTableSection):
+                    continue
+                for sym in section.iter_symbols():
+                    if sym['st_info']['type'] != 'STT_FUNC' or sym['st_value'] == 0:
+                        continue
+                    # prefer global names for aliases
+                    if sym['st_value'] not in funcs or sym['st_info']['bind'] == 'STB_GLOBAL':
+                        funcs[sym['st_value']] = (sym['st_size'], sym.name)
+        for addr in sorted(funcs):
+            self.addrs.append(addr)
+            self.syms.append((addr, funcs[addr][0], funcs[addr][1]))
+
+    def resolve(self, pc: int) -> str:
+        # callers are return addresses, look up the call instruction before them
+        i = bisect.bisect_right(self.addrs, pc - 1) - 1
+        if i >= 0:
+            addr, size, name = self.syms[i]
+            if pc - 1 < addr + max(size, 1):
+                return name
+        return '0x%08x' % pc
+
+
+def write_collapsed(callsites: List[HeapProfileCallsite], resolver: SymbolResolver, metric: str,
+                    out: TextIO) -> None:
+    stacks = OrderedDict()  # type: Dict[str, int]
+    for cs in callsites:
+        value = cs.counts[METRICS[metric]]
+        if value == 0:
+            continue
+        # callers are innermost first, flame graphs want the root first
+        frames = [resolver.resolve(pc) for pc in reversed(cs.callers)] or ['[unknown]']
+        stack = ';'.join(frames)
+        stacks[stack] = stacks.get(stack, 0) + value
+    for stack, value in stacks.items():
+        out.write('%s %d\n' % (stack, value))
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='Convert a sampling heap profile dump to collapsed stacks for flame graphs')
+    parser.add_argument('--elf', '-b', help='Program ELF file used to resolve function names')
+    parser.add_argument('--metric', '-m', choices=list(METRICS.keys()), default='live_bytes',
+                        help='Value to plot: bytes or allocations not freed yet (live) or allocated in total '
+                             '(default: %(default)s)')
+    parser.add_argument('--output', '-o', type=argparse.FileType('w'), default=sys.stdout,
+                        help='Output file (default: stdout)')
+    parser.add_argument('log', type=argparse.FileType('r'), nargs='?', default=sys.stdin,
+                        help='Console log containing the output of heap_trace_dump() (default: stdin)')
+    args = parser.parse_args()
+
+    callsites = parse_profile(args.log)
+    if not callsites:
+        sys.exit('No heap profile found in the log, was CONFIG_HEAP_TRACING_SAMPLING enabled?')
+    write_collapsed(callsites, SymbolResolver(args.elf), args.metric, args.output)
+
+
+if __name__ == '__main__':
+    main()
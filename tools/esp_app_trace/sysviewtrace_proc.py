@@ -1,6 +1,6 @@
 #!/usr/bin/env python
 #
-# SPDX-FileCopyrightText: 2019-2022 Espressif Systems (Shanghai) CO LTD
+# SPDX-FileCopyrightText: 2019-2024 Espressif Systems (Shanghai) CO LTD
 # SPDX-License-Identifier: Apache-2.0
 #
 # This is python script to process various types trace data streams in SystemView format.
@@ -41,6 +41,8 @@ def main():
     parser.add_argument('--toolchain', '-t', help='Toolchain prefix.', type=str, default='xtensa-esp32-elf-')
     parser.add_argument('--events-map', '-e', help='Events map file.', type=str, default=os.path.join(os.path.dirname(__file__), 'SYSVIEW_FreeRTOS.txt'))
     parser.add_argument('--to-json', '-j', help='Print JSON.', action='store_true', default=False)
+    parser.add_argument('--to-chrome-trace', '-c', help='Write trace in Chrome Trace Event format (for chrome://tracing or Perfetto UI) to the file.',
+                        type=str, default='')
     parser.add_argument('--verbose', '-v', help='Verbosity level. Default 1', choices=range(0, len(verbosity_levels)), type=int, default=1)
     args = parser.parse_args()
 
@@ -97,7 +99,7 @@ def main():
 
     # merge and process traces
     try:
-        proc = sysview.SysViewMultiStreamTraceDataProcessor(traces=parsers, print_events=args.dump_events, keep_all_events=True if args.to_json else False)
+        proc = sysview.SysViewMultiStreamTraceDataProcessor(traces=parsers, print_events=args.dump_events, keep_all_events=True if args.to_json or args.to_chrome_trace else False)
         if include_events['heap']:
             proc.add_stream_processor(sysview.SysViewTraceDataParser.STREAMID_HEAP,
                                       sysview.SysViewHeapTraceDataProcessor(args.toolchain, args.elf_file, root_proc=proc, print_heap_events=args.print_events))
@@ -118,6 +120,10 @@ def main():
         traceback.print_exc()
         sys.exit(2)
     finally:
+        if args.to_chrome_trace:
+            with open(args.to_chrome_trace, 'w') as f:
+                json.dump(sysview.SysViewChromeTraceExporter(proc).export(), f, indent=1)
+                f.write('\n')
         if args.to_json:
             print(json.dumps(proc, cls=sysview.SysViewTraceDataJsonEncoder, indent=4, separators=(',', ': '), sort_keys=True))
         else:
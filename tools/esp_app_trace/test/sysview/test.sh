@@ -27,3 +27,10 @@
     && diff output.json expected_output_mcore.json \
     && python -m coverage report \
 ; } || { echo 'The test for mcore sysviewtrace_proc JSON functionality has failed. Please examine the artifacts.' ; exit 1; }
+
+{ python -m coverage debug sys \
+    && python -m coverage erase &> output \
+    && python -m coverage run -a $IDF_PATH/tools/esp_app_trace/sysviewtrace_proc.py -c output_chrome.json -b test.elf cpu0.svdat cpu1.svdat &>> output \
+    && diff output_chrome.json expected_output_chrome.json \
+    && python -m coverage report \
+; } || { echo 'The test for sysviewtrace_proc Chrome trace functionality has failed. Please examine the artifacts.' ; exit 1; }
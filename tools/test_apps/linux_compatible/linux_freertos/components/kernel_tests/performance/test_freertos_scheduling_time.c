@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Linux version of the scheduling time test of the FreeRTOS test app (test_freertos_scheduling_time.c). The time
+ * is measured with the host's monotonic clock instead of the CPU cycle count, and is only logged as it depends on
+ * the host and on the task switching implementation of the port (see CONFIG_FREERTOS_LINUX_UCONTEXT).
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "unity.h"
+
+#define NUMBER_OF_ITERATIONS 1000
+
+typedef struct {
+    SemaphoreHandle_t end_sema;
+    volatile uint64_t before_sched;
+    uint64_t ns_to_sched;
+    TaskHandle_t t1_handle;
+} test_context_t;
+
+static uint64_t get_time_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void test_task_1(void *arg)
+{
+    test_context_t *context = (test_context_t *)arg;
+
+    for (;;) {
+        context->before_sched = get_time_ns();
+        vPortYield();
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void test_task_2(void *arg)
+{
+    test_context_t *context = (test_context_t *)arg;
+    uint64_t accumulator = 0;
+
+    vTaskPrioritySet(NULL, CONFIG_UNITY_FREERTOS_PRIORITY + 1);
+    vTaskPrioritySet(context->t1_handle, CONFIG_UNITY_FREERTOS_PRIORITY + 1);
+    vPortYield();
+
+    for (int i = 0; i < NUMBER_OF_ITERATIONS; i++) {
+        accumulator += (get_time_ns() - context->before_sched);
+        vPortYield();
+    }
+
+    context->ns_to_sched = accumulator / NUMBER_OF_ITERATIONS;
+    vTaskDelete(context->t1_handle);
+    xSemaphoreGive(context->end_sema);
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("scheduling time test", "[freertos]")
+{
+    test_context_t context;
+
+    context.end_sema = xSemaphoreCreateBinary();
+    TEST_ASSERT(context.end_sema != NULL);
+
+    xTaskCreatePinnedToCore(test_task_1, "test1", 4096, &context, CONFIG_UNITY_FREERTOS_PRIORITY - 1, &context.t1_handle, 0);
+    xTaskCreatePinnedToCore(test_task_2, "test2", 4096, &context, CONFIG_UNITY_FREERTOS_PRIORITY - 1, NULL, 0);
+
+    BaseType_t result = xSemaphoreTake(context.end_sema, portMAX_DELAY);
+    TEST_ASSERT_EQUAL_HEX32(pdTRUE, result);
+    printf("scheduling time: %"PRIu64" ns\n", context.ns_to_sched);
+
+    vSemaphoreDelete(context.end_sema);
+}
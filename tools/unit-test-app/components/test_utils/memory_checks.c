@@ -8,7 +8,7 @@
 #include "esp_heap_caps.h"
 #include "unity.h"
 #include "memory_checks.h"
-#ifdef CONFIG_HEAP_TRACING
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
 #include "esp_heap_trace.h"
 #endif
 
@@ -51,7 +51,7 @@ void test_utils_record_free_mem(void)
 
 void setup_heap_record(void)
 {
-#ifdef CONFIG_HEAP_TRACING
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
     const size_t num_heap_records = 80;
     static heap_trace_record_t *record_buffer;
     if (!record_buffer) {